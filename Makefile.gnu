@@ -11,7 +11,7 @@ INSTALLDIR ?= $(DESTDIR)/usr/lib
 # Converts cr/lf to just lf
 DOS2UNIX = dos2unix
 
-LIBRARIES = -lstdc++
+LIBRARIES = -lstdc++ -lpthread
 
 MODULES = $(SRCS:.c=.o)
 MODULES := $(MODULES:.cpp=.o)
@@ -20,6 +20,8 @@ CFLAGS ?= -O3 -fPIC -fexceptions -fvisibility=hidden
 CFLAGS += -DOPJ_STATIC
 # LibRaw
 CFLAGS += -DNO_LCMS
+# LibWebP
+CFLAGS += -DWEBP_USE_THREAD
 # LibJXR
 CFLAGS += -DDISABLE_PERF_MEASUREMENT -D__ANSI__
 CFLAGS += $(INCLUDE)
@@ -121,6 +121,9 @@
 
 FI_STRUCT (FIBITMAP) { void *data; };
 FI_STRUCT (FIMULTIBITMAP) { void *data; };
+FI_STRUCT (FISCANLINEREADER) { void *data; };
+FI_STRUCT (FISCANLINEWRITER) { void *data; };
+FI_STRUCT (FITILEREADER) { void *data; };
 
 // Types used in the library (directly copied from Windows) -----------------
 
@@ -376,6 +379,16 @@ FI_STRUCT (FIICCPROFILE) {
 	void   *data;	//! points to a block of contiguous memory containing the profile
 };
 
+// Bitmap memory pool support -----------------------------------------------
+
+FI_STRUCT (FIPOOLSTATS) {
+	UINT64 hits;			//! number of bitmap allocations served from the pool
+	UINT64 misses;			//! number of bitmap allocations forwarded to the allocator
+	UINT64 bytes_retained;	//! number of bytes currently held by the pool
+	UINT64 blocks_retained;	//! number of memory blocks currently held by the pool
+	UINT64 max_bytes;		//! maximum number of bytes the pool may hold (0 when the pool is disabled)
+};
+
 // Important enums ----------------------------------------------------------
 
 /** I/O image format identifiers.
@@ -616,6 +629,16 @@ Handle to a memory I/O stream
 */
 FI_STRUCT (FIMEMORY) { void *data; };
 
+/**
+Grow callback of a writable user buffer (see FreeImage_OpenMemoryBuffer)
+@param data Current buffer
+@param size_in_bytes Current buffer size on input, new buffer size on output (at least min_size)
+@param min_size Minimum size of the new buffer
+@param user_data User data given to FreeImage_OpenMemoryBuffer
+@return Returns the new buffer, holding the content of the current one, returns NULL if the buffer cannot grow
+*/
+typedef BYTE *(DLL_CALLCONV *FI_MemoryGrowProc) (BYTE *data, DWORD *size_in_bytes, DWORD min_size, void *user_data);
+
 #endif // FREEIMAGE_IO
 
 // Plugin routines ----------------------------------------------------------
@@ -640,6 +663,76 @@ typedef BOOL (DLL_CALLCONV *FI_SupportsExportTypeProc)(FREE_IMAGE_TYPE type);
 typedef BOOL (DLL_CALLCONV *FI_SupportsICCProfilesProc)(void);
 typedef BOOL (DLL_CALLCONV *FI_SupportsNoPixelsProc)(void);
 
+/**
+File signature ('magic number') found at the start of every file a plugin can validate. 
+Signatures are used to select candidate plugins when identifying a file, 
+they can be at most 64 bytes long.
+*/
+FI_STRUCT (FIMAGICNUMBER) {
+	unsigned length;		//! number of bytes to compare
+	const BYTE *bytes;		//! expected bytes
+	const BYTE *mask;		//! mask applied to the file bytes before comparison, NULL to compare all bits
+};
+
+typedef const FIMAGICNUMBER *(DLL_CALLCONV *FI_MagicNumberProc)(int *count);
+
+/**
+Reduced-resolution loading: decode an image at the cheapest resolution still covering 
+a max_width x max_height box (a side <= 0 is unconstrained). 
+The returned image may be larger than the box, it is fitted to the box by the caller.
+*/
+typedef FIBITMAP *(DLL_CALLCONV *FI_LoadScaledProc)(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height);
+
+/**
+Scanline decoding: rows are decoded on demand, top row first. 
+FI_OpenScanlinesProc returns a decoder and a header-only image describing the rows (the header is owned by the caller), 
+or NULL when the image can only be decoded as a whole. 
+FI_ReadScanlinesProc decodes the next count rows (pitch bytes apart) and returns the number of rows actually decoded.
+*/
+typedef void *(DLL_CALLCONV *FI_OpenScanlinesProc)(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header);
+typedef unsigned (DLL_CALLCONV *FI_ReadScanlinesProc)(FreeImageIO *io, fi_handle handle, void *reader, BYTE *bits, unsigned pitch, unsigned count);
+typedef void (DLL_CALLCONV *FI_CloseScanlinesProc)(FreeImageIO *io, fi_handle handle, void *reader);
+
+/**
+Scanline encoding: rows are encoded as they are supplied, top row first. 
+FI_CreateScanlinesProc writes the file header described by a (usually header-only) image, which stays valid until 
+the encoder is finished, and returns an encoder, or NULL, without writing anything, when the image can only be saved as a whole. 
+FI_WriteScanlinesProc encodes the next count rows (pitch bytes apart) and returns the number of rows actually encoded. 
+FI_FinishScanlinesProc completes the file once every row has been encoded, releases the encoder and returns TRUE on success.
+*/
+typedef void *(DLL_CALLCONV *FI_CreateScanlinesProc)(FreeImageIO *io, fi_handle handle, FIBITMAP *header, int page, int flags, void *data);
+typedef unsigned (DLL_CALLCONV *FI_WriteScanlinesProc)(FreeImageIO *io, fi_handle handle, void *writer, const BYTE *bits, unsigned pitch, unsigned count);
+typedef BOOL (DLL_CALLCONV *FI_FinishScanlinesProc)(FreeImageIO *io, fi_handle handle, void *writer);
+
+/**
+Region-of-interest loading: decode the pixels inside the [left, right[ x [top, bottom[ rectangle (left < right, top < bottom) 
+clipped to the image bounds. Returns the region, or NULL when the image can only be decoded as a whole.
+*/
+typedef FIBITMAP *(DLL_CALLCONV *FI_LoadRegionProc)(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int left, int top, int right, int bottom);
+
+/**
+Tile decoding: tiles are decoded on demand, in any order. 
+FI_OpenTilesProc returns a decoder, a header-only image describing the image (the header is owned by the caller) and 
+the size of the tiles, or NULL when the image can only be decoded as a whole. 
+FI_ReadTileProc decodes the tile at (column, row) of the tile grid into tile_height rows (pitch bytes apart), top row first, 
+leaving the pixels outside of the image unchanged, and returns TRUE on success.
+*/
+typedef void *(DLL_CALLCONV *FI_OpenTilesProc)(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header, unsigned *tile_width, unsigned *tile_height);
+typedef BOOL (DLL_CALLCONV *FI_ReadTileProc)(FreeImageIO *io, fi_handle handle, void *reader, unsigned column, unsigned row, BYTE *bits, unsigned pitch);
+typedef void (DLL_CALLCONV *FI_CloseTilesProc)(FreeImageIO *io, fi_handle handle, void *reader);
+
+/**
+Multipage loading: returns TRUE if the data returned by FI_OpenProc may be kept open between two page loads, 
+i.e. if FI_LoadProc can load any page in any order from the same data.
+*/
+typedef BOOL (DLL_CALLCONV *FI_KeepsLoadDataProc)(void);
+
+/**
+Multipage editing: returns the lossless format used to cache the pages added to a multipage bitmap. 
+Without this proc, pages are cached in the format of the plugin.
+*/
+typedef FREE_IMAGE_FORMAT (DLL_CALLCONV *FI_CacheFormatProc)(void);
+
 FI_STRUCT (Plugin) {
 	FI_FormatProc format_proc;
 	FI_DescriptionProc description_proc;
@@ -657,6 +750,20 @@ FI_STRUCT (Plugin) {
 	FI_SupportsExportTypeProc supports_export_type_proc;
 	FI_SupportsICCProfilesProc supports_icc_profiles_proc;
 	FI_SupportsNoPixelsProc supports_no_pixels_proc;
+	FI_MagicNumberProc magic_number_proc;
+	FI_LoadScaledProc load_scaled_proc;
+	FI_OpenScanlinesProc open_scanlines_proc;
+	FI_ReadScanlinesProc read_scanlines_proc;
+	FI_CloseScanlinesProc close_scanlines_proc;
+	FI_CreateScanlinesProc create_scanlines_proc;
+	FI_WriteScanlinesProc write_scanlines_proc;
+	FI_FinishScanlinesProc finish_scanlines_proc;
+	FI_LoadRegionProc load_region_proc;
+	FI_OpenTilesProc open_tiles_proc;
+	FI_ReadTileProc read_tile_proc;
+	FI_CloseTilesProc close_tiles_proc;
+	FI_KeepsLoadDataProc keeps_load_data_proc;
+	FI_CacheFormatProc cache_format_proc;
 };
 
 typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
@@ -684,12 +791,19 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define GIF_DEFAULT			0
 #define GIF_LOAD256			1		//! load the image as a 256 color image with ununsed palette entries, if it's 16 or 2 color
 #define GIF_PLAYBACK		2		//! 'Play' the GIF to generate each frame (as 32bpp) instead of returning raw frame data when loading
+#define GIF_OPTIMIZE		4		//! save opaque full screen pages as the rectangle that changed since the previous page, unchanged pixels made transparent
 #define HDR_DEFAULT			0
 #define ICO_DEFAULT         0
 #define ICO_MAKEALPHA		1		//! convert to 32bpp and create an alpha channel from the AND-mask when loading
 #define IFF_DEFAULT         0
 #define J2K_DEFAULT			0		//! save with a 16:1 rate
+#define J2K_REDUCE(n)		((n) & 0x1F)	//! load discarding the n highest resolution levels, i.e. at 1/2^n of the full size (use | to combine with J2K_LAYERS)
+#define J2K_LAYERS(n)		(((n) & 0xFF) << 5)	//! load decoding only the first n quality layers (use | to combine with J2K_REDUCE)
+#define J2K_TILESIZE(n)		((((n) >> 5) & 0xFF) << 10)	//! save as n x n tiles, n being rounded down to a multiple of 32 (32 to 8160, use | to combine with the rate)
 #define JP2_DEFAULT			0		//! save with a 16:1 rate
+#define JP2_REDUCE(n)		((n) & 0x1F)	//! load discarding the n highest resolution levels, i.e. at 1/2^n of the full size (use | to combine with JP2_LAYERS)
+#define JP2_LAYERS(n)		(((n) & 0xFF) << 5)	//! load decoding only the first n quality layers (use | to combine with JP2_REDUCE)
+#define JP2_TILESIZE(n)		((((n) >> 5) & 0xFF) << 10)	//! save as n x n tiles, n being rounded down to a multiple of 32 (32 to 8160, use | to combine with the rate)
 #define JPEG_DEFAULT        0		//! loading (see JPEG_FAST); saving (see JPEG_QUALITYGOOD|JPEG_SUBSAMPLING_420)
 #define JPEG_FAST           0x0001	//! load the file as fast as possible, sacrificing some quality
 #define JPEG_ACCURATE       0x0002	//! load the file with the best quality, sacrificing some speed
@@ -725,6 +839,9 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define PNG_Z_BEST_COMPRESSION		0x0009	//! save using ZLib level 9 compression flag (default value is 6)
 #define PNG_Z_NO_COMPRESSION		0x0100	//! save without ZLib compression
 #define PNG_INTERLACED				0x0200	//! save using Adam7 interlacing (use | to combine with other save flags)
+#define PNG_PARALLEL				0x0400	//! save compressing blocks of rows on several threads (use | to combine with other save flags, ignored with PNG_INTERLACED)
+#define PNG_FILTER_ADAPTIVE			0x0800	//! save choosing the filter of each row among the 5 PNG filters (fast heuristic, ignored with PNG_INTERLACED)
+#define PNG_FILTER_BRUTE			0x1000	//! save choosing the filter of each row by compressing the row with each PNG filter (slow, ignored with PNG_INTERLACED)
 #define PNM_DEFAULT         0
 #define PNM_SAVE_RAW        0       //! if set the writer saves in RAW format (i.e. P4, P5 or P6)
 #define PNM_SAVE_ASCII      1       //! if set the writer saves in ASCII format (i.e. P1, P2 or P3)
@@ -755,11 +872,21 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define TIFF_LZW			0x4000	//! save using LZW compression
 #define TIFF_JPEG			0x8000	//! save using JPEG compression
 #define TIFF_LOGLUV			0x10000	//! save using LogLuv compression
+#define TIFF_TILED			0x20000	//! save as 256 x 256 tiles instead of strips (use | to combine with TIFF_TILESIZE)
+#define TIFF_TILESIZE(n)	((((n) >> 4) & 0xFF) << 20)	//! save as n x n tiles, n being rounded down to a multiple of 16 (16 to 4080, use with TIFF_TILED)
+#define TIFF_PYRAMID		0x40000	//! save as tiles followed by tiled half-size levels (stored as SubIFDs) down to a single tile (8-bit greyscale, 24-/32-bit, 16-bit and float images)
+#define TIFF_LEVEL(n)		(((n) & 0xFF) << 20)	//! load the level n (1 to 255) of a pyramid saved with TIFF_PYRAMID (0 or TIFF_DEFAULT loads the image)
 #define WBMP_DEFAULT        0
 #define XBM_DEFAULT			0
 #define XPM_DEFAULT			0
 #define WEBP_DEFAULT		0		//! save with good quality (75:1)
+#define WEBP_PLAYBACK		2		//! load an animated WebP page as the full canvas (32bpp) rendered up to this page, instead of the raw frame data
 #define WEBP_LOSSLESS		0x100	//! save in lossless mode
+#define WEBP_METHOD(n)		((((n) & 0x7) + 1) << 9)	//! save using the compression method n, from 0 (fastest) to 6 (slowest and smallest, the default)
+#define WEBP_THREADS		0x1000	//! encode with a second thread when FreeImage_GetThreadCount() > 1 (the output is the same)
+#define WEBP_SEGMENTS(n)	(((n) & 0x3) << 13)	//! lossy save using n segments, from 1 to 4 (the default)
+#define WEBP_EXACT			0x8000	//! keep the RGB values of fully transparent pixels instead of discarding them
+#define WEBP_NEAR_LOSSLESS(n)	((((100 - (n)) & 0x7F) << 16) | WEBP_LOSSLESS)	//! save in near-lossless mode with preprocessing strength n, from 0 (strongest) to 100 (lossless)
 #define JXR_DEFAULT			0		//! save with quality 80 and no chroma subsampling (4:4:4)
 #define JXR_LOSSLESS		0x0064	//! save lossless
 #define JXR_PROGRESSIVE		0x2000	//! save as a progressive-JXR (use | to combine with other save flags)
@@ -779,6 +906,7 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define FI_RESCALE_DEFAULT			0x00    //! default options; none of the following other options apply
 #define FI_RESCALE_TRUE_COLOR		0x01	//! for non-transparent greyscale images, convert to 24-bit if src bitdepth <= 8 (default is a 8-bit greyscale image). 
 #define FI_RESCALE_OMIT_METADATA	0x02	//! do not copy metadata to the rescaled image
+#define FI_RESCALE_FIXED_POINT		0x04	//! filter 8- and 16-bit channels with faster 14-bit fixed-point weights (default is double precision; results may differ by a few levels)
 
 
 #ifdef __cplusplus
@@ -804,13 +932,34 @@ DLL_API void DLL_CALLCONV FreeImage_SetOutputMessageStdCall(FreeImage_OutputMess
 DLL_API void DLL_CALLCONV FreeImage_SetOutputMessage(FreeImage_OutputMessageFunction omf);
 DLL_API void DLL_CALLCONV FreeImage_OutputMessageProc(int fif, const char *fmt, ...);
 
+// Multi-threading routines -------------------------------------------------
+
+DLL_API void DLL_CALLCONV FreeImage_SetThreadCount(int count);
+DLL_API int DLL_CALLCONV FreeImage_GetThreadCount(void);
+
 // Allocate / Clone / Unload routines ---------------------------------------
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Allocate(int width, int height, int bpp, unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_AllocateT(FREE_IMAGE_TYPE type, int width, int height, int bpp FI_DEFAULT(8), unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_AllocateHeader(BOOL header_only, int width, int height, int bpp, unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_AllocateHeaderT(BOOL header_only, FREE_IMAGE_TYPE type, int width, int height, int bpp FI_DEFAULT(8), unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
 DLL_API FIBITMAP * DLL_CALLCONV FreeImage_Clone(FIBITMAP *dib);
 DLL_API void DLL_CALLCONV FreeImage_Unload(FIBITMAP *dib);
 
+// Bitmap memory management routines ----------------------------------------
+
+typedef void *(DLL_CALLCONV *FI_AllocateProc)(size_t size, size_t alignment);
+typedef void (DLL_CALLCONV *FI_FreeProc)(void *mem);
+
+// FreeImage_SetAllocator returns FALSE (and keeps the current allocator) while any FIBITMAP is allocated: 
+// call it before allocating images, or after unloading all of them. NULL procs restore the default allocator.
+DLL_API BOOL DLL_CALLCONV FreeImage_SetAllocator(FI_AllocateProc allocate_proc, FI_FreeProc free_proc);
+DLL_API void DLL_CALLCONV FreeImage_SetBitmapPoolSize(size_t max_bytes);
+DLL_API void DLL_CALLCONV FreeImage_GetBitmapPoolStats(FIPOOLSTATS *stats);
+DLL_API void DLL_CALLCONV FreeImage_PurgeBitmapPool(void);
+DLL_API void DLL_CALLCONV FreeImage_SetCopyOnWrite(BOOL enable);
+DLL_API BOOL DLL_CALLCONV FreeImage_IsCopyOnWrite(void);
+
 // Header loading routines
 DLL_API BOOL DLL_CALLCONV FreeImage_HasPixels(FIBITMAP *dib);
 
@@ -819,6 +968,12 @@ DLL_API BOOL DLL_CALLCONV FreeImage_HasPixels(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Load(FREE_IMAGE_FORMAT fif, const char *filename, int flags FI_DEFAULT(0));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags FI_DEFAULT(0));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadScaled(FREE_IMAGE_FORMAT fif, const char *filename, int max_width, int max_height, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadScaledU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int max_width, int max_height, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadScaledFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int max_width, int max_height, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadRegion(FREE_IMAGE_FORMAT fif, const char *filename, int left, int top, int right, int bottom, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadRegionU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int left, int top, int right, int bottom, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadRegionFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int left, int top, int right, int bottom, int flags FI_DEFAULT(0));
 DLL_API BOOL DLL_CALLCONV FreeImage_Save(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, const char *filename, int flags FI_DEFAULT(0));
 DLL_API BOOL DLL_CALLCONV FreeImage_SaveU(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, const wchar_t *filename, int flags FI_DEFAULT(0));
 DLL_API BOOL DLL_CALLCONV FreeImage_SaveToHandle(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FreeImageIO *io, fi_handle handle, int flags FI_DEFAULT(0));
@@ -828,6 +983,8 @@ DLL_API BOOL DLL_CALLCONV FreeImage_SaveToHandle(FREE_IMAGE_FORMAT fif, FIBITMAP
 DLL_API FIMEMORY *DLL_CALLCONV FreeImage_OpenMemory(BYTE *data FI_DEFAULT(0), DWORD size_in_bytes FI_DEFAULT(0));
 DLL_API void DLL_CALLCONV FreeImage_CloseMemory(FIMEMORY *stream);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadScaledFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int max_width, int max_height, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadRegionFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int left, int top, int right, int bottom, int flags FI_DEFAULT(0));
 DLL_API BOOL DLL_CALLCONV FreeImage_SaveToMemory(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FIMEMORY *stream, int flags FI_DEFAULT(0));
 DLL_API long DLL_CALLCONV FreeImage_TellMemory(FIMEMORY *stream);
 DLL_API BOOL DLL_CALLCONV FreeImage_SeekMemory(FIMEMORY *stream, long offset, int origin);
@@ -835,6 +992,15 @@ DLL_API BOOL DLL_CALLCONV FreeImage_AcquireMemory(FIMEMORY *stream, BYTE **data,
 DLL_API unsigned DLL_CALLCONV FreeImage_ReadMemory(void *buffer, unsigned size, unsigned count, FIMEMORY *stream);
 DLL_API unsigned DLL_CALLCONV FreeImage_WriteMemory(const void *buffer, unsigned size, unsigned count, FIMEMORY *stream);
 
+DLL_API FIMEMORY *DLL_CALLCONV FreeImage_OpenMemoryBuffer(BYTE *data, DWORD size_in_bytes, FI_MemoryGrowProc grow_proc FI_DEFAULT(0), void *user_data FI_DEFAULT(0));
+DLL_API FIMEMORY *DLL_CALLCONV FreeImage_OpenMemoryChunked(DWORD chunk_size FI_DEFAULT(0));
+DLL_API BOOL DLL_CALLCONV FreeImage_GetMemoryChunk(FIMEMORY *stream, unsigned index, BYTE **data, DWORD *size_in_bytes);
+
+DLL_API FIMEMORY *DLL_CALLCONV FreeImage_OpenMemoryMapped(const char *filename);
+DLL_API FIMEMORY *DLL_CALLCONV FreeImage_OpenMemoryMappedU(const wchar_t *filename);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadMapped(FREE_IMAGE_FORMAT fif, const char *filename, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadMappedU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags FI_DEFAULT(0));
+
 DLL_API FIMULTIBITMAP *DLL_CALLCONV FreeImage_LoadMultiBitmapFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags FI_DEFAULT(0));
 DLL_API BOOL DLL_CALLCONV FreeImage_SaveMultiBitmapToMemory(FREE_IMAGE_FORMAT fif, FIMULTIBITMAP *bitmap, FIMEMORY *stream, int flags);
 
@@ -876,6 +1042,41 @@ DLL_API void DLL_CALLCONV FreeImage_UnlockPage(FIMULTIBITMAP *bitmap, FIBITMAP *
 DLL_API BOOL DLL_CALLCONV FreeImage_MovePage(FIMULTIBITMAP *bitmap, int target, int source);
 DLL_API BOOL DLL_CALLCONV FreeImage_GetLockedPageNumbers(FIMULTIBITMAP *bitmap, int *pages, int *count);
 
+// Scanline streaming interface ---------------------------------------------
+
+DLL_API FISCANLINEREADER *DLL_CALLCONV FreeImage_OpenScanlineReader(FREE_IMAGE_FORMAT fif, const char *filename, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEREADER *DLL_CALLCONV FreeImage_OpenScanlineReaderU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEREADER *DLL_CALLCONV FreeImage_OpenScanlineReaderFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEREADER *DLL_CALLCONV FreeImage_OpenScanlineReaderFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_GetScanlineReaderInfo(FISCANLINEREADER *reader);
+DLL_API BOOL DLL_CALLCONV FreeImage_IsScanlineReaderStreaming(FISCANLINEREADER *reader);
+DLL_API unsigned DLL_CALLCONV FreeImage_GetScanlineReaderPosition(FISCANLINEREADER *reader);
+DLL_API unsigned DLL_CALLCONV FreeImage_ReadScanlines(FISCANLINEREADER *reader, BYTE *bits, unsigned pitch, unsigned count);
+DLL_API void DLL_CALLCONV FreeImage_CloseScanlineReader(FISCANLINEREADER *reader);
+
+DLL_API FISCANLINEWRITER *DLL_CALLCONV FreeImage_OpenScanlineWriter(FREE_IMAGE_FORMAT fif, FIBITMAP *header, const char *filename, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEWRITER *DLL_CALLCONV FreeImage_OpenScanlineWriterU(FREE_IMAGE_FORMAT fif, FIBITMAP *header, const wchar_t *filename, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEWRITER *DLL_CALLCONV FreeImage_OpenScanlineWriterToHandle(FREE_IMAGE_FORMAT fif, FIBITMAP *header, FreeImageIO *io, fi_handle handle, int flags FI_DEFAULT(0));
+DLL_API FISCANLINEWRITER *DLL_CALLCONV FreeImage_OpenScanlineWriterToMemory(FREE_IMAGE_FORMAT fif, FIBITMAP *header, FIMEMORY *stream, int flags FI_DEFAULT(0));
+DLL_API BOOL DLL_CALLCONV FreeImage_IsScanlineWriterStreaming(FISCANLINEWRITER *writer);
+DLL_API unsigned DLL_CALLCONV FreeImage_GetScanlineWriterPosition(FISCANLINEWRITER *writer);
+DLL_API unsigned DLL_CALLCONV FreeImage_WriteScanlines(FISCANLINEWRITER *writer, const BYTE *bits, unsigned pitch, unsigned count);
+DLL_API BOOL DLL_CALLCONV FreeImage_CloseScanlineWriter(FISCANLINEWRITER *writer);
+
+// Tile access interface ----------------------------------------------------
+
+DLL_API FITILEREADER *DLL_CALLCONV FreeImage_OpenTileReader(FREE_IMAGE_FORMAT fif, const char *filename, int page FI_DEFAULT(-1), int flags FI_DEFAULT(0));
+DLL_API FITILEREADER *DLL_CALLCONV FreeImage_OpenTileReaderU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int page FI_DEFAULT(-1), int flags FI_DEFAULT(0));
+DLL_API FITILEREADER *DLL_CALLCONV FreeImage_OpenTileReaderFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int page FI_DEFAULT(-1), int flags FI_DEFAULT(0));
+DLL_API FITILEREADER *DLL_CALLCONV FreeImage_OpenTileReaderFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int page FI_DEFAULT(-1), int flags FI_DEFAULT(0));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_GetTileReaderInfo(FITILEREADER *reader);
+DLL_API BOOL DLL_CALLCONV FreeImage_IsTileReaderStreaming(FITILEREADER *reader);
+DLL_API BOOL DLL_CALLCONV FreeImage_GetTileReaderGrid(FITILEREADER *reader, unsigned *tile_width, unsigned *tile_height, unsigned *columns, unsigned *rows);
+DLL_API void DLL_CALLCONV FreeImage_SetTileReaderCacheSize(FITILEREADER *reader, unsigned tiles);
+DLL_API BOOL DLL_CALLCONV FreeImage_ReadTile(FITILEREADER *reader, unsigned column, unsigned row, BYTE *bits, unsigned pitch);
+DLL_API BOOL DLL_CALLCONV FreeImage_ReadTiles(FITILEREADER *reader, unsigned first_column, unsigned first_row, unsigned columns, unsigned rows, BYTE *bits, unsigned pitch);
+DLL_API void DLL_CALLCONV FreeImage_CloseTileReader(FITILEREADER *reader);
+
 // File type request routines ------------------------------------------------
 
 DLL_API FREE_IMAGE_FORMAT DLL_CALLCONV FreeImage_GetFileType(const char *filename, int size FI_DEFAULT(0));
@@ -1113,6 +1314,9 @@ DLL_API BOOL DLL_CALLCONV FreeImage_FlipVertical(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Rescale(FIBITMAP *dib, int dst_width, int dst_height, FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_CATMULLROM));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_MakeThumbnail(FIBITMAP *dib, int max_pixel_size, BOOL convert FI_DEFAULT(TRUE));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_RescaleRect(FIBITMAP *dib, int dst_width, int dst_height, int left, int top, int right, int bottom, FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_CATMULLROM), unsigned flags FI_DEFAULT(0));
+DLL_API void DLL_CALLCONV FreeImage_SetRescaleCacheSize(size_t max_bytes);
+DLL_API BOOL DLL_CALLCONV FreeImage_PrewarmRescaleCache(int src_width, int src_height, int dst_width, int dst_height, FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_CATMULLROM));
+DLL_API void DLL_CALLCONV FreeImage_ClearRescaleCache(void);
 
 // color manipulation routines (point operations)
 DLL_API BOOL DLL_CALLCONV FreeImage_AdjustCurve(FIBITMAP *dib, BYTE *LUT, FREE_IMAGE_COLOR_CHANNEL channel);
@@ -32,6 +32,8 @@
 #if defined(_WIN32) || defined(_WIN64) || defined(__MINGW32__)
 #include <malloc.h>
 #endif // _WIN32 || _WIN64 || __MINGW32__
+#include <mutex>
+#include <atomic>
 
 #include "FreeImage.h"
 #include "FreeImageIO.h"
@@ -65,8 +67,18 @@ typedef std::map<int, TAGMAP*> METADATAMAP;
 
 /** helper for metadata iterator */
 FI_STRUCT (METADATAHEADER) { 
-	long pos;		//! current position when iterating the map
-	TAGMAP *tagmap;	//! pointer to the tag map
+	TAGMAP::iterator pos;	//! current position when iterating the map
+	TAGMAP *tagmap;			//! pointer to the tag map
+};
+
+/**
+Reference counted memory block, holding the pixels shared by copy-on-write clones
+*/
+FI_STRUCT (SHAREDPIXELS) {
+	std::atomic<unsigned> refs;	//! number of references to the block
+	void *block;				//! memory block, as returned by the bitmap allocator
+	size_t block_size;			//! size of the memory block
+	BYTE *bits;					//! pixels stored in the memory block
 };
 
 // ----------------------------------------------------------
@@ -118,6 +130,19 @@ FI_STRUCT (FREEIMAGEHEADER) {
 	unsigned external_pitch;
 	//@}
 
+	/** size of the memory block holding this header, as returned by the bitmap allocator */
+	size_t block_size;
+
+	/**@name copy-on-write management */
+	//@{
+	/** pixels shared with copy-on-write clones, NULL otherwise (read without lock, see GetBitsReadOnly) */
+	std::atomic<SHAREDPIXELS*> shared_pixels;
+	/** reference counted view of the memory block holding this header, when its pixels are shared, NULL otherwise */
+	SHAREDPIXELS *shared_header;
+	/** reference counter of a metadata map shared with copy-on-write clones, NULL otherwise */
+	std::atomic<unsigned> *shared_metadata;
+	//@}
+
 	//BYTE filler[1];			 // fill to 32-bit alignment
 };
 
@@ -193,6 +218,231 @@ void FreeImage_Aligned_Free(void* mem) {
 
 #endif // _WIN32 || _WIN64
 
+// ----------------------------------------------------------
+//  FIBITMAP allocator and memory block pool
+// ----------------------------------------------------------
+
+static void * DLL_CALLCONV
+DefaultAllocateProc(size_t size, size_t alignment) {
+	return FreeImage_Aligned_Malloc(size, alignment);
+}
+
+static void DLL_CALLCONV
+DefaultFreeProc(void *mem) {
+	FreeImage_Aligned_Free(mem);
+}
+
+/** current allocator, only accessed with the BitmapPool mutex held */
+static FI_AllocateProc s_allocate_proc = DefaultAllocateProc;
+static FI_FreeProc s_free_proc = DefaultFreeProc;
+
+/**
+Pool of FIBITMAP memory blocks, sorted by size class. 
+Blocks released by FreeImage_Unload are kept on a free list (one list per size class) 
+as long as the pool holds less than max_bytes, and are handed back by FreeImage_AllocateBitmap 
+to any request falling into the same size class. When the pool is full, released blocks 
+are returned to the allocator. The pool is disabled by default (max_bytes == 0).<br>
+The pool also counts the blocks obtained from the allocator and not yet given back to it, 
+so that the allocator is never changed while one of its blocks is in use.
+*/
+class BitmapPool {
+public:
+	static BitmapPool& instance() {
+		static BitmapPool s;
+		return s;
+	}
+
+	/**
+	Get a memory block of at least 'size' bytes
+	@param size Requested size in bytes
+	@param block_size Returns the actual size of the block
+	@return Returns the memory block if successful, returns NULL otherwise
+	*/
+	void* Allocate(size_t size, size_t *block_size) {
+		FI_AllocateProc allocate_proc = NULL;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if(m_max_bytes > 0) {
+				// round the request up to its size class, so that the block can be recycled later
+				size = GetSizeClass(size);
+
+				BLOCKMAP::iterator i = m_free_blocks.find(size);
+				if((i != m_free_blocks.end()) && !i->second.empty()) {
+					void *block = i->second.back();
+					i->second.pop_back();
+					m_bytes_retained -= size;
+					m_blocks_retained--;
+					m_hits++;
+					*block_size = size;
+					return block;
+				}
+			}
+			m_misses++;
+			m_blocks_live++;
+			allocate_proc = s_allocate_proc;
+		}
+
+		*block_size = size;
+		void *block = allocate_proc(size, FIBITMAP_ALIGNMENT);
+		if(!block) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_blocks_live--;
+		}
+		return block;
+	}
+
+	/**
+	Give back a memory block obtained from Allocate
+	@param block Memory block
+	@param block_size Size of the memory block, as returned by Allocate
+	*/
+	void Release(void *block, size_t block_size) {
+		FI_FreeProc free_proc = NULL;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if((block_size <= m_max_bytes - m_bytes_retained) && (GetSizeClass(block_size) == block_size)) {
+				try {
+					m_free_blocks[block_size].push_back(block);
+					m_bytes_retained += block_size;
+					m_blocks_retained++;
+					return;
+				} catch(std::bad_alloc &) {
+					// no room left for the free list, release the block
+				}
+			}
+			m_blocks_live--;
+			free_proc = s_free_proc;
+		}
+
+		free_proc(block);
+	}
+
+	/**
+	Set the maximum amount of memory held by the pool, releasing blocks if needed
+	*/
+	void SetMaxBytes(size_t max_bytes) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_max_bytes = max_bytes;
+		Trim(max_bytes);
+	}
+
+	/**
+	Release all blocks held by the pool
+	*/
+	void Purge() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Trim(0);
+	}
+
+	/**
+	Change the allocator, unless blocks of the current allocator are still in use 
+	(blocks held by the pool are released first)
+	@return Returns TRUE if successful, returns FALSE otherwise
+	*/
+	BOOL SetAllocator(FI_AllocateProc allocate_proc, FI_FreeProc free_proc) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Trim(0);
+		if(m_blocks_live > 0) {
+			return FALSE;
+		}
+		s_allocate_proc = allocate_proc;
+		s_free_proc = free_proc;
+		return TRUE;
+	}
+
+	void GetStats(FIPOOLSTATS *stats) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		stats->hits = m_hits;
+		stats->misses = m_misses;
+		stats->bytes_retained = m_bytes_retained;
+		stats->blocks_retained = m_blocks_retained;
+		stats->max_bytes = m_max_bytes;
+	}
+
+private:
+	typedef std::map<size_t, std::vector<void*> > BLOCKMAP;
+
+	BitmapPool() : m_max_bytes(0), m_bytes_retained(0), m_blocks_retained(0), m_blocks_live(0), m_hits(0), m_misses(0) {
+	}
+
+	~BitmapPool() {
+		Purge();
+	}
+
+	/**
+	Size classes are spaced by 1/8th of the nearest lower power of two (with a 64 bytes minimum spacing), 
+	so that images of close dimensions share the same blocks while wasting at most 12.5% of the memory
+	*/
+	static size_t GetSizeClass(size_t size) {
+		size_t step = 1;
+		while((step << 1) <= size && (step << 1) != 0) {
+			step <<= 1;
+		}
+		step = MAX(step / 8, (size_t)64);
+		if(size > ((size_t)-1) - step) {
+			return size;
+		}
+		return ((size + step - 1) / step) * step;
+	}
+
+	/**
+	Release the largest blocks first until the pool holds no more than max_bytes (mutex must be held)
+	*/
+	void Trim(size_t max_bytes) {
+		while((m_bytes_retained > max_bytes) && !m_free_blocks.empty()) {
+			BLOCKMAP::iterator i = --m_free_blocks.end();
+			while(!i->second.empty() && (m_bytes_retained > max_bytes)) {
+				s_free_proc(i->second.back());
+				i->second.pop_back();
+				m_bytes_retained -= i->first;
+				m_blocks_retained--;
+				m_blocks_live--;
+			}
+			if(i->second.empty()) {
+				m_free_blocks.erase(i);
+			}
+		}
+	}
+
+private:
+	std::mutex m_mutex;
+	BLOCKMAP m_free_blocks;
+	size_t m_max_bytes;
+	size_t m_bytes_retained;
+	size_t m_blocks_retained;
+	size_t m_blocks_live;
+	UINT64 m_hits;
+	UINT64 m_misses;
+};
+
+BOOL DLL_CALLCONV
+FreeImage_SetAllocator(FI_AllocateProc allocate_proc, FI_FreeProc free_proc) {
+	// a block must be released by the allocator that returned it: refuse the change while FIBITMAP are alive
+	if(allocate_proc && free_proc) {
+		return BitmapPool::instance().SetAllocator(allocate_proc, free_proc);
+	}
+	return BitmapPool::instance().SetAllocator(DefaultAllocateProc, DefaultFreeProc);
+}
+
+void DLL_CALLCONV
+FreeImage_SetBitmapPoolSize(size_t max_bytes) {
+	BitmapPool::instance().SetMaxBytes(max_bytes);
+}
+
+void DLL_CALLCONV
+FreeImage_GetBitmapPoolStats(FIPOOLSTATS *stats) {
+	if(stats) {
+		BitmapPool::instance().GetStats(stats);
+	}
+}
+
+void DLL_CALLCONV
+FreeImage_PurgeBitmapPool() {
+	BitmapPool::instance().Purge();
+}
+
 // ----------------------------------------------------------
 //  FIBITMAP memory management
 // ----------------------------------------------------------
@@ -387,7 +637,9 @@ FreeImage_AllocateBitmap(BOOL header_only, BYTE *ext_bits, unsigned ext_pitch, F
 			return NULL;
 		}
 
-		bitmap->data = (BYTE *)FreeImage_Aligned_Malloc(dib_size * sizeof(BYTE), FIBITMAP_ALIGNMENT);
+		size_t block_size = 0;
+
+		bitmap->data = (BYTE *)BitmapPool::instance().Allocate(dib_size * sizeof(BYTE), &block_size);
 
 		if (bitmap->data != NULL) {
 			memset(bitmap->data, 0, dib_size);
@@ -396,6 +648,8 @@ FreeImage_AllocateBitmap(BOOL header_only, BYTE *ext_bits, unsigned ext_pitch, F
 
 			FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)bitmap->data;
 
+			fih->block_size = block_size;
+
 			fih->type = type;
 
 			memset(&fih->bkgnd_color, 0, sizeof(RGBQUAD));
@@ -492,6 +746,322 @@ FreeImage_AllocateT(FREE_IMAGE_TYPE type, int width, int height, int bpp, unsign
 	return FreeImage_AllocateBitmap(FALSE, NULL, 0, type, width, height, bpp, red_mask, green_mask, blue_mask);
 }
 
+// ----------------------------------------------------------
+//  Copy-on-write management
+// ----------------------------------------------------------
+
+/**
+When TRUE, FreeImage_Clone shares the pixels and the metadata of the source image 
+instead of copying them. Shared data are copied on first write.
+*/
+static std::atomic<BOOL> s_copy_on_write(FALSE);
+
+void DLL_CALLCONV
+FreeImage_SetCopyOnWrite(BOOL enable) {
+	s_copy_on_write = enable ? TRUE : FALSE;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_IsCopyOnWrite() {
+	return s_copy_on_write;
+}
+
+/**
+Test hook: number of metadata maps that FreeImage_Clone will fail to share, 
+as if the shared reference counter could not be allocated
+*/
+static std::atomic<unsigned> s_metadata_share_failures(0);
+
+void
+FreeImage_FailMetadataShares(unsigned count) {
+	s_metadata_share_failures = count;
+}
+
+/**
+Consume one of the failures requested by FreeImage_FailMetadataShares
+@return Returns TRUE if the metadata share must fail, returns FALSE otherwise
+*/
+static BOOL
+FailMetadataShare() {
+	unsigned failures = s_metadata_share_failures;
+	while(failures) {
+		if(s_metadata_share_failures.compare_exchange_weak(failures, failures - 1)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+Returns a pointer to the pixels, without copying pixels shared with copy-on-write clones. 
+Use only for read access: the pixels are not moved, so several threads may read them at the same time.
+*/
+static BYTE *
+GetBitsReadOnly(FIBITMAP *dib) {
+	const FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+
+	const SHAREDPIXELS *shared = fih->shared_pixels;
+	if(shared) {
+		return shared->bits;
+	}
+	if(fih->external_bits) {
+		return fih->external_bits;
+	}
+
+	// returns the pixels aligned on a FIBITMAP_ALIGNMENT bytes alignment boundary
+	size_t lp = (size_t)FreeImage_GetInfoHeader(dib);
+	lp += sizeof(BITMAPINFOHEADER) + sizeof(RGBQUAD) * FreeImage_GetColorsUsed(dib);
+	lp += FreeImage_HasRGBMasks(dib) ? sizeof(DWORD) * 3 : 0;
+	lp += (lp % FIBITMAP_ALIGNMENT ? FIBITMAP_ALIGNMENT - lp % FIBITMAP_ALIGNMENT : 0);
+	return (BYTE *)lp;
+}
+
+/**
+Returns the lock serializing the copy-on-write state changes of a FIBITMAP. 
+Locks are picked from a small table using the address of the header, so that unrelated images rarely contend.
+*/
+static std::mutex&
+GetCopyOnWriteLock(FIBITMAP *dib) {
+	static std::mutex locks[16];
+	return locks[((size_t)dib->data / FIBITMAP_ALIGNMENT) % 16];
+}
+
+/**
+Delete a metadata map, including all its models
+*/
+static void
+DeleteMetadata(METADATAMAP *metadata) {
+	for(METADATAMAP::iterator i = (*metadata).begin(); i != (*metadata).end(); i++) {
+		TAGMAP *tagmap = (*i).second;
+
+		if(tagmap) {
+			for(TAGMAP::iterator j = tagmap->begin(); j != tagmap->end(); j++) {
+				FITAG *tag = (*j).second;
+				FreeImage_DeleteTag(tag);
+			}
+
+			delete tagmap;
+		}
+	}
+
+	delete metadata;
+}
+
+/**
+Clone a metadata model
+*/
+static TAGMAP*
+CloneTagMap(const TAGMAP *src_tagmap) {
+	TAGMAP *dst_tagmap = new(std::nothrow) TAGMAP();
+
+	if(dst_tagmap) {
+		// fill the model (keys are visited in order, so that every tag is inserted at the end of the map)
+		for(TAGMAP::const_iterator j = src_tagmap->begin(); j != src_tagmap->end(); j++) {
+			FITAG *dst_tag = FreeImage_CloneTag( (*j).second );
+
+			// assign key and tag value
+			dst_tagmap->insert(dst_tagmap->end(), TAGMAP::value_type((*j).first, dst_tag));
+		}
+	}
+
+	return dst_tagmap;
+}
+
+/**
+Copy all metadata models from src_metadata to dst_metadata
+*/
+static void
+CopyMetadata(METADATAMAP *dst_metadata, METADATAMAP *src_metadata) {
+	for(METADATAMAP::iterator i = (*src_metadata).begin(); i != (*src_metadata).end(); i++) {
+		int model = (*i).first;
+		TAGMAP *src_tagmap = (*i).second;
+
+		if(src_tagmap) {
+			// create a metadata model
+			TAGMAP *dst_tagmap = CloneTagMap(src_tagmap);
+
+			if(dst_tagmap) {
+				// assign model and tagmap
+				(*dst_metadata)[model] = dst_tagmap;
+			}
+		}
+	}
+}
+
+/**
+Release the metadata map of a FIBITMAP. 
+A map shared with copy-on-write clones is deleted when its last owner releases it.
+*/
+static void
+ReleaseMetadata(FREEIMAGEHEADER *fih) {
+	if(fih->shared_metadata) {
+		if(--(*fih->shared_metadata) == 0) {
+			DeleteMetadata(fih->metadata);
+			delete fih->shared_metadata;
+		}
+	} else {
+		DeleteMetadata(fih->metadata);
+	}
+
+	fih->metadata = NULL;
+	fih->shared_metadata = NULL;
+}
+
+/**
+Let dst share the metadata map of src. 
+On failure, the metadata map of dst is left unchanged.
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL
+ShareMetadata(FIBITMAP *dst, FIBITMAP *src) {
+	FREEIMAGEHEADER *src_fih = (FREEIMAGEHEADER *)src->data;
+	FREEIMAGEHEADER *dst_fih = (FREEIMAGEHEADER *)dst->data;
+
+	// several threads may clone src at the same time
+	std::lock_guard<std::mutex> lock(GetCopyOnWriteLock(src));
+
+	if(!src_fih->shared_metadata) {
+		src_fih->shared_metadata = FailMetadataShare() ? NULL : new(std::nothrow) std::atomic<unsigned>(1);
+		if(!src_fih->shared_metadata) {
+			// dst keeps its own map
+			return FALSE;
+		}
+	}
+
+	// nothing can fail from here: replace the map of dst
+	ReleaseMetadata(dst_fih);
+
+	(*src_fih->shared_metadata)++;
+	dst_fih->metadata = src_fih->metadata;
+	dst_fih->shared_metadata = src_fih->shared_metadata;
+
+	return TRUE;
+}
+
+/**
+Give a FIBITMAP its own copy of a metadata map shared with copy-on-write clones. 
+Must be called before the metadata map is modified.
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL
+UnshareMetadata(FIBITMAP *dib) {
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+
+	if(fih->shared_metadata) {
+		if(*fih->shared_metadata > 1) {
+			METADATAMAP *metadata = new(std::nothrow) METADATAMAP;
+			if(!metadata) {
+				return FALSE;
+			}
+			CopyMetadata(metadata, fih->metadata);
+			ReleaseMetadata(fih);
+			fih->metadata = metadata;
+		} else {
+			// last owner of the map
+			delete fih->shared_metadata;
+			fih->shared_metadata = NULL;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+Release a pixel block shared with copy-on-write clones. 
+The block is given back to the bitmap allocator when its last owner releases it.
+*/
+static void
+ReleasePixels(SHAREDPIXELS *shared) {
+	if(--shared->refs == 0) {
+		BitmapPool::instance().Release(shared->block, shared->block_size);
+		delete shared;
+	}
+}
+
+/**
+Share the pixels of a FIBITMAP with a new copy-on-write clone. 
+The header of dib is left in place: the first time its pixels are shared, the memory block holding 
+the header and the pixels becomes a reference counted block, released when dib and every clone using 
+its pixels have been unloaded. Several threads may clone the same FIBITMAP at the same time.
+@return Returns the shared pixels with a new reference for the clone, returns NULL if the pixels can't be shared
+*/
+static SHAREDPIXELS*
+SharePixels(FIBITMAP *dib) {
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+
+	// user provided pixel buffers are always copied
+	if(fih->external_bits) {
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(GetCopyOnWriteLock(dib));
+
+	SHAREDPIXELS *shared = fih->shared_pixels;
+	if(!shared) {
+		shared = new(std::nothrow) SHAREDPIXELS;
+		if(!shared) {
+			return NULL;
+		}
+		// one reference for the header of dib, one for its pixels
+		shared->refs = 2;
+		shared->block = dib->data;
+		shared->block_size = fih->block_size;
+		shared->bits = GetBitsReadOnly(dib);
+
+		fih->shared_header = shared;
+		fih->shared_pixels = shared;
+	}
+	shared->refs++;
+
+	return shared;
+}
+
+/**
+Give a FIBITMAP its own copy of pixels shared with copy-on-write clones. 
+Must be called before the pixels are modified. Safe to call from several threads on the same FIBITMAP.
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL
+UnsharePixels(FIBITMAP *dib) {
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+
+	// the references held by dib itself: its pixels, and its header when the block also holds the header
+	SHAREDPIXELS *shared = fih->shared_pixels;
+	if(!shared || (shared->refs <= ((shared == fih->shared_header) ? 2U : 1U))) {
+		return TRUE;
+	}
+
+	std::lock_guard<std::mutex> lock(GetCopyOnWriteLock(dib));
+
+	// another thread may have copied the pixels while we were waiting
+	shared = fih->shared_pixels;
+	if(shared->refs > ((shared == fih->shared_header) ? 2U : 1U)) {
+		const size_t size = (size_t)FreeImage_GetPitch(dib) * FreeImage_GetHeight(dib);
+
+		SHAREDPIXELS *copy = new(std::nothrow) SHAREDPIXELS;
+		if(!copy) {
+			return FALSE;
+		}
+		copy->block = BitmapPool::instance().Allocate(size, &copy->block_size);
+		if(!copy->block) {
+			delete copy;
+			return FALSE;
+		}
+		copy->refs = 1;
+		copy->bits = (BYTE *)copy->block;
+
+		memcpy(copy->bits, shared->bits, size);
+
+		fih->shared_pixels = copy;
+
+		ReleasePixels(shared);
+	}
+
+	return TRUE;
+}
+
+// ----------------------------------------------------------
+
 void DLL_CALLCONV
 FreeImage_Unload(FIBITMAP *dib) {
 	if (NULL != dib) {	
@@ -502,28 +1072,25 @@ FreeImage_Unload(FIBITMAP *dib) {
 			}
 
 			// delete metadata models
-			METADATAMAP *metadata = ((FREEIMAGEHEADER *)dib->data)->metadata;
-
-			for(METADATAMAP::iterator i = (*metadata).begin(); i != (*metadata).end(); i++) {
-				TAGMAP *tagmap = (*i).second;
-
-				if(tagmap) {
-					for(TAGMAP::iterator j = tagmap->begin(); j != tagmap->end(); j++) {
-						FITAG *tag = (*j).second;
-						FreeImage_DeleteTag(tag);
-					}
-
-					delete tagmap;
-				}
-			}
-
-			delete metadata;
+			ReleaseMetadata((FREEIMAGEHEADER *)dib->data);
 
 			// delete embedded thumbnail
 			FreeImage_Unload(FreeImage_GetThumbnail(dib));
 
+			// release pixels shared with copy-on-write clones
+			FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+			SHAREDPIXELS *shared_header = fih->shared_header;
+			if(fih->shared_pixels) {
+				ReleasePixels(fih->shared_pixels);
+			}
+
 			// delete bitmap ...
-			FreeImage_Aligned_Free(dib->data);
+			if(shared_header) {
+				// ... unless clones are still using the pixels stored after the header
+				ReleasePixels(shared_header);
+			} else {
+				BitmapPool::instance().Release(dib->data, fih->block_size);
+			}
 		}
 
 		free(dib);		// ... and the wrapper
@@ -543,18 +1110,28 @@ FreeImage_Clone(FIBITMAP *dib) {
 	unsigned height	= FreeImage_GetHeight(dib);
 	unsigned bpp	= FreeImage_GetBPP(dib);
 
-	// if the FIBITMAP is a wrapper to a user provided pixel buffer, get a pointer to this buffer
-	const BYTE *ext_bits = ((FREEIMAGEHEADER *)dib->data)->external_bits;
-	
 	// check for pixel availability ...
 	BOOL header_only = FreeImage_HasPixels(dib) ? FALSE : TRUE;
 
+	// check for copy-on-write cloning (user provided pixel buffers are always copied)
+	const BOOL copy_on_write = s_copy_on_write;
+	SHAREDPIXELS *shared_pixels = NULL;
+	if(copy_on_write && !header_only) {
+		shared_pixels = SharePixels(dib);
+	}
+
+	// if the FIBITMAP is a wrapper to a user provided pixel buffer, get a pointer to this buffer
+	const BYTE *ext_bits = ((FREEIMAGEHEADER *)dib->data)->external_bits;
+
 	// check whether this image has masks defined ...
 	BOOL need_masks = (bpp == 16 && type == FIT_BITMAP) ? TRUE : FALSE;
 
 	// allocate a new dib
-	FIBITMAP *new_dib = FreeImage_AllocateHeaderT(header_only, type, width, height, bpp,
-			FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib));
+	FIBITMAP *new_dib = FreeImage_AllocateHeaderT(header_only || shared_pixels, type, width, height, bpp,
+		FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib));
+	if(!new_dib && shared_pixels) {
+		ReleasePixels(shared_pixels);
+	}
 
 	if (new_dib) {
 		// save ICC profile links
@@ -565,6 +1142,9 @@ FreeImage_Clone(FIBITMAP *dib) {
 		METADATAMAP *src_metadata = ((FREEIMAGEHEADER *)dib->data)->metadata;
 		METADATAMAP *dst_metadata = ((FREEIMAGEHEADER *)new_dib->data)->metadata;
 
+		// save memory block size
+		const size_t dst_block_size = ((FREEIMAGEHEADER *)new_dib->data)->block_size;
+
 		// calculate the size of the dst image
 		// align the palette and the pixels on a FIBITMAP_ALIGNMENT bytes alignment boundary
 		// palette is aligned on a 16 bytes boundary
@@ -572,7 +1152,7 @@ FreeImage_Clone(FIBITMAP *dib) {
 		
 		// when using a user provided pixel buffer, force a 'header only' calculation		
 
-		size_t dib_size = FreeImage_GetInternalImageSize(header_only || ext_bits, width, height, bpp, need_masks);
+		size_t dib_size = FreeImage_GetInternalImageSize(header_only || ext_bits || shared_pixels, width, height, bpp, need_masks);
 
 		// copy the bitmap + internal pointers (remember to restore new_dib internal pointers later)
 		memcpy(new_dib->data, dib->data, dib_size);
@@ -582,6 +1162,10 @@ FreeImage_Clone(FIBITMAP *dib) {
 
 		// restore metadata link for new_dib
 		((FREEIMAGEHEADER *)new_dib->data)->metadata = dst_metadata;
+		((FREEIMAGEHEADER *)new_dib->data)->shared_metadata = NULL;
+
+		// restore memory block size for new_dib
+		((FREEIMAGEHEADER *)new_dib->data)->block_size = dst_block_size;
 
 		// reset thumbnail link for new_dib
 		((FREEIMAGEHEADER *)new_dib->data)->thumbnail = NULL;
@@ -590,33 +1174,18 @@ FreeImage_Clone(FIBITMAP *dib) {
 		((FREEIMAGEHEADER *)new_dib->data)->external_bits = NULL;
 		((FREEIMAGEHEADER *)new_dib->data)->external_pitch = 0;
 
+		// share the pixels of dib (the reference was taken by SharePixels)
+		((FREEIMAGEHEADER *)new_dib->data)->shared_pixels = shared_pixels;
+		((FREEIMAGEHEADER *)new_dib->data)->shared_header = NULL;
+		((FREEIMAGEHEADER *)new_dib->data)->has_pixels = !header_only;
+
 		// copy possible ICC profile
 		FreeImage_CreateICCProfile(new_dib, src_iccProfile->data, src_iccProfile->size);
 		dst_iccProfile->flags = src_iccProfile->flags;
 
-		// copy metadata models
-		for(METADATAMAP::iterator i = (*src_metadata).begin(); i != (*src_metadata).end(); i++) {
-			int model = (*i).first;
-			TAGMAP *src_tagmap = (*i).second;
-
-			if(src_tagmap) {
-				// create a metadata model
-				TAGMAP *dst_tagmap = new(std::nothrow) TAGMAP();
-
-				if(dst_tagmap) {
-					// fill the model
-					for(TAGMAP::iterator j = src_tagmap->begin(); j != src_tagmap->end(); j++) {
-						std::string dst_key = (*j).first;
-						FITAG *dst_tag = FreeImage_CloneTag( (*j).second );
-
-						// assign key and tag value
-						(*dst_tagmap)[dst_key] = dst_tag;
-					}
-
-					// assign model and tagmap
-					(*dst_metadata)[model] = dst_tagmap;
-				}
-			}
+		// share or copy metadata models
+		if(!copy_on_write || !ShareMetadata(new_dib, dib)) {
+			CopyMetadata(((FREEIMAGEHEADER *)new_dib->data)->metadata, src_metadata);
 		}
 
 		// copy the thumbnail
@@ -646,16 +1215,18 @@ FreeImage_GetBits(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	if(((FREEIMAGEHEADER *)dib->data)->external_bits) {
-		return ((FREEIMAGEHEADER *)dib->data)->external_bits;
+	// the caller may write to the pixels: make sure they are not shared with a copy-on-write clone
+	if(!UnsharePixels(dib)) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return NULL;
 	}
 
-	// returns the pixels aligned on a FIBITMAP_ALIGNMENT bytes alignment boundary
-	size_t lp = (size_t)FreeImage_GetInfoHeader(dib);
-	lp += sizeof(BITMAPINFOHEADER) + sizeof(RGBQUAD) * FreeImage_GetColorsUsed(dib);
-	lp += FreeImage_HasRGBMasks(dib) ? sizeof(DWORD) * 3 : 0;
-	lp += (lp % FIBITMAP_ALIGNMENT ? FIBITMAP_ALIGNMENT - lp % FIBITMAP_ALIGNMENT : 0);
-	return (BYTE *)lp;
+	return GetBitsReadOnly(dib);
+}
+
+const BYTE * DLL_CALLCONV
+FreeImage_GetConstBits(FIBITMAP *dib) {
+	return FreeImage_HasPixels(dib) ? GetBitsReadOnly(dib) : NULL;
 }
 
 // ----------------------------------------------------------
@@ -787,7 +1358,7 @@ FreeImage_GetColorType(FIBITMAP *dib) {
 			if( FreeImage_HasPixels(dib) ) {
 				// check for fully opaque alpha layer
 				for (unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
-					rgb = (RGBQUAD *)FreeImage_GetScanLine(dib, y);
+					rgb = (RGBQUAD *)CalculateScanLine(GetBitsReadOnly(dib), FreeImage_GetPitch(dib), y);
 
 					for (unsigned x = 0; x < FreeImage_GetWidth(dib); x++) {
 						if (rgb[x].rgbReserved != 0xFF) {
@@ -1205,27 +1776,22 @@ FreeImage_FindFirstMetadata(FREE_IMAGE_MDMODEL model, FIBITMAP *dib, FITAG **tag
 	if( (*metadata).find(model) != (*metadata).end() ) {
 		tagmap = (*metadata)[model];
 	}
-	if(tagmap) {
+	if(tagmap && !tagmap->empty()) {
 		// allocate a handle
 		FIMETADATA 	*handle = (FIMETADATA *)malloc(sizeof(FIMETADATA));
 		if(handle) {
-			// calculate the size of a METADATAHEADER
-			const size_t header_size = sizeof(METADATAHEADER);
+			// write out the METADATAHEADER
+			METADATAHEADER *mdh = new(std::nothrow) METADATAHEADER;
 
-			handle->data = (BYTE *)malloc(header_size);
+			handle->data = mdh;
 			
 			if(handle->data) {
-				memset(handle->data, 0, header_size);
-
-				// write out the METADATAHEADER
-				METADATAHEADER *mdh = (METADATAHEADER *)handle->data;
-
-				mdh->pos = 1;
 				mdh->tagmap = tagmap;
 
 				// get the first element
-				TAGMAP::iterator i = tagmap->begin();
-				*tag = (*i).second;
+				mdh->pos = tagmap->begin();
+				*tag = (*mdh->pos).second;
+				mdh->pos++;
 
 				return handle;
 			}
@@ -1244,23 +1810,11 @@ FreeImage_FindNextMetadata(FIMETADATA *mdhandle, FITAG **tag) {
 	}
 
 	METADATAHEADER *mdh = (METADATAHEADER *)mdhandle->data;
-	TAGMAP *tagmap = mdh->tagmap;
 
-	int current_pos = mdh->pos;
-	int mapsize     = (int)tagmap->size();
-
-	if(current_pos < mapsize) {
-		// get the tag element at position pos
-		int count = 0;
-
-		for(TAGMAP::iterator i = tagmap->begin(); i != tagmap->end(); i++) {
-			if(count == current_pos) {
-				*tag = (*i).second;
-				mdh->pos++;
-				break;
-			}
-			count++;
-		}
+	if(mdh->pos != mdh->tagmap->end()) {
+		// get the tag element at the current position
+		*tag = (*mdh->pos).second;
+		mdh->pos++;
 		
 		return TRUE;
 	}
@@ -1271,9 +1825,7 @@ FreeImage_FindNextMetadata(FIMETADATA *mdhandle, FITAG **tag) {
 void DLL_CALLCONV 
 FreeImage_FindCloseMetadata(FIMETADATA *mdhandle) {
 	if (NULL != mdhandle) {	// delete the handle
-		if (NULL != mdhandle->data) {
-			free(mdhandle->data);
-		}
+		delete (METADATAHEADER *)mdhandle->data;
 		free(mdhandle);		// ... and the wrapper
 	}
 }
@@ -1287,6 +1839,11 @@ FreeImage_CloneMetadata(FIBITMAP *dst, FIBITMAP *src) {
 		return FALSE;
 	}
 
+	// dst may share its metadata with a copy-on-write clone
+	if(!UnshareMetadata(dst)) {
+		return FALSE;
+	}
+
 	// get metadata links
 	METADATAMAP *src_metadata = ((FREEIMAGEHEADER *)src->data)->metadata;
 	METADATAMAP *dst_metadata = ((FREEIMAGEHEADER *)dst->data)->metadata;
@@ -1306,18 +1863,9 @@ FreeImage_CloneMetadata(FIBITMAP *dst, FIBITMAP *src) {
 			}
 
 			// create a metadata model
-			TAGMAP *dst_tagmap = new(std::nothrow) TAGMAP();
+			TAGMAP *dst_tagmap = CloneTagMap(src_tagmap);
 
 			if(dst_tagmap) {
-				// fill the model
-				for(TAGMAP::iterator j = src_tagmap->begin(); j != src_tagmap->end(); j++) {
-					std::string dst_key = (*j).first;
-					FITAG *dst_tag = FreeImage_CloneTag( (*j).second );
-
-					// assign key and tag value
-					(*dst_tagmap)[dst_key] = dst_tag;
-				}
-
 				// assign model and tagmap
 				(*dst_metadata)[model] = dst_tagmap;
 			}
@@ -1339,6 +1887,11 @@ FreeImage_SetMetadata(FREE_IMAGE_MDMODEL model, FIBITMAP *dib, const char *key,
 		return FALSE;
 	}
 
+	// dib may share its metadata with a copy-on-write clone
+	if(!UnshareMetadata(dib)) {
+		return FALSE;
+	}
+
 	TAGMAP *tagmap = NULL;
 
 	// get the metadata model
@@ -1526,7 +2079,9 @@ FreeImage_GetMemorySize(FIBITMAP *dib) {
 	FREEIMAGEHEADER *header = (FREEIMAGEHEADER *)dib->data;
 	BITMAPINFOHEADER *bih = FreeImage_GetInfoHeader(dib);
 
-	BOOL header_only = !header->has_pixels || header->external_bits != NULL;
+	// pixels shared with copy-on-write clones, or copied from them, live outside the header block
+	const SHAREDPIXELS *shared = header->shared_pixels;
+	BOOL header_only = !header->has_pixels || header->external_bits != NULL || (shared && shared != header->shared_header);
 	BOOL need_masks = bih->biCompression == BI_BITFIELDS;
 	unsigned width = bih->biWidth;
 	unsigned height = bih->biHeight;
@@ -1538,6 +2093,11 @@ FreeImage_GetMemorySize(FIBITMAP *dib) {
 	// add sizes of FREEIMAGEHEADER, BITMAPINFOHEADER, palette and DIB data
 	size += FreeImage_GetInternalImageSize(header_only, width, height, bpp, need_masks);
 
+	// add the pixels copied from copy-on-write clones (pixels still shared are not counted)
+	if (header->has_pixels && shared && shared != header->shared_header && shared->refs == 1) {
+		size += (size_t)FreeImage_GetPitch(dib) * height;
+	}
+
 	// add ICC profile size
 	size += header->iccProfile.size;
 
@@ -61,12 +61,112 @@ SetDefaultIO(FreeImageIO *io) {
 // Memory IO functions
 // =====================================================================
 
+/**
+Copy bytes between a buffer and the chunks of a chunked memory stream
+@param mem_header Memory stream header
+@param position Stream position of the first byte
+@param buffer User buffer
+@param length Number of bytes to copy
+@param to_chunks TRUE to copy the buffer into the chunks, FALSE to copy the chunks into the buffer
+*/
+static void
+CopyChunks(FIMEMORYHEADER *mem_header, long position, BYTE *buffer, long length, BOOL to_chunks) {
+	while(length > 0) {
+		const unsigned index = (unsigned)(position / mem_header->chunk_size);
+		const long offset = position % mem_header->chunk_size;
+		const long count = MIN(length, mem_header->chunk_size - offset);
+
+		BYTE *chunk = mem_header->chunks[index] + offset;
+		if(to_chunks) {
+			memcpy(chunk, buffer, count);
+		} else {
+			memcpy(buffer, chunk, count);
+		}
+
+		position += count;
+		buffer += count;
+		length -= count;
+	}
+}
+
+/**
+Allocate the chunks needed to store length bytes in a chunked memory stream. 
+Chunks already allocated are left untouched.
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL
+ReserveChunks(FIMEMORYHEADER *mem_header, long length) {
+	const unsigned needed = (unsigned)((length + mem_header->chunk_size - 1) / mem_header->chunk_size);
+
+	if(needed > mem_header->chunk_capacity) {
+		// grow the chunk table (the chunks themselves are never moved)
+		const unsigned capacity = MAX(needed, MAX(16U, 2 * mem_header->chunk_capacity));
+		BYTE **chunks = (BYTE**)realloc(mem_header->chunks, capacity * sizeof(BYTE*));
+		if(!chunks) {
+			return FALSE;
+		}
+		mem_header->chunks = chunks;
+		mem_header->chunk_capacity = capacity;
+	}
+	while(mem_header->chunk_count < needed) {
+		BYTE *chunk = (BYTE*)malloc(mem_header->chunk_size);
+		if(!chunk) {
+			return FALSE;
+		}
+		mem_header->chunks[mem_header->chunk_count++] = chunk;
+	}
+
+	return TRUE;
+}
+
+/**
+Grow a writable user buffer using its grow callback
+@return Returns TRUE if the buffer can hold length bytes, returns FALSE otherwise
+*/
+static BOOL
+GrowUserBuffer(FIMEMORYHEADER *mem_header, long length) {
+	if(length <= mem_header->data_length) {
+		return TRUE;
+	}
+	if(!mem_header->grow_proc) {
+		// fixed size buffer
+		return FALSE;
+	}
+
+	// ask for (at least) twice the current size, so that the callback is seldom called
+	long min_size = MAX(length, 4096L);
+	if(mem_header->data_length < 0x40000000) {
+		min_size = MAX(min_size, mem_header->data_length << 1);
+	}
+
+	DWORD new_size = (DWORD)mem_header->data_length;
+	BYTE *new_data = mem_header->grow_proc((BYTE*)mem_header->data, &new_size, (DWORD)min_size, mem_header->grow_data);
+	if(!new_data) {
+		return FALSE;
+	}
+	mem_header->data = new_data;
+	mem_header->data_length = (long)MIN(new_size, (DWORD)0x7FFFFFFF);
+
+	return (length <= mem_header->data_length);
+}
+
 unsigned DLL_CALLCONV 
 _MemoryReadProc(void *buffer, unsigned size, unsigned count, fi_handle handle) {
 	unsigned x;
 
 	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)handle)->data);
 
+	if(mem_header->chunks) {
+		// chunked storage
+		const long remaining_bytes = MAX(0L, mem_header->file_length - mem_header->current_position);
+		x = size ? (unsigned)MIN((long)count, remaining_bytes / (long)size) : count;
+		//if there isn't count items left to read, read the remaining bytes, set pos to eof and return a short count
+		const long length = (x < count) ? remaining_bytes : (long)(x * size);
+		CopyChunks(mem_header, mem_header->current_position, (BYTE*)buffer, length, FALSE);
+		mem_header->current_position += length;
+		return x;
+	}
+
 	for(x = 0; x < count; x++) {
 		long remaining_bytes = mem_header->file_length - mem_header->current_position;
 		//if there isn't size bytes left to read, set pos to eof and return a short count
@@ -92,30 +192,46 @@ _MemoryWriteProc(void *buffer, unsigned size, unsigned count, fi_handle handle)
 
 	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)handle)->data);
 
-	//double the data block size if we need to
-	while( (mem_header->current_position + (long)(size * count)) >= mem_header->data_length ) {
-		//if we are at or above 1G, we cant double without going negative
-		if( mem_header->data_length & 0x40000000 ) {
-			//max 2G
-			if( mem_header->data_length == 0x7FFFFFFF ) {
-				return 0;
-			}
-			newdatalen = 0x7FFFFFFF;
-		} else if( mem_header->data_length == 0 ) {
-			//default to 4K if nothing yet
-			newdatalen = 4096;
-		} else {
-			//double size
-			newdatalen = mem_header->data_length << 1;
+	if(mem_header->chunks || mem_header->chunk_size) {
+		// chunked storage: allocate new chunks if we need to
+		if(!ReserveChunks(mem_header, mem_header->current_position + (long)(size * count))) {
+			return 0;
 		}
-		newdata = realloc( mem_header->data, newdatalen );
-		if( !newdata ) {
+		CopyChunks(mem_header, mem_header->current_position, (BYTE*)buffer, (long)(size * count), TRUE);
+	}
+	else if(mem_header->user_buffer) {
+		// user buffer: use the grow callback if we need to
+		if(!GrowUserBuffer(mem_header, mem_header->current_position + (long)(size * count))) {
 			return 0;
 		}
-		mem_header->data = newdata;
-		mem_header->data_length = newdatalen;
+		memcpy( (char *)mem_header->data + mem_header->current_position, buffer, size * count );
+	}
+	else {
+		//double the data block size if we need to
+		while( (mem_header->current_position + (long)(size * count)) >= mem_header->data_length ) {
+			//if we are at or above 1G, we cant double without going negative
+			if( mem_header->data_length & 0x40000000 ) {
+				//max 2G
+				if( mem_header->data_length == 0x7FFFFFFF ) {
+					return 0;
+				}
+				newdatalen = 0x7FFFFFFF;
+			} else if( mem_header->data_length == 0 ) {
+				//default to 4K if nothing yet
+				newdatalen = 4096;
+			} else {
+				//double size
+				newdatalen = mem_header->data_length << 1;
+			}
+			newdata = realloc( mem_header->data, newdatalen );
+			if( !newdata ) {
+				return 0;
+			}
+			mem_header->data = newdata;
+			mem_header->data_length = newdatalen;
+		}
+		memcpy( (char *)mem_header->data + mem_header->current_position, buffer, size * count );
 	}
-	memcpy( (char *)mem_header->data + mem_header->current_position, buffer, size * count );
 	mem_header->current_position += size * count;
 	if( mem_header->current_position > mem_header->file_length ) {
 		mem_header->file_length = mem_header->current_position;
@@ -173,3 +289,69 @@ SetMemoryIO(FreeImageIO *io) {
 	io->tell_proc  = _MemoryTellProc;
 	io->write_proc = _MemoryWriteProc;
 }
+
+/**
+Get direct access to the buffer of a read-only memory stream 
+(i.e. a wrapped user buffer or a memory mapped file). 
+@param io FreeImageIO structure used to access the stream
+@param handle Stream handle
+@param data Returns the start address of the buffer
+@param size_in_bytes Returns the size of the buffer
+@return Returns TRUE if handle is a read-only memory stream accessed using the memory IO functions, returns FALSE otherwise
+*/
+BOOL
+GetMemoryIOBuffer(FreeImageIO *io, fi_handle handle, void **data, long *size_in_bytes) {
+	if(io && handle && (io->read_proc == _MemoryReadProc) && (io->seek_proc == _MemorySeekProc)) {
+		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)handle)->data);
+
+		if(mem_header && !mem_header->delete_me && !mem_header->user_buffer && mem_header->data) {
+			*data = mem_header->data;
+			*size_in_bytes = mem_header->file_length;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+Check if a memory stream can be written (i.e. it is not a read-only user buffer or memory mapped file)
+*/
+BOOL
+IsMemoryIOWritable(FIMEMORY *stream) {
+	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+	return mem_header->delete_me || mem_header->user_buffer;
+}
+
+/**
+Convert a chunked memory stream into a contiguous one. 
+This copies the stream content once, the stream then grows as a standard read/write stream.
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+BOOL
+FlattenMemoryIOChunks(FIMEMORY *stream) {
+	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+
+	if(mem_header->chunks || mem_header->chunk_size) {
+		BYTE *data = (BYTE*)malloc(MAX(1L, mem_header->file_length));
+		if(!data) {
+			return FALSE;
+		}
+		if(mem_header->chunks) {
+			CopyChunks(mem_header, 0, data, mem_header->file_length, FALSE);
+
+			for(unsigned i = 0; i < mem_header->chunk_count; i++) {
+				free(mem_header->chunks[i]);
+			}
+			free(mem_header->chunks);
+		}
+		mem_header->chunks = NULL;
+		mem_header->chunk_count = mem_header->chunk_capacity = 0;
+		mem_header->chunk_size = 0;
+
+		mem_header->data = data;
+		mem_header->data_length = MAX(1L, mem_header->file_length);
+	}
+
+	return TRUE;
+}
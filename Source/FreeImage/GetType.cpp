@@ -35,11 +35,35 @@
 
 FREE_IMAGE_FORMAT DLL_CALLCONV
 FreeImage_GetFileTypeFromHandle(FreeImageIO *io, fi_handle handle, int size) {
-	if (handle != NULL) {
+	PluginList *plugins = FreeImage_GetPluginList();
+
+	if ((handle != NULL) && (plugins != NULL)) {
 		int fif_count = FreeImage_GetFIFCount();
 
+		// read the file header once and find the plugins whose magic number matches
+		BYTE header[FI_MAGIC_HEADER_SIZE];
+		memset(header, 0, FI_MAGIC_HEADER_SIZE);
+
+		long tell = io->tell_proc(handle);
+		io->read_proc(header, 1, FI_MAGIC_HEADER_SIZE, handle);
+		io->seek_proc(handle, tell, SEEK_SET);
+
+		std::vector<int> candidates;
+		plugins->FindNodesFromMagicNumber(header, candidates);
+
 		for (int i = 0; i < fif_count; ++i) {
 			FREE_IMAGE_FORMAT fif = (FREE_IMAGE_FORMAT)i;
+
+			PluginNode *node = plugins->FindNodeFromFIF(fif);
+			if (!node || !node->m_enabled || !node->m_plugin->validate_proc) {
+				// this plugin cannot validate anything
+				continue;
+			}
+			if (node->m_magic_indexed && !std::binary_search(candidates.begin(), candidates.end(), i)) {
+				// the file header doesn't match the plugin magic numbers
+				continue;
+			}
+			// plugins without magic numbers (or matching ones) need a full validation
 			if (FreeImage_ValidateFIF(fif, io, handle)) {
 				if(fif == FIF_TIFF) {
 					// many camera raw files use a TIFF signature ...
@@ -23,6 +23,11 @@
 #include "Utilities.h"
 #include "../LibOpenJPEG/openjpeg.h"
 #include "J2KHelper.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
 
 // --------------------------------------------------------------------------
 
@@ -409,6 +414,376 @@ FIBITMAP* J2KImageToFIBITMAP(int format_id, const opj_image_t *image, BOOL heade
 
 }
 
+/**
+Returns the number of resolution levels that can be discarded when decoding a codestream
+*/
+static unsigned 
+GetMaxReduceLevel(opj_codec_t *codec) {
+	// the reduction is limited by the number of resolution levels of the codestream
+	unsigned max_level = 0;
+	opj_codestream_info_v2_t *cstr_info = opj_get_cstr_info(codec);
+	if(cstr_info) {
+		if(cstr_info->m_default_tile_info.tccp_info) {
+			max_level = OPJ_J2K_MAXRLVLS;
+			for(OPJ_UINT32 c = 0; c < cstr_info->nbcomps; c++) {
+				const OPJ_UINT32 numresolutions = cstr_info->m_default_tile_info.tccp_info[c].numresolutions;
+				max_level = MIN(max_level, (numresolutions > 0) ? (unsigned)(numresolutions - 1) : 0U);
+			}
+		}
+		opj_destroy_cstr_info(&cstr_info);
+	}
+
+	return max_level;
+}
+
+/**
+Select the number of highest resolution levels to discard when decoding a codestream, 
+so that the decoded image is as small as possible while still covering a bounding box. 
+Must be called after opj_read_header: the components of the image header are resized 
+to the reduced resolution, so that opj_decode outputs compact component buffers. 
+@param codec Decompressor handle
+@param image Image header returned by opj_read_header
+@param max_width Box width, a value <= 0 leaves the width unconstrained
+@param max_height Box height, a value <= 0 leaves the height unconstrained
+@return Returns the number of discarded levels
+*/
+unsigned J2KSetReduceFactor(opj_codec_t *codec, opj_image_t *image, int max_width, int max_height) {
+	if(!image || !image->numcomps || ((max_width <= 0) && (max_height <= 0))) {
+		return 0;
+	}
+
+	const unsigned level = CalculateFitReductionLevel(image->comps[0].w, image->comps[0].h, max_width, max_height, GetMaxReduceLevel(codec));
+
+	return J2KSetReduceLevel(codec, image, level);
+}
+
+/**
+Discard the highest resolution levels of a codestream when decoding it. 
+Must be called after opj_read_header: the components of the image header are resized 
+to the reduced resolution, so that opj_decode outputs compact component buffers. 
+@param codec Decompressor handle
+@param image Image header returned by opj_read_header
+@param level Number of resolution levels to discard, clamped to the levels available in the codestream
+@return Returns the number of discarded levels
+*/
+unsigned J2KSetReduceLevel(opj_codec_t *codec, opj_image_t *image, unsigned level) {
+	if(!image || !image->numcomps) {
+		return 0;
+	}
+
+	level = MIN(level, GetMaxReduceLevel(codec));
+	if((level > 0) && opj_set_decoded_resolution_factor(codec, level)) {
+		for(OPJ_UINT32 c = 0; c < image->numcomps; c++) {
+			opj_image_comp_t *comp = &image->comps[c];
+			const int x0 = int_ceildivpow2((int)comp->x0, (int)level);
+			const int y0 = int_ceildivpow2((int)comp->y0, (int)level);
+			comp->w = (OPJ_UINT32)(int_ceildivpow2((int)(comp->x0 + comp->w), (int)level) - x0);
+			comp->h = (OPJ_UINT32)(int_ceildivpow2((int)(comp->y0 + comp->h), (int)level) - y0);
+			comp->x0 = (OPJ_UINT32)x0;
+			comp->y0 = (OPJ_UINT32)y0;
+		}
+		return level;
+	}
+
+	return 0;
+}
+
+/**
+Restrict the decoding of a codestream to a region of the image: only the tiles intersecting 
+the region are decoded and the components of the image header are resized to the region. 
+Must be called after opj_read_header. 
+@param codec Decompressor handle
+@param image Image header returned by opj_read_header
+@param left Left bound of the region, in pixels
+@param top Top bound of the region, in pixels
+@param right Right bound of the region (exclusive), in pixels
+@param bottom Bottom bound of the region (exclusive), in pixels
+@return Returns FALSE if the region doesn't intersect the image, returns TRUE otherwise
+*/
+BOOL J2KSetDecodeArea(opj_codec_t *codec, opj_image_t *image, int left, int top, int right, int bottom) {
+	if(!image || !image->numcomps) {
+		return FALSE;
+	}
+
+	const opj_image_comp_t *comp = &image->comps[0];
+
+	if(!ClipRegion(comp->w, comp->h, &left, &top, &right, &bottom)) {
+		return FALSE;
+	}
+
+	// the decoded area is given on the reference grid
+	const OPJ_INT32 x0 = (OPJ_INT32)((comp->x0 + left) * comp->dx);
+	const OPJ_INT32 y0 = (OPJ_INT32)((comp->y0 + top) * comp->dy);
+	const OPJ_INT32 x1 = MIN((OPJ_INT32)((comp->x0 + right) * comp->dx), (OPJ_INT32)image->x1);
+	const OPJ_INT32 y1 = MIN((OPJ_INT32)((comp->y0 + bottom) * comp->dy), (OPJ_INT32)image->y1);
+
+	return opj_set_decode_area(codec, image, x0, y0, x1, y1) ? TRUE : FALSE;
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Read-only stream over a FreeImageIO handle shared by several decoders (see J2KDecodeTiles). 
+Each stream has its own position, the handle is repositioned under a lock before each read. 
+*/
+typedef struct tagJ2KSharedFIO_t {
+	FreeImageIO *io;		//! FreeImage IO
+	fi_handle handle;		//! FreeImage handle
+	std::mutex *lock;		//! lock protecting the handle
+	long start;				//! position of the codestream in the handle
+	OPJ_OFF_T length;		//! length of the stream
+	OPJ_OFF_T position;		//! position of the stream, relative to start
+} J2KSharedFIO_t;
+
+static OPJ_SIZE_T 
+_SharedReadProc(void *p_buffer, OPJ_SIZE_T p_nb_bytes, void *p_user_data) {
+	J2KSharedFIO_t *fio = (J2KSharedFIO_t*)p_user_data;
+	std::lock_guard<std::mutex> guard(*fio->lock);
+	if(fio->io->seek_proc(fio->handle, fio->start + (long)fio->position, SEEK_SET)) {
+		return (OPJ_SIZE_T)-1;
+	}
+	OPJ_SIZE_T l_nb_read = fio->io->read_proc(p_buffer, 1, (unsigned)p_nb_bytes, fio->handle);
+	fio->position += (OPJ_OFF_T)l_nb_read;
+	return l_nb_read ? l_nb_read : (OPJ_SIZE_T)-1;
+}
+
+static OPJ_OFF_T 
+_SharedSkipProc(OPJ_OFF_T p_nb_bytes, void *p_user_data) {
+	J2KSharedFIO_t *fio = (J2KSharedFIO_t*)p_user_data;
+	// a truncated stream must not be skipped past its end
+	if(fio->position + p_nb_bytes > fio->length) {
+		return -1;
+	}
+	fio->position += p_nb_bytes;
+	return p_nb_bytes;
+}
+
+static OPJ_BOOL 
+_SharedSeekProc(OPJ_OFF_T p_nb_bytes, void *p_user_data) {
+	J2KSharedFIO_t *fio = (J2KSharedFIO_t*)p_user_data;
+	if(p_nb_bytes > fio->length) {
+		return OPJ_FALSE;
+	}
+	fio->position = p_nb_bytes;
+	return OPJ_TRUE;
+}
+
+/**
+Warnings of the decoders of J2KDecodeTiles, reported once all the bands have been decoded
+*/
+typedef struct tagJ2KMessages_t {
+	std::mutex lock;					//! lock protecting the list
+	std::vector<std::string> warnings;	//! warning messages, in the order they were received
+} J2KMessages_t;
+
+static void 
+_CollectWarning(const char *msg, void *client_data) {
+	J2KMessages_t *messages = (J2KMessages_t*)client_data;
+	std::lock_guard<std::mutex> guard(messages->lock);
+	messages->warnings.push_back(msg);
+}
+
+/**
+Decode a tiled codestream on the worker threads (see FreeImage_SetThreadCount). 
+OpenJPEG decodes the tiles of a codec one after the other, so the tile grid is split into 
+rectangular bands of tiles, each band being decoded by its own codec reading its own stream 
+over the shared handle. The decoded bands are then copied into the components of the image. 
+The handle is left at its position on entry, so that on failure the caller can still decode 
+the image with its own codec and stream. The errors of the band decoders are not reported: on failure, 
+the codec of the caller reports its own errors. Their warnings are only reported when the decoding succeeds. 
+@param format Codec format (OPJ_CODEC_J2K or OPJ_CODEC_JP2)
+@param io FreeImage IO
+@param handle FreeImage handle
+@param start Position of the codestream (or of the JP2 file) in the handle
+@param parameters Decoding parameters used to setup the codec
+@param codec Decompressor handle, after opj_read_header
+@param image Image header returned by opj_read_header, possibly reduced with J2KSetReduceLevel
+@param level Number of resolution levels discarded (as returned by J2KSetReduceLevel)
+@param warning_callback OpenJPEG warning callback
+@return Returns TRUE if successful, returns FALSE if the codestream has a single tile or if the decoding failed
+*/
+BOOL J2KDecodeTiles(OPJ_CODEC_FORMAT format, FreeImageIO *io, fi_handle handle, long start, const opj_dparameters_t *parameters, opj_codec_t *codec, opj_image_t *image, unsigned level, opj_msg_callback warning_callback) {
+	if(!image || !image->numcomps) {
+		return FALSE;
+	}
+
+	// get the tile grid
+	OPJ_UINT32 tx0 = 0, ty0 = 0, tdx = 0, tdy = 0, tw = 0, th = 0;
+	opj_codestream_info_v2_t *cstr_info = opj_get_cstr_info(codec);
+	if(cstr_info) {
+		tx0 = cstr_info->tx0; ty0 = cstr_info->ty0;
+		tdx = cstr_info->tdx; tdy = cstr_info->tdy;
+		tw = cstr_info->tw; th = cstr_info->th;
+		opj_destroy_cstr_info(&cstr_info);
+	}
+	if((tw * th < 2) || !tdx || !tdy) {
+		return FALSE;
+	}
+
+	// split the grid into bands of whole tile rows, then into columns when there are few tile rows
+	const unsigned task_target = 2 * ThreadPool::instance().getThreadCount();
+	const unsigned row_bands = MIN((unsigned)th, task_target);
+	const unsigned col_bands = MIN((unsigned)tw, (task_target + row_bands - 1) / row_bands);
+
+	// allocate the components of the full image
+	for(OPJ_UINT32 c = 0; c < image->numcomps; c++) {
+		opj_image_comp_t *comp = &image->comps[c];
+		free(comp->data);
+		comp->data = (OPJ_INT32*)malloc((size_t)comp->w * comp->h * sizeof(OPJ_INT32));
+		if(!comp->data) {
+			for(OPJ_UINT32 k = 0; k < image->numcomps; k++) {
+				free(image->comps[k].data);
+				image->comps[k].data = NULL;
+			}
+			return FALSE;
+		}
+	}
+
+	const long position = io->tell_proc(handle);
+	io->seek_proc(handle, 0, SEEK_END);
+	const OPJ_UINT64 length = (OPJ_UINT64)(io->tell_proc(handle) - start);
+
+	std::mutex lock;
+	std::atomic<bool> failed(false);
+	J2KMessages_t messages;
+
+	ThreadPool::instance().run(row_bands * col_bands, [&](unsigned index) {
+		if(failed) {
+			return;
+		}
+
+		// band bounds on the reference grid
+		const unsigned row = index / col_bands;
+		const unsigned col = index % col_bands;
+		const OPJ_INT32 x0 = (OPJ_INT32)MAX(image->x0, tx0 + (OPJ_UINT32)(col * tw / col_bands) * tdx);
+		const OPJ_INT32 y0 = (OPJ_INT32)MAX(image->y0, ty0 + (OPJ_UINT32)(row * th / row_bands) * tdy);
+		const OPJ_INT32 x1 = (OPJ_INT32)MIN(image->x1, tx0 + (OPJ_UINT32)((col + 1) * tw / col_bands) * tdx);
+		const OPJ_INT32 y1 = (OPJ_INT32)MIN(image->y1, ty0 + (OPJ_UINT32)((row + 1) * th / row_bands) * tdy);
+
+		J2KSharedFIO_t fio = { io, handle, &lock, start, (OPJ_OFF_T)length, 0 };
+		opj_dparameters_t band_parameters = *parameters;
+		opj_codec_t *band_codec = NULL;
+		opj_image_t *band = NULL;
+		BOOL bSuccess = FALSE;
+
+		opj_stream_t *band_stream = opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, OPJ_TRUE);
+		if(band_stream) {
+			opj_stream_set_user_data(band_stream, &fio, NULL);
+			opj_stream_set_user_data_length(band_stream, length);
+			opj_stream_set_read_function(band_stream, (opj_stream_read_fn)_SharedReadProc);
+			opj_stream_set_skip_function(band_stream, (opj_stream_skip_fn)_SharedSkipProc);
+			opj_stream_set_seek_function(band_stream, (opj_stream_seek_fn)_SharedSeekProc);
+
+			band_codec = opj_create_decompress(format);
+		}
+		if(band_codec) {
+			opj_set_info_handler(band_codec, NULL, NULL);
+			opj_set_warning_handler(band_codec, _CollectWarning, &messages);
+			opj_set_error_handler(band_codec, NULL, NULL);
+
+			bSuccess = opj_setup_decoder(band_codec, &band_parameters) && opj_read_header(band_stream, band_codec, &band);
+			if(bSuccess && (level > 0)) {
+				// opj_set_decode_area sizes the band components with their own reduction factor
+				bSuccess = opj_set_decoded_resolution_factor(band_codec, level);
+				for(OPJ_UINT32 c = 0; c < band->numcomps; c++) {
+					band->comps[c].factor = level;
+				}
+			}
+			bSuccess = bSuccess 
+				&& opj_set_decode_area(band_codec, band, x0, y0, x1, y1) 
+				&& opj_decode(band_codec, band_stream, band) 
+				&& opj_end_decompress(band_codec, band_stream);
+			bSuccess = bSuccess && (band->numcomps == image->numcomps);
+		}
+
+		if(bSuccess) {
+			// copy the band into the full image
+			for(OPJ_UINT32 c = 0; c < image->numcomps; c++) {
+				const opj_image_comp_t *src = &band->comps[c];
+				opj_image_comp_t *dst = &image->comps[c];
+				const int left = int_ceildivpow2((int)src->x0, (int)src->factor) - (int)dst->x0;
+				const int top = int_ceildivpow2((int)src->y0, (int)src->factor) - (int)dst->y0;
+				if(!src->data || (left < 0) || (top < 0) || ((OPJ_UINT32)left + src->w > dst->w) || ((OPJ_UINT32)top + src->h > dst->h)) {
+					bSuccess = FALSE;
+					break;
+				}
+				for(OPJ_UINT32 y = 0; y < src->h; y++) {
+					memcpy(dst->data + (size_t)(top + y) * dst->w + left, src->data + (size_t)y * src->w, src->w * sizeof(OPJ_INT32));
+				}
+			}
+			if(bSuccess && (index == 0)) {
+				// keep the colour information set by the JP2 decoder
+				image->color_space = band->color_space;
+				if(band->icc_profile_buf && !image->icc_profile_buf) {
+					image->icc_profile_buf = band->icc_profile_buf;
+					image->icc_profile_len = band->icc_profile_len;
+					band->icc_profile_buf = NULL;
+					band->icc_profile_len = 0;
+				}
+			}
+		}
+
+		if(!bSuccess) {
+			failed = true;
+		}
+
+		if(band_codec) opj_destroy_codec(band_codec);
+		if(band) opj_image_destroy(band);
+		if(band_stream) opj_stream_destroy(band_stream);
+	});
+
+	io->seek_proc(handle, position, SEEK_SET);
+
+	if(failed) {
+		for(OPJ_UINT32 c = 0; c < image->numcomps; c++) {
+			free(image->comps[c].data);
+			image->comps[c].data = NULL;
+		}
+		return FALSE;
+	}
+
+	if(warning_callback) {
+		for(size_t i = 0; i < messages.warnings.size(); i++) {
+			warning_callback(messages.warnings[i].c_str(), NULL);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+Encode an image as square tiles. 
+OpenJPEG only checks the number of resolution levels against the image size, while the partial 
+tiles of the right and bottom edges must also be large enough to hold the lowest resolution level: 
+the number of resolution levels is reduced accordingly. 
+@param parameters Compression parameters
+@param dib Image to encode
+@param tile_size Tile width and height, in pixels
+*/
+void J2KSetTileSize(opj_cparameters_t *parameters, FIBITMAP *dib, int tile_size) {
+	const int width = (int)FreeImage_GetWidth(dib);
+	const int height = (int)FreeImage_GetHeight(dib);
+	if((tile_size <= 0) || ((tile_size >= width) && (tile_size >= height))) {
+		return;
+	}
+
+	parameters->tile_size_on = OPJ_TRUE;
+	parameters->cp_tdx = tile_size;
+	parameters->cp_tdy = tile_size;
+
+	// smallest tile dimension
+	int min_size = MIN(tile_size, MIN(width, height));
+	if(width % tile_size) {
+		min_size = MIN(min_size, width % tile_size);
+	}
+	if(height % tile_size) {
+		min_size = MIN(min_size, height % tile_size);
+	}
+	while((parameters->numresolution > 1) && ((1 << (parameters->numresolution - 1)) > min_size)) {
+		parameters->numresolution--;
+	}
+}
+
 /**
 Convert a FIBITMAP to a OpenJPEG image
 @param format_id Plugin ID
@@ -505,7 +880,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 1:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						BYTE *bits = FreeImage_GetScanLine(dib, h - 1 - y);
+						const BYTE *bits = FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[x];
 							index++;
@@ -515,7 +890,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 3:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						BYTE *bits = FreeImage_GetScanLine(dib, h - 1 - y);
+						const BYTE *bits = FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[FI_RGBA_RED];
 							image->comps[1].data[index] = bits[FI_RGBA_GREEN];
@@ -528,7 +903,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 4:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						BYTE *bits = FreeImage_GetScanLine(dib, h - 1 - y);
+						const BYTE *bits = FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[FI_RGBA_RED];
 							image->comps[1].data[index] = bits[FI_RGBA_GREEN];
@@ -546,7 +921,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 1:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						WORD *bits = (WORD*)FreeImage_GetScanLine(dib, h - 1 - y);
+						const WORD *bits = (const WORD*)FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[x];
 							index++;
@@ -556,7 +931,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 3:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						FIRGB16 *bits = (FIRGB16*)FreeImage_GetScanLine(dib, h - 1 - y);
+						const FIRGB16 *bits = (const FIRGB16*)FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[x].red;
 							image->comps[1].data[index] = bits[x].green;
@@ -568,7 +943,7 @@ opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparamet
 				case 4:
 					index = 0;
 					for(y = 0; y < h; y++) {
-						FIRGBA16 *bits = (FIRGBA16*)FreeImage_GetScanLine(dib, h - 1 - y);
+						const FIRGBA16 *bits = (const FIRGBA16*)FreeImage_GetConstScanLine(dib, h - 1 - y);
 						for(x = 0; x < w; x++) {
 							image->comps[0].data[index] = bits[x].red;
 							image->comps[1].data[index] = bits[x].green;
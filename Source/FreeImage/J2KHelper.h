@@ -29,6 +29,23 @@ Conversion opj_image_t => FIBITMAP
 */
 FIBITMAP* J2KImageToFIBITMAP(int format_id, const opj_image_t *image, BOOL header_only);
 /**
+Reduced-resolution decoding (see J2KHelper.cpp)
+*/
+unsigned J2KSetReduceFactor(opj_codec_t *codec, opj_image_t *image, int max_width, int max_height);
+unsigned J2KSetReduceLevel(opj_codec_t *codec, opj_image_t *image, unsigned level);
+/**
+Region-of-interest decoding (see J2KHelper.cpp)
+*/
+BOOL J2KSetDecodeArea(opj_codec_t *codec, opj_image_t *image, int left, int top, int right, int bottom);
+/**
+Multi-threaded decoding of tiled codestreams (see J2KHelper.cpp)
+*/
+BOOL J2KDecodeTiles(OPJ_CODEC_FORMAT format, FreeImageIO *io, fi_handle handle, long start, const opj_dparameters_t *parameters, opj_codec_t *codec, opj_image_t *image, unsigned level, opj_msg_callback warning_callback);
+/**
+Tiled encoding (see J2KHelper.cpp)
+*/
+void J2KSetTileSize(opj_cparameters_t *parameters, FIBITMAP *dib, int tile_size);
+/**
 Conversion FIBITMAP => opj_image_t
 */
 opj_image_t* FIBITMAPToJ2KImage(int format_id, FIBITMAP *dib, const opj_cparameters_t *parameters);
@@ -20,6 +20,18 @@
 // Use at your own risk!
 // ==========================================================
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include <limits.h>
+
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "FreeImageIO.h"
@@ -69,11 +81,262 @@ FreeImage_CloseMemory(FIMEMORY *stream) {
 		if(mem_header->delete_me) {
 			free(mem_header->data);
 		}
+		for(unsigned i = 0; i < mem_header->chunk_count; i++) {
+			free(mem_header->chunks[i]);
+		}
+		free(mem_header->chunks);
+		if(mem_header->mapped_file) {
+#ifdef _WIN32
+			UnmapViewOfFile(mem_header->data);
+#else
+			munmap(mem_header->data, (size_t)mem_header->data_length);
+#endif
+		}
 		free(mem_header);
 		free(stream);
 	}
 }
 
+// =====================================================================
+// Writable user buffers and chunked streams
+// =====================================================================
+
+/**
+Allocate a memory stream with a zeroed header
+*/
+static FIMEMORY *
+AllocateMemoryStream() {
+	FIMEMORY *stream = (FIMEMORY*)malloc(sizeof(FIMEMORY));
+	if(stream) {
+		stream->data = (BYTE*)malloc(sizeof(FIMEMORYHEADER));
+
+		if(stream->data) {
+			memset(stream->data, 0, sizeof(FIMEMORYHEADER));
+			return stream;
+		}
+		free(stream);
+	}
+
+	return NULL;
+}
+
+FIMEMORY * DLL_CALLCONV 
+FreeImage_OpenMemoryBuffer(BYTE *data, DWORD size_in_bytes, FI_MemoryGrowProc grow_proc, void *user_data) {
+	if(!data && !grow_proc) {
+		return NULL;
+	}
+
+	FIMEMORY *stream = AllocateMemoryStream();
+	if(stream) {
+		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+
+		// write into a user buffer, the stream starts empty
+		mem_header->delete_me = FALSE;
+		mem_header->user_buffer = TRUE;
+		mem_header->data = data;
+		mem_header->data_length = data ? (long)MIN(size_in_bytes, (DWORD)LONG_MAX) : 0;
+		mem_header->grow_proc = grow_proc;
+		mem_header->grow_data = user_data;
+	}
+
+	return stream;
+}
+
+FIMEMORY * DLL_CALLCONV 
+FreeImage_OpenMemoryChunked(DWORD chunk_size) {
+	FIMEMORY *stream = AllocateMemoryStream();
+	if(stream) {
+		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+
+		// the chunks are allocated on the first write
+		mem_header->delete_me = TRUE;
+		mem_header->chunk_size = (chunk_size > 0) ? (long)MIN(chunk_size, (DWORD)0x40000000) : 256 * 1024;
+	}
+
+	return stream;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_GetMemoryChunk(FIMEMORY *stream, unsigned index, BYTE **data, DWORD *size_in_bytes) {
+	if(stream && data && size_in_bytes) {
+		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+
+		if(mem_header->chunk_size) {
+			// the last chunk is only partially used
+			const long offset = (long)index * mem_header->chunk_size;
+			if((index < mem_header->chunk_count) && (offset < mem_header->file_length)) {
+				*data = mem_header->chunks[index];
+				*size_in_bytes = (DWORD)MIN(mem_header->chunk_size, mem_header->file_length - offset);
+				return TRUE;
+			}
+		}
+		else if((index == 0) && (mem_header->file_length > 0)) {
+			// a contiguous stream is a single chunk
+			*data = (BYTE*)mem_header->data;
+			*size_in_bytes = mem_header->file_length;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+// =====================================================================
+// Memory mapped files
+// =====================================================================
+
+/**
+Wrap a read-only view of a memory mapped file into a memory stream
+@param view Start address of the view
+@param size_in_bytes Size of the view
+@return Returns the memory stream if successful, returns NULL otherwise
+*/
+static FIMEMORY *
+WrapMappedFile(void *view, long size_in_bytes) {
+	FIMEMORY *stream = (FIMEMORY*)malloc(sizeof(FIMEMORY));
+	if(stream) {
+		stream->data = (BYTE*)malloc(sizeof(FIMEMORYHEADER));
+
+		if(stream->data) {
+			FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+
+			memset(mem_header, 0, sizeof(FIMEMORYHEADER));
+
+			mem_header->delete_me = FALSE;
+			mem_header->mapped_file = TRUE;
+			mem_header->data = view;
+			mem_header->data_length = mem_header->file_length = size_in_bytes;
+
+			return stream;
+		}
+		free(stream);
+	}
+
+	return NULL;
+}
+
+#ifdef _WIN32
+
+/**
+Map a whole file read-only into memory and close the file handle
+*/
+static FIMEMORY *
+MapFile(HANDLE hFile) {
+	FIMEMORY *stream = NULL;
+
+	if(hFile == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	LARGE_INTEGER file_size;
+	if(GetFileSizeEx(hFile, &file_size) && (file_size.QuadPart > 0) && (file_size.QuadPart <= LONG_MAX)) {
+		HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(hMapping) {
+			void *view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			// the view keeps a reference to the mapping object
+			CloseHandle(hMapping);
+
+			if(view) {
+				stream = WrapMappedFile(view, (long)file_size.QuadPart);
+				if(!stream) {
+					UnmapViewOfFile(view);
+				}
+			}
+		}
+	}
+	CloseHandle(hFile);
+
+	return stream;
+}
+
+#else
+
+/**
+Map a whole file read-only into memory and close the file descriptor
+*/
+static FIMEMORY *
+MapFile(int fd) {
+	FIMEMORY *stream = NULL;
+
+	if(fd == -1) {
+		return NULL;
+	}
+
+	struct stat file_stat;
+	if((fstat(fd, &file_stat) == 0) && (file_stat.st_size > 0) && ((unsigned long long)file_stat.st_size <= (unsigned long long)LONG_MAX)) {
+		void *view = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(view != MAP_FAILED) {
+			stream = WrapMappedFile(view, (long)file_stat.st_size);
+			if(!stream) {
+				munmap(view, (size_t)file_stat.st_size);
+			}
+		}
+	}
+	// the mapping keeps a reference to the file
+	close(fd);
+
+	return stream;
+}
+
+#endif // _WIN32
+
+FIMEMORY * DLL_CALLCONV 
+FreeImage_OpenMemoryMapped(const char *filename) {
+	if(!filename) {
+		return NULL;
+	}
+#ifdef _WIN32
+	return MapFile(CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+#else
+	return MapFile(open(filename, O_RDONLY));
+#endif
+}
+
+FIMEMORY * DLL_CALLCONV 
+FreeImage_OpenMemoryMappedU(const wchar_t *filename) {
+#ifdef _WIN32
+	if(filename) {
+		return MapFile(CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	}
+#endif
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadMapped(FREE_IMAGE_FORMAT fif, const char *filename, int flags) {
+	FIMEMORY *stream = FreeImage_OpenMemoryMapped(filename);
+
+	if (stream) {
+		FIBITMAP *bitmap = FreeImage_LoadFromMemory(fif, stream, flags);
+
+		FreeImage_CloseMemory(stream);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadMapped: failed to map file %s", filename);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadMappedU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags) {
+#ifdef _WIN32
+	FIMEMORY *stream = FreeImage_OpenMemoryMappedU(filename);
+
+	if (stream) {
+		FIBITMAP *bitmap = FreeImage_LoadFromMemory(fif, stream, flags);
+
+		FreeImage_CloseMemory(stream);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadMappedU: failed to map input file");
+	}
+#endif
+	return NULL;
+}
+
 // =====================================================================
 // Memory stream load/save functions
 // =====================================================================
@@ -90,6 +353,30 @@ FreeImage_LoadFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags) {
 	return NULL;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadScaledFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int max_width, int max_height, int flags) {
+	if (stream && stream->data) {
+		FreeImageIO io;
+		SetMemoryIO(&io);
+
+		return FreeImage_LoadScaledFromHandle(fif, &io, (fi_handle)stream, max_width, max_height, flags);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadRegionFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int left, int top, int right, int bottom, int flags) {
+	if (stream && stream->data) {
+		FreeImageIO io;
+		SetMemoryIO(&io);
+
+		return FreeImage_LoadRegionFromHandle(fif, &io, (fi_handle)stream, left, top, right, bottom, flags);
+	}
+
+	return NULL;
+}
+
 
 BOOL DLL_CALLCONV
 FreeImage_SaveToMemory(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FIMEMORY *stream, int flags) {
@@ -97,9 +384,7 @@ FreeImage_SaveToMemory(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FIMEMORY *stream, i
 		FreeImageIO io;
 		SetMemoryIO(&io);
 
-		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
-
-		if(mem_header->delete_me == TRUE) {
+		if(IsMemoryIOWritable(stream)) {
 			return FreeImage_SaveToHandle(fif, dib, &io, (fi_handle)stream, flags);
 		} else {
 			// do not save in a user buffer
@@ -119,6 +404,11 @@ FreeImage_AcquireMemory(FIMEMORY *stream, BYTE **data, DWORD *size_in_bytes) {
 	if (stream) {
 		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
 
+		// a chunked stream is converted into a contiguous one (see FreeImage_GetMemoryChunk for a zero-copy access)
+		if(!FlattenMemoryIOChunks(stream)) {
+			return FALSE;
+		}
+
 		*data = (BYTE*)mem_header->data;
 		*size_in_bytes = mem_header->file_length;
 		return TRUE;
@@ -206,9 +496,7 @@ FreeImage_WriteMemory(const void *buffer, unsigned size, unsigned count, FIMEMOR
 		FreeImageIO io;
 		SetMemoryIO(&io);
 
-		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)stream)->data);
-
-		if(mem_header->delete_me == TRUE) {
+		if(IsMemoryIOWritable(stream)) {
 			return io.write_proc((void *)buffer, size, count, stream);
 		} else {
 			// do not write in a user buffer
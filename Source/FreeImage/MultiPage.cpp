@@ -106,9 +106,16 @@ struct MULTIBITMAPHEADER {
 		, read_only(TRUE)
 		, cache_fif(fif)
 		, load_flags(0)
+		, load_data(NULL)
 	{
 		SetDefaultIO(&io);
 	}
+
+	~MULTIBITMAPHEADER() {
+		for (std::map<int, FIBITMAP *>::iterator i = cached_metadata.begin(); i != cached_metadata.end(); ++i) {
+			FreeImage_Unload(i->second);
+		}
+	}
 	
 	PluginNode *node;
 	FREE_IMAGE_FORMAT fif;
@@ -123,6 +130,8 @@ struct MULTIBITMAPHEADER {
 	BOOL read_only;
 	FREE_IMAGE_FORMAT cache_fif;
 	int load_flags;
+	void *load_data;	//! plugin data kept open between two FreeImage_LockPage calls (see KeepsLoadData)
+	std::map<int, FIBITMAP *> cached_metadata;	//! metadata of the cached pages, by cache reference (see StorePageMetadata)
 };
 
 // =====================================================================
@@ -143,6 +152,76 @@ ReplaceExtension(std::string& dst_filename, const std::string& src_filename, con
 	}
 }
 
+/**
+Returns TRUE if the plugin data returned by Open may be kept open between two page loads 
+(see FI_KeepsLoadDataProc). Reusing the data saves a file scan per locked page.
+*/
+inline BOOL
+KeepsLoadData(PluginNode *node) {
+	return (node->m_plugin->keeps_load_data_proc != NULL) ? node->m_plugin->keeps_load_data_proc() : FALSE;
+}
+
+/**
+Returns the format used to cache the pages added to a multipage bitmap (see FI_CacheFormatProc)
+*/
+inline FREE_IMAGE_FORMAT
+CacheFormat(PluginNode *node, FREE_IMAGE_FORMAT fif) {
+	return (node->m_plugin->cache_format_proc != NULL) ? node->m_plugin->cache_format_proc() : fif;
+}
+
+/**
+Copy the metadata of a page, including the animation tags left out by FreeImage_CloneMetadata
+*/
+static void
+CopyPageMetadata(FIBITMAP *dst, FIBITMAP *src) {
+	FreeImage_CloneMetadata(dst, src);
+
+	FITAG *tag = NULL;
+	FIMETADATA *mdhandle = FreeImage_FindFirstMetadata(FIMD_ANIMATION, src, &tag);
+	if (mdhandle) {
+		do {
+			FreeImage_SetMetadata(FIMD_ANIMATION, dst, FreeImage_GetTagKey(tag), tag);
+		} while (FreeImage_FindNextMetadata(mdhandle, &tag));
+		FreeImage_FindCloseMetadata(mdhandle);
+	}
+}
+
+/**
+Keep the metadata of a page written to the cache. The cache format may not store
+all of it, e.g. the animation tags of a page cached as PNG.
+*/
+static void
+StorePageMetadata(MULTIBITMAPHEADER *header, int ref, FIBITMAP *dib) {
+	FIBITMAP *metadata = FreeImage_AllocateHeader(TRUE, 1, 1, 8);
+	if (metadata) {
+		CopyPageMetadata(metadata, dib);
+		header->cached_metadata[ref] = metadata;
+	}
+}
+
+/**
+Release the metadata kept for a cached page
+*/
+static void
+DeletePageMetadata(MULTIBITMAPHEADER *header, int ref) {
+	std::map<int, FIBITMAP *>::iterator i = header->cached_metadata.find(ref);
+	if (i != header->cached_metadata.end()) {
+		FreeImage_Unload(i->second);
+		header->cached_metadata.erase(i);
+	}
+}
+
+/**
+Close the plugin data kept by FreeImage_LockPage, if any
+*/
+inline void
+CloseLoadData(MULTIBITMAPHEADER *header) {
+	if (header->load_data) {
+		FreeImage_Close(header->node, &header->io, header->handle, header->load_data);
+		header->load_data = NULL;
+	}
+}
+
 } //< ns
 
 
@@ -279,7 +358,7 @@ FreeImage_OpenMultiBitmap(FREE_IMAGE_FORMAT fif, const char *filename, BOOL crea
 				header->fif = fif;
 				header->handle = handle;						
 				header->read_only = read_only;
-				header->cache_fif = fif;
+				header->cache_fif = CacheFormat(node, fif);
 				header->load_flags = flags;
 
 				// store the MULTIBITMAPHEADER in the surrounding FIMULTIBITMAP structure
@@ -344,7 +423,7 @@ FreeImage_OpenMultiBitmapFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_h
 					header->fif = fif;
 					header->handle = handle;						
 					header->read_only = read_only;	
-					header->cache_fif = fif;
+					header->cache_fif = CacheFormat(node, fif);
 					header->load_flags = flags;
 							
 					// store the MULTIBITMAPHEADER in the surrounding FIMULTIBITMAP structure
@@ -396,6 +475,7 @@ FreeImage_SaveMultiBitmapToHandle(FREE_IMAGE_FORMAT fif, FIMULTIBITMAP *bitmap,
 			
 			if(header->handle) {
 				// open src
+				CloseLoadData(header);
 				header->io.seek_proc(header->handle, 0, SEEK_SET);
 				data_read = FreeImage_Open(header->node, &header->io, header->handle, TRUE);
 			}
@@ -437,6 +517,12 @@ FreeImage_SaveMultiBitmapToHandle(FREE_IMAGE_FORMAT fif, FIMULTIBITMAP *bitmap,
 							FIMEMORY *hmem = FreeImage_OpenMemory(compressed_data, i->getSize());
 							FIBITMAP *dib = FreeImage_LoadFromMemory(header->cache_fif, hmem, 0);
 							FreeImage_CloseMemory(hmem);
+
+							// restore the metadata the cache format may have dropped
+							std::map<int, FIBITMAP *>::iterator metadata = header->cached_metadata.find(i->getReference());
+							if (dib && (metadata != header->cached_metadata.end())) {
+								CopyPageMetadata(dib, metadata->second);
+							}
 							
 							// get rid of the buffer
 							free(compressed_data);
@@ -479,6 +565,8 @@ FreeImage_CloseMultiBitmap(FIMULTIBITMAP *bitmap, int flags) {
 		
 		if (bitmap->data) {
 			MULTIBITMAPHEADER *header = FreeImage_GetMultiBitmapHeader(bitmap);			
+
+			CloseLoadData(header);
 			
 			// saves changes only of images loaded directly from a file
 			if (header->changed && !header->m_filename.empty()) {
@@ -605,6 +693,8 @@ FreeImage_SavePageToBlock(MULTIBITMAPHEADER *header, FIBITMAP *data) {
 	int ref = header->m_cachefile.writeFile(compressed_data, compressed_size);
 	// get rid of the compressed data
 	FreeImage_CloseMemory(hmem);
+	// keep the metadata along with it
+	StorePageMetadata(header, ref, data);
 	
 	res = PageBlock(BLOCK_REFERENCE, ref, compressed_size);
 	
@@ -669,6 +759,7 @@ FreeImage_DeletePage(FIMULTIBITMAP *bitmap, int page) {
 							
 						case BLOCK_REFERENCE :
 							header->m_cachefile.deleteFile(i->getReference());
+							DeletePageMetadata(header, i->getReference());
 							header->m_blocks.erase(i);
 							break;
 					}
@@ -694,20 +785,28 @@ FreeImage_LockPage(FIMULTIBITMAP *bitmap, int page) {
 			}
 		}
 
-		// open the bitmap
+		// open the bitmap (or reuse the data kept from the previous call)
 		
-		header->io.seek_proc(header->handle, 0, SEEK_SET);
+		void *data = header->load_data;
+
+		if (data == NULL) {
+			header->io.seek_proc(header->handle, 0, SEEK_SET);
 		
-		void *data = FreeImage_Open(header->node, &header->io, header->handle, TRUE);
+			data = FreeImage_Open(header->node, &header->io, header->handle, TRUE);
+		}
 		
 		// load the bitmap data
 		
 		if (data != NULL) {
 			FIBITMAP *dib = (header->node->m_plugin->load_proc != NULL) ? header->node->m_plugin->load_proc(&header->io, header->handle, page, header->load_flags, data) : NULL;
 
-			// close the file
+			// close the file, unless the plugin data can be reused by the next call
 			
-			FreeImage_Close(header->node, &header->io, header->handle, data);
+			if (KeepsLoadData(header->node)) {
+				header->load_data = data;
+			} else {
+				FreeImage_Close(header->node, &header->io, header->handle, data);
+			}
 
 			// if there was still another bitmap open, get rid of it
 
@@ -757,9 +856,11 @@ FreeImage_UnlockPage(FIMULTIBITMAP *bitmap, FIBITMAP *page, BOOL changed) {
 				
 				if (i->m_type == BLOCK_REFERENCE) {
 					header->m_cachefile.deleteFile(i->getReference());
+					DeletePageMetadata(header, i->getReference());
 				}
 				
 				int iPage = header->m_cachefile.writeFile(compressed_data, compressed_size);
+				StorePageMetadata(header, iPage, page);
 				
 				*i = PageBlock(BLOCK_REFERENCE, iPage, compressed_size);
 				
@@ -855,7 +956,7 @@ FreeImage_LoadMultiBitmapFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int
 						SetMemoryIO(&header->io);
 						header->handle = (fi_handle)stream;						
 						header->read_only = read_only;
-						header->cache_fif = fif;
+						header->cache_fif = CacheFormat(node, fif);
 						header->load_flags = flags;
 
 						// store the MULTIBITMAPHEADER in the surrounding FIMULTIBITMAP structure
@@ -35,6 +35,14 @@ FreeImage_GetScanLine(FIBITMAP *dib, int scanline) {
 	return CalculateScanLine(FreeImage_GetBits(dib), FreeImage_GetPitch(dib), scanline);
 }
 
+const BYTE * DLL_CALLCONV
+FreeImage_GetConstScanLine(FIBITMAP *dib, int scanline) {
+	if(!FreeImage_HasPixels(dib)) {
+		return NULL;
+	}
+	return CalculateScanLine(FreeImage_GetConstBits(dib), FreeImage_GetPitch(dib), scanline);
+}
+
 BOOL DLL_CALLCONV
 FreeImage_GetPixelIndex(FIBITMAP *dib, unsigned x, unsigned y, BYTE *value) {
 	BYTE shift;
@@ -43,7 +51,7 @@ FreeImage_GetPixelIndex(FIBITMAP *dib, unsigned x, unsigned y, BYTE *value) {
 		return FALSE;
 
 	if((x < FreeImage_GetWidth(dib)) && (y < FreeImage_GetHeight(dib))) {
-		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		const BYTE *bits = FreeImage_GetConstScanLine(dib, y);
 
 		switch(FreeImage_GetBPP(dib)) {
 			case 1:
@@ -72,13 +80,13 @@ FreeImage_GetPixelColor(FIBITMAP *dib, unsigned x, unsigned y, RGBQUAD *value) {
 		return FALSE;
 
 	if((x < FreeImage_GetWidth(dib)) && (y < FreeImage_GetHeight(dib))) {
-		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		const BYTE *bits = FreeImage_GetConstScanLine(dib, y);
 
 		switch(FreeImage_GetBPP(dib)) {
 			case 16:
 			{
 				bits += 2*x;
-				WORD *pixel = (WORD *)bits;
+				const WORD *pixel = (const WORD *)bits;
 				if((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
 					value->rgbBlue		= (BYTE)((((*pixel & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F);
 					value->rgbGreen		= (BYTE)((((*pixel & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F);
@@ -37,6 +37,7 @@
 #include "Utilities.h"
 #include "FreeImageIO.h"
 #include "Plugin.h"
+#include "ThreadPool.h"
 
 #include "../Metadata/FreeImageTag.h"
 
@@ -124,6 +125,7 @@ PluginList::AddNode(FI_InitProc init_proc, void *instance, const char *format, c
 			node->m_extension = extension;
 			node->m_regexpr = regexpr;
 			node->m_enabled = TRUE;
+			node->m_magic_indexed = IndexMagicNumbers(node);
 
 			m_plugin_map[(const int)m_plugin_map.size()] = node;
 
@@ -180,6 +182,82 @@ PluginList::FindNodeFromFIF(int node_id) {
 	return NULL;
 }
 
+/**
+Add the magic numbers of a plugin to the magic number table. 
+Each magic number is stored under every first byte value it can match.
+@param node Plugin node
+@return Returns TRUE if the plugin magic numbers have been indexed, returns FALSE if the plugin has no (valid) magic numbers
+*/
+BOOL
+PluginList::IndexMagicNumbers(PluginNode *node) {
+	if (node->m_plugin->magic_number_proc == NULL) {
+		return FALSE;
+	}
+
+	int count = 0;
+	const FIMAGICNUMBER *magic = node->m_plugin->magic_number_proc(&count);
+
+	if ((magic == NULL) || (count <= 0)) {
+		return FALSE;
+	}
+	for (int k = 0; k < count; k++) {
+		if ((magic[k].bytes == NULL) || (magic[k].length == 0) || (magic[k].length > FI_MAGIC_HEADER_SIZE)) {
+			return FALSE;
+		}
+	}
+
+	try {
+		for (int k = 0; k < count; k++) {
+			const BYTE mask = magic[k].mask ? magic[k].mask[0] : 0xFF;
+
+			for (int value = 0; value < 256; value++) {
+				if ((value & mask) == (magic[k].bytes[0] & mask)) {
+					m_magic_table[value].push_back(MAGICENTRY(node->m_id, &magic[k]));
+				}
+			}
+		}
+	} catch(std::bad_alloc &) {
+		// remove partially indexed magic numbers
+		for (int value = 0; value < 256; value++) {
+			vector<MAGICENTRY> &entries = m_magic_table[value];
+			while (!entries.empty() && (entries.back().first == node->m_id)) {
+				entries.pop_back();
+			}
+		}
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+Find the plugins having a magic number that matches a file header
+@param header First FI_MAGIC_HEADER_SIZE bytes of the file (zero padded if the file is smaller)
+@param node_ids Returns the sorted list of matching plugins
+*/
+void
+PluginList::FindNodesFromMagicNumber(const BYTE *header, vector<int> &node_ids) {
+	const vector<MAGICENTRY> &entries = m_magic_table[header[0]];
+
+	for (vector<MAGICENTRY>::const_iterator i = entries.begin(); i != entries.end(); ++i) {
+		const FIMAGICNUMBER *magic = (*i).second;
+
+		if (!node_ids.empty() && (node_ids.back() == (*i).first)) {
+			// already matched
+			continue;
+		}
+
+		BOOL match = TRUE;
+		for (unsigned k = 1; (k < magic->length) && match; k++) {
+			const BYTE mask = magic->mask ? magic->mask[k] : 0xFF;
+			match = ((header[k] & mask) == (magic->bytes[k] & mask));
+		}
+		if (match) {
+			node_ids.push_back((*i).first);
+		}
+	}
+}
+
 int
 PluginList::Size() const {
 	return (int)m_plugin_map.size();
@@ -349,6 +427,9 @@ FreeImage_DeInitialise() {
 
 	if (s_plugin_reference_count == 0) {
 		delete s_plugins;
+
+		// join the worker threads while the library is still fully alive
+		ThreadPool::instance().shutdown();
 	}
 }
 
@@ -437,6 +518,256 @@ FreeImage_LoadU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags) {
 	return NULL;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadScaledFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int max_width, int max_height, int flags) {
+	if ((max_width <= 0) && (max_height <= 0)) {
+		return FreeImage_LoadFromHandle(fif, io, handle, flags);
+	}
+
+	if ((fif >= 0) && (fif < FreeImage_GetFIFCount())) {
+		PluginNode *node = s_plugins->FindNodeFromFIF(fif);
+		
+		if (node != NULL) {
+			if(node->m_plugin->load_proc != NULL) {
+				FIBITMAP *bitmap = NULL;
+
+				void *data = FreeImage_Open(node, io, handle, TRUE);
+
+				if(node->m_plugin->load_scaled_proc != NULL) {
+					// use the plugin reduced-resolution decoding
+					bitmap = node->m_plugin->load_scaled_proc(io, handle, -1, flags, data, max_width, max_height);
+				} else {
+					// no native path: decode the full image
+					bitmap = node->m_plugin->load_proc(io, handle, -1, flags, data);
+				}
+
+				FreeImage_Close(node, io, handle, data);
+
+				if(bitmap && FreeImage_HasPixels(bitmap)) {
+					// fit the decoded image inside the box
+					const unsigned width = FreeImage_GetWidth(bitmap);
+					const unsigned height = FreeImage_GetHeight(bitmap);
+					unsigned fit_width, fit_height;
+					CalculateFitSize(width, height, max_width, max_height, &fit_width, &fit_height);
+
+					if((fit_width != width) || (fit_height != height)) {
+						FIBITMAP *scaled = FreeImage_Rescale(bitmap, fit_width, fit_height, FILTER_CATMULLROM);
+						if(scaled) {
+							// keep the color profile along with the metadata
+							FIICCPROFILE *icc = FreeImage_GetICCProfile(bitmap);
+							if(icc->data && icc->size) {
+								FreeImage_CreateICCProfile(scaled, icc->data, icc->size);
+							}
+							FreeImage_Unload(bitmap);
+							bitmap = scaled;
+						}
+					}
+				}
+
+				return bitmap;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadScaled(FREE_IMAGE_FORMAT fif, const char *filename, int max_width, int max_height, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+	
+	FILE *handle = fopen(filename, "rb");
+
+	if (handle) {
+		FIBITMAP *bitmap = FreeImage_LoadScaledFromHandle(fif, &io, (fi_handle)handle, max_width, max_height, flags);
+
+		fclose(handle);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadScaled: failed to open file %s", filename);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadScaledU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int max_width, int max_height, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+#ifdef _WIN32	
+	FILE *handle = _wfopen(filename, L"rb");
+
+	if (handle) {
+		FIBITMAP *bitmap = FreeImage_LoadScaledFromHandle(fif, &io, (fi_handle)handle, max_width, max_height, flags);
+
+		fclose(handle);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadScaledU: failed to open input file");
+	}
+#endif
+	return NULL;
+}
+
+/**
+Region-of-interest loading using the plugin scanline decoder: only a row of the image is buffered, 
+the rows above the region are decoded and dropped and decoding stops after the last row of the region
+@return Returns the region, or NULL if the plugin can't stream the image or the region is outside the image
+*/
+static FIBITMAP *
+LoadRegionFromScanlines(PluginNode *node, FreeImageIO *io, fi_handle handle, int flags, void *data, int left, int top, int right, int bottom) {
+	FIBITMAP *header = NULL;
+
+	void *decoder = node->m_plugin->open_scanlines_proc(io, handle, -1, flags, data, &header);
+
+	if(!decoder) {
+		if(header) {
+			FreeImage_Unload(header);
+		}
+		return NULL;
+	}
+
+	FIBITMAP *region = NULL;
+
+	if(ClipRegion(FreeImage_GetWidth(header), FreeImage_GetHeight(header), &left, &top, &right, &bottom)) {
+		const unsigned line = FreeImage_GetLine(header);
+		const unsigned bpp = FreeImage_GetBPP(header);
+
+		BYTE *buffer = (BYTE*)malloc(line * sizeof(BYTE));
+
+		region = buffer ? AllocateRegion(header, right - left, bottom - top) : NULL;
+
+		if(region) {
+			for(int y = 0; y < bottom; y++) {
+				if(node->m_plugin->read_scanlines_proc(io, handle, decoder, buffer, line, 1) != 1) {
+					FreeImage_Unload(region);
+					region = NULL;
+					break;
+				}
+				if(y >= top) {
+					// bitmaps are stored upside down
+					CopyPixelRun(FreeImage_GetScanLine(region, bottom - 1 - y), 0, buffer, left, right - left, bpp);
+				}
+			}
+		} else {
+			FreeImage_OutputMessageProc((int)node->m_id, FI_MSG_ERROR_MEMORY);
+		}
+
+		free(buffer);
+	}
+
+	node->m_plugin->close_scanlines_proc(io, handle, decoder);
+	FreeImage_Unload(header);
+
+	return region;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadRegionFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int left, int top, int right, int bottom, int flags) {
+	// normalize the rectangle
+	if(right < left) {
+		INPLACESWAP(left, right);
+	}
+	if(bottom < top) {
+		INPLACESWAP(top, bottom);
+	}
+
+	// a region is always loaded with its pixels
+	flags &= ~FIF_LOAD_NOPIXELS;
+
+	if ((fif >= 0) && (fif < FreeImage_GetFIFCount())) {
+		PluginNode *node = s_plugins->FindNodeFromFIF(fif);
+		
+		if (node != NULL) {
+			if(node->m_plugin->load_proc != NULL) {
+				FIBITMAP *bitmap = NULL;
+
+				const long start = io->tell_proc(handle);
+
+				void *data = FreeImage_Open(node, io, handle, TRUE);
+
+				if(node->m_plugin->load_region_proc != NULL) {
+					// use the plugin region decoding
+					bitmap = node->m_plugin->load_region_proc(io, handle, -1, flags, data, left, top, right, bottom);
+				} else if(node->m_plugin->open_scanlines_proc != NULL) {
+					// decode the rows up to the bottom of the region
+					bitmap = LoadRegionFromScanlines(node, io, handle, flags, data, left, top, right, bottom);
+				}
+
+				if(!bitmap) {
+					if(node->m_plugin->load_region_proc || node->m_plugin->open_scanlines_proc) {
+						// start again from the beginning of the stream
+						FreeImage_Close(node, io, handle, data);
+						io->seek_proc(handle, start, SEEK_SET);
+						data = FreeImage_Open(node, io, handle, TRUE);
+					}
+
+					// no native path: decode the full image and crop it
+					FIBITMAP *dib = node->m_plugin->load_proc(io, handle, -1, flags, data);
+
+					if(dib) {
+						if(ClipRegion(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), &left, &top, &right, &bottom)) {
+							bitmap = FreeImage_Copy(dib, left, top, right, bottom);
+						} else {
+							FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadRegion: the region is outside of the image");
+						}
+						FreeImage_Unload(dib);
+					}
+				}
+
+				FreeImage_Close(node, io, handle, data);
+
+				return bitmap;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadRegion(FREE_IMAGE_FORMAT fif, const char *filename, int left, int top, int right, int bottom, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+	
+	FILE *handle = fopen(filename, "rb");
+
+	if (handle) {
+		FIBITMAP *bitmap = FreeImage_LoadRegionFromHandle(fif, &io, (fi_handle)handle, left, top, right, bottom, flags);
+
+		fclose(handle);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadRegion: failed to open file %s", filename);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadRegionU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int left, int top, int right, int bottom, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+#ifdef _WIN32	
+	FILE *handle = _wfopen(filename, L"rb");
+
+	if (handle) {
+		FIBITMAP *bitmap = FreeImage_LoadRegionFromHandle(fif, &io, (fi_handle)handle, left, top, right, bottom, flags);
+
+		fclose(handle);
+
+		return bitmap;
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_LoadRegionU: failed to open input file");
+	}
+#endif
+	return NULL;
+}
+
 BOOL DLL_CALLCONV
 FreeImage_SaveToHandle(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FreeImageIO *io, fi_handle handle, int flags) {
 	// cannot save "header only" formats
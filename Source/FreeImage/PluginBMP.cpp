@@ -1060,6 +1060,19 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE bmp_signature1[] = { 0x42, 0x4D };
+	static const BYTE bmp_signature2[] = { 0x42, 0x41 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(bmp_signature1), bmp_signature1, NULL },
+		{ sizeof(bmp_signature2), bmp_signature2, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -1156,7 +1169,7 @@ On return, the function will return the real size of the target buffer, which sh
 @return Returns the target buffer size
 */
 static int
-RLEEncodeLine(BYTE *target, BYTE *source, int size) {
+RLEEncodeLine(BYTE *target, const BYTE *source, int size) {
 	BYTE buffer[256];
 	int buffer_size = 0;
 	int target_pos = 0;
@@ -1401,7 +1414,7 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			BYTE *buffer = (BYTE*)malloc(dst_pitch * 2 * sizeof(BYTE));
 
 			for (unsigned i = 0; i < dst_height; ++i) {
-				int size = RLEEncodeLine(buffer, FreeImage_GetScanLine(dib, i), FreeImage_GetLine(dib));
+				int size = RLEEncodeLine(buffer, FreeImage_GetConstScanLine(dib, i), FreeImage_GetLine(dib));
 
 				if (io->write_proc(buffer, size, 1, handle) != 1) {
 					free(buffer);
@@ -1424,9 +1437,9 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			WORD pad = 0;
 			WORD pixel;
 			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *line = FreeImage_GetScanLine(dib, y);
+				const BYTE *line = FreeImage_GetConstScanLine(dib, y);
 				for(unsigned x = 0; x < dst_width; x++) {
-					pixel = ((WORD *)line)[x];
+					pixel = ((const WORD *)line)[x];
 					SwapShort(&pixel);
 					if (io->write_proc(&pixel, sizeof(WORD), 1, handle) != 1) {
 						return FALSE;
@@ -1445,9 +1458,9 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			DWORD pad = 0;
 			FILE_BGR bgr;
 			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *line = FreeImage_GetScanLine(dib, y);
+				const BYTE *line = FreeImage_GetConstScanLine(dib, y);
 				for(unsigned x = 0; x < dst_width; x++) {
-					RGBTRIPLE *triple = ((RGBTRIPLE *)line)+x;
+					const RGBTRIPLE *triple = ((const RGBTRIPLE *)line)+x;
 					bgr.b = triple->rgbtBlue;
 					bgr.g = triple->rgbtGreen;
 					bgr.r = triple->rgbtRed;
@@ -1464,9 +1477,9 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		} else if (bpp == 32) {
 			FILE_BGRA bgra;
 			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *line = FreeImage_GetScanLine(dib, y);
+				const BYTE *line = FreeImage_GetConstScanLine(dib, y);
 				for(unsigned x = 0; x < dst_width; x++) {
-					RGBQUAD *quad = ((RGBQUAD *)line)+x;
+					const RGBQUAD *quad = ((const RGBQUAD *)line)+x;
 					bgra.b = quad->rgbBlue;
 					bgra.g = quad->rgbGreen;
 					bgra.r = quad->rgbRed;
@@ -1479,13 +1492,13 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 #endif
 		} 
 		else if (FreeImage_GetPitch(dib) == dst_pitch) {
-			return (io->write_proc(FreeImage_GetBits(dib), dst_height * dst_pitch, 1, handle) != 1) ? FALSE : TRUE;
+			return (io->write_proc((void *)FreeImage_GetConstBits(dib), dst_height * dst_pitch, 1, handle) != 1) ? FALSE : TRUE;
 		}
 		else {
 			for (unsigned y = 0; y < dst_height; y++) {
-				BYTE *line = (BYTE*)FreeImage_GetScanLine(dib, y);
+				const BYTE *line = FreeImage_GetConstScanLine(dib, y);
 				
-				if (io->write_proc(line, dst_pitch, 1, handle) != 1) {
+				if (io->write_proc((void *)line, dst_pitch, 1, handle) != 1) {
 					return FALSE;
 				}
 			}
@@ -1522,4 +1535,5 @@ InitBMP(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;	// not implemented yet;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
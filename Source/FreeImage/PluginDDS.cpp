@@ -825,6 +825,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return TRUE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE dds_signature[] = { 'D', 'D', 'S', ' ' };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(dds_signature), dds_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -916,4 +927,5 @@ InitDDS(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -150,6 +150,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(exr_signature, signature, 4) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE exr_signature[] = { 0x76, 0x2F, 0x31, 0x01 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(exr_signature), exr_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -171,8 +182,13 @@ SupportsNoPixels() {
 
 // --------------------------------------------------------------------------
 
-static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+/**
+Decode an image
+@param region Left, top, right and bottom bounds of the region to decode (relative to the data window), 
+NULL to decode the whole image
+*/
+static FIBITMAP *
+DecodeImage(FreeImageIO *io, fi_handle handle, int flags, const int *region) {
 	bool bUseRgbaInterface = false;
 	FIBITMAP *dib = NULL;	
 
@@ -197,6 +213,24 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		int width  = dataWindow.max.x - dataWindow.min.x + 1;
 		int height = dataWindow.max.y - dataWindow.min.y + 1;
 
+		// part of the data window to be decoded
+		Imath::Box2i window = dataWindow;
+		const int data_width = width;
+
+		if(region) {
+			int left = region[0], top = region[1], right = region[2], bottom = region[3];
+			if(!ClipRegion(width, height, &left, &top, &right, &bottom)) {
+				return NULL;
+			}
+			window.min.x = dataWindow.min.x + left;
+			window.min.y = dataWindow.min.y + top;
+			window.max.x = dataWindow.min.x + right - 1;
+			window.max.y = dataWindow.min.y + bottom - 1;
+
+			width  = right - left;
+			height = bottom - top;
+		}
+
 		//const Imf::Compression &compression = file.header().compression();
 
 		const Imf::ChannelList &channels = file.header().channels();
@@ -367,17 +401,17 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			Imf::RgbaInputFile rgbaFile(istream);
 
 			// read the file in chunks
-			Imath::Box2i dw = dataWindow;
-			Imf::Array2D<Imf::Rgba> chunk(chunk_size, width);
+			Imath::Box2i dw = window;
+			Imf::Array2D<Imf::Rgba> chunk(chunk_size, data_width);
 			while (dw.min.y <= dw.max.y) {
 				// read a chunk
-				rgbaFile.setFrameBuffer (&chunk[0][0] - dw.min.x - dw.min.y * width, 1, width);
+				rgbaFile.setFrameBuffer (&chunk[0][0] - dataWindow.min.x - dw.min.y * data_width, 1, data_width);
 				rgbaFile.readPixels (dw.min.y, MIN(dw.min.y + chunk_size - 1, dw.max.y));
 				// fill the dib
-				const int y_max = ((dw.max.y - dw.min.y) <= chunk_size) ? (dw.max.y - dw.min.y) : chunk_size;
+				const int y_max = MIN(dw.max.y - dw.min.y + 1, chunk_size);
 				for(int y = 0; y < y_max; y++) {
 					FIRGBF *pixel = (FIRGBF*)scanline;
-					const Imf::Rgba *half_rgba = chunk[y];
+					const Imf::Rgba *half_rgba = chunk[y] + (window.min.x - dataWindow.min.x);
 					for(int x = 0; x < width; x++) {
 						// convert from half to float
 						pixel[x].red = half_rgba[x].r;
@@ -394,38 +428,58 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		} else {
 			// use the low level interface
 
-			// build a frame buffer (i.e. what we want on output)
-			Imf::FrameBuffer frameBuffer;
+			// the decoder outputs whole rows of the data window: when only some columns 
+			// are needed, read the rows in chunks through a full-width buffer
+			const bool bCropColumns = (window.min.x != dataWindow.min.x) || (window.max.x != dataWindow.max.x);
+			const int chunk_size = bCropColumns ? 16 : height;
+			const size_t chunk_pitch = bCropColumns ? data_width * bytespp : pitch;
+			Imf::Array<BYTE> chunk(bCropColumns ? chunk_size * chunk_pitch : 0);
 
-			// allow dataWindow with minimal bounds different form zero
-			size_t offset = - dataWindow.min.x * bytespp - dataWindow.min.y * pitch;
+			for(int y = window.min.y; y <= window.max.y; y += chunk_size) {
+				const int y_last = MIN(y + chunk_size - 1, window.max.y);
 
-			if(components == 1) {
-				frameBuffer.insert ("Y",	// name
-					Imf::Slice (pixelType,	// type
-					(char*)(bits + offset), // base
-					bytespp,				// xStride
-					pitch,					// yStride
-					1, 1,					// x/y sampling
-					0.0));					// fillValue
-			} else if((components == 3) || (components == 4)) {
-				const char *channel_name[4] = { "R", "G", "B", "A" };
+				BYTE *chunk_bits = bCropColumns ? (BYTE*)chunk : (BYTE*)bits + (y - window.min.y) * pitch;
 
-				for(int c = 0; c < components; c++) {
-					frameBuffer.insert (
-						channel_name[c],					// name
-						Imf::Slice (pixelType,				// type
-						(char*)(bits + c * sizeof(float) + offset), // base
-						bytespp,							// xStride
-						pitch,								// yStride
-						1, 1,								// x/y sampling
-						0.0));								// fillValue
+				// build a frame buffer (i.e. what we want on output)
+				Imf::FrameBuffer frameBuffer;
+
+				// allow dataWindow with minimal bounds different form zero
+				const ptrdiff_t offset = - (ptrdiff_t)dataWindow.min.x * (ptrdiff_t)bytespp - (ptrdiff_t)y * (ptrdiff_t)chunk_pitch;
+
+				if(components == 1) {
+					frameBuffer.insert ("Y",	// name
+						Imf::Slice (pixelType,	// type
+						(char*)(chunk_bits + offset), // base
+						bytespp,				// xStride
+						chunk_pitch,			// yStride
+						1, 1,					// x/y sampling
+						0.0));					// fillValue
+				} else if((components == 3) || (components == 4)) {
+					const char *channel_name[4] = { "R", "G", "B", "A" };
+
+					for(int c = 0; c < components; c++) {
+						frameBuffer.insert (
+							channel_name[c],					// name
+							Imf::Slice (pixelType,				// type
+							(char*)(chunk_bits + c * sizeof(float) + offset), // base
+							bytespp,							// xStride
+							chunk_pitch,						// yStride
+							1, 1,								// x/y sampling
+							0.0));								// fillValue
+					}
 				}
-			}
 
-			// read the file
-			file.setFrameBuffer(frameBuffer);
-			file.readPixels(dataWindow.min.y, dataWindow.max.y);
+				// read the file
+				file.setFrameBuffer(frameBuffer);
+				file.readPixels(y, y_last);
+
+				if(bCropColumns) {
+					// keep the columns of the region
+					for(int row = y; row <= y_last; row++) {
+						memcpy((BYTE*)bits + (row - window.min.y) * pitch, chunk_bits + (row - y) * chunk_pitch + (window.min.x - dataWindow.min.x) * bytespp, width * bytespp);
+					}
+				}
+			}
 		}
 
 		// lastly, flip dib lines
@@ -443,6 +497,17 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return dib;
 }
 
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return DecodeImage(io, handle, flags, NULL);
+}
+
+static FIBITMAP * DLL_CALLCONV
+LoadRegion(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int left, int top, int right, int bottom) {
+	const int region[4] = { left, top, right, bottom };
+	return DecodeImage(io, handle, flags, region);
+}
+
 /**
 Set the preview image using the dib embedded thumbnail
 */
@@ -770,4 +835,6 @@ InitEXR(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_region_proc = LoadRegion;
 }
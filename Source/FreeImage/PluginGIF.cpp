@@ -47,6 +47,8 @@
 // ==========================================================
 
 
+class StringTable;
+
 struct GIFinfo {
 	BOOL read;
 	//only really used when reading
@@ -57,10 +59,25 @@ struct GIFinfo {
 	std::vector<size_t> comment_extension_offsets;
 	std::vector<size_t> graphic_control_extension_offsets;
 	std::vector<size_t> image_descriptor_offsets;
-
-	GIFinfo() : read(0), global_color_table_offset(0), global_color_table_size(0), background_color(0)
+	//GIF_PLAYBACK state, kept while the multipage handle is open:
+	//the composited logical screen on which page canvas_page will be drawn.
+	//GIF_OPTIMIZE state when writing: the last page written as a full screen frame
+	FIBITMAP *canvas;
+	int canvas_page;
+	//only used when writing with GIF_OPTIMIZE
+	int logical_width, logical_height;
+	//GIF_OPTIMIZE: the last page received, written when the next one is known
+	FIBITMAP *pending;
+	int pending_page, pending_flags;
+	//GIF_OPTIMIZE: a kept page could not be written, the following pages are refused
+	BOOL failed;
+	//LZW tables, shared by all the frames read or written through this handle
+	StringTable *stringtable;
+
+	GIFinfo() : read(0), global_color_table_offset(0), global_color_table_size(0), background_color(0), canvas(NULL), canvas_page(0), logical_width(0), logical_height(0), pending(NULL), pending_page(0), pending_flags(0), failed(FALSE), stringtable(NULL)
 	{
 	}
+	~GIFinfo();
 };
 
 struct PageInfo {
@@ -74,6 +91,10 @@ struct PageInfo {
 //GIF defines a max of 12 bits per code
 #define MAX_LZW_CODE			4096
 
+//size of the compressor hash table (a power of 2, at least twice MAX_LZW_CODE)
+#define LZW_HASH_BITS			13
+#define LZW_HASH_SIZE			(1 << LZW_HASH_BITS)
+
 class StringTable
 {
 public:
@@ -82,8 +103,11 @@ public:
 	void Initialize(int minCodeSize);
 	BYTE *FillInputBuffer(int len);
 	void CompressStart(int bpp, int width);
-	int CompressEnd(BYTE *buf); //0-4 bytes
-	bool Compress(BYTE *buf, int *len);
+	void CompressEnd(void);
+	void Compress(const BYTE *line);
+	BYTE *GetOutput(void) { return m_output; }
+	int GetOutputSize(void) const { return m_outputSize; }
+	void ConsumeOutput(int len);
 	bool Decompress(BYTE *buf, int *len);
 	void Done(void);
 
@@ -92,18 +116,32 @@ protected:
 
 	int m_minCodeSize, m_clearCode, m_endCode, m_nextCode;
 
-	int m_bpp, m_slack; //Compressor information
+	int m_bpp, m_width; //Compressor information
 
-	int m_prefix; //Compressor state variable
+	int m_prefix; //Compressor state variable (-1 until the first pixel has been read)
 	int m_codeSize, m_codeMask; //Compressor/Decompressor state variables
 	int m_oldCode; //Decompressor state variable
-	int m_partial, m_partialSize; //Compressor/Decompressor bit buffer
+	int m_partial, m_partialSize; //Decompressor bit buffer
+
+	//Compressor bit buffer, flushed to the output 32 bits at a time
+	UINT64 m_bits;
+	int m_bitCount;
 
-	int firstPixelPassed; // A specific flag that indicates if the first pixel
-	                      // of the whole image had already been read
+	//Compressor output, drained by the caller into sub-blocks
+	BYTE *m_output;
+	int m_outputSize, m_outputCapacity;
 
-	std::string m_strings[MAX_LZW_CODE]; //This is what is really the "string table" data for the Decompressor
-	int* m_strmap;
+	//This is the "string table" for the Compressor: an open-addressing hash 
+	//of (prefix code << 8 | character) keys (-1 for empty slots) to codes
+	int m_hashKeys[LZW_HASH_SIZE];
+	WORD m_hashCodes[LZW_HASH_SIZE];
+
+	//This is what is really the "string table" data for the Decompressor: 
+	//each string is the string of its prefix code followed by its suffix character
+	WORD m_prefixes[MAX_LZW_CODE];
+	BYTE m_suffixes[MAX_LZW_CODE];
+	BYTE m_firstChars[MAX_LZW_CODE]; //first character of each string
+	WORD m_lengths[MAX_LZW_CODE];
 
 	//input buffer
 	BYTE *m_buffer;
@@ -111,8 +149,34 @@ protected:
 
 	void ClearCompressorTable(void);
 	void ClearDecompressorTable(void);
+	inline int GetPixel(const BYTE *line, int x) const;
+	inline void PutCode(int code);
 };
 
+GIFinfo::~GIFinfo() {
+	if( canvas != NULL ) {
+		FreeImage_Unload(canvas);
+	}
+	if( pending != NULL ) {
+		FreeImage_Unload(pending);
+	}
+	delete stringtable;
+}
+
+/**
+Get the LZW tables of a handle, allocated on first use
+*/
+static StringTable* 
+GetStringTable(GIFinfo *info) {
+	if( info->stringtable == NULL ) {
+		info->stringtable = new(std::nothrow) StringTable;
+		if( info->stringtable == NULL ) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+	}
+	return info->stringtable;
+}
+
 #define GIF_PACKED_LSD_HAVEGCT		0x80
 #define GIF_PACKED_LSD_COLORRES		0x70
 #define GIF_PACKED_LSD_GCTSORTED	0x08
@@ -140,6 +204,47 @@ protected:
 static int g_GifInterlaceOffset[GIF_INTERLACE_PASSES] = {0, 4, 2, 1};
 static int g_GifInterlaceIncrement[GIF_INTERLACE_PASSES] = {8, 8, 4, 2};
 
+// ==========================================================
+// Playback helpers
+// ==========================================================
+
+/**
+Fill the area of a frame with the background color (GIF_DISPOSAL_BACKGROUND)
+*/
+static void 
+ClearFrameArea(FIBITMAP *dib, const PageInfo &frame, const RGBQUAD &background) {
+	const int logicalwidth = (int)FreeImage_GetWidth(dib);
+	const int logicalheight = (int)FreeImage_GetHeight(dib);
+	const int width = MIN((int)frame.width, logicalwidth - (int)frame.left);
+
+	for( int y = 0; y < frame.height; y++ ) {
+		const int scanidx = logicalheight - (y + frame.top) - 1;
+		if ( scanidx < 0 ) {
+			break;  // If data is corrupt, don't calculate in invalid scanline
+		}
+		RGBQUAD *scanline = (RGBQUAD *)FreeImage_GetScanLine(dib, scanidx) + frame.left;
+		for( int x = 0; x < width; x++ ) {
+			*scanline++ = background;
+		}
+	}
+}
+
+/**
+Copy a composited logical screen into the playback canvas of the handle. 
+On allocation failure the canvas is dropped and playback starts over on the next call.
+*/
+static void 
+StoreCanvas(GIFinfo *info, FIBITMAP *dib, int page) {
+	if( info->canvas == NULL ) {
+		info->canvas = FreeImage_Allocate(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), 32);
+		if( info->canvas == NULL ) {
+			return;
+		}
+	}
+	memcpy(FreeImage_GetBits(info->canvas), FreeImage_GetConstBits(dib), FreeImage_GetPitch(dib) * FreeImage_GetHeight(dib));
+	info->canvas_page = page;
+}
+
 // ==========================================================
 // Helpers Functions
 // ==========================================================
@@ -183,11 +288,9 @@ FreeImage_GetMetadataEx(FREE_IMAGE_MDMODEL model, FIBITMAP *dib, const char *key
 StringTable::StringTable()
 {
 	m_buffer = NULL;
-	firstPixelPassed = 0; // Still no pixel read
-	// Maximum number of entries in the map is MAX_LZW_CODE * 256 
-	// (aka 2**12 * 2**8 => a 20 bits key)
-	// This Map could be optmized to only handle MAX_LZW_CODE * 2**(m_bpp)
-	m_strmap = new(std::nothrow) int[1<<20];
+	m_output = NULL;
+	m_outputSize = 0;
+	m_outputCapacity = 0;
 }
 
 StringTable::~StringTable()
@@ -195,9 +298,8 @@ StringTable::~StringTable()
 	if( m_buffer != NULL ) {
 		delete [] m_buffer;
 	}
-	if( m_strmap != NULL ) {
-		delete [] m_strmap;
-		m_strmap = NULL;
+	if( m_output != NULL ) {
+		delete [] m_output;
 	}
 }
 
@@ -217,7 +319,6 @@ void StringTable::Initialize(int minCodeSize)
 	m_partialSize = 0;
 
 	m_bufferSize = 0;
-	ClearCompressorTable();
 	ClearDecompressorTable();
 }
 
@@ -240,130 +341,126 @@ BYTE *StringTable::FillInputBuffer(int len)
 void StringTable::CompressStart(int bpp, int width)
 {
 	m_bpp = bpp;
-	m_slack = (8 - ((width * bpp) % 8)) % 8;
+	m_width = width;
+	m_prefix = -1;
+
+	//a line adds at most one code per pixel plus a few clear codes (all <= 12 bits), 
+	//on top of the (less than one) sub-block left by the caller
+	const int capacity = 255 + 3 * width + 16;
+	if( capacity > m_outputCapacity ) {
+		delete [] m_output;
+		m_output = new(std::nothrow) BYTE[capacity];
+		if( m_output == NULL ) {
+			m_outputCapacity = 0;
+			throw FI_MSG_ERROR_MEMORY;
+		}
+		m_outputCapacity = capacity;
+	}
+	m_outputSize = 0;
+	m_bits = 0;
+	m_bitCount = 0;
 
-	m_partial |= m_clearCode << m_partialSize;
-	m_partialSize += m_codeSize;
 	ClearCompressorTable();
+	PutCode(m_clearCode);
 }
 
-int StringTable::CompressEnd(BYTE *buf)
+void StringTable::CompressEnd(void)
 {
-	int len = 0;
-
 	//output code for remaining prefix
-	m_partial |= m_prefix << m_partialSize;
-	m_partialSize += m_codeSize;
-	while( m_partialSize >= 8 ) {
-		*buf++ = (BYTE)m_partial;
-		m_partial >>= 8;
-		m_partialSize -= 8;
-		len++;
+	if( m_prefix >= 0 ) {
+		PutCode(m_prefix);
 	}
 
 	//add the end of information code and flush the entire buffer out
-	m_partial |= m_endCode << m_partialSize;
-	m_partialSize += m_codeSize;
-	while( m_partialSize > 0 ) {
-		*buf++ = (BYTE)m_partial;
-		m_partial >>= 8;
-		m_partialSize -= 8;
-		len++;
+	PutCode(m_endCode);
+	while( m_bitCount > 0 ) {
+		m_output[m_outputSize++] = (BYTE)m_bits;
+		m_bits >>= 8;
+		m_bitCount -= 8;
 	}
-
-	//most this can be is 4 bytes.  7 bits in m_partial to start + 12 for the
-	//last code + 12 for the end code = 31 bits total.
-	return len;
+	m_bits = 0;
+	m_bitCount = 0;
 }
 
-bool StringTable::Compress(BYTE *buf, int *len)
+void StringTable::ConsumeOutput(int len)
 {
-	if( m_bufferSize == 0 || m_done ) {
-		return false;
+	m_outputSize -= len;
+	if( m_outputSize > 0 ) {
+		memmove(m_output, m_output + len, m_outputSize);
 	}
+}
 
-	int mask = (1 << m_bpp) - 1;
-	BYTE *bufpos = buf;
-	while( m_bufferPos < m_bufferSize ) {
-		//get the current pixel value
-		char ch = (char)((m_buffer[m_bufferPos] >> m_bufferShift) & mask);
-
-		// The next prefix is : 
-		// <the previous LZW code (on 12 bits << 8)> | <the code of the current pixel (on 8 bits)>
-		int nextprefix = (((m_prefix)<<8)&0xFFF00) + (ch & 0x000FF);
-		if(firstPixelPassed) {
-			
-			if( m_strmap[nextprefix] > 0) {
-				m_prefix = m_strmap[nextprefix];
-			} else {
-				m_partial |= m_prefix << m_partialSize;
-				m_partialSize += m_codeSize;
-				//grab full bytes for the output buffer
-				while( m_partialSize >= 8 && bufpos - buf < *len ) {
-					*bufpos++ = (BYTE)m_partial;
-					m_partial >>= 8;
-					m_partialSize -= 8;
-				}
-
-				//add the code to the "table map"
-				m_strmap[nextprefix] = m_nextCode;
-
-				//increment the next highest valid code, increase the code size
-				if( m_nextCode == (1 << m_codeSize) ) {
-					m_codeSize++;
-				}
-				m_nextCode++;
-
-				//if we're out of codes, restart the string table
-				if( m_nextCode == MAX_LZW_CODE ) {
-					m_partial |= m_clearCode << m_partialSize;
-					m_partialSize += m_codeSize;
-					ClearCompressorTable();
-				}
+inline int StringTable::GetPixel(const BYTE *line, int x) const
+{
+	switch( m_bpp ) {
+		case 1:
+			return (line[x >> 3] >> (7 - (x & 7))) & 0x01;
+		case 4:
+			return (line[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0F;
+		default:
+			return line[x];
+	}
+}
 
-				// Only keep the 8 lowest bits (prevent problems with "negative chars")
-				m_prefix = ch & 0x000FF;
-			}
+inline void StringTable::PutCode(int code)
+{
+	m_bits |= (UINT64)code << m_bitCount;
+	m_bitCount += m_codeSize;
+	if( m_bitCount >= 32 ) {
+		//write a whole 32-bit word, least significant byte first
+		DWORD word = (DWORD)m_bits;
+#ifdef FREEIMAGE_BIGENDIAN
+		SwapLong(&word);
+#endif
+		memcpy(m_output + m_outputSize, &word, 4);
+		m_outputSize += 4;
+		m_bits >>= 32;
+		m_bitCount -= 32;
+	}
+}
 
-			//increment to the next pixel
-			if( m_bufferShift > 0 && !(m_bufferPos + 1 == m_bufferSize && m_bufferShift <= m_slack) ) {
-				m_bufferShift -= m_bpp;
-			} else {
-				m_bufferPos++;
-				m_bufferShift = 8 - m_bpp;
-			}
+void StringTable::Compress(const BYTE *line)
+{
+	int x = 0;
+	if( m_prefix < 0 ) {
+		// Specific behavior for the first pixel of the whole image
+		m_prefix = GetPixel(line, 0);
+		x = 1;
+	}
 
-			//jump out here if the output buffer is full
-			if( bufpos - buf == *len ) {
-				return true;
-			}
-		
-		} else {
-			// Specific behavior for the first pixel of the whole image
+	for( ; x < m_width; x++ ) {
+		const int ch = GetPixel(line, x);
 
-			firstPixelPassed=1;
-			// Only keep the 8 lowest bits (prevent problems with "negative chars")
-			m_prefix = ch & 0x000FF;
+		//look for the string <prefix><ch> in the table
+		const int key = (m_prefix << 8) | ch;
+		unsigned slot = ((unsigned)key * 2654435761U) >> (32 - LZW_HASH_BITS);
+		while( (m_hashKeys[slot] != key) && (m_hashKeys[slot] >= 0) ) {
+			slot = (slot + 1) & (LZW_HASH_SIZE - 1);
+		}
+		if( m_hashKeys[slot] == key ) {
+			m_prefix = m_hashCodes[slot];
+			continue;
+		}
 
-			//increment to the next pixel
-			if( m_bufferShift > 0 && !(m_bufferPos + 1 == m_bufferSize && m_bufferShift <= m_slack) ) {
-				m_bufferShift -= m_bpp;
-			} else {
-				m_bufferPos++;
-				m_bufferShift = 8 - m_bpp;
-			}
+		//not found: output the prefix and add the string to the table
+		PutCode(m_prefix);
+		m_hashKeys[slot] = key;
+		m_hashCodes[slot] = (WORD)m_nextCode;
 
-			//jump out here if the output buffer is full
-			if( bufpos - buf == *len ) {
-				return true;
-			}
+		//increment the next highest valid code, increase the code size
+		if( m_nextCode == (1 << m_codeSize) ) {
+			m_codeSize++;
 		}
-	}
+		m_nextCode++;
 
-	m_bufferSize = 0;
-	*len = (int)(bufpos - buf);
+		//if we're out of codes, restart the string table
+		if( m_nextCode == MAX_LZW_CODE ) {
+			PutCode(m_clearCode);
+			ClearCompressorTable();
+		}
 
-	return true;
+		m_prefix = ch;
+	}
 }
 
 bool StringTable::Decompress(BYTE *buf, int *len)
@@ -390,13 +487,24 @@ bool StringTable::Decompress(BYTE *buf, int *len)
 				ClearDecompressorTable();
 				continue;
 			}
+			if( m_oldCode == MAX_LZW_CODE && code >= m_clearCode ) {
+				//the first code after a clear code must be a character
+				m_done = true;
+				*len = (int)(bufpos - buf);
+				return true;
+			}
 
 			//add new string to string table, if not the first pass since a clear code
 			if( m_oldCode != MAX_LZW_CODE && m_nextCode < MAX_LZW_CODE) {
-				m_strings[m_nextCode] = m_strings[m_oldCode] + m_strings[code == m_nextCode ? m_oldCode : code][0];
+				m_prefixes[m_nextCode] = (WORD)m_oldCode;
+				m_suffixes[m_nextCode] = m_firstChars[code == m_nextCode ? m_oldCode : code];
+				m_firstChars[m_nextCode] = m_firstChars[m_oldCode];
+				m_lengths[m_nextCode] = (WORD)(m_lengths[m_oldCode] + 1);
 			}
 
-			if( (int)m_strings[code].size() > *len - (bufpos - buf) ) {
+			const int length = m_lengths[code];
+
+			if( length > *len - (bufpos - buf) ) {
 				//out of space, stuff the code back in for next time
 				m_partial <<= m_codeSize;
 				m_partialSize += m_codeSize;
@@ -406,9 +514,14 @@ bool StringTable::Decompress(BYTE *buf, int *len)
 				return true;
 			}
 
-			//output the string into the buffer
-			memcpy(bufpos, m_strings[code].data(), m_strings[code].size());
-			bufpos += m_strings[code].size();
+			//output the string into the buffer, from its last character to its first one
+			int prefix = code;
+			for( BYTE *out = bufpos + length - 1; out > bufpos; out-- ) {
+				*out = m_suffixes[prefix];
+				prefix = m_prefixes[prefix];
+			}
+			*bufpos = m_suffixes[prefix];
+			bufpos += length;
 
 			//increment the next highest valid code, add a bit to the mask if we need to increase the code size
 			if( m_oldCode != MAX_LZW_CODE && m_nextCode < MAX_LZW_CODE ) {
@@ -437,20 +550,19 @@ void StringTable::Done(void)
 
 void StringTable::ClearCompressorTable(void)
 {
-	if(m_strmap) {
-		memset(m_strmap, 0xFF, sizeof(unsigned int)*(1<<20));
-	}
+	memset(m_hashKeys, 0xFF, sizeof(m_hashKeys));
 	m_nextCode = m_endCode + 1;
 
-	m_prefix = 0;
 	m_codeSize = m_minCodeSize + 1;
 }
 
 void StringTable::ClearDecompressorTable(void)
 {
 	for( int i = 0; i < m_clearCode; i++ ) {
-		m_strings[i].resize(1);
-		m_strings[i][0] = (char)i;
+		m_prefixes[i] = (WORD)MAX_LZW_CODE;
+		m_suffixes[i] = (BYTE)i;
+		m_firstChars[i] = (BYTE)i;
+		m_lengths[i] = 1;
 	}
 	m_nextCode = m_endCode + 1;
 
@@ -459,6 +571,167 @@ void StringTable::ClearDecompressorTable(void)
 	m_oldCode = MAX_LZW_CODE;
 }
 
+// ==========================================================
+// Optimized save helpers (GIF_OPTIMIZE)
+// ==========================================================
+
+/**
+Returns TRUE if a page is opaque and covers the whole logical screen, 
+i.e. if it can be diffed against the previous one
+*/
+static BOOL 
+IsFullScreenPage(const GIFinfo *info, FIBITMAP *dib) {
+	FITAG *tag = NULL;
+	if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "FrameLeft", FIDT_SHORT, &tag) && (*(WORD *)FreeImage_GetTagValue(tag) != 0) ) {
+		return FALSE;
+	}
+	if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "FrameTop", FIDT_SHORT, &tag) && (*(WORD *)FreeImage_GetTagValue(tag) != 0) ) {
+		return FALSE;
+	}
+	return (FreeImage_GetWidth(dib) == (unsigned)info->logical_width) 
+		&& (FreeImage_GetHeight(dib) == (unsigned)info->logical_height) 
+		&& !FreeImage_IsTransparent(dib);
+}
+
+/**
+Keep a copy of the last full screen page written, reusing the previous copy when possible. 
+On allocation failure the copy is dropped and the next page is written in full.
+*/
+static void 
+StoreFrame(GIFinfo *info, FIBITMAP *dib) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bpp = FreeImage_GetBPP(dib);
+
+	FIBITMAP *canvas = info->canvas;
+	if( (canvas != NULL) && ((FreeImage_GetWidth(canvas) != width) || (FreeImage_GetHeight(canvas) != height) || (FreeImage_GetBPP(canvas) != bpp)) ) {
+		FreeImage_Unload(canvas);
+		canvas = NULL;
+	}
+	if( canvas == NULL ) {
+		canvas = FreeImage_Allocate(width, height, bpp);
+	}
+	if( canvas != NULL ) {
+		memcpy(FreeImage_GetBits(canvas), FreeImage_GetConstBits(dib), FreeImage_GetPitch(dib) * height);
+		memcpy(FreeImage_GetPalette(canvas), FreeImage_GetPalette(dib), FreeImage_GetColorsUsed(dib) * sizeof(RGBQUAD));
+	}
+	info->canvas = canvas;
+}
+
+/**
+Compare the colors of a pixel in two pages
+*/
+static inline BOOL 
+IsSamePixel(FIBITMAP *previous, FIBITMAP *dib, unsigned x, unsigned y) {
+	BYTE i0 = 0, i1 = 0;
+	FreeImage_GetPixelIndex(previous, x, y, &i0);
+	FreeImage_GetPixelIndex(dib, x, y, &i1);
+	const RGBQUAD *c0 = FreeImage_GetPalette(previous) + i0;
+	const RGBQUAD *c1 = FreeImage_GetPalette(dib) + i1;
+	return (c0->rgbRed == c1->rgbRed) && (c0->rgbGreen == c1->rgbGreen) && (c0->rgbBlue == c1->rgbBlue);
+}
+
+/**
+Build the frame written for a full screen page drawn over the previous one (disposal GIF_DISPOSAL_LEAVE): 
+the bounding rectangle of the changed pixels. For 8-bit pages, the unchanged pixels of that rectangle 
+are set to an index no changed pixel uses, which is marked transparent, so that LZW reduces them to long runs. 
+An unchanged page gives a single pixel frame.
+@return Returns the frame, with its FrameLeft / FrameTop metadata, or NULL if out of memory
+*/
+static FIBITMAP* 
+CreateDeltaFrame(FIBITMAP *previous, FIBITMAP *dib) {
+	const int width = (int)FreeImage_GetWidth(dib);
+	const int height = (int)FreeImage_GetHeight(dib);
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	const unsigned line = FreeImage_GetLine(dib);
+
+	//when both pages share the same palette, pixels can be compared by index
+	const BOOL same_palette = (FreeImage_GetBPP(previous) == bpp) && 
+		(memcmp(FreeImage_GetPalette(previous), FreeImage_GetPalette(dib), FreeImage_GetColorsUsed(dib) * sizeof(RGBQUAD)) == 0);
+
+	//bounding rectangle of the changed pixels, in scanline coordinates
+	int x0 = width, x1 = -1, y0 = height, y1 = -1;
+	for( int y = 0; y < height; y++ ) {
+		int first = -1, last = -1;
+		if( same_palette ) {
+			const BYTE *bits0 = FreeImage_GetConstScanLine(previous, y);
+			const BYTE *bits1 = FreeImage_GetConstScanLine(dib, y);
+			if( memcmp(bits0, bits1, line) == 0 ) {
+				continue;
+			}
+			unsigned i = 0, j = line - 1;
+			while( bits0[i] == bits1[i] ) i++;
+			while( bits0[j] == bits1[j] ) j--;
+			first = (int)((i * 8) / bpp);
+			last = MIN((int)(((j + 1) * 8) / bpp) - 1, width - 1);
+		} else {
+			for( int x = 0; x < width; x++ ) {
+				if( !IsSamePixel(previous, dib, x, y) ) {
+					if( first < 0 ) first = x;
+					last = x;
+				}
+			}
+			if( first < 0 ) {
+				continue;
+			}
+		}
+		x0 = MIN(x0, first);
+		x1 = MAX(x1, last);
+		y0 = MIN(y0, y);
+		y1 = y;
+	}
+	if( x1 < 0 ) {
+		x0 = x1 = 0;
+		y0 = y1 = height - 1;
+	}
+
+	FIBITMAP *delta = FreeImage_Copy(dib, x0, height - 1 - y1, x1 + 1, height - y0);
+	if( delta == NULL ) {
+		return NULL;
+	}
+	WORD left = (WORD)x0, top = (WORD)(height - 1 - y1);
+	FreeImage_SetMetadataEx(FIMD_ANIMATION, delta, "FrameLeft", ANIMTAG_FRAMELEFT, FIDT_SHORT, 1, 2, &left);
+	FreeImage_SetMetadataEx(FIMD_ANIMATION, delta, "FrameTop", ANIMTAG_FRAMETOP, FIDT_SHORT, 1, 2, &top);
+
+	if( bpp == 8 ) {
+		const int delta_width = x1 - x0 + 1;
+		const int delta_height = y1 - y0 + 1;
+
+		//find an index unused by the changed pixels
+		BYTE used[256];
+		memset(used, 0, sizeof(used));
+		for( int y = 0; y < delta_height; y++ ) {
+			const BYTE *bits0 = FreeImage_GetConstScanLine(previous, y0 + y) + x0;
+			const BYTE *bits = FreeImage_GetConstScanLine(delta, y);
+			for( int x = 0; x < delta_width; x++ ) {
+				if( same_palette ? (bits0[x] != bits[x]) : !IsSamePixel(previous, dib, x0 + x, y0 + y) ) {
+					used[bits[x]] = 1;
+				}
+			}
+		}
+		int transparent_index = 0;
+		while( (transparent_index < 256) && used[transparent_index] ) {
+			transparent_index++;
+		}
+
+		//replace the unchanged pixels
+		if( transparent_index < 256 ) {
+			for( int y = 0; y < delta_height; y++ ) {
+				const BYTE *bits0 = FreeImage_GetConstScanLine(previous, y0 + y) + x0;
+				BYTE *bits = FreeImage_GetScanLine(delta, y);
+				for( int x = 0; x < delta_width; x++ ) {
+					if( same_palette ? (bits0[x] == bits[x]) : IsSamePixel(previous, dib, x0 + x, y0 + y) ) {
+						bits[x] = (BYTE)transparent_index;
+					}
+				}
+			}
+			FreeImage_SetTransparentIndex(delta, transparent_index);
+		}
+	}
+
+	return delta;
+}
+
 // ==========================================================
 // Plugin Interface
 // ==========================================================
@@ -510,6 +783,19 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE GIF89a[] = { 0x47, 0x49, 0x46, 0x38, 0x39, 0x61 };
+	static const BYTE GIF87a[] = { 0x47, 0x49, 0x46, 0x38, 0x37, 0x61 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(GIF89a), GIF89a, NULL },
+		{ sizeof(GIF87a), GIF87a, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV 
 SupportsExportDepth(int depth) {
 	return	(depth == 1) ||
@@ -522,6 +808,15 @@ SupportsExportType(FREE_IMAGE_TYPE type) {
 	return (type == FIT_BITMAP) ? TRUE : FALSE;
 }
 
+/**
+Open indexes the whole file and Load only seeks to absolute offsets. 
+Keeping the data also keeps the GIF_PLAYBACK canvas, which makes sequential playback linear.
+*/
+static BOOL DLL_CALLCONV 
+KeepsLoadData() {
+	return TRUE;
+}
+
 // ----------------------------------------------------------
 
 static void *DLL_CALLCONV 
@@ -629,6 +924,8 @@ Open(FreeImageIO *io, fi_handle handle, BOOL read) {
 	return info;
 }
 
+static BOOL SavePendingPage(FreeImageIO *io, fi_handle handle, GIFinfo *info, BOOL next_full_screen);
+
 static void DLL_CALLCONV 
 Close(FreeImageIO *io, fi_handle handle, void *data) {
 	if( data == NULL ) {
@@ -637,6 +934,14 @@ Close(FreeImageIO *io, fi_handle handle, void *data) {
 	GIFinfo *info = (GIFinfo *)data;
 
 	if( !info->read ) {
+		//last page of a GIF_OPTIMIZE multipage save: 
+		//Close can't return an error, report it and leave the file without a trailer
+		if( !SavePendingPage(io, handle, info, FALSE) ) {
+			FreeImage_OutputMessageProc(s_format_id, "Failed to write the last page");
+			delete info;
+			return;
+		}
+
 		//Trailer
 		BYTE b = GIF_BLOCK_TRAILER;
 		io->write_proc(&b, 1, 1, handle);
@@ -702,31 +1007,25 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			}
 			background.rgbReserved = 0;
 
-			//allocate entire logical area
-			dib = FreeImage_Allocate(logicalwidth, logicalheight, 32);
-			if( dib == NULL ) {
-				throw FI_MSG_ERROR_DIB_MEMORY;
-			}
-
-			//fill with background color to start
-			int x, y;
-			RGBQUAD *scanline;
-			for( y = 0; y < logicalheight; y++ ) {
-				scanline = (RGBQUAD *)FreeImage_GetScanLine(dib, y);
-				for( x = 0; x < logicalwidth; x++ ) {
-					*scanline++ = background;
-				}
-			}
+			//the canvas kept by a previous call can be used if this page comes after it
+			GIFinfo *gifinfo = info;
+			const BOOL canvas_usable = (gifinfo->canvas != NULL) && (gifinfo->canvas_page <= page) 
+				&& (FreeImage_GetWidth(gifinfo->canvas) == logicalwidth) && (FreeImage_GetHeight(gifinfo->canvas) == logicalheight);
 
 			//cache some info about each of the pages so we can avoid decoding as many of them as possible
 			std::vector<PageInfo> pageinfo;
 			int start = page, end = page;
 			while( start >= 0 ) {
 				//Graphic Control Extension
-				io->seek_proc(handle, (long)(info->graphic_control_extension_offsets[start] + 1), SEEK_SET);
-				io->read_proc(&packed, 1, 1, handle);
-				have_transparent = (packed & GIF_PACKED_GCE_HAVETRANS) ? true : false;
-				disposal_method = (packed & GIF_PACKED_GCE_DISPOSAL) >> 2;
+				if( info->graphic_control_extension_offsets[start] != 0 ) {
+					io->seek_proc(handle, (long)(info->graphic_control_extension_offsets[start] + 1), SEEK_SET);
+					io->read_proc(&packed, 1, 1, handle);
+					have_transparent = (packed & GIF_PACKED_GCE_HAVETRANS) ? true : false;
+					disposal_method = (packed & GIF_PACKED_GCE_DISPOSAL) >> 2;
+				} else {
+					have_transparent = false;
+					disposal_method = GIF_DISPOSAL_UNSPECIFIED;
+				}
 				//Image Descriptor
 				io->seek_proc(handle, (long)(info->image_descriptor_offsets[start]), SEEK_SET);
 				io->read_proc(&left, 2, 1, handle);
@@ -742,6 +1041,10 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 				pageinfo.push_back(PageInfo(disposal_method, left, top, width, height));
 
+				if( canvas_usable && start == gifinfo->canvas_page ) {
+					//everything before this page is already composited
+					break;
+				}
 				if( start != end ) {
 					if( left == 0 && top == 0 && width == logicalwidth && height == logicalheight ) {
 						if( disposal_method == GIF_DISPOSAL_BACKGROUND ) {
@@ -761,6 +1064,32 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				start = 0;
 			}
 
+			int x, y;
+			RGBQUAD *scanline;
+
+			if( canvas_usable && start == gifinfo->canvas_page ) {
+				//start from the kept canvas
+				dib = FreeImage_Allocate(logicalwidth, logicalheight, 32);
+				if( dib == NULL ) {
+					throw FI_MSG_ERROR_DIB_MEMORY;
+				}
+				memcpy(FreeImage_GetBits(dib), FreeImage_GetBits(gifinfo->canvas), FreeImage_GetPitch(dib) * logicalheight);
+			} else {
+				//allocate entire logical area
+				dib = FreeImage_Allocate(logicalwidth, logicalheight, 32);
+				if( dib == NULL ) {
+					throw FI_MSG_ERROR_DIB_MEMORY;
+				}
+
+				//fill with background color to start
+				for( y = 0; y < logicalheight; y++ ) {
+					scanline = (RGBQUAD *)FreeImage_GetScanLine(dib, y);
+					for( x = 0; x < logicalwidth; x++ ) {
+						*scanline++ = background;
+					}
+				}
+			}
+
 			//draw each page into the logical area
 			delay_time = 0;
 			for( page = start; page <= end; page++ ) {
@@ -771,18 +1100,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 						continue;
 					}
 					if( info.disposal_method == GIF_DISPOSAL_BACKGROUND ) {
-						for( y = 0; y < info.height; y++ ) {
-							const int scanidx = logicalheight - (y + info.top) - 1;
-							if ( scanidx < 0 ) {
-								break;  // If data is corrupt, don't calculate in invalid scanline
-							}
-							scanline = (RGBQUAD *)FreeImage_GetScanLine(dib, scanidx) + info.left;
-							for( x = 0; x < info.width; x++ ) {
-								*scanline++ = background;
-							}
-						}
+						ClearFrameArea(dib, info, background);
 						continue;
 					}
+				} else if( info.disposal_method == GIF_DISPOSAL_PREVIOUS ) {
+					//the next page will be drawn on what is there before this one
+					StoreCanvas(gifinfo, dib, end + 1);
 				}
 
 				//decode page
@@ -829,6 +1152,15 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				}
 			}
 
+			//keep the canvas the next page will be drawn on, so that sequential playback 
+			//only decodes one frame per page
+			if( pageinfo[0].disposal_method != GIF_DISPOSAL_PREVIOUS ) {
+				StoreCanvas(gifinfo, dib, end + 1);
+				if( (pageinfo[0].disposal_method == GIF_DISPOSAL_BACKGROUND) && (gifinfo->canvas != NULL) ) {
+					ClearFrameArea(gifinfo->canvas, pageinfo[0], background);
+				}
+			}
+
 			//setup frame time
 			FreeImage_SetMetadataEx(FIMD_ANIMATION, dib, "FrameTime", ANIMTAG_FRAMETIME, FIDT_LONG, 1, 4, &delay_time);
 			return dib;
@@ -911,7 +1243,11 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 		//LZW Minimum Code Size
 		io->read_proc(&b, 1, 1, handle);
-		StringTable *stringtable = new(std::nothrow) StringTable;
+		if( b > 11 ) {
+			//the clear and end codes must fit in the 12-bit string table
+			throw "Invalid LZW minimum code size";
+		}
+		StringTable *stringtable = GetStringTable(info);
 		stringtable->Initialize(b);
 
 		//Image Data Sub-blocks
@@ -1058,8 +1394,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		b = (BYTE)disposal_method;
 		FreeImage_SetMetadataEx(FIMD_ANIMATION, dib, "DisposalMethod", ANIMTAG_DISPOSALMETHOD, FIDT_BYTE, 1, 1, &b);
 
-		delete stringtable;
-
 	} catch (const char *msg) {
 		if( dib != NULL ) {
 			FreeImage_Unload(dib);
@@ -1071,16 +1405,37 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return dib;
 }
 
-static BOOL DLL_CALLCONV 
-Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
-	if( data == NULL ) {
-		return FALSE;
+/**
+Write the compressed data as 255 bytes sub-blocks. 
+The last, shorter, sub-block is only written when flushing the end of the image.
+*/
+static void 
+WriteSubBlocks(FreeImageIO *io, fi_handle handle, StringTable *stringtable, BOOL flush) {
+	BYTE *output = stringtable->GetOutput();
+	const int size = stringtable->GetOutputSize();
+	int pos = 0;
+	BYTE b = 255; //255 is the max sub-block length
+	while( size - pos >= 255 ) {
+		io->write_proc(&b, 1, 1, handle);
+		io->write_proc(output + pos, 255, 1, handle);
+		pos += 255;
 	}
-	//GIFinfo *info = (GIFinfo *)data;
-
-	if( page == -1 ) {
-		page = 0;
+	if( flush && (pos < size) ) {
+		b = (BYTE)(size - pos);
+		io->write_proc(&b, 1, 1, handle);
+		io->write_proc(output + pos, b, 1, handle);
+		pos = size;
 	}
+	stringtable->ConsumeOutput(pos);
+}
+
+/**
+Write a page
+@param next_full_screen GIF_OPTIMIZE only: TRUE if the next page is an opaque full screen page
+*/
+static BOOL 
+SavePage(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, GIFinfo *info, BOOL next_full_screen) {
+	FIBITMAP *delta = NULL;
 
 	try {
 		BYTE packed, b;
@@ -1092,8 +1447,41 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			throw "Only 1, 4, or 8 bpp images supported";
 		}
 
+		int disposal_method = GIF_DISPOSAL_BACKGROUND;
+		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "DisposalMethod", FIDT_BYTE, &tag) ) {
+			disposal_method = *(BYTE *)FreeImage_GetTagValue(tag);
+		}
+
+		//opaque full screen pages are written as the difference with the previous one
+		if( (flags & GIF_OPTIMIZE) == GIF_OPTIMIZE ) {
+			if( IsFullScreenPage(info, dib) ) {
+				//a canvas is only kept when this page is drawn over the previous one (see below), 
+				//and a page cleared to the background color is only a delta frame when the next page covers it
+				if( (page > 0) && (info->canvas != NULL) && (next_full_screen || (disposal_method != GIF_DISPOSAL_BACKGROUND)) ) {
+					delta = CreateDeltaFrame(info->canvas, dib);
+					if( delta == NULL ) {
+						throw FI_MSG_ERROR_MEMORY;
+					}
+				}
+				if( next_full_screen ) {
+					//the next page hides the disposal of this one: leave it, so that the next page can be a delta frame
+					disposal_method = GIF_DISPOSAL_LEAVE;
+					StoreFrame(info, dib);
+				} else if( info->canvas != NULL ) {
+					FreeImage_Unload(info->canvas);
+					info->canvas = NULL;
+				}
+			} else if( info->canvas != NULL ) {
+				FreeImage_Unload(info->canvas);
+				info->canvas = NULL;
+			}
+			if( delta != NULL ) {
+				dib = delta;
+			}
+		}
+
 		bool have_transparent = false, no_local_palette = false, interlaced = false;
-		int disposal_method = GIF_DISPOSAL_BACKGROUND, delay_time = 100, transparent_color = 0;
+		int delay_time = 100, transparent_color = 0;
 		WORD left = 0, top = 0, width = (WORD)FreeImage_GetWidth(dib), height = (WORD)FreeImage_GetHeight(dib);
 		WORD output_height = height;
 		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "FrameLeft", FIDT_SHORT, &tag) ) {
@@ -1111,9 +1499,6 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "FrameTime", FIDT_LONG, &tag) ) {
 			delay_time = *(LONG *)FreeImage_GetTagValue(tag);
 		}
-		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "DisposalMethod", FIDT_BYTE, &tag) ) {
-			disposal_method = *(BYTE *)FreeImage_GetTagValue(tag);
-		}
 
 		RGBQUAD *pal = FreeImage_GetPalette(dib);
 #ifdef FREEIMAGE_BIGENDIAN
@@ -1312,28 +1697,15 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		//LZW Minimum Code Size
 		b = (BYTE)(bpp == 1 ? 2 : bpp);
 		io->write_proc(&b, 1, 1, handle);
-		StringTable *stringtable = new(std::nothrow) StringTable;
+		StringTable *stringtable = GetStringTable(info);
 		stringtable->Initialize(b);
-		stringtable->CompressStart(bpp, width);
+		stringtable->CompressStart(bpp, (int)FreeImage_GetWidth(dib));
 
 		//Image Data Sub-blocks
-		int y = 0, interlacepass = 0, line = FreeImage_GetLine(dib);
-		BYTE buf[255], *bufptr = buf; //255 is the max sub-block length
-		int size = sizeof(buf);
-		b = sizeof(buf);
+		int y = 0, interlacepass = 0;
 		while( y < output_height ) {
-			memcpy(stringtable->FillInputBuffer(line), FreeImage_GetScanLine(dib, output_height - y - 1), line);
-			while( stringtable->Compress(bufptr, &size) ) {
-				bufptr += size;
-				if( bufptr - buf == sizeof(buf) ) {
-					io->write_proc(&b, 1, 1, handle);
-					io->write_proc(buf, sizeof(buf), 1, handle);
-					size = sizeof(buf);
-					bufptr = buf;
-				} else {
-					size = (int)(sizeof(buf) - (bufptr - buf));
-				}
-			}
+			stringtable->Compress(FreeImage_GetConstScanLine(dib, output_height - y - 1));
+			WriteSubBlocks(io, handle, stringtable, FALSE);
 			if( interlaced ) {
 				y += g_GifInterlaceIncrement[interlacepass];
 				if( y >= output_height && ++interlacepass < GIF_INTERLACE_PASSES ) {
@@ -1343,35 +1715,23 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 				y++;
 			}
 		}
-		size = (int)(bufptr - buf);
-		BYTE last[4];
-		w = (WORD)stringtable->CompressEnd(last);
-		if( size + w >= sizeof(buf) ) {
-			//one last full size sub-block
-			io->write_proc(&b, 1, 1, handle);
-			io->write_proc(buf, size, 1, handle);
-			io->write_proc(last, sizeof(buf) - size, 1, handle);
-			//and possibly a tiny additional sub-block
-			b = (BYTE)(w - (sizeof(buf) - size));
-			if( b > 0 ) {
-				io->write_proc(&b, 1, 1, handle);
-				io->write_proc(last + w - b, b, 1, handle);
-			}
-		} else {
-			//last sub-block less than full size
-			b = (BYTE)(size + w);
-			io->write_proc(&b, 1, 1, handle);
-			io->write_proc(buf, size, 1, handle);
-			io->write_proc(last, w, 1, handle);
-		}
+		stringtable->CompressEnd();
+		WriteSubBlocks(io, handle, stringtable, TRUE);
 
 		//Block Terminator
 		b = 0;
-		io->write_proc(&b, 1, 1, handle);
+		if( io->write_proc(&b, 1, 1, handle) != 1 ) {
+			throw "Failed to write the image data";
+		}
 
-		delete stringtable;
+		if( delta != NULL ) {
+			FreeImage_Unload(delta);
+		}
 
 	} catch (const char *msg) {
+		if( delta != NULL ) {
+			FreeImage_Unload(delta);
+		}
 		FreeImage_OutputMessageProc(s_format_id, msg);
 		return FALSE;
 	}
@@ -1379,6 +1739,79 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 	return TRUE;
 }
 
+/**
+Write the page kept by a GIF_OPTIMIZE save, if any
+@param next_full_screen TRUE if the next page is an opaque full screen page
+*/
+static BOOL 
+SavePendingPage(FreeImageIO *io, fi_handle handle, GIFinfo *info, BOOL next_full_screen) {
+	BOOL bSuccess = TRUE;
+	if( info->pending != NULL ) {
+		bSuccess = SavePage(io, info->pending, handle, info->pending_page, info->pending_flags, info, next_full_screen);
+		FreeImage_Unload(info->pending);
+		info->pending = NULL;
+		if( !bSuccess ) {
+			info->failed = TRUE;
+		}
+	}
+	return bSuccess;
+}
+
+static BOOL DLL_CALLCONV 
+Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
+	if( data == NULL ) {
+		return FALSE;
+	}
+	GIFinfo *info = (GIFinfo *)data;
+
+	if( info->failed ) {
+		return FALSE;
+	}
+
+	//FreeImage_Save: the page is the only one, write it now
+	if( page == -1 ) {
+		return SavePage(io, dib, handle, 0, flags, info, FALSE);
+	}
+
+	if( (flags & GIF_OPTIMIZE) != GIF_OPTIMIZE ) {
+		return SavePage(io, dib, handle, page, flags, info, FALSE);
+	}
+
+	//GIF_OPTIMIZE multipage save: a page is written once the next one is known (or when the file is closed), 
+	//so that its disposal method is only changed when the next page covers the whole logical screen
+	const int bpp = FreeImage_GetBPP(dib);
+	if( bpp != 1 && bpp != 4 && bpp != 8 ) {
+		FreeImage_OutputMessageProc(s_format_id, "Only 1, 4, or 8 bpp images supported");
+		return FALSE;
+	}
+	if( page == 0 ) {
+		FITAG *tag = NULL;
+		info->logical_width = (int)FreeImage_GetWidth(dib);
+		info->logical_height = (int)FreeImage_GetHeight(dib);
+		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "LogicalWidth", FIDT_SHORT, &tag) ) {
+			info->logical_width = *(WORD *)FreeImage_GetTagValue(tag);
+		}
+		if( FreeImage_GetMetadataEx(FIMD_ANIMATION, dib, "LogicalHeight", FIDT_SHORT, &tag) ) {
+			info->logical_height = *(WORD *)FreeImage_GetTagValue(tag);
+		}
+	}
+
+	if( !SavePendingPage(io, handle, info, IsFullScreenPage(info, dib)) ) {
+		return FALSE;
+	}
+
+	info->pending = FreeImage_Clone(dib);
+	if( info->pending == NULL ) {
+		info->failed = TRUE;
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		return FALSE;
+	}
+	info->pending_page = page;
+	info->pending_flags = flags;
+
+	return TRUE;
+}
+
 // ==========================================================
 //   Init
 // ==========================================================
@@ -1402,4 +1835,6 @@ InitGIF(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->keeps_load_data_proc = KeepsLoadData;
 }
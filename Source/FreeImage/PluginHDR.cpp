@@ -606,6 +606,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(hdr_signature, signature, 2) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE hdr_signature[] = { '#', '?' };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(hdr_signature), hdr_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -678,6 +689,138 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return dib;
 }
 
+/**
+Scanline decoder state
+*/
+typedef struct tagScanlineDecoder {
+	unsigned width;
+	/// TRUE once a row could not be read
+	BOOL failed;
+} ScanlineDecoder;
+
+static void * DLL_CALLCONV
+OpenScanlines(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header) {
+	if(!handle) {
+		return NULL;
+	}
+
+	rgbeHeaderInfo header_info;
+	unsigned width, height;
+
+	// Read the header
+	if(rgbe_ReadHeader(io, handle, &width, &height, &header_info) == FALSE) {
+		return NULL;
+	}
+
+	ScanlineDecoder *decoder = (ScanlineDecoder*)malloc(sizeof(ScanlineDecoder));
+	*header = FreeImage_AllocateHeaderT(TRUE, FIT_RGBF, width, height);
+	if(!decoder || !*header) {
+		free(decoder);
+		FreeImage_Unload(*header);
+		*header = NULL;
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		return NULL;
+	}
+
+	// set the metadata as comments
+	rgbe_ReadMetadata(*header, &header_info);
+
+	decoder->width = width;
+	decoder->failed = FALSE;
+
+	return decoder;
+}
+
+static unsigned DLL_CALLCONV
+ReadScanlines(FreeImageIO *io, fi_handle handle, void *reader, BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
+
+	unsigned rows = 0;
+
+	for(; (rows < count) && !decoder->failed; rows++) {
+		if(!rgbe_ReadPixels_RLE(io, handle, (FIRGBF*)(bits + (size_t)rows * pitch), decoder->width, 1)) {
+			decoder->failed = TRUE;
+			break;
+		}
+	}
+
+	return rows;
+}
+
+static void DLL_CALLCONV
+CloseScanlines(FreeImageIO *io, fi_handle handle, void *reader) {
+	free(reader);
+}
+
+/**
+Scanline encoder state
+*/
+typedef struct tagScanlineEncoder {
+	unsigned width;
+	unsigned height;
+	/// number of rows written so far
+	unsigned rows;
+	/// TRUE once a row could not be written
+	BOOL failed;
+} ScanlineEncoder;
+
+static void * DLL_CALLCONV
+CreateScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *header, int page, int flags, void *data) {
+	if(!header || (FreeImage_GetImageType(header) != FIT_RGBF)) {
+		// let Save report the error
+		return NULL;
+	}
+
+	ScanlineEncoder *encoder = (ScanlineEncoder*)malloc(sizeof(ScanlineEncoder));
+	if(!encoder) {
+		return NULL;
+	}
+	encoder->width = FreeImage_GetWidth(header);
+	encoder->height = FreeImage_GetHeight(header);
+	encoder->rows = 0;
+	encoder->failed = FALSE;
+
+	// write the header (same as Save)
+
+	rgbeHeaderInfo header_info;
+	memset(&header_info, 0, sizeof(rgbeHeaderInfo));
+	rgbe_WriteMetadata(header, &header_info);
+	sprintf(header_info.comment, "# Made with FreeImage %s", FreeImage_GetVersion());
+	if(!rgbe_WriteHeader(io, handle, encoder->width, encoder->height, &header_info)) {
+		// the header may be partially written: don't fall back to Save
+		encoder->failed = TRUE;
+	}
+
+	return encoder;
+}
+
+static unsigned DLL_CALLCONV
+WriteScanlines(FreeImageIO *io, fi_handle handle, void *writer, const BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+
+	unsigned rows = 0;
+
+	for(; (rows < count) && (encoder->rows < encoder->height) && !encoder->failed; rows++, encoder->rows++) {
+		if(!rgbe_WritePixels_RLE(io, handle, (FIRGBF*)(bits + (size_t)rows * pitch), encoder->width, 1)) {
+			encoder->failed = TRUE;
+			break;
+		}
+	}
+
+	return rows;
+}
+
+static BOOL DLL_CALLCONV
+FinishScanlines(FreeImageIO *io, fi_handle handle, void *writer) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+
+	const BOOL bResult = (!encoder->failed && (encoder->rows == encoder->height)) ? TRUE : FALSE;
+
+	free(encoder);
+
+	return bResult;
+}
+
 static BOOL DLL_CALLCONV
 Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
 	if(!dib) return FALSE;
@@ -739,4 +882,11 @@ InitHDR(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->open_scanlines_proc = OpenScanlines;
+	plugin->read_scanlines_proc = ReadScanlines;
+	plugin->close_scanlines_proc = CloseScanlines;
+	plugin->create_scanlines_proc = CreateScanlines;
+	plugin->write_scanlines_proc = WriteScanlines;
+	plugin->finish_scanlines_proc = FinishScanlines;
 }
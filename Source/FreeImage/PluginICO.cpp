@@ -210,6 +210,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return ((icon_header.idReserved == 0) && (icon_header.idType == 1) && (icon_header.idCount > 0));
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE ico_signature[] = { 0x00, 0x00, 0x01, 0x00 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(ico_signature), ico_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -454,6 +465,62 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return NULL;
 }
 
+/**
+Reduced-resolution loading: load the smallest icon still covering the box 
+(or the largest icon if none does), preferring the deepest icon for a given size
+*/
+static FIBITMAP * DLL_CALLCONV
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
+	ICONHEADER *icon_header = (ICONHEADER*)data;
+
+	if ((page == -1) && handle && icon_header && (icon_header->idCount > 1)) {
+		// load the icon descriptions
+		ICONDIRENTRY *icon_list = (ICONDIRENTRY*)malloc(icon_header->idCount * sizeof(ICONDIRENTRY));
+		if(icon_list == NULL) {
+			return NULL;
+		}
+		io->seek_proc(handle, sizeof(ICONHEADER), SEEK_SET);
+		io->read_proc(icon_list, icon_header->idCount * sizeof(ICONDIRENTRY), 1, handle);
+#ifdef FREEIMAGE_BIGENDIAN
+		SwapIconDirEntries(icon_list, icon_header->idCount);
+#endif
+
+		int best = -1;
+		BOOL best_covers = FALSE;
+		unsigned best_area = 0;
+
+		for (int i = 0; i < icon_header->idCount; i++) {
+			// a 0 size means 256 pixels (or more, for PNG icons)
+			const unsigned width = icon_list[i].bWidth ? icon_list[i].bWidth : 256;
+			const unsigned height = icon_list[i].bHeight ? icon_list[i].bHeight : 256;
+			const unsigned area = width * height;
+			const BOOL covers = ((max_width > 0) && (width >= (unsigned)max_width)) || ((max_height > 0) && (height >= (unsigned)max_height));
+
+			BOOL better = FALSE;
+			if (best == -1) {
+				better = TRUE;
+			} else if (covers != best_covers) {
+				better = covers;
+			} else if (area != best_area) {
+				better = covers ? (area < best_area) : (area > best_area);
+			} else {
+				better = (icon_list[i].wBitCount > icon_list[best].wBitCount);
+			}
+			if (better) {
+				best = i;
+				best_covers = covers;
+				best_area = area;
+			}
+		}
+
+		free(icon_list);
+
+		page = best;
+	}
+
+	return Load(io, handle, page, flags, data);
+}
+
 // ----------------------------------------------------------
 
 static BOOL 
@@ -821,4 +888,6 @@ InitICO(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_scaled_proc = LoadScaled;
 }
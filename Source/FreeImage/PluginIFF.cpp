@@ -182,6 +182,21 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (type == ID_ILBM) || (type == ID_PBM);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	// chunk size (bytes 4 to 7) is ignored
+	static const BYTE form_mask[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+	static const BYTE ilbm_signature[] = { 'F', 'O', 'R', 'M', 0, 0, 0, 0, 'I', 'L', 'B', 'M' };
+	static const BYTE pbm_signature[] = { 'F', 'O', 'R', 'M', 0, 0, 0, 0, 'P', 'B', 'M', ' ' };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(ilbm_signature), ilbm_signature, form_mask },
+		{ sizeof(pbm_signature), pbm_signature, form_mask }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
@@ -456,4 +471,5 @@ InitIFF(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -80,6 +80,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(jng_signature, signature, JNG_SIGNATURE_SIZE) == 0) ? TRUE : FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE jng_signature[] = { 139, 74, 78, 71, 13, 10, 26, 10 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(jng_signature), jng_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -159,4 +170,5 @@ InitJNG(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
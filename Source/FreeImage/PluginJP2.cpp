@@ -88,6 +88,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(jp2_signature, signature, sizeof(jp2_signature)) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE jp2_signature[] = { 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(jp2_signature), jp2_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -125,8 +136,14 @@ Close(FreeImageIO *io, fi_handle handle, void *data) {
 
 // ----------------------------------------------------------
 
-static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+/**
+Decode an image
+@param max_width Reduced-resolution decoding box width (see LoadScaled)
+@param max_height Reduced-resolution decoding box height (see LoadScaled)
+@param region Left, top, right and bottom bounds of the region to decode, NULL to decode the whole image
+*/
+static FIBITMAP *
+DecodeImage(FreeImageIO *io, fi_handle handle, int flags, void *data, int max_width, int max_height, const int *region) {
 	J2KFIO_t *fio = (J2KFIO_t*)data;
 	if (handle && fio) {
 		opj_codec_t *d_codec = NULL;	// handle to a decompressor
@@ -144,10 +161,14 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 		// get the OpenJPEG stream
 		opj_stream_t *d_stream = fio->stream;
+		const long start = io->tell_proc(handle);
 
 		// set decoding parameters to default values 
 		opj_set_default_decoder_parameters(&parameters);
 
+		// decode only the first quality layers if requested with JP2_LAYERS (0 decodes all layers)
+		parameters.cp_layer = (OPJ_UINT32)((flags >> 5) & 0xFF);
+
 		try {
 			// decode the JPEG-2000 file
 
@@ -170,6 +191,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				throw "Failed to read the header\n";
 			}
 
+			// discard the highest resolution levels if requested with JP2_REDUCE
+			unsigned level = 0;
+			if(!region) {
+				level = J2KSetReduceLevel(d_codec, image, (unsigned)(flags & 0x1F));
+			}
+
 			// --- header only mode
 
 			if (header_only) {
@@ -184,9 +211,26 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				return dib;
 			}
 
-			// decode the stream and fill the image structure 
-			if( !( opj_decode(d_codec, d_stream, image) && opj_end_decompress(d_codec, d_stream) ) ) {
-				throw "Failed to decode image!\n";
+			if(region) {
+				// decode only the tiles intersecting the region
+				if(!J2KSetDecodeArea(d_codec, image, region[0], region[1], region[2], region[3])) {
+					opj_destroy_codec(d_codec);
+					opj_image_destroy(image);
+					return NULL;
+				}
+			} else if(level == 0) {
+				// discard the resolution levels not needed for a reduced-resolution loading
+				level = J2KSetReduceFactor(d_codec, image, max_width, max_height);
+			}
+
+			// decode the tiles of a tiled codestream on the worker threads, 
+			// otherwise decode the stream and fill the image structure 
+			const BOOL bParallel = !region && (FreeImage_GetThreadCount() > 1) 
+				&& J2KDecodeTiles(OPJ_CODEC_JP2, io, handle, start, &parameters, d_codec, image, level, jp2_warning_callback);
+			if(!bParallel) {
+				if( !( opj_decode(d_codec, d_stream, image) && opj_end_decompress(d_codec, d_stream) ) ) {
+					throw "Failed to decode image!\n";
+				}
 			}
 
 			// free the codec context
@@ -221,6 +265,22 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return NULL;
 }
 
+static FIBITMAP * DLL_CALLCONV
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
+	return DecodeImage(io, handle, flags, data, max_width, max_height, NULL);
+}
+
+static FIBITMAP * DLL_CALLCONV
+LoadRegion(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int left, int top, int right, int bottom) {
+	const int region[4] = { left, top, right, bottom };
+	return DecodeImage(io, handle, flags, data, 0, 0, region);
+}
+
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return DecodeImage(io, handle, flags, data, 0, 0, NULL);
+}
+
 static BOOL DLL_CALLCONV
 Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
 	J2KFIO_t *fio = (J2KFIO_t*)data;
@@ -239,15 +299,14 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		try {
 			parameters.tcp_numlayers = 0;
 			// if no rate entered, apply a 16:1 rate by default
-			if(flags == JP2_DEFAULT) {
-				parameters.tcp_rates[0] = (float)16;
-			} else {
-				// for now, the flags parameter is only used to specify the rate
-				parameters.tcp_rates[0] = (float)(flags & 0x3FF);
-			}
+			const int rate = flags & 0x3FF;
+			parameters.tcp_rates[0] = (float)(rate ? rate : 16);
 			parameters.tcp_numlayers++;
 			parameters.cp_disto_alloc = 1;
 
+			// save as tiles if requested with JP2_TILESIZE
+			J2KSetTileSize(&parameters, dib, ((flags >> 10) & 0xFF) << 5);
+
 			// convert the dib to a OpenJPEG image
 			image = FIBITMAPToJ2KImage(s_format_id, dib, &parameters);
 			if(!image) {
@@ -325,4 +384,7 @@ InitJP2(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_scaled_proc = LoadScaled;
+	plugin->load_region_proc = LoadRegion;
 }
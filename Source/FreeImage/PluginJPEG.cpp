@@ -1085,6 +1085,338 @@ store_size_info(FIBITMAP *dib, JDIMENSION width, JDIMENSION height) {
 	}
 }
 
+// ------------------------------------------------------------
+//   Decompression setup shared by the image and scanline loaders
+// ------------------------------------------------------------
+
+/**
+Set the decompression parameters according to the load flags
+@param cinfo Decompressor, after jpeg_read_header
+@param flags Load flags
+@param max_width Reduced-resolution box width (<= 0 if unconstrained)
+@param max_height Reduced-resolution box height (<= 0 if unconstrained)
+@return Returns the scaling denominator
+*/
+static unsigned
+SetDecompressParameters(j_decompress_ptr cinfo, int flags, int max_width, int max_height) {
+	unsigned scale_denom = 1;		// fraction by which to scale image
+	int	requested_size = flags >> 16;	// requested user size in pixels
+	if((max_width > 0) || (max_height > 0)) {
+		// reduced-resolution loading: use the largest x2, x4 or x8 scaling still covering the box
+		unsigned level = CalculateFitReductionLevel(cinfo->image_width, cinfo->image_height, max_width, max_height, 3);
+		if((flags & JPEG_EXIFROTATE) == JPEG_EXIFROTATE) {
+			// the image may be rotated by 90 degrees later on
+			level = MIN(level, CalculateFitReductionLevel(cinfo->image_width, cinfo->image_height, max_height, max_width, 3));
+		}
+		scale_denom = 1 << level;
+	}
+	else if(requested_size > 0) {
+		// the JPEG codec can perform x2, x4 or x8 scaling on loading
+		// try to find the more appropriate scaling according to user's need
+		double scale = MAX((double)cinfo->image_width, (double)cinfo->image_height) / (double)requested_size;
+		if(scale >= 8) {
+			scale_denom = 8;
+		} else if(scale >= 4) {
+			scale_denom = 4;
+		} else if(scale >= 2) {
+			scale_denom = 2;
+		}
+	}
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = scale_denom;
+
+	if ((flags & JPEG_ACCURATE) != JPEG_ACCURATE) {
+		cinfo->dct_method          = JDCT_IFAST;
+		cinfo->do_fancy_upsampling = FALSE;
+	}
+
+	if ((flags & JPEG_GREYSCALE) == JPEG_GREYSCALE) {
+		// force loading as a 8-bit greyscale image
+		cinfo->out_color_space = JCS_GRAYSCALE;
+	}
+
+	return scale_denom;
+}
+
+/**
+Allocate the image receiving the decompressed rows and fill its header (resolution, special markers)
+@param cinfo Decompressor, after jpeg_start_decompress
+@param flags Load flags
+@param scale_denom Scaling denominator
+@param header_only TRUE to allocate a header-only image
+@return Returns the image, throws an error message otherwise
+*/
+static FIBITMAP *
+AllocateDecompressedImage(j_decompress_ptr cinfo, int flags, unsigned scale_denom, BOOL header_only) {
+	FIBITMAP *dib = NULL;
+
+	if((cinfo->output_components == 4) && (cinfo->out_color_space == JCS_CMYK)) {
+		// CMYK image
+		if((flags & JPEG_CMYK) == JPEG_CMYK) {
+			// load as CMYK
+			dib = FreeImage_AllocateHeader(header_only, cinfo->output_width, cinfo->output_height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+			if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
+			FreeImage_GetICCProfile(dib)->flags |= FIICC_COLOR_IS_CMYK;
+		} else {
+			// load as CMYK and convert to RGB
+			dib = FreeImage_AllocateHeader(header_only, cinfo->output_width, cinfo->output_height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+			if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
+		}
+	} else {
+		// RGB or greyscale image
+		dib = FreeImage_AllocateHeader(header_only, cinfo->output_width, cinfo->output_height, 8 * cinfo->output_components, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
+
+		if (cinfo->output_components == 1) {
+			// build a greyscale palette
+			RGBQUAD *colors = FreeImage_GetPalette(dib);
+
+			for (int i = 0; i < 256; i++) {
+				colors[i].rgbRed   = (BYTE)i;
+				colors[i].rgbGreen = (BYTE)i;
+				colors[i].rgbBlue  = (BYTE)i;
+			}
+		}
+	}
+	if(scale_denom != 1) {
+		// store original size info if a scaling was requested
+		store_size_info(dib, cinfo->image_width, cinfo->image_height);
+	}
+
+	// handle metrices
+
+	if (cinfo->density_unit == 1) {
+		// dots/inch
+		FreeImage_SetDotsPerMeterX(dib, (unsigned) (((float)cinfo->X_density) / 0.0254000 + 0.5));
+		FreeImage_SetDotsPerMeterY(dib, (unsigned) (((float)cinfo->Y_density) / 0.0254000 + 0.5));
+	} else if (cinfo->density_unit == 2) {
+		// dots/cm
+		FreeImage_SetDotsPerMeterX(dib, (unsigned) (cinfo->X_density * 100));
+		FreeImage_SetDotsPerMeterY(dib, (unsigned) (cinfo->Y_density * 100));
+	}
+	
+	// read special markers
+	
+	read_markers(cinfo, dib);
+
+	return dib;
+}
+
+/**
+Check whether a dib can be saved as JPEG
+*/
+static BOOL
+CanCompressImage(FIBITMAP *dib) {
+	FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(dib);
+	WORD bpp = (WORD)FreeImage_GetBPP(dib);
+
+	if ((FreeImage_GetImageType(dib) != FIT_BITMAP) || ((bpp != 24) && (bpp != 8) && !(bpp == 32 && (color_type == FIC_CMYK)))) {
+		return FALSE;
+	}
+
+	if(bpp == 8) {
+		// allow grey, reverse grey and palette 
+		if ((color_type != FIC_MINISBLACK) && (color_type != FIC_MINISWHITE) && (color_type != FIC_PALETTE)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+Set the compression parameters (steps 3 and 4 of the compression) from the dib and the save flags
+*/
+static void
+SetCompressParameters(j_compress_ptr cinfo, FIBITMAP *dib, int flags) {
+	cinfo->image_width = FreeImage_GetWidth(dib);
+	cinfo->image_height = FreeImage_GetHeight(dib);
+
+	switch(FreeImage_GetColorType(dib)) {
+		case FIC_MINISBLACK :
+		case FIC_MINISWHITE :
+			cinfo->in_color_space = JCS_GRAYSCALE;
+			cinfo->input_components = 1;
+			break;
+		case FIC_CMYK:
+			cinfo->in_color_space = JCS_CMYK;
+			cinfo->input_components = 4;
+			break;
+		default :
+			cinfo->in_color_space = JCS_RGB;
+			cinfo->input_components = 3;
+			break;
+	}
+
+	jpeg_set_defaults(cinfo);
+
+    // progressive-JPEG support
+	if((flags & JPEG_PROGRESSIVE) == JPEG_PROGRESSIVE) {
+		jpeg_simple_progression(cinfo);
+	}
+	
+	// compute optimal Huffman coding tables for the image
+	if((flags & JPEG_OPTIMIZE) == JPEG_OPTIMIZE) {
+		cinfo->optimize_coding = TRUE;
+	}
+
+	// Set JFIF density parameters from the DIB data
+
+	cinfo->X_density = (UINT16) (0.5 + 0.0254 * FreeImage_GetDotsPerMeterX(dib));
+	cinfo->Y_density = (UINT16) (0.5 + 0.0254 * FreeImage_GetDotsPerMeterY(dib));
+	cinfo->density_unit = 1;	// dots / inch
+
+	// thumbnail support (JFIF 1.02 extension markers)
+	if(FreeImage_GetThumbnail(dib) != NULL) {
+		cinfo->write_JFIF_header = static_cast<boolean>(1); //<### force it, though when color is CMYK it will be incorrect
+		cinfo->JFIF_minor_version = 2;
+	}
+
+	// baseline JPEG support
+	if ((flags & JPEG_BASELINE) == JPEG_BASELINE) {
+		cinfo->write_JFIF_header = static_cast<boolean>(0);	// No marker for non-JFIF colorspaces
+		cinfo->write_Adobe_marker = static_cast<boolean>(0);	// write no Adobe marker by default				
+	}
+
+	// set subsampling options if required
+
+	if(cinfo->in_color_space == JCS_RGB) {
+		if((flags & JPEG_SUBSAMPLING_411) == JPEG_SUBSAMPLING_411) { 
+			// 4:1:1 (4x1 1x1 1x1) - CrH 25% - CbH 25% - CrV 100% - CbV 100%
+			// the horizontal color resolution is quartered
+			cinfo->comp_info[0].h_samp_factor = 4;	// Y 
+			cinfo->comp_info[0].v_samp_factor = 1; 
+			cinfo->comp_info[1].h_samp_factor = 1;	// Cb 
+			cinfo->comp_info[1].v_samp_factor = 1; 
+			cinfo->comp_info[2].h_samp_factor = 1;	// Cr 
+			cinfo->comp_info[2].v_samp_factor = 1; 
+		} else if((flags & JPEG_SUBSAMPLING_420) == JPEG_SUBSAMPLING_420) {
+			// 4:2:0 (2x2 1x1 1x1) - CrH 50% - CbH 50% - CrV 50% - CbV 50%
+			// the chrominance resolution in both the horizontal and vertical directions is cut in half
+			cinfo->comp_info[0].h_samp_factor = 2;	// Y
+			cinfo->comp_info[0].v_samp_factor = 2; 
+			cinfo->comp_info[1].h_samp_factor = 1;	// Cb
+			cinfo->comp_info[1].v_samp_factor = 1; 
+			cinfo->comp_info[2].h_samp_factor = 1;	// Cr
+			cinfo->comp_info[2].v_samp_factor = 1; 
+		} else if((flags & JPEG_SUBSAMPLING_422) == JPEG_SUBSAMPLING_422){ //2x1 (low) 
+			// 4:2:2 (2x1 1x1 1x1) - CrH 50% - CbH 50% - CrV 100% - CbV 100%
+			// half of the horizontal resolution in the chrominance is dropped (Cb & Cr), 
+			// while the full resolution is retained in the vertical direction, with respect to the luminance
+			cinfo->comp_info[0].h_samp_factor = 2;	// Y 
+			cinfo->comp_info[0].v_samp_factor = 1; 
+			cinfo->comp_info[1].h_samp_factor = 1;	// Cb 
+			cinfo->comp_info[1].v_samp_factor = 1; 
+			cinfo->comp_info[2].h_samp_factor = 1;	// Cr 
+			cinfo->comp_info[2].v_samp_factor = 1; 
+		} 
+		else if((flags & JPEG_SUBSAMPLING_444) == JPEG_SUBSAMPLING_444){ //1x1 (no subsampling) 
+			// 4:4:4 (1x1 1x1 1x1) - CrH 100% - CbH 100% - CrV 100% - CbV 100%
+			// the resolution of chrominance information (Cb & Cr) is preserved 
+			// at the same rate as the luminance (Y) information
+			cinfo->comp_info[0].h_samp_factor = 1;	// Y 
+			cinfo->comp_info[0].v_samp_factor = 1; 
+			cinfo->comp_info[1].h_samp_factor = 1;	// Cb 
+			cinfo->comp_info[1].v_samp_factor = 1; 
+			cinfo->comp_info[2].h_samp_factor = 1;	// Cr 
+			cinfo->comp_info[2].v_samp_factor = 1;  
+		} 
+	}
+
+	// Step 4: set quality
+	// the first 7 bits are reserved for low level quality settings
+	// the other bits are high level (i.e. enum-ish)
+
+	int quality;
+
+	if ((flags & JPEG_QUALITYBAD) == JPEG_QUALITYBAD) {
+		quality = 10;
+	} else if ((flags & JPEG_QUALITYAVERAGE) == JPEG_QUALITYAVERAGE) {
+		quality = 25;
+	} else if ((flags & JPEG_QUALITYNORMAL) == JPEG_QUALITYNORMAL) {
+		quality = 50;
+	} else if ((flags & JPEG_QUALITYGOOD) == JPEG_QUALITYGOOD) {
+		quality = 75;
+	} else 	if ((flags & JPEG_QUALITYSUPERB) == JPEG_QUALITYSUPERB) {
+		quality = 100;
+	} else {
+		if ((flags & 0x7F) == 0) {
+			quality = 75;
+		} else {
+			quality = flags & 0x7F;
+		}
+	}
+
+	jpeg_set_quality(cinfo, quality, TRUE); /* limit to baseline-JPEG values */
+}
+
+/**
+Convert a dib scanline to the compressor input format and write it (step 7 of the compression)
+@param cinfo Compressor
+@param color_type Color type of the dib
+@param palette Palette of the dib (8-bit palettized images only)
+@param source Scanline to write
+@param buffer Conversion buffer of at least 4 x image_width bytes (not used with FIC_MINISBLACK images)
+*/
+static void
+WriteScanline(j_compress_ptr cinfo, FREE_IMAGE_COLOR_TYPE color_type, RGBQUAD *palette, const BYTE *source, BYTE *buffer) {
+	JSAMPROW target = buffer;
+
+	switch(color_type) {
+		case FIC_RGB:
+		{
+			// 24-bit RGB image : need to swap red and blue channels
+			memcpy(target, source, 3 * cinfo->image_width);
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			// swap R and B channels
+			BYTE *target_p = target;
+			for(unsigned x = 0; x < cinfo->image_width; x++) {
+				INPLACESWAP(target_p[0], target_p[2]);
+				target_p += 3;
+			}
+#endif
+			break;
+		}
+		case FIC_CMYK:
+			// CMYK pixels are inverted
+			for(unsigned x = 0; x < 4 * cinfo->image_width; x++) {
+				target[x] = ~source[x];
+			}
+			break;
+
+		case FIC_MINISBLACK:
+			// 8-bit standard greyscale images
+			target = (JSAMPROW)source;
+			break;
+
+		case FIC_PALETTE:
+		{
+			// 8-bit palettized images are converted to 24-bit images
+			FreeImage_ConvertLine8To24(target, (BYTE*)source, cinfo->image_width, palette);
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			// swap R and B channels
+			BYTE *target_p = target;
+			for(unsigned x = 0; x < cinfo->image_width; x++) {
+				INPLACESWAP(target_p[0], target_p[2]);
+				target_p += 3;
+			}
+#endif
+			break;
+		}
+		case FIC_MINISWHITE:
+			// reverse 8-bit greyscale image, so reverse grey value on the fly
+			for(unsigned x = 0; x < cinfo->image_width; x++) {
+				target[x] = (BYTE)(255 - source[x]);
+			}
+			break;
+
+		default:
+			return;
+	}
+
+	jpeg_write_scanlines(cinfo, &target, 1);
+}
+
 // ==========================================================
 // Plugin Implementation
 // ==========================================================
@@ -1124,6 +1456,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(jpeg_signature, signature, sizeof(jpeg_signature)) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE jpeg_signature[] = { 0xFF, 0xD8 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(jpeg_signature), jpeg_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -1151,7 +1494,7 @@ SupportsNoPixels() {
 // ----------------------------------------------------------
 
 static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
 	if (handle) {
 		FIBITMAP *dib = NULL;
 
@@ -1198,87 +1541,15 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 			// step 4: set parameters for decompression
 
-			unsigned int scale_denom = 1;		// fraction by which to scale image
-			int	requested_size = flags >> 16;	// requested user size in pixels
-			if(requested_size > 0) {
-				// the JPEG codec can perform x2, x4 or x8 scaling on loading
-				// try to find the more appropriate scaling according to user's need
-				double scale = MAX((double)cinfo.image_width, (double)cinfo.image_height) / (double)requested_size;
-				if(scale >= 8) {
-					scale_denom = 8;
-				} else if(scale >= 4) {
-					scale_denom = 4;
-				} else if(scale >= 2) {
-					scale_denom = 2;
-				}
-			}
-			cinfo.scale_num = 1;
-			cinfo.scale_denom = scale_denom;
-
-			if ((flags & JPEG_ACCURATE) != JPEG_ACCURATE) {
-				cinfo.dct_method          = JDCT_IFAST;
-				cinfo.do_fancy_upsampling = FALSE;
-			}
-
-			if ((flags & JPEG_GREYSCALE) == JPEG_GREYSCALE) {
-				// force loading as a 8-bit greyscale image
-				cinfo.out_color_space = JCS_GRAYSCALE;
-			}
+			const unsigned scale_denom = SetDecompressParameters(&cinfo, flags, max_width, max_height);
 
 			// step 5a: start decompressor and calculate output width and height
 
 			jpeg_start_decompress(&cinfo);
 
-			// step 5b: allocate dib and init header
-
-			if((cinfo.output_components == 4) && (cinfo.out_color_space == JCS_CMYK)) {
-				// CMYK image
-				if((flags & JPEG_CMYK) == JPEG_CMYK) {
-					// load as CMYK
-					dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-					if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
-					FreeImage_GetICCProfile(dib)->flags |= FIICC_COLOR_IS_CMYK;
-				} else {
-					// load as CMYK and convert to RGB
-					dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-					if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
-				}
-			} else {
-				// RGB or greyscale image
-				dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 8 * cinfo.output_components, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-				if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
-
-				if (cinfo.output_components == 1) {
-					// build a greyscale palette
-					RGBQUAD *colors = FreeImage_GetPalette(dib);
-
-					for (int i = 0; i < 256; i++) {
-						colors[i].rgbRed   = (BYTE)i;
-						colors[i].rgbGreen = (BYTE)i;
-						colors[i].rgbBlue  = (BYTE)i;
-					}
-				}
-			}
-			if(scale_denom != 1) {
-				// store original size info if a scaling was requested
-				store_size_info(dib, cinfo.image_width, cinfo.image_height);
-			}
+			// step 5b: allocate dib and init header, read special markers
 
-			// step 5c: handle metrices
-
-			if (cinfo.density_unit == 1) {
-				// dots/inch
-				FreeImage_SetDotsPerMeterX(dib, (unsigned) (((float)cinfo.X_density) / 0.0254000 + 0.5));
-				FreeImage_SetDotsPerMeterY(dib, (unsigned) (((float)cinfo.Y_density) / 0.0254000 + 0.5));
-			} else if (cinfo.density_unit == 2) {
-				// dots/cm
-				FreeImage_SetDotsPerMeterX(dib, (unsigned) (cinfo.X_density * 100));
-				FreeImage_SetDotsPerMeterY(dib, (unsigned) (cinfo.Y_density * 100));
-			}
-			
-			// step 6: read special markers
-			
-			read_markers(&cinfo, dib);
+			dib = AllocateDecompressedImage(&cinfo, flags, scale_denom, header_only);
 
 			// --- header only mode => clean-up and return
 
@@ -1398,33 +1669,289 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return NULL;
 }
 
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return LoadScaled(io, handle, page, flags, data, 0, 0);
+}
+
 // ----------------------------------------------------------
 
-static BOOL DLL_CALLCONV
-Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
-	if ((dib) && (handle)) {
-		try {
-			// Check dib format
+/**
+Scanline decoder state
+*/
+typedef struct tagScanlineDecoder {
+	struct jpeg_decompress_struct cinfo;
+	ErrorManager fi_error_mgr;
+	/// load flags
+	int flags;
+	/// one-row-high sample array used for CMYK images, NULL otherwise
+	JSAMPARRAY buffer;
+	/// TRUE once the JPEG code has signaled an error
+	BOOL failed;
+} ScanlineDecoder;
+
+static void * DLL_CALLCONV
+OpenScanlines(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header) {
+	if(!handle || ((flags & JPEG_EXIFROTATE) == JPEG_EXIFROTATE)) {
+		// Exif rotation needs the whole image
+		return NULL;
+	}
+
+	ScanlineDecoder *volatile decoder = (ScanlineDecoder*)malloc(sizeof(ScanlineDecoder));
+	if(!decoder) {
+		return NULL;
+	}
+	memset(decoder, 0, sizeof(ScanlineDecoder));
+	decoder->flags = flags;
+
+	j_decompress_ptr cinfo = &decoder->cinfo;
+
+	// same setup as LoadScaled, the decompressor is kept alive between calls
+
+	cinfo->err = jpeg_std_error(&decoder->fi_error_mgr.pub);
+	decoder->fi_error_mgr.pub.error_exit     = jpeg_error_exit;
+	decoder->fi_error_mgr.pub.output_message = jpeg_output_message;
 
-			const char *sError = "only 24-bit RGB, 8-bit greyscale/palette or 32-bit CMYK bitmaps can be saved as JPEG";
+	if (setjmp(decoder->fi_error_mgr.setjmp_buffer)) {
+		// the JPEG object has already been destroyed by jpeg_error_exit
+		free(decoder);
+		return NULL;
+	}
+
+	jpeg_create_decompress(cinfo);
+
+	jpeg_freeimage_src(cinfo, handle, io);
+
+	jpeg_save_markers(cinfo, JPEG_COM, 0xFFFF);
+	for(int m = 0; m < 16; m++) {
+		jpeg_save_markers(cinfo, JPEG_APP0 + m, 0xFFFF);
+	}
+
+	jpeg_read_header(cinfo, TRUE);
+
+	const unsigned scale_denom = SetDecompressParameters(cinfo, flags, 0, 0);
+
+	jpeg_start_decompress(cinfo);
+
+	if(cinfo->out_color_space == JCS_CMYK) {
+		decoder->buffer = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, cinfo->output_width * cinfo->output_components, 1);
+	}
 
-			FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(dib);
-			WORD bpp = (WORD)FreeImage_GetBPP(dib);
+	try {
+		*header = AllocateDecompressedImage(cinfo, flags, scale_denom, TRUE);
 
-			if ((bpp != 24) && (bpp != 8) && !(bpp == 32 && (color_type == FIC_CMYK))) {
-				throw sError;
+		if((cinfo->out_color_space == JCS_CMYK) && ((flags & JPEG_CMYK) != JPEG_CMYK)) {
+			// if original image is CMYK but is converted to RGB, remove ICC profile from Exif-TIFF metadata
+			FreeImage_SetMetadata(FIMD_EXIF_MAIN, *header, "InterColorProfile", NULL);
+		}
+	} catch (const char *text) {
+		jpeg_destroy_decompress(cinfo);
+		free(decoder);
+		FreeImage_OutputMessageProc(s_format_id, text);
+		return NULL;
+	}
+
+	return decoder;
+}
+
+static unsigned DLL_CALLCONV
+ReadScanlines(FreeImageIO *io, fi_handle handle, void *reader, BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
+	j_decompress_ptr cinfo = &decoder->cinfo;
+
+	volatile unsigned rows = 0;
+
+	if(decoder->failed) {
+		return 0;
+	}
+
+	if (setjmp(decoder->fi_error_mgr.setjmp_buffer)) {
+		// the JPEG object has been destroyed by jpeg_error_exit, return the rows decoded so far
+		decoder->failed = TRUE;
+		return rows;
+	}
+
+	while((rows < count) && (cinfo->output_scanline < cinfo->output_height)) {
+		JSAMPROW dst = bits + (size_t)rows * pitch;
+
+		if(decoder->buffer) {
+			JSAMPROW src = decoder->buffer[0];
+
+			jpeg_read_scanlines(cinfo, decoder->buffer, 1);
+
+			if((decoder->flags & JPEG_CMYK) != JPEG_CMYK) {
+				// convert from CMYK to RGB
+				for(unsigned x = 0; x < cinfo->output_width; x++) {
+					WORD K = (WORD)src[3];
+					dst[FI_RGBA_RED]   = (BYTE)((K * src[0]) / 255);	// C -> R
+					dst[FI_RGBA_GREEN] = (BYTE)((K * src[1]) / 255);	// M -> G
+					dst[FI_RGBA_BLUE]  = (BYTE)((K * src[2]) / 255);	// Y -> B
+					src += 4;
+					dst += 3;
+				}
+			} else {
+				// convert from LibJPEG CMYK to standard CMYK (CMYK pixels are inverted)
+				for(unsigned x = 0; x < 4 * cinfo->output_width; x++) {
+					dst[x] = ~src[x];
+				}
 			}
+		} else {
+			jpeg_read_scanlines(cinfo, &dst, 1);
 
-			if(bpp == 8) {
-				// allow grey, reverse grey and palette 
-				if ((color_type != FIC_MINISBLACK) && (color_type != FIC_MINISWHITE) && (color_type != FIC_PALETTE)) {
-					throw sError;
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			if(cinfo->output_components == 3) {
+				// swap red and blue components (see LoadScaled)
+				for(unsigned x = 0; x < cinfo->output_width; x++, dst += 3) {
+					INPLACESWAP(dst[0], dst[2]);
 				}
 			}
+#endif
+		}
+
+		rows++;
+	}
+
+	return rows;
+}
 
+static void DLL_CALLCONV
+CloseScanlines(FreeImageIO *io, fi_handle handle, void *reader) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
+
+	// the decoder may be closed before the last row: don't call jpeg_finish_decompress
+	jpeg_destroy_decompress(&decoder->cinfo);
+	free(decoder);
+}
+
+// ----------------------------------------------------------
+
+/**
+Scanline encoder state
+*/
+typedef struct tagScanlineEncoder {
+	struct jpeg_compress_struct cinfo;
+	ErrorManager fi_error_mgr;
+	FREE_IMAGE_COLOR_TYPE color_type;
+	/// palette of the header (8-bit palettized images)
+	RGBQUAD *palette;
+	/// scanline conversion buffer
+	BYTE *buffer;
+	/// TRUE once the JPEG code has signaled an error
+	BOOL failed;
+} ScanlineEncoder;
+
+static void * DLL_CALLCONV
+CreateScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *header, int page, int flags, void *data) {
+	if(!header || !handle || !CanCompressImage(header)) {
+		// let Save report the error
+		return NULL;
+	}
+
+	ScanlineEncoder *encoder = (ScanlineEncoder*)malloc(sizeof(ScanlineEncoder));
+	if(!encoder) {
+		return NULL;
+	}
+	memset(encoder, 0, sizeof(ScanlineEncoder));
+	encoder->color_type = FreeImage_GetColorType(header);
+	encoder->palette = FreeImage_GetPalette(header);
+	encoder->buffer = (BYTE*)malloc(4 * FreeImage_GetWidth(header));
+	if(!encoder->buffer) {
+		free(encoder);
+		return NULL;
+	}
+
+	j_compress_ptr cinfo = &encoder->cinfo;
+
+	// same setup as Save, the compressor is kept alive between calls
+
+	cinfo->err = jpeg_std_error(&encoder->fi_error_mgr.pub);
+	encoder->fi_error_mgr.pub.error_exit     = jpeg_error_exit;
+	encoder->fi_error_mgr.pub.output_message = jpeg_output_message;
+
+	if (setjmp(encoder->fi_error_mgr.setjmp_buffer)) {
+		// the JPEG object has already been destroyed by jpeg_error_exit
+		free(encoder->buffer);
+		free(encoder);
+		return NULL;
+	}
+
+	jpeg_create_compress(cinfo);
+
+	jpeg_freeimage_dst(cinfo, handle, io);
+
+	SetCompressParameters(cinfo, header, flags);
+
+	jpeg_start_compress(cinfo, TRUE);
+
+	if ((flags & JPEG_BASELINE) !=  JPEG_BASELINE) {
+		write_markers(cinfo, header);
+	}
+
+	return encoder;
+}
+
+static unsigned DLL_CALLCONV
+WriteScanlines(FreeImageIO *io, fi_handle handle, void *writer, const BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+	j_compress_ptr cinfo = &encoder->cinfo;
+
+	volatile unsigned rows = 0;
+
+	if(encoder->failed) {
+		return 0;
+	}
+
+	if (setjmp(encoder->fi_error_mgr.setjmp_buffer)) {
+		// the JPEG object has been destroyed by jpeg_error_exit, return the rows written so far
+		encoder->failed = TRUE;
+		return rows;
+	}
+
+	while((rows < count) && (cinfo->next_scanline < cinfo->image_height)) {
+		WriteScanline(cinfo, encoder->color_type, encoder->palette, bits + (size_t)rows * pitch, encoder->buffer);
+		rows++;
+	}
+
+	return rows;
+}
+
+static BOOL DLL_CALLCONV
+FinishScanlines(FreeImageIO *io, fi_handle handle, void *writer) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+	j_compress_ptr cinfo = &encoder->cinfo;
+
+	volatile BOOL bResult = FALSE;
+
+	if(!encoder->failed && (cinfo->next_scanline == cinfo->image_height)) {
+		if (!setjmp(encoder->fi_error_mgr.setjmp_buffer)) {
+			jpeg_finish_compress(cinfo);
+			bResult = TRUE;
+		}
+	}
+
+	// an incomplete image is not finished (libjpeg would signal an error)
+	jpeg_destroy_compress(cinfo);
+	free(encoder->buffer);
+	free(encoder);
+
+	return bResult;
+}
+
+// ----------------------------------------------------------
+
+static BOOL DLL_CALLCONV
+Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
+	if ((dib) && (handle)) {
+		try {
+			// Check dib format
+
+			if (!CanCompressImage(dib)) {
+				throw "only 24-bit RGB, 8-bit greyscale/palette or 32-bit CMYK bitmaps can be saved as JPEG";
+			}
 
 			struct jpeg_compress_struct cinfo;
 			ErrorManager fi_error_mgr;
+			BYTE *volatile buffer = NULL;
 
 			// Step 1: allocate and initialize JPEG compression object
 
@@ -1438,6 +1965,7 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 				// If we get here, the JPEG code has signaled an error.
 				// We need to clean up the JPEG object, close the input file, and return.
 				jpeg_destroy_compress(&cinfo);
+				free(buffer);
 				throw (const char*)NULL;
 			}
 
@@ -1449,127 +1977,9 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 			jpeg_freeimage_dst(&cinfo, handle, io);
 
-			// Step 3: set parameters for compression 
-
-			cinfo.image_width = FreeImage_GetWidth(dib);
-			cinfo.image_height = FreeImage_GetHeight(dib);
-
-			switch(color_type) {
-				case FIC_MINISBLACK :
-				case FIC_MINISWHITE :
-					cinfo.in_color_space = JCS_GRAYSCALE;
-					cinfo.input_components = 1;
-					break;
-				case FIC_CMYK:
-					cinfo.in_color_space = JCS_CMYK;
-					cinfo.input_components = 4;
-					break;
-				default :
-					cinfo.in_color_space = JCS_RGB;
-					cinfo.input_components = 3;
-					break;
-			}
-
-			jpeg_set_defaults(&cinfo);
+			// Step 3 & 4: set parameters for compression and quality
 
-		    // progressive-JPEG support
-			if((flags & JPEG_PROGRESSIVE) == JPEG_PROGRESSIVE) {
-				jpeg_simple_progression(&cinfo);
-			}
-			
-			// compute optimal Huffman coding tables for the image
-			if((flags & JPEG_OPTIMIZE) == JPEG_OPTIMIZE) {
-				cinfo.optimize_coding = TRUE;
-			}
-
-			// Set JFIF density parameters from the DIB data
-
-			cinfo.X_density = (UINT16) (0.5 + 0.0254 * FreeImage_GetDotsPerMeterX(dib));
-			cinfo.Y_density = (UINT16) (0.5 + 0.0254 * FreeImage_GetDotsPerMeterY(dib));
-			cinfo.density_unit = 1;	// dots / inch
-
-			// thumbnail support (JFIF 1.02 extension markers)
-			if(FreeImage_GetThumbnail(dib) != NULL) {
-				cinfo.write_JFIF_header = static_cast<boolean>(1); //<### force it, though when color is CMYK it will be incorrect
-				cinfo.JFIF_minor_version = 2;
-			}
-
-			// baseline JPEG support
-			if ((flags & JPEG_BASELINE) == JPEG_BASELINE) {
-				cinfo.write_JFIF_header = static_cast<boolean>(0);	// No marker for non-JFIF colorspaces
-				cinfo.write_Adobe_marker = static_cast<boolean>(0);	// write no Adobe marker by default				
-			}
-
-			// set subsampling options if required
-
-			if(cinfo.in_color_space == JCS_RGB) {
-				if((flags & JPEG_SUBSAMPLING_411) == JPEG_SUBSAMPLING_411) { 
-					// 4:1:1 (4x1 1x1 1x1) - CrH 25% - CbH 25% - CrV 100% - CbV 100%
-					// the horizontal color resolution is quartered
-					cinfo.comp_info[0].h_samp_factor = 4;	// Y 
-					cinfo.comp_info[0].v_samp_factor = 1; 
-					cinfo.comp_info[1].h_samp_factor = 1;	// Cb 
-					cinfo.comp_info[1].v_samp_factor = 1; 
-					cinfo.comp_info[2].h_samp_factor = 1;	// Cr 
-					cinfo.comp_info[2].v_samp_factor = 1; 
-				} else if((flags & JPEG_SUBSAMPLING_420) == JPEG_SUBSAMPLING_420) {
-					// 4:2:0 (2x2 1x1 1x1) - CrH 50% - CbH 50% - CrV 50% - CbV 50%
-					// the chrominance resolution in both the horizontal and vertical directions is cut in half
-					cinfo.comp_info[0].h_samp_factor = 2;	// Y
-					cinfo.comp_info[0].v_samp_factor = 2; 
-					cinfo.comp_info[1].h_samp_factor = 1;	// Cb
-					cinfo.comp_info[1].v_samp_factor = 1; 
-					cinfo.comp_info[2].h_samp_factor = 1;	// Cr
-					cinfo.comp_info[2].v_samp_factor = 1; 
-				} else if((flags & JPEG_SUBSAMPLING_422) == JPEG_SUBSAMPLING_422){ //2x1 (low) 
-					// 4:2:2 (2x1 1x1 1x1) - CrH 50% - CbH 50% - CrV 100% - CbV 100%
-					// half of the horizontal resolution in the chrominance is dropped (Cb & Cr), 
-					// while the full resolution is retained in the vertical direction, with respect to the luminance
-					cinfo.comp_info[0].h_samp_factor = 2;	// Y 
-					cinfo.comp_info[0].v_samp_factor = 1; 
-					cinfo.comp_info[1].h_samp_factor = 1;	// Cb 
-					cinfo.comp_info[1].v_samp_factor = 1; 
-					cinfo.comp_info[2].h_samp_factor = 1;	// Cr 
-					cinfo.comp_info[2].v_samp_factor = 1; 
-				} 
-				else if((flags & JPEG_SUBSAMPLING_444) == JPEG_SUBSAMPLING_444){ //1x1 (no subsampling) 
-					// 4:4:4 (1x1 1x1 1x1) - CrH 100% - CbH 100% - CrV 100% - CbV 100%
-					// the resolution of chrominance information (Cb & Cr) is preserved 
-					// at the same rate as the luminance (Y) information
-					cinfo.comp_info[0].h_samp_factor = 1;	// Y 
-					cinfo.comp_info[0].v_samp_factor = 1; 
-					cinfo.comp_info[1].h_samp_factor = 1;	// Cb 
-					cinfo.comp_info[1].v_samp_factor = 1; 
-					cinfo.comp_info[2].h_samp_factor = 1;	// Cr 
-					cinfo.comp_info[2].v_samp_factor = 1;  
-				} 
-			}
-
-			// Step 4: set quality
-			// the first 7 bits are reserved for low level quality settings
-			// the other bits are high level (i.e. enum-ish)
-
-			int quality;
-
-			if ((flags & JPEG_QUALITYBAD) == JPEG_QUALITYBAD) {
-				quality = 10;
-			} else if ((flags & JPEG_QUALITYAVERAGE) == JPEG_QUALITYAVERAGE) {
-				quality = 25;
-			} else if ((flags & JPEG_QUALITYNORMAL) == JPEG_QUALITYNORMAL) {
-				quality = 50;
-			} else if ((flags & JPEG_QUALITYGOOD) == JPEG_QUALITYGOOD) {
-				quality = 75;
-			} else 	if ((flags & JPEG_QUALITYSUPERB) == JPEG_QUALITYSUPERB) {
-				quality = 100;
-			} else {
-				if ((flags & 0x7F) == 0) {
-					quality = 75;
-				} else {
-					quality = flags & 0x7F;
-				}
-			}
-
-			jpeg_set_quality(&cinfo, quality, TRUE); /* limit to baseline-JPEG values */
+			SetCompressParameters(&cinfo, dib, flags);
 
 			// Step 5: Start compressor 
 
@@ -1583,115 +1993,22 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 			// Step 7: while (scan lines remain to be written) 
 
-			if(color_type == FIC_RGB) {
-				// 24-bit RGB image : need to swap red and blue channels
-				unsigned pitch = FreeImage_GetPitch(dib);
-				BYTE *target = (BYTE*)malloc(pitch * sizeof(BYTE));
-				if (target == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
+			const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(dib);
+			RGBQUAD *palette = FreeImage_GetPalette(dib);
 
-				while (cinfo.next_scanline < cinfo.image_height) {
-					// get a copy of the scanline
-					memcpy(target, FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1), pitch);
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// swap R and B channels
-					BYTE *target_p = target;
-					for(unsigned x = 0; x < cinfo.image_width; x++) {
-						INPLACESWAP(target_p[0], target_p[2]);
-						target_p += 3;
-					}
-#endif
-					// write the scanline
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
-				free(target);
-			}
-			else if(color_type == FIC_CMYK) {
-				unsigned pitch = FreeImage_GetPitch(dib);
-				BYTE *target = (BYTE*)malloc(pitch * sizeof(BYTE));
-				if (target == NULL) {
+			if(color_type != FIC_MINISBLACK) {
+				buffer = (BYTE*)malloc(4 * cinfo.image_width);
+				if (buffer == NULL) {
+					jpeg_destroy_compress(&cinfo);
 					throw FI_MSG_ERROR_MEMORY;
 				}
-				
-				while (cinfo.next_scanline < cinfo.image_height) {
-					// get a copy of the scanline
-					memcpy(target, FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1), pitch);
-					
-					BYTE *target_p = target;
-					for(unsigned x = 0; x < cinfo.image_width; x++) {
-						// CMYK pixels are inverted
-						target_p[0] = ~target_p[0];	// C
-						target_p[1] = ~target_p[1];	// M
-						target_p[2] = ~target_p[2];	// Y
-						target_p[3] = ~target_p[3];	// K
-
-						target_p += 4;
-					}
-					
-					// write the scanline
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
-				free(target);
 			}
-			else if(color_type == FIC_MINISBLACK) {
-				// 8-bit standard greyscale images
-				while (cinfo.next_scanline < cinfo.image_height) {
-					JSAMPROW b = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
-
-					jpeg_write_scanlines(&cinfo, &b, 1);
-				}
-			}
-			else if(color_type == FIC_PALETTE) {
-				// 8-bit palettized images are converted to 24-bit images
-				RGBQUAD *palette = FreeImage_GetPalette(dib);
-				BYTE *target = (BYTE*)malloc(cinfo.image_width * 3);
-				if (target == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
-
-				while (cinfo.next_scanline < cinfo.image_height) {
-					BYTE *source = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
-					FreeImage_ConvertLine8To24(target, source, cinfo.image_width, palette);
-
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// swap R and B channels
-					BYTE *target_p = target;
-					for(unsigned x = 0; x < cinfo.image_width; x++) {
-						INPLACESWAP(target_p[0], target_p[2]);
-						target_p += 3;
-					}
-#endif
-
-
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
 
-				free(target);
+			while (cinfo.next_scanline < cinfo.image_height) {
+				WriteScanline(&cinfo, color_type, palette, FreeImage_GetConstScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1), buffer);
 			}
-			else if(color_type == FIC_MINISWHITE) {
-				// reverse 8-bit greyscale image, so reverse grey value on the fly
-				unsigned i;
-				BYTE reverse[256];
-				BYTE *target = (BYTE *)malloc(cinfo.image_width);
-				if (target == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
-
-				for(i = 0; i < 256; i++) {
-					reverse[i] = (BYTE)(255 - i);
-				}
 
-				while(cinfo.next_scanline < cinfo.image_height) {
-					BYTE *source = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
-					for(i = 0; i < cinfo.image_width; i++) {
-						target[i] = reverse[ source[i] ];
-					}
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
-
-				free(target);
-			}
+			free(buffer);
 
 			// Step 8: Finish compression 
 
@@ -1738,4 +2055,12 @@ InitJPEG(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_scaled_proc = LoadScaled;
+	plugin->open_scanlines_proc = OpenScanlines;
+	plugin->read_scanlines_proc = ReadScanlines;
+	plugin->close_scanlines_proc = CloseScanlines;
+	plugin->create_scanlines_proc = CreateScanlines;
+	plugin->write_scanlines_proc = WriteScanlines;
+	plugin->finish_scanlines_proc = FinishScanlines;
 }
@@ -907,6 +907,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(jxr_signature, signature, 3) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE jxr_signature[] = { 0x49, 0x49, 0xBC };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(jxr_signature), jxr_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -1471,5 +1482,6 @@ InitJXR(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
 
@@ -122,6 +122,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(koala_signature, signature, sizeof(koala_signature)) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE koala_signature[] = { 0x00, 0x60 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(koala_signature), koala_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -240,4 +251,5 @@ InitKOALA(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -277,6 +277,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return pcx_validate(io, handle);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE pcx_signature[] = { 0x0A };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(pcx_signature), pcx_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 /*!
     This function is used to 'ask' the plugin if it can write
 	a bitmap in a certain bitdepth. Different bitmap types have different
@@ -698,4 +709,5 @@ InitPCX(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -174,6 +174,19 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE pfm_id1[] = { 0x50, 0x46 };
+	static const BYTE pfm_id2[] = { 0x50, 0x66 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(pfm_id1), pfm_id1, NULL },
+		{ sizeof(pfm_id2), pfm_id2, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -406,4 +419,5 @@ InitPFM(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -29,6 +29,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define FI_PNG_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "../Metadata/FreeImageTag.h"
 
@@ -72,7 +80,11 @@ _ReadProc(png_structp png_ptr, unsigned char *data, png_size_t size) {
 static void
 _WriteProc(png_structp png_ptr, unsigned char *data, png_size_t size) {
     pfi_ioStructure pfio = (pfi_ioStructure)png_get_io_ptr(png_ptr);
-    pfio->s_io->write_proc(data, (unsigned int)size, 1, pfio->s_handle);
+	unsigned n = pfio->s_io->write_proc(data, (unsigned int)size, 1, pfio->s_handle);
+	if(size && (n == 0)) {
+		// e.g. a fixed size memory buffer is full
+		throw "Write error: unable to write the PNG stream";
+	}
 }
 
 static void
@@ -279,6 +291,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(png_signature, signature, 8) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE png_signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(png_signature), png_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -500,15 +523,186 @@ ConfigureDecoder(png_structp png_ptr, png_infop info_ptr, int flags, FREE_IMAGE_
 	return TRUE;
 }
 
-static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
-	png_structp png_ptr = NULL;
-	png_infop info_ptr = NULL;
+/**
+Configure the decoder and allocate the image receiving the decoded rows. 
+The image header is filled with the palette, transparency, background color, resolution and ICC profile. 
+@param png_ptr PNG handle, after png_read_info
+@param info_ptr PNG info handle
+@param flags Load flags
+@param header_only TRUE to allocate a header-only image
+@return Returns the image, throws an error message otherwise
+*/
+static FIBITMAP *
+AllocateDecodedImage(png_structp png_ptr, png_infop info_ptr, int flags, BOOL header_only) {
 	png_uint_32 width, height;
 	int color_type;
 	int bit_depth;
 	int pixel_depth = 0;	// pixel_depth = bit_depth * channels
 
+	FIBITMAP *dib = NULL;
+
+	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
+
+	// configure the decoder
+
+	FREE_IMAGE_TYPE image_type = FIT_BITMAP;
+
+	if(!ConfigureDecoder(png_ptr, info_ptr, flags, &image_type)) {
+		throw FI_MSG_ERROR_UNSUPPORTED_FORMAT;
+	}
+
+	// update image info
+
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	pixel_depth = bit_depth * png_get_channels(png_ptr, info_ptr);
+
+	// create a dib and write the bitmap header
+	// set up the dib palette, if needed
+
+	switch (color_type) {
+		case PNG_COLOR_TYPE_RGB:
+		case PNG_COLOR_TYPE_RGB_ALPHA:
+			dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+			break;
+
+		case PNG_COLOR_TYPE_PALETTE:
+			dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+			if(dib) {
+				png_colorp png_palette = NULL;
+				int palette_entries = 0;
+
+				png_get_PLTE(png_ptr,info_ptr, &png_palette, &palette_entries);
+
+				palette_entries = MIN((unsigned)palette_entries, FreeImage_GetColorsUsed(dib));
+
+				// store the palette
+
+				RGBQUAD *palette = FreeImage_GetPalette(dib);
+				for(int i = 0; i < palette_entries; i++) {
+					palette[i].rgbRed   = png_palette[i].red;
+					palette[i].rgbGreen = png_palette[i].green;
+					palette[i].rgbBlue  = png_palette[i].blue;
+				}
+			}
+			break;
+
+		case PNG_COLOR_TYPE_GRAY:
+			dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+
+			if(dib && (pixel_depth <= 8)) {
+				RGBQUAD *palette = FreeImage_GetPalette(dib);
+				const int palette_entries = 1 << pixel_depth;
+
+				for(int i = 0; i < palette_entries; i++) {
+					palette[i].rgbRed   =
+					palette[i].rgbGreen =
+					palette[i].rgbBlue  = (BYTE)((i * 255) / (palette_entries - 1));
+				}
+			}
+			break;
+
+		default:
+			throw FI_MSG_ERROR_UNSUPPORTED_FORMAT;
+	}
+
+	if(!dib) {
+		throw FI_MSG_ERROR_DIB_MEMORY;
+	}
+
+	// store the transparency table
+
+	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+		// array of alpha (transparency) entries for palette
+		png_bytep trans_alpha = NULL;
+		// number of transparent entries
+		int num_trans = 0;						
+		// graylevel or color sample values of the single transparent color for non-paletted images
+		png_color_16p trans_color = NULL;
+
+		png_get_tRNS(png_ptr, info_ptr, &trans_alpha, &num_trans, &trans_color);
+
+		if((color_type == PNG_COLOR_TYPE_GRAY) && trans_color) {
+			// single transparent color
+			if (trans_color->gray < 256) { 
+				BYTE table[256]; 
+				memset(table, 0xFF, 256); 
+				table[trans_color->gray] = 0; 
+				FreeImage_SetTransparencyTable(dib, table, 256); 
+			}
+			// check for a full transparency table, too
+			else if ((trans_alpha) && (pixel_depth <= 8)) {
+				FreeImage_SetTransparencyTable(dib, (BYTE *)trans_alpha, num_trans);
+			}
+
+		} else if((color_type == PNG_COLOR_TYPE_PALETTE) && trans_alpha) {
+			// transparency table
+			FreeImage_SetTransparencyTable(dib, (BYTE *)trans_alpha, num_trans);
+		}
+	}
+
+	// store the background color (only supported for FIT_BITMAP types)
+
+	if ((image_type == FIT_BITMAP) && png_get_valid(png_ptr, info_ptr, PNG_INFO_bKGD)) {
+		// Get the background color to draw transparent and alpha images over.
+		// Note that even if the PNG file supplies a background, you are not required to
+		// use it - you should use the (solid) application background if it has one.
+
+		png_color_16p image_background = NULL;
+		RGBQUAD rgbBkColor;
+
+		if (png_get_bKGD(png_ptr, info_ptr, &image_background)) {
+			rgbBkColor.rgbRed      = (BYTE)image_background->red;
+			rgbBkColor.rgbGreen    = (BYTE)image_background->green;
+			rgbBkColor.rgbBlue     = (BYTE)image_background->blue;
+			rgbBkColor.rgbReserved = 0;
+
+			FreeImage_SetBackgroundColor(dib, &rgbBkColor);
+		}
+	}
+
+	// get physical resolution
+
+	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_pHYs)) {
+		png_uint_32 res_x, res_y;
+		
+		// we'll overload this var and use 0 to mean no phys data,
+		// since if it's not in meters we can't use it anyway
+
+		int res_unit_type = PNG_RESOLUTION_UNKNOWN;
+
+		png_get_pHYs(png_ptr,info_ptr, &res_x, &res_y, &res_unit_type);
+
+		if (res_unit_type == PNG_RESOLUTION_METER) {
+			FreeImage_SetDotsPerMeterX(dib, res_x);
+			FreeImage_SetDotsPerMeterY(dib, res_y);
+		}
+	}
+
+	// get possible ICC profile
+
+	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_iCCP)) {
+		png_charp profile_name = NULL;
+		png_bytep profile_data = NULL;
+		png_uint_32 profile_length = 0;
+		int  compression_type;
+
+		png_get_iCCP(png_ptr, info_ptr, &profile_name, &compression_type, &profile_data, &profile_length);
+
+		// copy ICC profile data (must be done after FreeImage_AllocateHeader)
+
+		FreeImage_CreateICCProfile(dib, profile_data, profile_length);
+	}
+
+	return dib;
+}
+
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_uint_32 height;
+
 	FIBITMAP *dib = NULL;
 	png_bytepp row_pointers = NULL;
 
@@ -565,158 +759,11 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			// read the IHDR chunk
 
 			png_read_info(png_ptr, info_ptr);
-			png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
-
-			// configure the decoder
-
-			FREE_IMAGE_TYPE image_type = FIT_BITMAP;
-
-			if(!ConfigureDecoder(png_ptr, info_ptr, flags, &image_type)) {
-				throw FI_MSG_ERROR_UNSUPPORTED_FORMAT;
-			}
-
-			// update image info
-
-			color_type = png_get_color_type(png_ptr, info_ptr);
-			bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-			pixel_depth = bit_depth * png_get_channels(png_ptr, info_ptr);
-
-			// create a dib and write the bitmap header
-			// set up the dib palette, if needed
-
-			switch (color_type) {
-				case PNG_COLOR_TYPE_RGB:
-				case PNG_COLOR_TYPE_RGB_ALPHA:
-					dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-					break;
-
-				case PNG_COLOR_TYPE_PALETTE:
-					dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-					if(dib) {
-						png_colorp png_palette = NULL;
-						int palette_entries = 0;
-
-						png_get_PLTE(png_ptr,info_ptr, &png_palette, &palette_entries);
-
-						palette_entries = MIN((unsigned)palette_entries, FreeImage_GetColorsUsed(dib));
-
-						// store the palette
-
-						RGBQUAD *palette = FreeImage_GetPalette(dib);
-						for(int i = 0; i < palette_entries; i++) {
-							palette[i].rgbRed   = png_palette[i].red;
-							palette[i].rgbGreen = png_palette[i].green;
-							palette[i].rgbBlue  = png_palette[i].blue;
-						}
-					}
-					break;
-
-				case PNG_COLOR_TYPE_GRAY:
-					dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, pixel_depth, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-
-					if(dib && (pixel_depth <= 8)) {
-						RGBQUAD *palette = FreeImage_GetPalette(dib);
-						const int palette_entries = 1 << pixel_depth;
-
-						for(int i = 0; i < palette_entries; i++) {
-							palette[i].rgbRed   =
-							palette[i].rgbGreen =
-							palette[i].rgbBlue  = (BYTE)((i * 255) / (palette_entries - 1));
-						}
-					}
-					break;
-
-				default:
-					throw FI_MSG_ERROR_UNSUPPORTED_FORMAT;
-			}
-
-			if(!dib) {
-				throw FI_MSG_ERROR_DIB_MEMORY;
-			}
-
-			// store the transparency table
-
-			if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
-				// array of alpha (transparency) entries for palette
-				png_bytep trans_alpha = NULL;
-				// number of transparent entries
-				int num_trans = 0;						
-				// graylevel or color sample values of the single transparent color for non-paletted images
-				png_color_16p trans_color = NULL;
-
-				png_get_tRNS(png_ptr, info_ptr, &trans_alpha, &num_trans, &trans_color);
-
-				if((color_type == PNG_COLOR_TYPE_GRAY) && trans_color) {
-					// single transparent color
-					if (trans_color->gray < 256) { 
-						BYTE table[256]; 
-						memset(table, 0xFF, 256); 
-						table[trans_color->gray] = 0; 
-						FreeImage_SetTransparencyTable(dib, table, 256); 
-					}
-					// check for a full transparency table, too
-					else if ((trans_alpha) && (pixel_depth <= 8)) {
-						FreeImage_SetTransparencyTable(dib, (BYTE *)trans_alpha, num_trans);
-					}
-
-				} else if((color_type == PNG_COLOR_TYPE_PALETTE) && trans_alpha) {
-					// transparency table
-					FreeImage_SetTransparencyTable(dib, (BYTE *)trans_alpha, num_trans);
-				}
-			}
-
-			// store the background color (only supported for FIT_BITMAP types)
-
-			if ((image_type == FIT_BITMAP) && png_get_valid(png_ptr, info_ptr, PNG_INFO_bKGD)) {
-				// Get the background color to draw transparent and alpha images over.
-				// Note that even if the PNG file supplies a background, you are not required to
-				// use it - you should use the (solid) application background if it has one.
-
-				png_color_16p image_background = NULL;
-				RGBQUAD rgbBkColor;
-
-				if (png_get_bKGD(png_ptr, info_ptr, &image_background)) {
-					rgbBkColor.rgbRed      = (BYTE)image_background->red;
-					rgbBkColor.rgbGreen    = (BYTE)image_background->green;
-					rgbBkColor.rgbBlue     = (BYTE)image_background->blue;
-					rgbBkColor.rgbReserved = 0;
-
-					FreeImage_SetBackgroundColor(dib, &rgbBkColor);
-				}
-			}
-
-			// get physical resolution
-
-			if (png_get_valid(png_ptr, info_ptr, PNG_INFO_pHYs)) {
-				png_uint_32 res_x, res_y;
-				
-				// we'll overload this var and use 0 to mean no phys data,
-				// since if it's not in meters we can't use it anyway
-
-				int res_unit_type = PNG_RESOLUTION_UNKNOWN;
-
-				png_get_pHYs(png_ptr,info_ptr, &res_x, &res_y, &res_unit_type);
-
-				if (res_unit_type == PNG_RESOLUTION_METER) {
-					FreeImage_SetDotsPerMeterX(dib, res_x);
-					FreeImage_SetDotsPerMeterY(dib, res_y);
-				}
-			}
-
-			// get possible ICC profile
-
-			if (png_get_valid(png_ptr, info_ptr, PNG_INFO_iCCP)) {
-				png_charp profile_name = NULL;
-				png_bytep profile_data = NULL;
-				png_uint_32 profile_length = 0;
-				int  compression_type;
-
-				png_get_iCCP(png_ptr, info_ptr, &profile_name, &compression_type, &profile_data, &profile_length);
+			height = png_get_image_height(png_ptr, info_ptr);
 
-				// copy ICC profile data (must be done after FreeImage_AllocateHeader)
+			// configure the decoder, create a dib and write the bitmap header
 
-				FreeImage_CreateICCProfile(dib, profile_data, profile_length);
-			}
+			dib = AllocateDecodedImage(png_ptr, info_ptr, flags, header_only);
 
 			// --- header only mode => clean-up and return
 
@@ -805,257 +852,1199 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 // --------------------------------------------------------------------------
 
-static BOOL DLL_CALLCONV
-Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
+/**
+Scanline decoder state
+*/
+typedef struct tagScanlineDecoder {
 	png_structp png_ptr;
 	png_infop info_ptr;
-	png_colorp palette = NULL;
-	png_uint_32 width, height;
-	BOOL has_alpha_channel = FALSE;
+	/// libpng keeps a pointer to this IO structure
+	fi_ioStructure fio;
+	/// TRUE once libpng has signaled an error
+	BOOL failed;
+} ScanlineDecoder;
 
-	RGBQUAD *pal;					// pointer to dib palette
-	int bit_depth, pixel_depth;		// pixel_depth = bit_depth * channels
-	int palette_entries;
-	int	interlace_type;
+static void DLL_CALLCONV
+CloseScanlines(FreeImageIO *io, fi_handle handle, void *reader) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
 
-	fi_ioStructure fio;
-    fio.s_handle = handle;
-	fio.s_io = io;
+	if (decoder->png_ptr) {
+		png_destroy_read_struct(&decoder->png_ptr, &decoder->info_ptr, (png_infopp)NULL);
+	}
+	free(decoder);
+}
 
-	if ((dib) && (handle)) {
-		try {
-			// create the chunk manage structure
+static void * DLL_CALLCONV
+OpenScanlines(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header) {
+	if (!handle) {
+		return NULL;
+	}
 
-			png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, error_handler, warning_handler);
+	ScanlineDecoder *volatile decoder = (ScanlineDecoder*)malloc(sizeof(ScanlineDecoder));
+	if (!decoder) {
+		return NULL;
+	}
+	memset(decoder, 0, sizeof(ScanlineDecoder));
+	decoder->fio.s_handle = handle;
+	decoder->fio.s_io = io;
 
-			if (!png_ptr)  {
-				return FALSE;
-			}
+	try {
+		// same setup as Load, the decoder is kept alive between calls
 
-			// allocate/initialize the image information data.
+		BYTE png_check[PNG_BYTES_TO_CHECK];
 
-			info_ptr = png_create_info_struct(png_ptr);
+		io->read_proc(png_check, PNG_BYTES_TO_CHECK, 1, handle);
 
-			if (!info_ptr)  {
-				png_destroy_write_struct(&png_ptr,  (png_infopp)NULL);
-				return FALSE;
-			}
+		if (png_sig_cmp(png_check, (png_size_t)0, PNG_BYTES_TO_CHECK) != 0) {
+			throw (const char*)NULL;	// Bad signature
+		}
 
-			// Set error handling.  REQUIRED if you aren't supplying your own
-			// error handling functions in the png_create_write_struct() call.
+		decoder->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, error_handler, warning_handler);
+		if (!decoder->png_ptr) {
+			throw (const char*)NULL;
+		}
+		decoder->info_ptr = png_create_info_struct(decoder->png_ptr);
+		if (!decoder->info_ptr) {
+			throw (const char*)NULL;
+		}
 
-			if (setjmp(png_jmpbuf(png_ptr)))  {
-				// if we get here, we had a problem reading the file
+		png_set_read_fn(decoder->png_ptr, &decoder->fio, _ReadProc);
 
-				png_destroy_write_struct(&png_ptr, &info_ptr);
+		if (setjmp(png_jmpbuf(decoder->png_ptr))) {
+			// assume error_handler was called before by the PNG library
+			throw (const char*)NULL;
+		}
 
-				return FALSE;
-			}
+		png_set_sig_bytes(decoder->png_ptr, PNG_BYTES_TO_CHECK);
 
-			// init the IO
-            
-			png_set_write_fn(png_ptr, &fio, _WriteProc, _FlushProc);
+		png_read_info(decoder->png_ptr, decoder->info_ptr);
 
-			// set physical resolution
+		if (png_get_interlace_type(decoder->png_ptr, decoder->info_ptr) != PNG_INTERLACE_NONE) {
+			// interlaced rows are only complete after the last pass
+			throw (const char*)NULL;
+		}
 
-			png_uint_32 res_x = (png_uint_32)FreeImage_GetDotsPerMeterX(dib);
-			png_uint_32 res_y = (png_uint_32)FreeImage_GetDotsPerMeterY(dib);
+		*header = AllocateDecodedImage(decoder->png_ptr, decoder->info_ptr, flags, TRUE);
 
-			if ((res_x > 0) && (res_y > 0))  {
-				png_set_pHYs(png_ptr, info_ptr, res_x, res_y, PNG_RESOLUTION_METER);
-			}
-	
-			// Set the image information here.  Width and height are up to 2^31,
-			// bit_depth is one of 1, 2, 4, 8, or 16, but valid values also depend on
-			// the color_type selected. color_type is one of PNG_COLOR_TYPE_GRAY,
-			// PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE, PNG_COLOR_TYPE_RGB,
-			// or PNG_COLOR_TYPE_RGB_ALPHA.  interlace is either PNG_INTERLACE_NONE or
-			// PNG_INTERLACE_ADAM7, and the compression_type and filter_type MUST
-			// currently be PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE. REQUIRED
+		if (FreeImage_GetBPP(*header) == 32) {
+			FreeImage_SetTransparent(*header, (FreeImage_GetColorType(*header) == FIC_RGBALPHA) ? TRUE : FALSE);
+		}
 
-			width = FreeImage_GetWidth(dib);
-			height = FreeImage_GetHeight(dib);
-			pixel_depth = FreeImage_GetBPP(dib);
+		// metadata located before the image data (the metadata located after the image data is ignored)
+		ReadMetadata(decoder->png_ptr, decoder->info_ptr, *header);
 
-			BOOL bInterlaced = FALSE;
-			if( (flags & PNG_INTERLACED) == PNG_INTERLACED) {
-				interlace_type = PNG_INTERLACE_ADAM7;
-				bInterlaced = TRUE;
-			} else {
-				interlace_type = PNG_INTERLACE_NONE;
-			}
+		png_set_benign_errors(decoder->png_ptr, 1);
 
-			// set the ZLIB compression level or default to PNG default compression level (ZLIB level = 6)
-			int zlib_level = flags & 0x0F;
-			if((zlib_level >= 1) && (zlib_level <= 9)) {
-				png_set_compression_level(png_ptr, zlib_level);
-			} else if((flags & PNG_Z_NO_COMPRESSION) == PNG_Z_NO_COMPRESSION) {
-				png_set_compression_level(png_ptr, Z_NO_COMPRESSION);
-			}
+		return decoder;
 
-			// filtered strategy works better for high color images
-			if(pixel_depth >= 16){
-				png_set_compression_strategy(png_ptr, Z_FILTERED);
-				png_set_filter(png_ptr, 0, PNG_FILTER_NONE|PNG_FILTER_SUB|PNG_FILTER_PAETH);
-			} else {
-				png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
-			}
+	} catch (const char *text) {
+		if (*header) {
+			FreeImage_Unload(*header);
+			*header = NULL;
+		}
+		CloseScanlines(io, handle, decoder);
+		if (NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+	}
 
-			FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
-			if(image_type == FIT_BITMAP) {
-				// standard image type
-				bit_depth = (pixel_depth > 8) ? 8 : pixel_depth;
-			} else {
-				// 16-bit greyscale or 16-bit RGB(A)
-				bit_depth = 16;
-			}
+	return NULL;
+}
 
-			// check for transparent images
-			BOOL bIsTransparent = 
-				(image_type == FIT_BITMAP) && FreeImage_IsTransparent(dib) && (FreeImage_GetTransparencyCount(dib) > 0) ? TRUE : FALSE;
+static unsigned DLL_CALLCONV
+ReadScanlines(FreeImageIO *io, fi_handle handle, void *reader, BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
 
-			switch (FreeImage_GetColorType(dib)) {
-				case FIC_MINISWHITE:
-					if(!bIsTransparent) {
-						// Invert monochrome files to have 0 as black and 1 as white (no break here)
-						png_set_invert_mono(png_ptr);
-					}
-					// (fall through)
-
-				case FIC_MINISBLACK:
-					if(!bIsTransparent) {
-						png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
-							PNG_COLOR_TYPE_GRAY, interlace_type, 
-							PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-						break;
-					}
-					// If a monochrome image is transparent, save it with a palette
-					// (fall through)
+	volatile unsigned rows = 0;
 
-				case FIC_PALETTE:
-				{
-					png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
-						PNG_COLOR_TYPE_PALETTE, interlace_type, 
-						PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	if (decoder->failed) {
+		return 0;
+	}
 
-					// set the palette
+	try {
+		if (setjmp(png_jmpbuf(decoder->png_ptr))) {
+			// assume error_handler was called before by the PNG library
+			throw (const char*)NULL;
+		}
 
-					palette_entries = 1 << bit_depth;
-					palette = (png_colorp)png_malloc(png_ptr, palette_entries * sizeof (png_color));
-					pal = FreeImage_GetPalette(dib);
+		const png_size_t rowbytes = png_get_rowbytes(decoder->png_ptr, decoder->info_ptr);
 
-					for (int i = 0; i < palette_entries; i++) {
-						palette[i].red   = pal[i].rgbRed;
-						palette[i].green = pal[i].rgbGreen;
-						palette[i].blue  = pal[i].rgbBlue;
-					}
-					
-					png_set_PLTE(png_ptr, info_ptr, palette, palette_entries);
+		for (; rows < count; rows++) {
+			BYTE *row = bits + (size_t)rows * pitch;
+			// libpng keeps the unused bits of a partial last byte: clear them like a newly allocated dib
+			row[rowbytes - 1] = 0;
+			png_read_row(decoder->png_ptr, row, NULL);
+		}
 
-					// You must not free palette here, because png_set_PLTE only makes a link to
-					// the palette that you malloced.  Wait until you are about to destroy
-					// the png structure.
+	} catch (const char *text) {
+		// return the rows decoded so far
+		decoder->failed = TRUE;
+		if (NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+	}
 
-					break;
-				}
+	return rows;
+}
 
-				case FIC_RGBALPHA :
-					has_alpha_channel = TRUE;
+// --------------------------------------------------------------------------
 
-					png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
-						PNG_COLOR_TYPE_RGBA, interlace_type, 
-						PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+/**
+Describe a dib to the PNG encoder and write the file header
+@param png_ptr PNG encoder
+@param info_ptr PNG image information
+@param dib Image to be saved (may be a header-only image)
+@param flags Save flags
+@param palette Returns the palette allocated with png_malloc (or NULL), to be released with png_free after the image is written
+@return Returns TRUE if 32-bit rows must be converted to 24-bit rows before being written, returns FALSE otherwise
+*/
+static BOOL
+WriteImageHeader(png_structp png_ptr, png_infop info_ptr, FIBITMAP *dib, int flags, png_colorp *palette) {
+	png_uint_32 width, height;
+	BOOL has_alpha_channel = FALSE;
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// flip BGR pixels to RGB
-					if(image_type == FIT_BITMAP) {
-						png_set_bgr(png_ptr);
-					}
-#endif
-					break;
-	
-				case FIC_RGB:
-					png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
-						PNG_COLOR_TYPE_RGB, interlace_type, 
-						PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	RGBQUAD *pal;					// pointer to dib palette
+	int bit_depth, pixel_depth;		// pixel_depth = bit_depth * channels
+	int palette_entries;
+	int	interlace_type;
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// flip BGR pixels to RGB
-					if(image_type == FIT_BITMAP) {
-						png_set_bgr(png_ptr);
-					}
-#endif
-					break;
-					
-				case FIC_CMYK:
-					break;
-			}
+	*palette = NULL;
 
-			// write possible ICC profile
+	// set physical resolution
 
-			FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
-			if (iccProfile->size && iccProfile->data) {
-				// skip ICC profile check
-				png_set_option(png_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, 1);
-				png_set_iCCP(png_ptr, info_ptr, "Embedded Profile", 0, (png_const_bytep)iccProfile->data, iccProfile->size);
-			}
+	png_uint_32 res_x = (png_uint_32)FreeImage_GetDotsPerMeterX(dib);
+	png_uint_32 res_y = (png_uint_32)FreeImage_GetDotsPerMeterY(dib);
+
+	if ((res_x > 0) && (res_y > 0))  {
+		png_set_pHYs(png_ptr, info_ptr, res_x, res_y, PNG_RESOLUTION_METER);
+	}
+
+	// Set the image information here.  Width and height are up to 2^31,
+	// bit_depth is one of 1, 2, 4, 8, or 16, but valid values also depend on
+	// the color_type selected. color_type is one of PNG_COLOR_TYPE_GRAY,
+	// PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE, PNG_COLOR_TYPE_RGB,
+	// or PNG_COLOR_TYPE_RGB_ALPHA.  interlace is either PNG_INTERLACE_NONE or
+	// PNG_INTERLACE_ADAM7, and the compression_type and filter_type MUST
+	// currently be PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE. REQUIRED
+
+	width = FreeImage_GetWidth(dib);
+	height = FreeImage_GetHeight(dib);
+	pixel_depth = FreeImage_GetBPP(dib);
+
+	if( (flags & PNG_INTERLACED) == PNG_INTERLACED) {
+		interlace_type = PNG_INTERLACE_ADAM7;
+	} else {
+		interlace_type = PNG_INTERLACE_NONE;
+	}
 
-			// write metadata
+	// set the ZLIB compression level or default to PNG default compression level (ZLIB level = 6)
+	int zlib_level = flags & 0x0F;
+	if((zlib_level >= 1) && (zlib_level <= 9)) {
+		png_set_compression_level(png_ptr, zlib_level);
+	} else if((flags & PNG_Z_NO_COMPRESSION) == PNG_Z_NO_COMPRESSION) {
+		png_set_compression_level(png_ptr, Z_NO_COMPRESSION);
+	}
 
-			WriteMetadata(png_ptr, info_ptr, dib);
+	// filtered strategy works better for high color images
+	if(pixel_depth >= 16){
+		png_set_compression_strategy(png_ptr, Z_FILTERED);
+		png_set_filter(png_ptr, 0, PNG_FILTER_NONE|PNG_FILTER_SUB|PNG_FILTER_PAETH);
+	} else {
+		png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
+	}
 
-			// Optional gamma chunk is strongly suggested if you have any guess
-			// as to the correct gamma of the image.
-			// png_set_gAMA(png_ptr, info_ptr, gamma);
+	FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	if(image_type == FIT_BITMAP) {
+		// standard image type
+		bit_depth = (pixel_depth > 8) ? 8 : pixel_depth;
+	} else {
+		// 16-bit greyscale or 16-bit RGB(A)
+		bit_depth = 16;
+	}
 
-			// set the transparency table
+	// check for transparent images
+	BOOL bIsTransparent = 
+		(image_type == FIT_BITMAP) && FreeImage_IsTransparent(dib) && (FreeImage_GetTransparencyCount(dib) > 0) ? TRUE : FALSE;
 
-			if (bIsTransparent) {
-				png_set_tRNS(png_ptr, info_ptr, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib), NULL);
+	switch (FreeImage_GetColorType(dib)) {
+		case FIC_MINISWHITE:
+			if(!bIsTransparent) {
+				// Invert monochrome files to have 0 as black and 1 as white (no break here)
+				png_set_invert_mono(png_ptr);
+			}
+			// (fall through)
+
+		case FIC_MINISBLACK:
+			if(!bIsTransparent) {
+				png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
+					PNG_COLOR_TYPE_GRAY, interlace_type, 
+					PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+				break;
 			}
+			// If a monochrome image is transparent, save it with a palette
+			// (fall through)
 
-			// set the background color
+		case FIC_PALETTE:
+		{
+			png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
+				PNG_COLOR_TYPE_PALETTE, interlace_type, 
+				PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
-			if(FreeImage_HasBackgroundColor(dib)) {
-				png_color_16 image_background;
-				RGBQUAD rgbBkColor;
+			// set the palette
 
-				FreeImage_GetBackgroundColor(dib, &rgbBkColor);
-				memset(&image_background, 0, sizeof(png_color_16));
-				image_background.blue  = rgbBkColor.rgbBlue;
-				image_background.green = rgbBkColor.rgbGreen;
-				image_background.red   = rgbBkColor.rgbRed;
-				image_background.index = rgbBkColor.rgbReserved;
+			palette_entries = 1 << bit_depth;
+			*palette = (png_colorp)png_malloc(png_ptr, palette_entries * sizeof (png_color));
+			pal = FreeImage_GetPalette(dib);
 
-				png_set_bKGD(png_ptr, info_ptr, &image_background);
+			for (int i = 0; i < palette_entries; i++) {
+				(*palette)[i].red   = pal[i].rgbRed;
+				(*palette)[i].green = pal[i].rgbGreen;
+				(*palette)[i].blue  = pal[i].rgbBlue;
 			}
 			
-			// Write the file header information.
+			png_set_PLTE(png_ptr, info_ptr, *palette, palette_entries);
 
-			png_write_info(png_ptr, info_ptr);
+			// You must not free palette here, because png_set_PLTE only makes a link to
+			// the palette that you malloced.  Wait until you are about to destroy
+			// the png structure.
 
-			// write out the image data
+			break;
+		}
 
-#ifndef FREEIMAGE_BIGENDIAN
-			if (bit_depth == 16) {
-				// turn on 16 bit byte swapping
-				png_set_swap(png_ptr);
+		case FIC_RGBALPHA :
+			has_alpha_channel = TRUE;
+
+			png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
+				PNG_COLOR_TYPE_RGBA, interlace_type, 
+				PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			// flip BGR pixels to RGB
+			if(image_type == FIT_BITMAP) {
+				png_set_bgr(png_ptr);
 			}
 #endif
+			break;
 
-			int number_passes = 1;
-			if (bInterlaced) {
-				number_passes = png_set_interlace_handling(png_ptr);
+		case FIC_RGB:
+			png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, 
+				PNG_COLOR_TYPE_RGB, interlace_type, 
+				PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			// flip BGR pixels to RGB
+			if(image_type == FIT_BITMAP) {
+				png_set_bgr(png_ptr);
 			}
+#endif
+			break;
+			
+		case FIC_CMYK:
+			break;
+	}
 
-			if ((pixel_depth == 32) && (!has_alpha_channel)) {
-				BYTE *buffer = (BYTE *)malloc(width * 3);
+	// write possible ICC profile
 
-				// transparent conversion to 24-bit
+	FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
+	if (iccProfile->size && iccProfile->data) {
+		// skip ICC profile check
+		png_set_option(png_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, 1);
+		png_set_iCCP(png_ptr, info_ptr, "Embedded Profile", 0, (png_const_bytep)iccProfile->data, iccProfile->size);
+	}
+
+	// write metadata
+
+	WriteMetadata(png_ptr, info_ptr, dib);
+
+	// Optional gamma chunk is strongly suggested if you have any guess
+	// as to the correct gamma of the image.
+	// png_set_gAMA(png_ptr, info_ptr, gamma);
+
+	// set the transparency table
+
+	if (bIsTransparent) {
+		png_set_tRNS(png_ptr, info_ptr, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib), NULL);
+	}
+
+	// set the background color
+
+	if(FreeImage_HasBackgroundColor(dib)) {
+		png_color_16 image_background;
+		RGBQUAD rgbBkColor;
+
+		FreeImage_GetBackgroundColor(dib, &rgbBkColor);
+		memset(&image_background, 0, sizeof(png_color_16));
+		image_background.blue  = rgbBkColor.rgbBlue;
+		image_background.green = rgbBkColor.rgbGreen;
+		image_background.red   = rgbBkColor.rgbRed;
+		image_background.index = rgbBkColor.rgbReserved;
+
+		png_set_bKGD(png_ptr, info_ptr, &image_background);
+	}
+	
+	// Write the file header information.
+
+	png_write_info(png_ptr, info_ptr);
+
+	// write out the image data
+
+#ifndef FREEIMAGE_BIGENDIAN
+	if (bit_depth == 16) {
+		// turn on 16 bit byte swapping
+		png_set_swap(png_ptr);
+	}
+#endif
+
+	// 32-bit images without an alpha channel are saved as 24-bit images
+	return ((pixel_depth == 32) && (!has_alpha_channel)) ? TRUE : FALSE;
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Scanline encoder state
+*/
+typedef struct tagScanlineEncoder {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	/// libpng keeps a pointer to this IO structure
+	fi_ioStructure fio;
+	/// palette linked to info_ptr
+	png_colorp palette;
+	/// 24-bit conversion buffer for 32-bit images without alpha channel, NULL otherwise
+	BYTE *buffer;
+	png_uint_32 width;
+	png_uint_32 height;
+	/// number of rows written so far
+	png_uint_32 rows;
+	/// TRUE once libpng has signaled an error
+	BOOL failed;
+} ScanlineEncoder;
+
+static void
+DestroyScanlineEncoder(ScanlineEncoder *encoder) {
+	if (encoder->png_ptr) {
+		if (encoder->palette) {
+			png_free(encoder->png_ptr, encoder->palette);
+		}
+		png_destroy_write_struct(&encoder->png_ptr, &encoder->info_ptr);
+	}
+	free(encoder->buffer);
+	free(encoder);
+}
+
+static void * DLL_CALLCONV
+CreateScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *header, int page, int flags, void *data) {
+	if (!header || !handle || ((flags & PNG_INTERLACED) == PNG_INTERLACED)) {
+		// interlaced rows are only written after the last row is known
+		return NULL;
+	}
+
+	ScanlineEncoder *volatile encoder = (ScanlineEncoder*)malloc(sizeof(ScanlineEncoder));
+	if (!encoder) {
+		return NULL;
+	}
+	memset(encoder, 0, sizeof(ScanlineEncoder));
+	encoder->fio.s_handle = handle;
+	encoder->fio.s_io = io;
+	encoder->width = FreeImage_GetWidth(header);
+	encoder->height = FreeImage_GetHeight(header);
+
+	try {
+		// same setup as Save, the encoder is kept alive between calls
+
+		encoder->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, error_handler, warning_handler);
+		if (!encoder->png_ptr) {
+			throw (const char*)NULL;
+		}
+		encoder->info_ptr = png_create_info_struct(encoder->png_ptr);
+		if (!encoder->info_ptr) {
+			throw (const char*)NULL;
+		}
+
+		if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+			// assume error_handler was called before by the PNG library
+			throw (const char*)NULL;
+		}
+
+		png_set_write_fn(encoder->png_ptr, &encoder->fio, _WriteProc, _FlushProc);
+
+		if (WriteImageHeader(encoder->png_ptr, encoder->info_ptr, header, flags, &encoder->palette)) {
+			encoder->buffer = (BYTE*)malloc(encoder->width * 3);
+			if (!encoder->buffer) {
+				throw FI_MSG_ERROR_MEMORY;
+			}
+		}
+
+		return encoder;
+
+	} catch (const char *text) {
+		DestroyScanlineEncoder(encoder);
+		if (NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+	}
+
+	return NULL;
+}
+
+static unsigned DLL_CALLCONV
+WriteScanlines(FreeImageIO *io, fi_handle handle, void *writer, const BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+
+	volatile unsigned rows = 0;
+
+	if (encoder->failed) {
+		return 0;
+	}
+
+	try {
+		if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+			// assume error_handler was called before by the PNG library
+			throw (const char*)NULL;
+		}
+
+		for (; (rows < count) && (encoder->rows < encoder->height); rows++, encoder->rows++) {
+			const BYTE *row = bits + (size_t)rows * pitch;
+
+			if (encoder->buffer) {
+				// transparent conversion to 24-bit
+				FreeImage_ConvertLine32To24(encoder->buffer, (BYTE*)row, encoder->width);
+				png_write_row(encoder->png_ptr, encoder->buffer);
+			} else {
+				png_write_row(encoder->png_ptr, row);
+			}
+		}
+
+	} catch (const char *text) {
+		// return the rows written so far
+		encoder->failed = TRUE;
+		if (NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+	}
+
+	return rows;
+}
+
+static BOOL DLL_CALLCONV
+FinishScanlines(FreeImageIO *io, fi_handle handle, void *writer) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+
+	volatile BOOL bResult = FALSE;
+
+	if (!encoder->failed && (encoder->rows == encoder->height)) {
+		try {
+			if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+				// assume error_handler was called before by the PNG library
+				throw (const char*)NULL;
+			}
+
+			png_write_end(encoder->png_ptr, encoder->info_ptr);
+
+			bResult = TRUE;
+
+		} catch (const char *text) {
+			if (NULL != text) {
+				FreeImage_OutputMessageProc(s_format_id, text);
+			}
+		}
+	}
+
+	DestroyScanlineEncoder(encoder);
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------------
+// Row filtering and compression
+// --------------------------------------------------------------------------
+
+/// size of the filtered data filtered and compressed as a unit (see PNG_PARALLEL)
+static const size_t PNG_BLOCK_SIZE = 256 * 1024;
+/// deflate window size: the end of a block is the dictionary of the next one
+static const size_t PNG_WINDOW_SIZE = 32768;
+
+/**
+Layout of the rows handed to libpng, reproducing the transformations set by WriteImageHeader, 
+and coding of the filtered rows
+*/
+typedef struct tagPNGRowLayout {
+	/// PNG row size, without the filter type byte
+	size_t rowbytes;
+	/// distance of the Sub, Average and Paeth filters
+	unsigned bytesperpixel;
+	/// 32-bit rows saved as 24-bit rows
+	BOOL convertTo24;
+	/// png_set_invert_mono
+	BOOL invert;
+	/// png_set_bgr
+	BOOL swapRB;
+	/// png_set_swap
+	BOOL swap16;
+	/// PNG_FILTER_xxx mask the filter of each row is chosen from
+	int filters;
+	/// TRUE to choose the filter of each row by compressing the row (PNG_FILTER_BRUTE)
+	BOOL brute;
+	/// ZLIB compression level and strategy
+	int level;
+	int strategy;
+} PNGRowLayout;
+
+/**
+Describe the rows written by libpng for a dib
+@param bConvertTo24 Value returned by WriteImageHeader
+@param flags Save flags
+@return Returns FALSE if the rows cannot be written without libpng
+*/
+static BOOL
+GetRowLayout(FIBITMAP *dib, BOOL bConvertTo24, int flags, PNGRowLayout *layout) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(dib);
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	const unsigned pixel_depth = bConvertTo24 ? 24 : bpp;
+
+	const BOOL bIsTransparent = 
+		(image_type == FIT_BITMAP) && FreeImage_IsTransparent(dib) && (FreeImage_GetTransparencyCount(dib) > 0) ? TRUE : FALSE;
+
+	if(color_type == FIC_CMYK) {
+		return FALSE;
+	}
+
+	memset(layout, 0, sizeof(PNGRowLayout));
+
+	layout->rowbytes = ((size_t)FreeImage_GetWidth(dib) * pixel_depth + 7) / 8;
+	layout->bytesperpixel = MAX((unsigned)1, pixel_depth / 8);
+	layout->convertTo24 = bConvertTo24;
+	layout->invert = ((color_type == FIC_MINISWHITE) && !bIsTransparent) ? TRUE : FALSE;
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	layout->swapRB = ((image_type == FIT_BITMAP) && (pixel_depth >= 24)) ? TRUE : FALSE;
+#endif
+#ifndef FREEIMAGE_BIGENDIAN
+	layout->swap16 = (image_type != FIT_BITMAP) ? TRUE : FALSE;
+#endif
+
+	// same ZLIB settings as WriteImageHeader
+	layout->level = Z_DEFAULT_COMPRESSION;
+	const int zlib_level = flags & 0x0F;
+	if((zlib_level >= 1) && (zlib_level <= 9)) {
+		layout->level = zlib_level;
+	} else if((flags & PNG_Z_NO_COMPRESSION) == PNG_Z_NO_COMPRESSION) {
+		layout->level = Z_NO_COMPRESSION;
+	}
+	layout->strategy = (bpp >= 16) ? Z_FILTERED : Z_DEFAULT_STRATEGY;
+
+	// filters: libpng uses none for palettes and bit depths below 8 (see WriteImageHeader for the others), 
+	// the heuristic does not work for them but the compressed size does
+	const BOOL bFiltered = (bpp >= 16) || ((bpp == 8) && ((color_type == FIC_MINISBLACK) || (color_type == FIC_MINISWHITE)) && !bIsTransparent);
+
+	if(((flags & PNG_FILTER_BRUTE) == PNG_FILTER_BRUTE) && (layout->level != Z_NO_COMPRESSION)) {
+		layout->filters = PNG_ALL_FILTERS;
+		layout->brute = TRUE;
+	} else if(!bFiltered) {
+		layout->filters = PNG_FILTER_NONE;
+	} else if((bpp >= 16) && ((flags & PNG_FILTER_ADAPTIVE) != PNG_FILTER_ADAPTIVE)) {
+		layout->filters = PNG_FILTER_NONE | PNG_FILTER_SUB | PNG_FILTER_PAETH;
+	} else {
+		layout->filters = PNG_ALL_FILTERS;
+	}
+
+	return TRUE;
+}
+
+/**
+Convert a dib scanline to a PNG row
+*/
+static void
+ConvertRow(BYTE *dst, const BYTE *src, unsigned width, const PNGRowLayout *layout) {
+	if(layout->convertTo24) {
+		FreeImage_ConvertLine32To24(dst, (BYTE*)src, width);
+	} else {
+		memcpy(dst, src, layout->rowbytes);
+	}
+	if(layout->invert) {
+		for(size_t i = 0; i < layout->rowbytes; i++) {
+			dst[i] = (BYTE)~dst[i];
+		}
+	}
+	if(layout->swapRB) {
+		for(size_t i = 0; i < layout->rowbytes; i += layout->bytesperpixel) {
+			INPLACESWAP(dst[i], dst[i + 2]);
+		}
+	}
+	if(layout->swap16) {
+		for(size_t i = 0; i < layout->rowbytes; i += 2) {
+			INPLACESWAP(dst[i], dst[i + 1]);
+		}
+	}
+}
+
+static inline BYTE
+PaethPredictor(int a, int b, int c) {
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+	return (BYTE)(((pa <= pb) && (pa <= pc)) ? a : ((pb <= pc) ? b : c));
+}
+
+#ifdef FI_PNG_SSE2
+
+/// Average filter predictor of 16 bytes: (a + b) >> 1
+static inline __m128i
+AveragePredictorSSE2(__m128i a, __m128i b) {
+	// pavgb rounds up
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+/// Paeth predictor of 8 samples widened to 16 bits
+static inline __m128i
+PaethPredictorSSE2(__m128i a, __m128i b, __m128i c) {
+	const __m128i zero = _mm_setzero_si128();
+	// pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+	const __m128i bc = _mm_sub_epi16(b, c);
+	const __m128i ac = _mm_sub_epi16(a, c);
+	const __m128i abc = _mm_add_epi16(ac, bc);
+	const __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+	const __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+	const __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+	// b if pb <= pc, c otherwise
+	const __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+	const __m128i bc_pred = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+	// a if pa <= pb and pa <= pc
+	const __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	return _mm_or_si128(_mm_and_si128(not_a, bc_pred), _mm_andnot_si128(not_a, a));
+}
+
+#endif // FI_PNG_SSE2
+
+/**
+Apply a PNG filter to a row
+@param out Filtered row: filter type byte followed by rowbytes bytes
+@param row PNG row
+@param prev Previous PNG row (zeros for the first row)
+*/
+static void
+FilterRow(BYTE *out, const BYTE *row, const BYTE *prev, size_t rowbytes, unsigned bpp, BYTE filter) {
+	*out++ = filter;
+
+	const size_t head = MIN((size_t)bpp, rowbytes);
+	size_t i = 0;
+
+	switch(filter) {
+		case PNG_FILTER_VALUE_SUB:
+			for(; i < head; i++) {
+				out[i] = row[i];
+			}
+#ifdef FI_PNG_SSE2
+			for(; i + 16 <= rowbytes; i += 16) {
+				const __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				const __m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				_mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, a));
+			}
+#endif
+			for(; i < rowbytes; i++) {
+				out[i] = (BYTE)(row[i] - row[i - bpp]);
+			}
+			break;
+
+		case PNG_FILTER_VALUE_UP:
+#ifdef FI_PNG_SSE2
+			for(; i + 16 <= rowbytes; i += 16) {
+				const __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				_mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, b));
+			}
+#endif
+			for(; i < rowbytes; i++) {
+				out[i] = (BYTE)(row[i] - prev[i]);
+			}
+			break;
+
+		case PNG_FILTER_VALUE_AVG:
+			for(; i < head; i++) {
+				out[i] = (BYTE)(row[i] - (prev[i] >> 1));
+			}
+#ifdef FI_PNG_SSE2
+			for(; i + 16 <= rowbytes; i += 16) {
+				const __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				const __m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				_mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, AveragePredictorSSE2(a, b)));
+			}
+#endif
+			for(; i < rowbytes; i++) {
+				out[i] = (BYTE)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+			}
+			break;
+
+		case PNG_FILTER_VALUE_PAETH:
+			for(; i < head; i++) {
+				out[i] = (BYTE)(row[i] - prev[i]);
+			}
+#ifdef FI_PNG_SSE2
+			{
+				const __m128i zero = _mm_setzero_si128();
+				for(; i + 16 <= rowbytes; i += 16) {
+					const __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+					const __m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+					const __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+					const __m128i c = _mm_loadu_si128((const __m128i*)(prev + i - bpp));
+					const __m128i lo = PaethPredictorSSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+					const __m128i hi = PaethPredictorSSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+					_mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, _mm_packus_epi16(lo, hi)));
+				}
+			}
+#endif
+			for(; i < rowbytes; i++) {
+				out[i] = (BYTE)(row[i] - PaethPredictor(row[i - bpp], prev[i], prev[i - bpp]));
+			}
+			break;
+
+		default:
+			memcpy(out, row, rowbytes);
+			break;
+	}
+}
+
+/**
+Filter selection heuristic: sum of the absolute values of the filtered bytes, read as signed bytes
+*/
+static size_t
+SumAbsoluteValues(const BYTE *data, size_t length) {
+	size_t sum = 0;
+	size_t i = 0;
+
+#ifdef FI_PNG_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	for(; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+		// |v| = min(v, 256 - v)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero));
+	}
+	UINT64 lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	sum = (size_t)(lanes[0] + lanes[1]);
+#endif
+
+	for(; i < length; i++) {
+		sum += (data[i] < 128) ? data[i] : 256 - data[i];
+	}
+
+	return sum;
+}
+
+/**
+Filter selection by brute force: size of a filtered row compressed after the rows preceding it
+@param z Raw deflate stream of the compression settings
+@param buffer Output buffer
+@param context Filtered rows preceding the row (at most PNG_WINDOW_SIZE bytes are used)
+*/
+static size_t
+CompressedSize(z_stream *z, std::vector<BYTE>& buffer, const BYTE *data, size_t length, const BYTE *context, size_t context_length) {
+	deflateReset(z);
+
+	if(context_length > PNG_WINDOW_SIZE) {
+		context += context_length - PNG_WINDOW_SIZE;
+		context_length = PNG_WINDOW_SIZE;
+	}
+	if(context_length > 0) {
+		deflateSetDictionary(z, context, (uInt)context_length);
+	}
+
+	z->next_in = (Bytef*)data;
+	z->avail_in = (uInt)length;
+
+	size_t size = 0;
+	do {
+		z->next_out = &buffer[0];
+		z->avail_out = (uInt)buffer.size();
+		if(deflate(z, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+			return (size_t)-1;
+		}
+		size += buffer.size() - z->avail_out;
+	} while(z->avail_out == 0);
+
+	return size;
+}
+
+/**
+Convert and filter consecutive rows. 
+The filter of each row is the one of the layout filter mask giving the smallest sum of absolute values 
+(the libpng heuristic) or the smallest compressed size (PNG_FILTER_BRUTE).
+@param filtered Output buffer, count x (1 + rowbytes) bytes
+@param dib Image to filter
+@param bits Pixels of dib, read by the pool threads instead of calling FreeImage_GetScanLine
+@param pitch Pitch of dib
+@param first Index of the first row (top row first)
+@param count Number of rows
+@return Returns FALSE if a memory allocation failed
+*/
+static BOOL
+FilterRows(BYTE *filtered, FIBITMAP *dib, const BYTE *bits, unsigned pitch, unsigned first, unsigned count, const PNGRowLayout *layout) {
+	static const int masks[PNG_FILTER_VALUE_LAST] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH };
+
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const size_t stride = 1 + layout->rowbytes;
+
+	BYTE *buffer = (BYTE*)malloc(3 * stride);
+	if(!buffer) {
+		return FALSE;
+	}
+	BYTE *prev = buffer;
+	BYTE *row = buffer + stride;
+	BYTE *scratch = buffer + 2 * stride;
+
+	// brute force: the context of a row is limited to the previous rows of the block, 
+	// so that the filters do not depend on the number of threads
+	z_stream trial;
+	std::vector<BYTE> trial_buffer;
+	if(layout->brute) {
+		memset(&trial, 0, sizeof(z_stream));
+		if(deflateInit2(&trial, layout->level, Z_DEFLATED, -MAX_WBITS, 8, layout->strategy) != Z_OK) {
+			free(buffer);
+			return FALSE;
+		}
+		trial_buffer.resize(deflateBound(&trial, (uLong)stride) + 16);
+	}
+
+	if(first > 0) {
+		ConvertRow(prev, CalculateScanLine(bits, pitch, height - first), width, layout);
+	} else {
+		memset(prev, 0, stride);
+	}
+
+	for(unsigned k = 0; k < count; k++) {
+		BYTE *out = filtered + (size_t)k * stride;
+
+		ConvertRow(row, CalculateScanLine(bits, pitch, height - first - k - 1), width, layout);
+
+		size_t best_cost = (size_t)-1;
+
+		for(BYTE filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST; filter++) {
+			if(layout->filters == masks[filter]) {
+				// a single filter
+				FilterRow(out, row, prev, layout->rowbytes, layout->bytesperpixel, filter);
+				break;
+			}
+			if(layout->filters & masks[filter]) {
+				FilterRow(scratch, row, prev, layout->rowbytes, layout->bytesperpixel, filter);
+
+				const size_t cost = layout->brute ? 
+					CompressedSize(&trial, trial_buffer, scratch, stride, filtered, (size_t)k * stride) :
+					SumAbsoluteValues(scratch + 1, layout->rowbytes);
+
+				if(cost < best_cost) {
+					best_cost = cost;
+					memcpy(out, scratch, stride);
+				}
+			}
+		}
+
+		std::swap(prev, row);
+	}
+
+	if(layout->brute) {
+		deflateEnd(&trial);
+	}
+	free(buffer);
+
+	return TRUE;
+}
+
+/**
+Compressed block of filtered rows
+*/
+typedef struct tagPNGBlock {
+	std::vector<BYTE> data;
+	uLong adler;
+	size_t length;
+	BOOL failed;
+} PNGBlock;
+
+/**
+Compress filtered rows as a raw deflate block, ending at a byte boundary (full flush) 
+so that the blocks can be concatenated
+@param dictionary Data preceding the block, at most PNG_WINDOW_SIZE bytes are used
+@param last TRUE for the last block of the image (the deflate stream is closed)
+*/
+static void
+CompressBlock(PNGBlock *block, const BYTE *data, size_t length, const BYTE *dictionary, size_t dictionary_length, const PNGRowLayout *layout, BOOL last) {
+	z_stream z;
+	memset(&z, 0, sizeof(z_stream));
+
+	block->length = length;
+	block->adler = adler32(1L, data, (uInt)length);
+	block->failed = TRUE;
+
+	if(deflateInit2(&z, layout->level, Z_DEFLATED, -MAX_WBITS, 8, layout->strategy) != Z_OK) {
+		return;
+	}
+
+	if(dictionary_length > PNG_WINDOW_SIZE) {
+		dictionary += dictionary_length - PNG_WINDOW_SIZE;
+		dictionary_length = PNG_WINDOW_SIZE;
+	}
+	if(dictionary_length > 0) {
+		deflateSetDictionary(&z, dictionary, (uInt)dictionary_length);
+	}
+
+	const int flush = last ? Z_FINISH : Z_FULL_FLUSH;
+
+	block->data.resize(deflateBound(&z, (uLong)length) + 16);
+	z.next_in = (Bytef*)data;
+	z.avail_in = (uInt)length;
+
+	for(;;) {
+		if(z.total_out == block->data.size()) {
+			block->data.resize(2 * block->data.size());
+		}
+		z.next_out = &block->data[z.total_out];
+		z.avail_out = (uInt)(block->data.size() - z.total_out);
+
+		const int ret = deflate(&z, flush);
+		if(ret == Z_STREAM_ERROR) {
+			break;
+		}
+		if(last ? (ret == Z_STREAM_END) : (z.avail_out != 0)) {
+			block->failed = FALSE;
+			break;
+		}
+	}
+
+	block->data.resize(z.total_out);
+	deflateEnd(&z);
+}
+
+/**
+Write the image data as IDAT chunks, then the IEND chunk (replaces png_write_row and png_write_end).<br>
+Rows are converted and filtered on the thread pool by blocks of PNG_BLOCK_SIZE bytes. 
+With PNG_PARALLEL, each block is also compressed on the thread pool, using the end of the previous 
+one as a dictionary (the pigz approach), otherwise the blocks are compressed as a single stream.
+The block boundaries do not depend on the number of threads: the file is always the same.
+@param bits Pixels of dib, as returned by FreeImage_GetConstBits on the calling thread
+@param pitch Pitch of dib
+@return Returns FALSE if the compression failed
+*/
+static BOOL
+WriteImageData(png_structp png_ptr, FIBITMAP *dib, const BYTE *bits, unsigned pitch, const PNGRowLayout *layout, int flags) {
+	const unsigned height = FreeImage_GetHeight(dib);
+	const size_t stride = 1 + layout->rowbytes;
+	const BOOL bParallel = ((flags & PNG_PARALLEL) == PNG_PARALLEL);
+
+	ThreadPool& pool = ThreadPool::instance();
+
+	const unsigned rows_per_block = (unsigned)MAX((size_t)1, PNG_BLOCK_SIZE / stride);
+	const unsigned blocks_per_batch = 4 * pool.getThreadCount();
+	const unsigned rows_per_batch = rows_per_block * blocks_per_batch;
+
+	std::vector<BYTE> filtered((size_t)MIN(rows_per_batch, height) * stride);
+	std::vector<BYTE> window;
+	std::vector<PNGBlock> blocks(bParallel ? blocks_per_batch : 0);
+
+	// single stream (serial compression)
+	z_stream stream;
+	std::vector<BYTE> chunk;
+	if(!bParallel) {
+		memset(&stream, 0, sizeof(z_stream));
+		if(deflateInit2(&stream, layout->level, Z_DEFLATED, MAX_WBITS, 8, layout->strategy) != Z_OK) {
+			return FALSE;
+		}
+		chunk.resize(PNG_BLOCK_SIZE);
+	}
+
+	// zlib stream header of the blocks (see deflate.c)
+	const int level = layout->level;
+	const int level_flags = ((layout->strategy >= Z_HUFFMAN_ONLY) || ((level >= 0) && (level < 2))) ? 0 : (((level >= 0) && (level < 6)) ? 1 : (((level == 6) || (level == Z_DEFAULT_COMPRESSION)) ? 2 : 3));
+	unsigned header = ((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (level_flags << 6);
+	header += 31 - (header % 31);
+
+	uLong adler = adler32(0L, Z_NULL, 0);
+	BOOL bResult = TRUE;
+
+	for(unsigned first = 0; (first < height) && bResult; first += rows_per_batch) {
+		const unsigned rows = MIN(rows_per_batch, height - first);
+		const unsigned block_count = (rows + rows_per_block - 1) / rows_per_block;
+		const size_t batch_length = (size_t)rows * stride;
+		const BOOL last_batch = (first + rows == height);
+
+		// filter the rows of the batch
+
+		std::atomic<bool> bMemoryError(false);
+
+		pool.run(block_count, [&](unsigned i) {
+			const unsigned row = i * rows_per_block;
+			if(!FilterRows(&filtered[(size_t)row * stride], dib, bits, pitch, first + row, MIN(rows_per_block, rows - row), layout)) {
+				bMemoryError = true;
+			}
+		});
+
+		if(bMemoryError) {
+			bResult = FALSE;
+			break;
+		}
+
+		if(!bParallel) {
+			// compress the batch as a part of a single stream
+
+			stream.next_in = &filtered[0];
+			stream.avail_in = (uInt)batch_length;
+
+			const int flush = last_batch ? Z_FINISH : Z_NO_FLUSH;
+			int ret;
+			do {
+				stream.next_out = &chunk[0];
+				stream.avail_out = (uInt)chunk.size();
+				ret = deflate(&stream, flush);
+				if(ret == Z_STREAM_ERROR) {
+					bResult = FALSE;
+					break;
+				}
+				const size_t size = chunk.size() - stream.avail_out;
+				if(size > 0) {
+					png_write_chunk(png_ptr, (png_const_bytep)"IDAT", &chunk[0], size);
+				}
+			} while((stream.avail_out == 0) || (last_batch && (ret != Z_STREAM_END)));
+
+			continue;
+		}
+
+		// compress the blocks of the batch
+
+		pool.run(block_count, [&](unsigned i) {
+			const size_t offset = (size_t)i * rows_per_block * stride;
+			const size_t length = MIN((size_t)rows_per_block * stride, batch_length - offset);
+			const BOOL last = last_batch && (offset + length == batch_length);
+
+			if(i == 0) {
+				CompressBlock(&blocks[i], &filtered[offset], length, window.empty() ? NULL : &window[0], window.size(), layout, last);
+			} else {
+				CompressBlock(&blocks[i], &filtered[offset], length, &filtered[0], offset, layout, last);
+			}
+		});
+
+		// keep the end of the batch for the next one
+		const size_t window_length = MIN(batch_length, PNG_WINDOW_SIZE);
+		window.assign(filtered.begin() + (batch_length - window_length), filtered.begin() + batch_length);
+
+		// write the blocks in order
+
+		for(unsigned i = 0; i < block_count; i++) {
+			PNGBlock& block = blocks[i];
+			if(block.failed) {
+				bResult = FALSE;
+				break;
+			}
+			adler = adler32_combine(adler, block.adler, (z_off_t)block.length);
+
+			if((first == 0) && (i == 0)) {
+				const BYTE zlib_header[2] = { (BYTE)(header >> 8), (BYTE)(header & 0xFF) };
+				block.data.insert(block.data.begin(), zlib_header, zlib_header + 2);
+			}
+			if(last_batch && (i == block_count - 1)) {
+				const BYTE zlib_trailer[4] = { (BYTE)(adler >> 24), (BYTE)(adler >> 16), (BYTE)(adler >> 8), (BYTE)adler };
+				block.data.insert(block.data.end(), zlib_trailer, zlib_trailer + 4);
+			}
+
+			png_write_chunk(png_ptr, (png_const_bytep)"IDAT", &block.data[0], block.data.size());
+
+			std::vector<BYTE>().swap(block.data);
+		}
+	}
+
+	if(!bParallel) {
+		deflateEnd(&stream);
+	}
+
+	if(bResult) {
+		png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+	}
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------------
+
+static BOOL DLL_CALLCONV
+Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_colorp palette = NULL;
+	png_uint_32 width, height;
+
+	fi_ioStructure fio;
+    fio.s_handle = handle;
+	fio.s_io = io;
+
+	if ((dib) && (handle)) {
+		try {
+			// create the chunk manage structure
+
+			png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, error_handler, warning_handler);
+
+			if (!png_ptr)  {
+				return FALSE;
+			}
+
+			// allocate/initialize the image information data.
+
+			info_ptr = png_create_info_struct(png_ptr);
+
+			if (!info_ptr)  {
+				png_destroy_write_struct(&png_ptr,  (png_infopp)NULL);
+				return FALSE;
+			}
+
+			// Set error handling.  REQUIRED if you aren't supplying your own
+			// error handling functions in the png_create_write_struct() call.
+
+			if (setjmp(png_jmpbuf(png_ptr)))  {
+				// if we get here, we had a problem reading the file
+
+				png_destroy_write_struct(&png_ptr, &info_ptr);
+
+				return FALSE;
+			}
+
+			// init the IO
+            
+			png_set_write_fn(png_ptr, &fio, _WriteProc, _FlushProc);
+
+			// set the image information and write the file header
+
+			const BOOL bConvertTo24 = WriteImageHeader(png_ptr, info_ptr, dib, flags, &palette);
+
+			width = FreeImage_GetWidth(dib);
+			height = FreeImage_GetHeight(dib);
+
+			int number_passes = 1;
+			if ((flags & PNG_INTERLACED) == PNG_INTERLACED) {
+				number_passes = png_set_interlace_handling(png_ptr);
+			}
+
+			// read-only access to the pixels, resolved once on this thread before any row is dispatched 
+			// (FreeImage_GetScanLine would copy pixels shared with a copy-on-write clone)
+			const BYTE *bits = FreeImage_GetConstBits(dib);
+			const unsigned pitch = FreeImage_GetPitch(dib);
+
+			PNGRowLayout layout;
+			const BOOL bOwnEncoder = ((flags & (PNG_PARALLEL | PNG_FILTER_ADAPTIVE | PNG_FILTER_BRUTE)) != 0) && (number_passes == 1) && GetRowLayout(dib, bConvertTo24, flags, &layout);
+
+			if (bOwnEncoder) {
+				// filter and compress blocks of rows on the thread pool, this also writes the end of the file
+				if (!WriteImageData(png_ptr, dib, bits, pitch, &layout, flags)) {
+					throw "Failed to compress the PNG image data";
+				}
+			} else if (bConvertTo24) {
+				BYTE *buffer = (BYTE *)malloc(width * 3);
+
+				// transparent conversion to 24-bit
 				// the number of passes is either 1 for non-interlaced images, or 7 for interlaced images
 				for (int pass = 0; pass < number_passes; pass++) {
 					for (png_uint_32 k = 0; k < height; k++) {
-						FreeImage_ConvertLine32To24(buffer, FreeImage_GetScanLine(dib, height - k - 1), width);
+						FreeImage_ConvertLine32To24(buffer, (BYTE*)CalculateScanLine(bits, pitch, height - k - 1), width);
 						png_write_row(png_ptr, buffer);
 					}
 				}
@@ -1064,15 +2053,17 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 				// the number of passes is either 1 for non-interlaced images, or 7 for interlaced images
 				for (int pass = 0; pass < number_passes; pass++) {
 					for (png_uint_32 k = 0; k < height; k++) {
-						png_write_row(png_ptr, FreeImage_GetScanLine(dib, height - k - 1));
+						png_write_row(png_ptr, CalculateScanLine(bits, pitch, height - k - 1));
 					}
 				}
 			}
 
-			// It is REQUIRED to call this to finish writing the rest of the file
-			// Bug with png_flush
+			if (!bOwnEncoder) {
+				// It is REQUIRED to call this to finish writing the rest of the file
+				// Bug with png_flush
 
-			png_write_end(png_ptr, info_ptr);
+				png_write_end(png_ptr, info_ptr);
+			}
 
 			// clean up after the write, and free any memory allocated
 			if (palette) {
@@ -1118,4 +2109,11 @@ InitPNG(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->open_scanlines_proc = OpenScanlines;
+	plugin->read_scanlines_proc = ReadScanlines;
+	plugin->close_scanlines_proc = CloseScanlines;
+	plugin->create_scanlines_proc = CreateScanlines;
+	plugin->write_scanlines_proc = WriteScanlines;
+	plugin->finish_scanlines_proc = FinishScanlines;
 }
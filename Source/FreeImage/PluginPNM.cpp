@@ -186,6 +186,27 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE pbm_id1[] = { 0x50, 0x31 };
+	static const BYTE pbm_id2[] = { 0x50, 0x34 };
+	static const BYTE pgm_id1[] = { 0x50, 0x32 };
+	static const BYTE pgm_id2[] = { 0x50, 0x35 };
+	static const BYTE ppm_id1[] = { 0x50, 0x33 };
+	static const BYTE ppm_id2[] = { 0x50, 0x36 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(pbm_id1), pbm_id1, NULL },
+		{ sizeof(pbm_id2), pbm_id2, NULL },
+		{ sizeof(pgm_id1), pgm_id1, NULL },
+		{ sizeof(pgm_id2), pgm_id2, NULL },
+		{ sizeof(ppm_id1), ppm_id1, NULL },
+		{ sizeof(ppm_id2), ppm_id2, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -835,4 +856,5 @@ InitPNM(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
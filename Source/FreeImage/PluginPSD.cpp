@@ -70,6 +70,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE psd_id[] = { 0x38, 0x42, 0x50, 0x53 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(psd_id), psd_id, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -166,4 +177,5 @@ InitPSD(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels; 
+	plugin->magic_number_proc = MagicNumbers;
 }
@@ -173,6 +173,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(ras_signature, signature, sizeof(ras_signature)) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE ras_signature[] = { 0x59, 0xA6, 0x6A, 0x95 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(ras_signature), ras_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return FALSE;
@@ -509,4 +520,5 @@ InitRAS(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
 }
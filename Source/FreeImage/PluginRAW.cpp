@@ -673,7 +673,7 @@ SupportsNoPixels() {
 // ----------------------------------------------------------
 
 static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
 	FIBITMAP *dib = NULL;
 	LibRaw *RawProcessor = NULL;
 
@@ -707,6 +707,18 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			throw "LibRaw : failed to open input stream (unknown format)";
 		}
 
+		if((max_width > 0) || (max_height > 0)) {
+			// reduced-resolution loading: use the 50% size output when it still covers the box 
+			// (the image may be rotated by 90 degrees during processing)
+			const libraw_image_sizes_t *sizes = &RawProcessor->imgdata.sizes;
+			const unsigned level = MIN(
+				CalculateFitReductionLevel(sizes->width, sizes->height, max_width, max_height, 1),
+				CalculateFitReductionLevel(sizes->width, sizes->height, max_height, max_width, 1));
+			if(level > 0) {
+				RawProcessor->imgdata.params.half_size = 1;
+			}
+		}
+
 		if(header_only) {
 			// header only mode
 			dib = FreeImage_AllocateHeaderT(header_only, FIT_RGB16, RawProcessor->imgdata.sizes.width, RawProcessor->imgdata.sizes.height);
@@ -766,6 +778,11 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return NULL;
 }
 
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return LoadScaled(io, handle, page, flags, data, 0, 0);
+}
+
 // ==========================================================
 //   Init
 // ==========================================================
@@ -790,4 +807,5 @@ InitRAW(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->load_scaled_proc = LoadScaled;
 }
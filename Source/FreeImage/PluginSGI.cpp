@@ -201,6 +201,17 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return (memcmp(sgi_signature, signature, sizeof(sgi_signature)) == 0);
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE sgi_signature[] = { 0x01, 0xDA };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(sgi_signature), sgi_signature, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
   return FALSE;
@@ -421,5 +432,6 @@ InitSGI(Plugin *plugin, int format_id) {
 	plugin->supports_export_bpp_proc = SupportsExportDepth;
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = NULL;
+	plugin->magic_number_proc = MagicNumbers;
 }
 
@@ -43,6 +43,7 @@
 
 #include "FreeImageIO.h"
 #include "PSDParser.h"
+#include "ThreadPool.h"
 
 // --------------------------------------------------------------------------
 // GeoTIFF profile (see XTIFF.cpp)
@@ -167,8 +168,21 @@ _tiffSizeProc(thandle_t handle) {
     return fileSize;
 }
 
+/**
+Map the TIFF file into memory. 
+Read-only memory streams (wrapped user buffers and memory mapped files) are already in memory: 
+libtiff can then decode the strips and tiles directly from the stream buffer, without copying them.
+*/
 static int
-_tiffMapProc(thandle_t, void** base, toff_t* size) {
+_tiffMapProc(thandle_t handle, void** base, toff_t* size) {
+	fi_TIFFIO *fio = (fi_TIFFIO*)handle;
+	void *data = NULL;
+	long size_in_bytes = 0;
+	if(GetMemoryIOBuffer(fio->io, fio->handle, &data, &size_in_bytes)) {
+		*base = data;
+		*size = (toff_t)size_in_bytes;
+		return 1;
+	}
 	return 0;
 }
 
@@ -1005,6 +1019,23 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	static const BYTE tiff_id1[] = { 0x49, 0x49, 0x2A, 0x00 };
+	static const BYTE tiff_id2[] = { 0x4D, 0x4D, 0x00, 0x2A };
+	static const BYTE tiff_id3[] = { 0x49, 0x49, 0x2B, 0x00 };
+	static const BYTE tiff_id4[] = { 0x4D, 0x4D, 0x00, 0x2B };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(tiff_id1), tiff_id1, NULL },
+		{ sizeof(tiff_id2), tiff_id2, NULL },
+		{ sizeof(tiff_id3), tiff_id3, NULL },
+		{ sizeof(tiff_id4), tiff_id4, NULL }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -1322,6 +1353,42 @@ ReadThumbnail(FreeImageIO *io, fi_handle handle, void *data, TIFF *tiff, FIBITMA
 	FreeImage_Unload(thumbnail);
 }
 
+/**
+Move to a level of a pyramid saved with TIFF_PYRAMID: 
+levels are the tiled reduced-resolution SubIFDs of the current directory, largest first
+@param flags Load flags, see TIFF_LEVEL
+@return Returns TRUE if no level was requested or if the level was found, returns FALSE otherwise
+*/
+static BOOL 
+SelectLevel(TIFF *tif, int flags) {
+	const int level = (flags >> 20) & 0xFF;
+	if(level == 0) {
+		return TRUE;
+	}
+
+	uint16 subIFD_count = 0;
+	toff_t* subIFD_offsets = NULL;
+	if(!TIFFGetField(tif, TIFFTAG_SUBIFD, &subIFD_count, &subIFD_offsets)) {
+		return FALSE;
+	}
+
+	// the tag array is released when the directory changes
+	std::vector<toff_t> sub_offsets(subIFD_offsets, subIFD_offsets + subIFD_count);
+
+	int count = 0;
+	for(size_t i = 0; i < sub_offsets.size(); i++) {
+		if(TIFFSetSubDirectory(tif, sub_offsets[i]) && TIFFIsTiled(tif)) {
+			uint32 subfiletype = 0;
+			TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfiletype);
+			if((subfiletype & FILETYPE_REDUCEDIMAGE) && (++count == level)) {
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
 // --------------------------------------------------------------------------
 
 static FIBITMAP * DLL_CALLCONV
@@ -1355,6 +1422,10 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				throw "Error encountered while opening TIFF file";			
 			}
 		}
+
+		if (!SelectLevel(tif, flags)) {
+			throw "Pyramid level not found";
+		}
 		
 		const BOOL asCMYK = (flags & TIFF_CMYK) == TIFF_CMYK;
 
@@ -2267,380 +2338,1518 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 // --------------------------------------------------------------------------
 
 /**
-Save a single image into a TIF
-
-@param io FreeImage IO
-@param dib The dib to be saved
-@param handle FreeImage handle
-@param page Page number
-@param flags FreeImage TIFF save flag
-@param data TIFF plugin context
-@param ifd TIFF Image File Directory (0 means save image, > 0 && (page == -1) means save thumbnail)
-@param ifdCount 1 if no thumbnail to save, 2 if image + thumbnail to save
-@return Returns TRUE if successful, returns FALSE otherwise
+Scanline decoder state. 
+Only images loaded with the generic strip method and stored as contiguous strips are streamed.
 */
-static BOOL 
-SaveOneTIFF(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data, unsigned ifd, unsigned ifdCount) {
-	if (!dib || !handle || !data) {
-		return FALSE;
-	} 
-	
-	try { 
-		fi_TIFFIO *fio = (fi_TIFFIO*)data;
-		TIFF *out = fio->tif;
+typedef struct tagScanlineDecoder {
+	TIFF *tif;
+	uint32 width;
+	uint32 height;
+	uint32 rowsperstrip;
+	/// decoded strip
+	BYTE *buf;
+	tmsize_t src_line;
+	/// first row and number of rows held by buf
+	uint32 strip_row;
+	uint32 strip_rows;
+	/// next row to be read
+	uint32 row;
+	/// destination line size and pixel sizes in bytes (0 for bitdepths lower than 8)
+	unsigned dst_line;
+	unsigned Bpp;
+	unsigned srcBpp;
+	/// TRUE when red and blue must be swapped
+	BOOL swap_red_blue;
+	/// TRUE once a strip could not be decoded
+	BOOL warning;
+} ScanlineDecoder;
 
-		const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+static void * DLL_CALLCONV
+OpenScanlines(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header) {
+	if (!handle || !data) {
+		return NULL;
+	}
 
-		const uint32 width = FreeImage_GetWidth(dib);
-		const uint32 height = FreeImage_GetHeight(dib);
-		const uint16 bitsperpixel = (uint16)FreeImage_GetBPP(dib);
+	TIFF *tif = ((fi_TIFFIO*)data)->tif;
 
-		const FIICCPROFILE* iccProfile = FreeImage_GetICCProfile(dib);
-		
-		// setup out-variables based on dib and flag options
-		
-		uint16 bitspersample;
-		uint16 samplesperpixel;
-		uint16 photometric;
+	uint32 height = 0; 
+	uint32 width = 0; 
+	uint16 bitspersample = 1;
+	uint16 samplesperpixel = 1;
+	uint32 rowsperstrip = (uint32)-1;  
+	uint16 photometric = PHOTOMETRIC_MINISWHITE;
+	uint16 planar_config;
+	uint32 iccSize = 0;		// ICC profile length
+	void *iccBuf = NULL;	// ICC profile data		
 
-		if(image_type == FIT_BITMAP) {
-			// standard image: 1-, 4-, 8-, 16-, 24-, 32-bit
+	TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+	TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+	TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+	TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);   			
+	TIFFGetField(tif, TIFFTAG_ICCPROFILE, &iccSize, &iccBuf);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar_config);
 
-			samplesperpixel = ((bitsperpixel == 24) ? 3 : ((bitsperpixel == 32) ? 4 : 1));
-			bitspersample = bitsperpixel / samplesperpixel;
-			photometric	= GetPhotometric(dib);
+	if (IsValidBitsPerSample(photometric, bitspersample, samplesperpixel) == FALSE) {
+		return NULL;
+	}
 
-			if((bitsperpixel == 8) && FreeImage_IsTransparent(dib)) {
-				// 8-bit transparent picture : convert later to 8-bit + 8-bit alpha
-				samplesperpixel = 2;
-				bitspersample = 8;
-			}
-			else if(bitsperpixel == 32) {
-				// 32-bit images : check for CMYK or alpha transparency
-
-				if((((iccProfile->flags & FIICC_COLOR_IS_CMYK) == FIICC_COLOR_IS_CMYK) || ((flags & TIFF_CMYK) == TIFF_CMYK))) {
-					// CMYK support
-					photometric = PHOTOMETRIC_SEPARATED;
-					TIFFSetField(out, TIFFTAG_INKSET, INKSET_CMYK);
-					TIFFSetField(out, TIFFTAG_NUMBEROFINKS, 4);
-				}
-				else if(photometric == PHOTOMETRIC_RGB) {
-					// transparency mask support
-					uint16 sampleinfo[1]; 
-					// unassociated alpha data is transparency information
-					sampleinfo[0] = EXTRASAMPLE_UNASSALPHA;
-					TIFFSetField(out, TIFFTAG_EXTRASAMPLES, 1, sampleinfo);
-				}
-			}
-		} else if(image_type == FIT_RGB16) {
-			// 48-bit RGB
+	// other load methods need (or are faster with) the whole image: let Load handle them
 
-			samplesperpixel = 3;
-			bitspersample = bitsperpixel / samplesperpixel;
-			photometric	= PHOTOMETRIC_RGB;
-		} else if(image_type == FIT_RGBA16) {
-			// 64-bit RGBA
+	const FREE_IMAGE_TYPE image_type = ReadImageType(tif, bitspersample, samplesperpixel);
 
-			samplesperpixel = 4;
-			bitspersample = bitsperpixel / samplesperpixel;
-			if((((iccProfile->flags & FIICC_COLOR_IS_CMYK) == FIICC_COLOR_IS_CMYK) || ((flags & TIFF_CMYK) == TIFF_CMYK))) {
-				// CMYK support
-				photometric = PHOTOMETRIC_SEPARATED;
-				TIFFSetField(out, TIFFTAG_INKSET, INKSET_CMYK);
-				TIFFSetField(out, TIFFTAG_NUMBEROFINKS, 4);
-			}
-			else {
-				photometric	= PHOTOMETRIC_RGB;
-				// transparency mask support
-				uint16 sampleinfo[1]; 
-				// unassociated alpha data is transparency information
-				sampleinfo[0] = EXTRASAMPLE_UNASSALPHA;
-				TIFFSetField(out, TIFFTAG_EXTRASAMPLES, 1, sampleinfo);
-			}
-		} else if(image_type == FIT_RGBF) {
-			// 96-bit RGBF => store with a LogLuv encoding ?
-
-			samplesperpixel = 3;
-			bitspersample = bitsperpixel / samplesperpixel;
-			// the library converts to and from floating-point XYZ CIE values
-			if((flags & TIFF_LOGLUV) == TIFF_LOGLUV) {
-				photometric	= PHOTOMETRIC_LOGLUV;
-				TIFFSetField(out, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT);
-				// TIFFSetField(out, TIFFTAG_STONITS, 1.0);   // assume unknown 
-			}
-			else {
-				// store with default compression (LZW) or with input compression flag
-				photometric	= PHOTOMETRIC_RGB;
-			}
-			
-		} else if (image_type == FIT_RGBAF) {
-			// 128-bit RGBAF => store with default compression (LZW) or with input compression flag
-			
-			samplesperpixel = 4;
-			bitspersample = bitsperpixel / samplesperpixel;
-			photometric	= PHOTOMETRIC_RGB;
-		} else {
-			// special image type (int, long, double, ...)
-			
-			samplesperpixel = 1;
-			bitspersample = bitsperpixel;
-			photometric	= PHOTOMETRIC_MINISBLACK;
-		}
+	if ((FindLoadMethod(tif, image_type, flags) != LoadAsGenericStrip) || (planar_config != PLANARCONFIG_CONTIG)) {
+		return NULL;
+	}
 
-		// set image data type
+	// same header as Load
 
-		WriteImageType(out, image_type);
-		
-		// write possible ICC profile
+	const uint16 chCount = MIN<uint16>(samplesperpixel, 4);
+	FIBITMAP *dib = CreateImageType(TRUE, image_type, width, height, bitspersample, chCount);
+	if (!dib) {
+		return NULL;
+	}
 
-		if (iccProfile->size && iccProfile->data) {
-			TIFFSetField(out, TIFFTAG_ICCPROFILE, iccProfile->size, iccProfile->data);
-		}
+	ReadResolution(tif, dib);
+	ReadPalette(tif, photometric, bitspersample, dib);
+	ReadMetadata(io, handle, tif, dib);
+	FreeImage_CreateICCProfile(dib, iccBuf, iccSize);
+
+	ScanlineDecoder *decoder = (ScanlineDecoder*)malloc(sizeof(ScanlineDecoder));
+	BYTE *buf = (BYTE*)malloc(TIFFStripSize(tif) * sizeof(BYTE));
+	if (!decoder || !buf) {
+		free(decoder);
+		free(buf);
+		FreeImage_Unload(dib);
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		return NULL;
+	}
+	memset(buf, 0, TIFFStripSize(tif) * sizeof(BYTE));
+	memset(decoder, 0, sizeof(ScanlineDecoder));
+
+	decoder->tif = tif;
+	decoder->width = width;
+	decoder->height = height;
+	decoder->rowsperstrip = MAX<uint32>(1, MIN(rowsperstrip, height));
+	decoder->buf = buf;
+	decoder->src_line = TIFFScanlineSize(tif);
+	decoder->dst_line = FreeImage_GetLine(dib);
+	decoder->Bpp = FreeImage_GetBPP(dib) / 8;
+	decoder->srcBpp = bitspersample * samplesperpixel / 8;
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	decoder->swap_red_blue = (image_type == FIT_BITMAP) && ((decoder->Bpp == 3) || (decoder->Bpp == 4));
+#endif
 
-		// handle standard width/height/bpp stuff
+	*header = dib;
 
-		TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
-		TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
-		TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, samplesperpixel);
-		TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, bitspersample);
-		TIFFSetField(out, TIFFTAG_PHOTOMETRIC, photometric);
-		TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);	// single image plane 
-		TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-		TIFFSetField(out, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
-		TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(out, (uint32) -1)); 
+	return decoder;
+}
 
-		// handle metrics
+static unsigned DLL_CALLCONV
+ReadScanlines(FreeImageIO *io, fi_handle handle, void *reader, BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
 
-		WriteResolution(out, dib);
+	unsigned rows = 0;
 
-		// multi-paging
+	for (; (rows < count) && (decoder->row < decoder->height); rows++, decoder->row++) {
+		if ((decoder->row < decoder->strip_row) || (decoder->row >= decoder->strip_row + decoder->strip_rows)) {
+			// decode the strip holding the row
+			decoder->strip_row = decoder->row - decoder->row % decoder->rowsperstrip;
+			decoder->strip_rows = MIN(decoder->rowsperstrip, decoder->height - decoder->strip_row);
 
-		if (page >= 0) {
-			char page_number[20];
-			sprintf(page_number, "Page %d", page);
+			if (TIFFReadEncodedStrip(decoder->tif, TIFFComputeStrip(decoder->tif, decoder->row, 0), decoder->buf, decoder->strip_rows * decoder->src_line) == -1) {
+				// ignore errors as they can be frequent and not really valid errors, especially with fax images
+				if (!decoder->warning) {
+					decoder->warning = TRUE;
+					FreeImage_OutputMessageProc(s_format_id, "Warning: parsing error. Image may be incomplete or contain invalid data !");
+				}
+			}
+		}
 
-			TIFFSetField(out, TIFFTAG_SUBFILETYPE, (uint32)FILETYPE_PAGE);
-			TIFFSetField(out, TIFFTAG_PAGENUMBER, (uint16)page, (uint16)0);
-			TIFFSetField(out, TIFFTAG_PAGENAME, page_number);
+		const BYTE *src = decoder->buf + (decoder->row - decoder->strip_row) * decoder->src_line;
+		BYTE *dst = bits + (size_t)rows * pitch;
 
+		if (decoder->src_line == (tmsize_t)decoder->dst_line) {
+			// channel count match
+			memcpy(dst, src, decoder->dst_line);
 		} else {
-			// is it a thumbnail ? 
-			TIFFSetField(out, TIFFTAG_SUBFILETYPE, (ifd == 0) ? (uint32)0 : (uint32)FILETYPE_REDUCEDIMAGE);
+			for (uint32 x = 0; x < decoder->width; x++, dst += decoder->Bpp, src += decoder->srcBpp) {
+				AssignPixel(dst, src, decoder->Bpp);
+			}
+			dst = bits + (size_t)rows * pitch;
 		}
 
-		// palettes (image colormaps are automatically scaled to 16-bits)
+		if (decoder->swap_red_blue) {
+			for (BYTE *pixel = dst; pixel < dst + decoder->dst_line; pixel += decoder->Bpp) {
+				INPLACESWAP(pixel[0], pixel[2]);
+			}
+		}
+	}
 
-		if (photometric == PHOTOMETRIC_PALETTE) {
-			uint16 *r, *g, *b;
-			uint16 nColors = (uint16)FreeImage_GetColorsUsed(dib);
-			RGBQUAD *pal = FreeImage_GetPalette(dib);
+	return rows;
+}
 
-			r = (uint16 *) _TIFFmalloc(sizeof(uint16) * 3 * nColors);
-			if(r == NULL) {
-				throw FI_MSG_ERROR_MEMORY;
-			}
-			g = r + nColors;
-			b = g + nColors;
+static void DLL_CALLCONV
+CloseScanlines(FreeImageIO *io, fi_handle handle, void *reader) {
+	ScanlineDecoder *decoder = (ScanlineDecoder*)reader;
 
-			for (int i = nColors - 1; i >= 0; i--) {
-				r[i] = SCALE((uint16)pal[i].rgbRed);
-				g[i] = SCALE((uint16)pal[i].rgbGreen);
-				b[i] = SCALE((uint16)pal[i].rgbBlue);
-			}
+	free(decoder->buf);
+	free(decoder);
+}
 
-			TIFFSetField(out, TIFFTAG_COLORMAP, r, g, b);
+// --------------------------------------------------------------------------
 
-			_TIFFfree(r);
-		}
+/**
+Read the header of a tiled image loaded with the LoadAsTiled method of Load
+@param tileWidth Returned tile width
+@param tileHeight Returned tile height
+@return Returns a header only image if successful, returns NULL otherwise
+*/
+static FIBITMAP * 
+ReadTiledHeader(FreeImageIO *io, fi_handle handle, TIFF *tif, int flags, uint32 *tileWidth, uint32 *tileHeight) {
+	uint32 width = 0;
+	uint32 height = 0;
+	uint16 bitspersample = 1;
+	uint16 samplesperpixel = 1;
+	uint16 photometric = PHOTOMETRIC_MINISWHITE;
+	uint16 planar_config;
+	uint32 iccSize = 0;		// ICC profile length
+	void *iccBuf = NULL;	// ICC profile data		
+
+	TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+	TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+	TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+	TIFFGetField(tif, TIFFTAG_ICCPROFILE, &iccSize, &iccBuf);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar_config);
+
+	if (IsValidBitsPerSample(photometric, bitspersample, samplesperpixel) == FALSE) {
+		return NULL;
+	}
+
+	const FREE_IMAGE_TYPE image_type = ReadImageType(tif, bitspersample, samplesperpixel);
+
+	if ((FindLoadMethod(tif, image_type, flags) != LoadAsTiled) || (planar_config != PLANARCONFIG_CONTIG)) {
+		return NULL;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_TILEWIDTH, tileWidth) || !TIFFGetField(tif, TIFFTAG_TILELENGTH, tileHeight) || !*tileWidth || !*tileHeight) {
+		return NULL;
+	}
 
-		// compression tag
+	FIBITMAP *header = CreateImageType(TRUE, image_type, width, height, bitspersample, samplesperpixel);
+	if (!header) {
+		return NULL;
+	}
 
-		WriteCompression(out, bitspersample, samplesperpixel, photometric, flags);
+	ReadResolution(tif, header);
+	ReadPalette(tif, photometric, bitspersample, header);
+	ReadMetadata(io, handle, tif, header);
+	FreeImage_CreateICCProfile(header, iccBuf, iccSize);
 
-		// metadata
+	return header;
+}
 
-		WriteMetadata(out, dib);
+/**
+Region-of-interest loading. 
+Only the strips or the tiles intersecting the region are decoded. 
+Images needing another load method are loaded by Load.
+*/
+static FIBITMAP * DLL_CALLCONV
+LoadRegion(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int left, int top, int right, int bottom) {
+	if (!handle || !data) {
+		return NULL;
+	}
 
-		// thumbnail tag
+	TIFF *tif = ((fi_TIFFIO*)data)->tif;
 
-		if((ifd == 0) && (ifdCount > 1)) {
-			uint16 nsubifd = 1;
-			uint64 subifd[1];
-			subifd[0] = 0;
-			TIFFSetField(out, TIFFTAG_SUBIFD, nsubifd, subifd);
+	if (page != -1) {
+		if (!tif || !TIFFSetDirectory(tif, (uint16)page)) {
+			FreeImage_OutputMessageProc(s_format_id, "Error encountered while opening TIFF file");
+			return NULL;
 		}
+	}
 
-		// read the DIB lines from bottom to top
-		// and save them in the TIF
-		// -------------------------------------
-		
-		const uint32 pitch = FreeImage_GetPitch(dib);
+	if (!SelectLevel(tif, flags)) {
+		FreeImage_OutputMessageProc(s_format_id, "Pyramid level not found");
+		return NULL;
+	}
 
-		if(image_type == FIT_BITMAP) {
-			// standard bitmap type
-		
-			switch(bitsperpixel) {
-				case 1 :
-				case 4 :
-				case 8 :
-				{
-					if((bitsperpixel == 8) && FreeImage_IsTransparent(dib)) {
-						// 8-bit transparent picture : convert to 8-bit + 8-bit alpha
+	FIBITMAP *region = NULL;
 
-						// get the transparency table
-						BYTE *trns = FreeImage_GetTransparencyTable(dib);
+	if (!TIFFIsTiled(tif)) {
+		// strips: use the scanline decoder, starting at the top of the region
 
-						BYTE *buffer = (BYTE *)malloc(2 * width * sizeof(BYTE));
-						if(buffer == NULL) {
-							throw FI_MSG_ERROR_MEMORY;
-						}
+		FIBITMAP *header = NULL;
+		ScanlineDecoder *decoder = (ScanlineDecoder*)OpenScanlines(io, handle, -1, flags, data, &header);
+		if (!decoder) {
+			return NULL;
+		}
 
-						for (int y = height - 1; y >= 0; y--) {
-							BYTE *bits = FreeImage_GetScanLine(dib, y);
+		if (ClipRegion(decoder->width, decoder->height, &left, &top, &right, &bottom)) {
+			const unsigned bpp = FreeImage_GetBPP(header);
 
-							BYTE *p = bits, *b = buffer;
+			BYTE *buffer = (BYTE*)malloc(decoder->dst_line * sizeof(BYTE));
 
-							for(uint32 x = 0; x < width; x++) {
-								// copy the 8-bit layer
-								b[0] = *p;
-								// convert the trns table to a 8-bit alpha layer
-								b[1] = trns[ b[0] ];
+			region = buffer ? AllocateRegion(header, right - left, bottom - top) : NULL;
 
-								p++;
-								b += samplesperpixel;
-							}
+			if (region) {
+				decoder->row = top;
+				for (int y = top; y < bottom; y++) {
+					ReadScanlines(io, handle, decoder, buffer, decoder->dst_line, 1);
+					CopyPixelRun(FreeImage_GetScanLine(region, bottom - 1 - y), 0, buffer, left, right - left, bpp);
+				}
+			} else {
+				FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+			}
 
-							// write the scanline to disc
+			free(buffer);
+		}
 
-							TIFFWriteScanline(out, buffer, height - y - 1, 0);
-						}
+		CloseScanlines(io, handle, decoder);
+		FreeImage_Unload(header);
 
-						free(buffer);
-					}
-					else {
-						// other cases
-						BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-						if(buffer == NULL) {
-							throw FI_MSG_ERROR_MEMORY;
-						}
+		return region;
+	}
 
-						for (uint32 y = 0; y < height; y++) {
-							// get a copy of the scanline
-							memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
-							// write the scanline to disc
-							TIFFWriteScanline(out, buffer, y, 0);
-						}
-						free(buffer);
-					}
+	// tiles: same conditions and same header as the LoadAsTiled method of Load
 
-					break;
-				}				
+	uint32 tileWidth = 0;
+	uint32 tileHeight = 0;
 
-				case 24:
-				case 32:
-				{
-					BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-					if(buffer == NULL) {
-						throw FI_MSG_ERROR_MEMORY;
-					}
+	FIBITMAP *header = ReadTiledHeader(io, handle, tif, flags, &tileWidth, &tileHeight);
+	if (!header) {
+		return NULL;
+	}
+	if (!ClipRegion(FreeImage_GetWidth(header), FreeImage_GetHeight(header), &left, &top, &right, &bottom)) {
+		FreeImage_Unload(header);
+		return NULL;
+	}
 
-					for (uint32 y = 0; y < height; y++) {
-						// get a copy of the scanline
+	const tmsize_t tileSize = TIFFTileSize(tif);
+	const uint32 tileRowSize = (uint32)TIFFTileRowSize(tif);
+	const unsigned bpp = FreeImage_GetBPP(header);
 
-						memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
+	BYTE *tileBuffer = (BYTE*)malloc(tileSize * sizeof(BYTE));
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-						if (photometric != PHOTOMETRIC_SEPARATED) {
-							// TIFFs store color data RGB(A) instead of BGR(A)
-		
-							BYTE *pBuf = buffer;
-		
-							for (uint32 x = 0; x < width; x++) {
-								INPLACESWAP(pBuf[0], pBuf[2]);
-								pBuf += samplesperpixel;
-							}
-						}
-#endif
-						// write the scanline to disc
+	region = tileBuffer ? AllocateRegion(header, right - left, bottom - top) : NULL;
 
-						TIFFWriteScanline(out, buffer, y, 0);
-					}
+	if (region) {
+		const uint32 x_first = (uint32)left - (uint32)left % tileWidth;
+		const uint32 y_first = (uint32)top - (uint32)top % tileHeight;
 
-					free(buffer);
+		for (uint32 y = y_first; y < (uint32)bottom; y += tileHeight) {
+			// rows of the tile inside the region
+			const uint32 y0 = MAX<uint32>(y, top);
+			const uint32 y1 = MIN<uint32>(y + tileHeight, bottom);
 
-					break;
-				}
-			}//< switch (bitsperpixel)
+			for (uint32 x = x_first; x < (uint32)right; x += tileWidth) {
+				// columns of the tile inside the region
+				const uint32 x0 = MAX<uint32>(x, left);
+				const uint32 x1 = MIN<uint32>(x + tileWidth, right);
 
-		} else if(image_type == FIT_RGBF && (flags & TIFF_LOGLUV) == TIFF_LOGLUV) {
-			// RGBF image => store as XYZ using a LogLuv encoding
+				memset(tileBuffer, 0, tileSize);
 
-			BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-			if(buffer == NULL) {
-				throw FI_MSG_ERROR_MEMORY;
-			}
+				if (TIFFReadTile(tif, tileBuffer, x, y, 0, 0) < 0) {
+					FreeImage_Unload(region);
+					region = NULL;
+					FreeImage_OutputMessageProc(s_format_id, "Corrupted tiled TIFF file");
+					break;
+				}
 
-			for (uint32 y = 0; y < height; y++) {
-				// get a copy of the scanline and convert from RGB to XYZ
-				tiff_ConvertLineRGBToXYZ(buffer, FreeImage_GetScanLine(dib, height - y - 1), width);
-				// write the scanline to disc
-				TIFFWriteScanline(out, buffer, y, 0);
-			}
-			free(buffer);
-		} else {
-			// just dump the dib (tiff supports all dib types)
-			
-			BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-			if(buffer == NULL) {
-				throw FI_MSG_ERROR_MEMORY;
+				for (uint32 k = y0; k < y1; k++) {
+					// bitmaps are stored upside down
+					CopyPixelRun(FreeImage_GetScanLine(region, bottom - 1 - k), x0 - left, tileBuffer + (k - y) * tileRowSize, x0 - x, x1 - x0, bpp);
+				}
 			}
-			
-			for (uint32 y = 0; y < height; y++) {
-				// get a copy of the scanline
-				memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
-				// write the scanline to disc
-				TIFFWriteScanline(out, buffer, y, 0);
+			if (!region) {
+				break;
 			}
-			free(buffer);
 		}
 
-		// write out the directory tag if we wrote a page other than -1 or if we have a thumbnail to write later
-
-		if( (page >= 0) || ((ifd == 0) && (ifdCount > 1)) ) {
-			TIFFWriteDirectory(out);
-			// else: TIFFClose will WriteDirectory
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+		if (region) {
+			SwapRedBlue32(region);
 		}
+#endif
+	} else {
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+	}
 
-		return TRUE;
-		
-	} catch(const char *text) {
-		FreeImage_OutputMessageProc(s_format_id, text);
-		return FALSE;
-	} 
+	free(tileBuffer);
+	FreeImage_Unload(header);
+
+	return region;
 }
 
-static BOOL DLL_CALLCONV
-Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
-	BOOL bResult = FALSE;
-	
-	// handle thumbnail as SubIFD
-	const BOOL bHasThumbnail = (FreeImage_GetThumbnail(dib) != NULL);
-	const unsigned ifdCount = bHasThumbnail ? 2 : 1;
-	
-	FIBITMAP *bitmap = dib;
+// --------------------------------------------------------------------------
 
-	for(unsigned ifd = 0; ifd < ifdCount; ifd++) {
-		// redirect dib to thumbnail for the second pass
-		if(ifd == 1) {
-			bitmap = FreeImage_GetThumbnail(dib);
-		}
+/**
+Tile decoder state. 
+Tiled images are decoded tile by tile, images stored as strips are delivered as full width tiles of rowsperstrip rows. 
+Images needing another load method are decoded as a whole by the caller.
+*/
+typedef struct tagTileDecoder {
+	TIFF *tif;
+	uint32 width;
+	uint32 height;
+	uint32 tileWidth;
+	uint32 tileHeight;
+	/// scanline decoder, when the image is stored as strips
+	ScanlineDecoder *strips;
+	/// decoded tile (tiled images) or decoded row (strips)
+	BYTE *buf;
+	tmsize_t tileSize;
+	uint32 tileRowSize;
+	unsigned bpp;
+	/// TRUE when red and blue must be swapped
+	BOOL swap_red_blue;
+} TileDecoder;
 
-		bResult = SaveOneTIFF(io, bitmap, handle, page, flags, data, ifd, ifdCount);
-		if(!bResult) {
-			return FALSE;
+static void * DLL_CALLCONV
+OpenTiles(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, FIBITMAP **header, unsigned *tile_width, unsigned *tile_height) {
+	if (!handle || !data) {
+		return NULL;
+	}
+
+	TIFF *tif = ((fi_TIFFIO*)data)->tif;
+
+	if (page != -1) {
+		if (!tif || !TIFFSetDirectory(tif, (uint16)page)) {
+			FreeImage_OutputMessageProc(s_format_id, "Error encountered while opening TIFF file");
+			return NULL;
 		}
 	}
 
+	if (!SelectLevel(tif, flags)) {
+		FreeImage_OutputMessageProc(s_format_id, "Pyramid level not found");
+		return NULL;
+	}
+
+	TileDecoder *decoder = (TileDecoder*)malloc(sizeof(TileDecoder));
+	if (!decoder) {
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		return NULL;
+	}
+	memset(decoder, 0, sizeof(TileDecoder));
+
+	FIBITMAP *dib = NULL;
+
+	if (!TIFFIsTiled(tif)) {
+		decoder->strips = (ScanlineDecoder*)OpenScanlines(io, handle, -1, flags, data, &dib);
+		if (decoder->strips) {
+			decoder->tileWidth = decoder->strips->width;
+			decoder->tileHeight = decoder->strips->rowsperstrip;
+			decoder->tileSize = decoder->strips->dst_line;
+		}
+	} else {
+		dib = ReadTiledHeader(io, handle, tif, flags, &decoder->tileWidth, &decoder->tileHeight);
+		if (dib) {
+			decoder->tileSize = TIFFTileSize(tif);
+			decoder->tileRowSize = (uint32)TIFFTileRowSize(tif);
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+			decoder->swap_red_blue = (FreeImage_GetImageType(dib) == FIT_BITMAP) && ((FreeImage_GetBPP(dib) == 24) || (FreeImage_GetBPP(dib) == 32));
+#endif
+		}
+	}
+
+	if (dib) {
+		decoder->tif = tif;
+		decoder->width = FreeImage_GetWidth(dib);
+		decoder->height = FreeImage_GetHeight(dib);
+		decoder->bpp = FreeImage_GetBPP(dib);
+		decoder->buf = (BYTE*)malloc(decoder->tileSize * sizeof(BYTE));
+
+		if (decoder->buf) {
+			*header = dib;
+			*tile_width = decoder->tileWidth;
+			*tile_height = decoder->tileHeight;
+
+			return decoder;
+		}
+
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		FreeImage_Unload(dib);
+		if (decoder->strips) {
+			CloseScanlines(io, handle, decoder->strips);
+		}
+	}
+
+	free(decoder);
+
+	return NULL;
+}
+
+static BOOL DLL_CALLCONV
+ReadTile(FreeImageIO *io, fi_handle handle, void *reader, unsigned column, unsigned row, BYTE *bits, unsigned pitch) {
+	TileDecoder *decoder = (TileDecoder*)reader;
+
+	const uint32 x = column * decoder->tileWidth;
+	const uint32 y = row * decoder->tileHeight;
+
+	if ((x >= decoder->width) || (y >= decoder->height)) {
+		return FALSE;
+	}
+
+	// rows and columns of the tile inside the image
+	const uint32 rows = MIN(decoder->tileHeight, decoder->height - y);
+	const uint32 columns = MIN(decoder->tileWidth, decoder->width - x);
+
+	if (decoder->strips) {
+		// the scanline decoder writes DWORD aligned rows
+		decoder->strips->row = y;
+		for (uint32 k = 0; k < rows; k++, bits += pitch) {
+			ReadScanlines(io, handle, decoder->strips, decoder->buf, decoder->strips->dst_line, 1);
+			CopyPixelRun(bits, 0, decoder->buf, 0, columns, decoder->bpp);
+		}
+		return TRUE;
+	}
+
+	memset(decoder->buf, 0, decoder->tileSize);
+
+	if (TIFFReadTile(decoder->tif, decoder->buf, x, y, 0, 0) < 0) {
+		FreeImage_OutputMessageProc(s_format_id, "Corrupted tiled TIFF file");
+		return FALSE;
+	}
+
+	for (uint32 k = 0; k < rows; k++, bits += pitch) {
+		CopyPixelRun(bits, 0, decoder->buf + k * decoder->tileRowSize, 0, columns, decoder->bpp);
+
+		if (decoder->swap_red_blue) {
+			const unsigned Bpp = decoder->bpp / 8;
+			for (BYTE *pixel = bits; pixel < bits + columns * Bpp; pixel += Bpp) {
+				INPLACESWAP(pixel[0], pixel[2]);
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static void DLL_CALLCONV
+CloseTiles(FreeImageIO *io, fi_handle handle, void *reader) {
+	TileDecoder *decoder = (TileDecoder*)reader;
+
+	if (decoder->strips) {
+		CloseScanlines(io, handle, decoder->strips);
+	}
+	free(decoder->buf);
+	free(decoder);
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Reduced-resolution image candidate (pyramid level)
+*/
+typedef struct tagTIFFLevel {
+	toff_t offset;			//! IFD offset, 0 for the full resolution image
+	uint32 width;
+	uint32 height;
+} TIFFLevel;
+
+/**
+Check if the current directory is a reduced-resolution version of an image, 
+stored with the same pixel layout
+*/
+static BOOL 
+IsReducedLevel(TIFF *tif, uint16 photometric, uint16 bitspersample, uint16 samplesperpixel, TIFFLevel *level) {
+	uint32 subfiletype = 0;
+	uint16 level_photometric = PHOTOMETRIC_MINISWHITE;
+	uint16 level_bitspersample = 1;
+	uint16 level_samplesperpixel = 1;
+
+	TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfiletype);
+	TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &level_photometric);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &level_bitspersample);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &level_samplesperpixel);
+
+	if(!(subfiletype & FILETYPE_REDUCEDIMAGE) || (level_photometric != photometric) || (level_bitspersample != bitspersample) || (level_samplesperpixel != samplesperpixel)) {
+		return FALSE;
+	}
+
+	level->offset = TIFFCurrentDirOffset(tif);
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &level->width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &level->height);
+
+	return (level->width > 0) && (level->height > 0);
+}
+
+/**
+Reduced-resolution loading: when the image comes with a pyramid of reduced-resolution images 
+(stored as SubIFDs or as the IFDs following the image), load the smallest one still covering the box
+*/
+static FIBITMAP * DLL_CALLCONV
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
+	if (!handle || !data ) {
+		return NULL;
+	}
+
+	TIFF *tif = ((fi_TIFFIO*)data)->tif;
+
+	if (page != -1) {
+		if (!tif || !TIFFSetDirectory(tif, (uint16)page)) {
+			FreeImage_OutputMessageProc(s_format_id, "Error encountered while opening TIFF file");
+			return NULL;
+		}
+	}
+
+	const uint16 cur_dir = TIFFCurrentDirectory(tif);
+
+	uint16 photometric = PHOTOMETRIC_MINISWHITE;
+	uint16 bitspersample = 1;
+	uint16 samplesperpixel = 1;
+	TIFFLevel best = { 0, 0, 0 };
+
+	TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &best.width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &best.height);
+
+	unsigned fit_width, fit_height;
+	CalculateFitSize(best.width, best.height, max_width, max_height, &fit_width, &fit_height);
+
+	if((fit_width != best.width) || (fit_height != best.height)) {
+		std::vector<toff_t> sub_offsets;
+		std::vector<TIFFLevel> levels;
+		TIFFLevel level;
+
+		uint16 subIFD_count = 0;
+		toff_t* subIFD_offsets = NULL;
+		if(TIFFGetField(tif, TIFFTAG_SUBIFD, &subIFD_count, &subIFD_offsets)) {
+			sub_offsets.assign(subIFD_offsets, subIFD_offsets + subIFD_count);
+		}
+
+		// levels stored after the image in the main IFD chain
+		while(TIFFReadDirectory(tif) && IsReducedLevel(tif, photometric, bitspersample, samplesperpixel, &level)) {
+			levels.push_back(level);
+		}
+
+		// levels stored as SubIFDs, each one possibly followed by smaller ones (e.g. Photoshop pyramids)
+		for(size_t i = 0; i < sub_offsets.size(); i++) {
+			if(TIFFSetSubDirectory(tif, sub_offsets[i])) {
+				do {
+					if(IsReducedLevel(tif, photometric, bitspersample, samplesperpixel, &level)) {
+						levels.push_back(level);
+					}
+				} while(TIFFReadDirectory(tif));
+			}
+		}
+
+		for(size_t i = 0; i < levels.size(); i++) {
+			const TIFFLevel& candidate = levels[i];
+			if((candidate.width >= fit_width) && (candidate.height >= fit_height) && (candidate.width < best.width)) {
+				best = candidate;
+			}
+		}
+
+		// back to the image directory (or to the selected level)
+		TIFFSetDirectory(tif, cur_dir);
+		if(best.offset != 0) {
+			TIFFSetSubDirectory(tif, best.offset);
+		}
+	}
+
+	// the level is selected above
+	return Load(io, handle, -1, flags & ~TIFF_LEVEL(0xFF), data);
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Get the tile size of a tiled image or of a pyramid (see TIFF_TILESIZE)
+*/
+static uint32 
+GetTileSize(int flags) {
+	// tile sizes must be a multiple of 16
+	const uint32 tileSize = (uint32)((flags >> 20) & 0xFF) << 4;
+	return (tileSize == 0) ? 256 : tileSize;
+}
+
+/**
+Set the tags describing an image (the image data are written separately)
+
+@param out TIFF handle
+@param dib The dib to be saved (may be a header-only image)
+@param page Page number
+@param flags FreeImage TIFF save flag
+@param ifd TIFF Image File Directory (0 means save image, > 0 means save a SubIFD: thumbnail or pyramid level)
+@param ifdCount 1 + number of SubIFDs to save (thumbnail and pyramid levels)
+@param samplesperpixel_out Returns the number of samples per pixel of the saved image
+@param photometric_out Returns the photometric interpretation of the saved image
+*/
+static void 
+WriteImageTags(TIFF *out, FIBITMAP *dib, int page, int flags, unsigned ifd, unsigned ifdCount, uint16 *samplesperpixel_out, uint16 *photometric_out) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+
+	const uint32 width = FreeImage_GetWidth(dib);
+	const uint32 height = FreeImage_GetHeight(dib);
+	const uint16 bitsperpixel = (uint16)FreeImage_GetBPP(dib);
+
+	const FIICCPROFILE* iccProfile = FreeImage_GetICCProfile(dib);
+	
+	// setup out-variables based on dib and flag options
+	
+	uint16 bitspersample;
+	uint16 samplesperpixel;
+	uint16 photometric;
+
+	if(image_type == FIT_BITMAP) {
+		// standard image: 1-, 4-, 8-, 16-, 24-, 32-bit
+
+		samplesperpixel = ((bitsperpixel == 24) ? 3 : ((bitsperpixel == 32) ? 4 : 1));
+		bitspersample = bitsperpixel / samplesperpixel;
+		photometric	= GetPhotometric(dib);
+
+		if((bitsperpixel == 8) && FreeImage_IsTransparent(dib)) {
+			// 8-bit transparent picture : convert later to 8-bit + 8-bit alpha
+			samplesperpixel = 2;
+			bitspersample = 8;
+		}
+		else if(bitsperpixel == 32) {
+			// 32-bit images : check for CMYK or alpha transparency
+
+			if((((iccProfile->flags & FIICC_COLOR_IS_CMYK) == FIICC_COLOR_IS_CMYK) || ((flags & TIFF_CMYK) == TIFF_CMYK))) {
+				// CMYK support
+				photometric = PHOTOMETRIC_SEPARATED;
+				TIFFSetField(out, TIFFTAG_INKSET, INKSET_CMYK);
+				TIFFSetField(out, TIFFTAG_NUMBEROFINKS, 4);
+			}
+			else if(photometric == PHOTOMETRIC_RGB) {
+				// transparency mask support
+				uint16 sampleinfo[1]; 
+				// unassociated alpha data is transparency information
+				sampleinfo[0] = EXTRASAMPLE_UNASSALPHA;
+				TIFFSetField(out, TIFFTAG_EXTRASAMPLES, 1, sampleinfo);
+			}
+		}
+	} else if(image_type == FIT_RGB16) {
+		// 48-bit RGB
+
+		samplesperpixel = 3;
+		bitspersample = bitsperpixel / samplesperpixel;
+		photometric	= PHOTOMETRIC_RGB;
+	} else if(image_type == FIT_RGBA16) {
+		// 64-bit RGBA
+
+		samplesperpixel = 4;
+		bitspersample = bitsperpixel / samplesperpixel;
+		if((((iccProfile->flags & FIICC_COLOR_IS_CMYK) == FIICC_COLOR_IS_CMYK) || ((flags & TIFF_CMYK) == TIFF_CMYK))) {
+			// CMYK support
+			photometric = PHOTOMETRIC_SEPARATED;
+			TIFFSetField(out, TIFFTAG_INKSET, INKSET_CMYK);
+			TIFFSetField(out, TIFFTAG_NUMBEROFINKS, 4);
+		}
+		else {
+			photometric	= PHOTOMETRIC_RGB;
+			// transparency mask support
+			uint16 sampleinfo[1]; 
+			// unassociated alpha data is transparency information
+			sampleinfo[0] = EXTRASAMPLE_UNASSALPHA;
+			TIFFSetField(out, TIFFTAG_EXTRASAMPLES, 1, sampleinfo);
+		}
+	} else if(image_type == FIT_RGBF) {
+		// 96-bit RGBF => store with a LogLuv encoding ?
+
+		samplesperpixel = 3;
+		bitspersample = bitsperpixel / samplesperpixel;
+		// the library converts to and from floating-point XYZ CIE values
+		if((flags & TIFF_LOGLUV) == TIFF_LOGLUV) {
+			photometric	= PHOTOMETRIC_LOGLUV;
+			TIFFSetField(out, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT);
+			// TIFFSetField(out, TIFFTAG_STONITS, 1.0);   // assume unknown 
+		}
+		else {
+			// store with default compression (LZW) or with input compression flag
+			photometric	= PHOTOMETRIC_RGB;
+		}
+		
+	} else if (image_type == FIT_RGBAF) {
+		// 128-bit RGBAF => store with default compression (LZW) or with input compression flag
+		
+		samplesperpixel = 4;
+		bitspersample = bitsperpixel / samplesperpixel;
+		photometric	= PHOTOMETRIC_RGB;
+	} else {
+		// special image type (int, long, double, ...)
+		
+		samplesperpixel = 1;
+		bitspersample = bitsperpixel;
+		photometric	= PHOTOMETRIC_MINISBLACK;
+	}
+
+	// set image data type
+
+	WriteImageType(out, image_type);
+	
+	// write possible ICC profile
+
+	if (iccProfile->size && iccProfile->data) {
+		TIFFSetField(out, TIFFTAG_ICCPROFILE, iccProfile->size, iccProfile->data);
+	}
+
+	// handle standard width/height/bpp stuff
+
+	TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+	TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+	TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, samplesperpixel);
+	TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, bitspersample);
+	TIFFSetField(out, TIFFTAG_PHOTOMETRIC, photometric);
+	TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);	// single image plane 
+	TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+	TIFFSetField(out, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+	TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(out, (uint32) -1)); 
+
+	// handle metrics
+
+	WriteResolution(out, dib);
+
+	// multi-paging
+
+	if ((page >= 0) && (ifd == 0)) {
+		char page_number[20];
+		sprintf(page_number, "Page %d", page);
+
+		TIFFSetField(out, TIFFTAG_SUBFILETYPE, (uint32)FILETYPE_PAGE);
+		TIFFSetField(out, TIFFTAG_PAGENUMBER, (uint16)page, (uint16)0);
+		TIFFSetField(out, TIFFTAG_PAGENAME, page_number);
+
+	} else {
+		// is it a thumbnail or a pyramid level ? 
+		TIFFSetField(out, TIFFTAG_SUBFILETYPE, (ifd == 0) ? (uint32)0 : (uint32)FILETYPE_REDUCEDIMAGE);
+	}
+
+	// palettes (image colormaps are automatically scaled to 16-bits)
+
+	if (photometric == PHOTOMETRIC_PALETTE) {
+		uint16 *r, *g, *b;
+		uint16 nColors = (uint16)FreeImage_GetColorsUsed(dib);
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+
+		r = (uint16 *) _TIFFmalloc(sizeof(uint16) * 3 * nColors);
+		if(r == NULL) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+		g = r + nColors;
+		b = g + nColors;
+
+		for (int i = nColors - 1; i >= 0; i--) {
+			r[i] = SCALE((uint16)pal[i].rgbRed);
+			g[i] = SCALE((uint16)pal[i].rgbGreen);
+			b[i] = SCALE((uint16)pal[i].rgbBlue);
+		}
+
+		TIFFSetField(out, TIFFTAG_COLORMAP, r, g, b);
+
+		_TIFFfree(r);
+	}
+
+	// compression tag
+
+	WriteCompression(out, bitspersample, samplesperpixel, photometric, flags);
+
+	// tiles (replace the strips)
+
+	if((flags & TIFF_TILED) == TIFF_TILED) {
+		const uint32 tileSize = GetTileSize(flags);
+		TIFFUnsetField(out, TIFFTAG_ROWSPERSTRIP);
+		TIFFSetField(out, TIFFTAG_TILEWIDTH, tileSize);
+		TIFFSetField(out, TIFFTAG_TILELENGTH, tileSize);
+	}
+
+	// metadata
+
+	WriteMetadata(out, dib);
+
+	// thumbnail and pyramid levels tag (the next IFDs are written as SubIFDs)
+
+	if((ifd == 0) && (ifdCount > 1)) {
+		const uint16 nsubifd = (uint16)(ifdCount - 1);
+		std::vector<uint64> subifd(nsubifd, 0);
+		TIFFSetField(out, TIFFTAG_SUBIFD, nsubifd, &subifd[0]);
+	}
+
+	*samplesperpixel_out = samplesperpixel;
+	*photometric_out = photometric;
+}
+
+/**
+Convert a dib scanline to the TIFF samples layout
+
+@param buffer Output buffer, at least MAX(pitch, 2 x width) bytes
+@param bits Scanline to be saved
+@param dib The dib to be saved (may be a header-only image)
+@param samplesperpixel Number of samples per pixel (see WriteImageTags)
+@param photometric Photometric interpretation (see WriteImageTags)
+@param flags FreeImage TIFF save flag
+*/
+static void 
+ConvertScanline(BYTE *buffer, const BYTE *bits, FIBITMAP *dib, uint16 samplesperpixel, uint16 photometric, int flags) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	const uint32 width = FreeImage_GetWidth(dib);
+	const uint16 bitsperpixel = (uint16)FreeImage_GetBPP(dib);
+
+	if((image_type == FIT_BITMAP) && (bitsperpixel == 8) && FreeImage_IsTransparent(dib)) {
+		// 8-bit transparent picture : convert to 8-bit + 8-bit alpha
+
+		// get the transparency table
+		BYTE *trns = FreeImage_GetTransparencyTable(dib);
+
+		const BYTE *p = bits;
+		BYTE *b = buffer;
+
+		for(uint32 x = 0; x < width; x++) {
+			// copy the 8-bit layer
+			b[0] = *p;
+			// convert the trns table to a 8-bit alpha layer
+			b[1] = trns[ b[0] ];
+
+			p++;
+			b += samplesperpixel;
+		}
+	}
+	else if((image_type == FIT_BITMAP) && ((bitsperpixel == 24) || (bitsperpixel == 32))) {
+		// get a copy of the scanline
+
+		memcpy(buffer, bits, FreeImage_GetLine(dib));
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+		if (photometric != PHOTOMETRIC_SEPARATED) {
+			// TIFFs store color data RGB(A) instead of BGR(A)
+
+			BYTE *pBuf = buffer;
+
+			for (uint32 x = 0; x < width; x++) {
+				INPLACESWAP(pBuf[0], pBuf[2]);
+				pBuf += samplesperpixel;
+			}
+		}
+#endif
+	}
+	else if((image_type == FIT_RGBF) && ((flags & TIFF_LOGLUV) == TIFF_LOGLUV)) {
+		// RGBF image => store as XYZ using a LogLuv encoding
+		tiff_ConvertLineRGBToXYZ(buffer, (BYTE*)bits, width);
+	}
+	else {
+		// just dump the scanline (tiff supports all dib types)
+		memcpy(buffer, bits, FreeImage_GetLine(dib));
+	}
+}
+
+// --------------------------------------------------------------------------
+
+/// uncompressed size of the strips or tiles compressed by a batch (bounds the memory used by the compressed data)
+static const tmsize_t TIFF_BATCH_SIZE = 16 * 1024 * 1024;
+
+/**
+Strip or tile encoding parameters. 
+They are read from the output TIFF by the calling thread, the compression threads never access it.
+*/
+typedef struct tagBlockCoding {
+	uint32 width;
+	uint32 height;
+	uint16 bitspersample;
+	uint16 samplesperpixel;
+	uint16 sampleformat;
+	uint16 photometric;
+	uint16 fillorder;
+	uint16 compression;
+	uint16 predictor;
+	uint32 group3options;
+	int sgilogdatafmt;
+	BOOL tiled;
+	/// strip or tile height
+	uint32 rowsperblock;
+	uint32 tileWidth;
+	uint32 blockCount;
+	tmsize_t blockSize;
+	tmsize_t scanlineSize;
+	tmsize_t tileRowSize;
+} BlockCoding;
+
+/**
+Read the tags driving the strip or tile encoding
+*/
+static void 
+ReadBlockCoding(TIFF *out, BlockCoding *coding) {
+	memset(coding, 0, sizeof(BlockCoding));
+
+	TIFFGetField(out, TIFFTAG_IMAGEWIDTH, &coding->width);
+	TIFFGetField(out, TIFFTAG_IMAGELENGTH, &coding->height);
+	TIFFGetFieldDefaulted(out, TIFFTAG_BITSPERSAMPLE, &coding->bitspersample);
+	TIFFGetFieldDefaulted(out, TIFFTAG_SAMPLESPERPIXEL, &coding->samplesperpixel);
+	TIFFGetFieldDefaulted(out, TIFFTAG_SAMPLEFORMAT, &coding->sampleformat);
+	TIFFGetField(out, TIFFTAG_PHOTOMETRIC, &coding->photometric);
+	TIFFGetFieldDefaulted(out, TIFFTAG_FILLORDER, &coding->fillorder);
+	TIFFGetFieldDefaulted(out, TIFFTAG_COMPRESSION, &coding->compression);
+
+	// codec tags (see WriteCompression)
+	if(coding->compression == COMPRESSION_LZW) {
+		TIFFGetFieldDefaulted(out, TIFFTAG_PREDICTOR, &coding->predictor);
+	} else if(coding->compression == COMPRESSION_CCITTFAX3) {
+		TIFFGetField(out, TIFFTAG_GROUP3OPTIONS, &coding->group3options);
+	} else if(coding->compression == COMPRESSION_SGILOG) {
+		TIFFGetField(out, TIFFTAG_SGILOGDATAFMT, &coding->sgilogdatafmt);
+	}
+
+	coding->tiled = TIFFIsTiled(out);
+	coding->scanlineSize = TIFFScanlineSize(out);
+
+	if(coding->tiled) {
+		TIFFGetField(out, TIFFTAG_TILEWIDTH, &coding->tileWidth);
+		TIFFGetField(out, TIFFTAG_TILELENGTH, &coding->rowsperblock);
+		coding->blockCount = TIFFNumberOfTiles(out);
+		coding->blockSize = TIFFTileSize(out);
+		coding->tileRowSize = TIFFTileRowSize(out);
+	} else {
+		coding->rowsperblock = coding->height;
+		TIFFGetFieldDefaulted(out, TIFFTAG_ROWSPERSTRIP, &coding->rowsperblock);
+		coding->rowsperblock = MAX<uint32>(1, MIN(coding->rowsperblock, coding->height));
+		coding->blockCount = TIFFNumberOfStrips(out);
+		coding->blockSize = TIFFStripSize(out);
+	}
+}
+
+/**
+Set up a TIFF with the strip or tile encoding of the output TIFF
+*/
+static void 
+WriteBlockCoding(TIFF *tif, const BlockCoding *coding) {
+	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, coding->width);
+	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, coding->height);
+	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, coding->bitspersample);
+	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, coding->samplesperpixel);
+	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, coding->sampleformat);
+	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, coding->photometric);
+	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+	TIFFSetField(tif, TIFFTAG_FILLORDER, coding->fillorder);
+
+	if(coding->tiled) {
+		TIFFSetField(tif, TIFFTAG_TILEWIDTH, coding->tileWidth);
+		TIFFSetField(tif, TIFFTAG_TILELENGTH, coding->rowsperblock);
+	} else {
+		TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, coding->rowsperblock);
+	}
+
+	TIFFSetField(tif, TIFFTAG_COMPRESSION, coding->compression);
+
+	if(coding->compression == COMPRESSION_LZW) {
+		TIFFSetField(tif, TIFFTAG_PREDICTOR, coding->predictor);
+	} else if(coding->compression == COMPRESSION_CCITTFAX3) {
+		TIFFSetField(tif, TIFFTAG_GROUP3OPTIONS, coding->group3options);
+	} else if(coding->compression == COMPRESSION_SGILOG) {
+		TIFFSetField(tif, TIFFTAG_SGILOGDATAFMT, coding->sgilogdatafmt);
+	}
+}
+
+/**
+Conversion buffers of a compression thread
+*/
+typedef struct tagBlockRows {
+	/// scanline conversion buffer, see ConvertScanline
+	BYTE *line;
+	/// converted rows of the current row of tiles
+	BYTE *rows;
+	/// first row held by rows, (uint32)-1 if none
+	uint32 first;
+} BlockRows;
+
+/**
+Convert the rows of a strip or of a tile to the TIFF samples layout
+@param block Output buffer, blockSize bytes
+@param index Strip or tile index
+@param bits Pixels of dib, as returned by FreeImage_GetConstBits on the calling thread
+@param pitch Pitch of dib
+@return Returns the size of the strip or tile data
+*/
+static tmsize_t 
+FillBlock(const BlockCoding *coding, BlockRows *cache, BYTE *block, uint32 index, FIBITMAP *dib, const BYTE *bits, unsigned pitch, uint16 samplesperpixel, uint16 photometric, int flags) {
+	const uint32 height = coding->height;
+
+	if(!coding->tiled) {
+		// the last strip may be shorter
+		const uint32 first = index * coding->rowsperblock;
+		const uint32 last = MIN(height, first + coding->rowsperblock);
+
+		for(uint32 y = first; y < last; y++, block += coding->scanlineSize) {
+			ConvertScanline(cache->line, CalculateScanLine(bits, pitch, height - y - 1), dib, samplesperpixel, photometric, flags);
+			memcpy(block, cache->line, coding->scanlineSize);
+		}
+
+		return (last - first) * coding->scanlineSize;
+	}
+
+	const uint32 tilesAcross = (coding->width + coding->tileWidth - 1) / coding->tileWidth;
+	const uint32 column = index % tilesAcross;
+	const uint32 y = (index / tilesAcross) * coding->rowsperblock;
+	const uint32 rows = MIN(coding->rowsperblock, height - y);
+
+	if(cache->first != y) {
+		// convert the rows once for the whole row of tiles
+		for(uint32 k = 0; k < rows; k++) {
+			ConvertScanline(cache->line, CalculateScanLine(bits, pitch, height - y - k - 1), dib, samplesperpixel, photometric, flags);
+			memcpy(cache->rows + k * coding->scanlineSize, cache->line, coding->scanlineSize);
+		}
+		cache->first = y;
+	}
+
+	// tile widths are multiples of 16: the tiles start on a byte boundary of the scanlines
+	const tmsize_t offset = column * coding->tileRowSize;
+	const tmsize_t size = MIN(coding->tileRowSize, coding->scanlineSize - offset);
+
+	// the pixels outside of the image are black
+	memset(block, 0, coding->blockSize);
+
+	for(uint32 k = 0; k < rows; k++, block += coding->tileRowSize) {
+		memcpy(block, cache->rows + k * coding->scanlineSize + offset, size);
+	}
+
+	return coding->blockSize;
+}
+
+/**
+Compressed strips or tiles of a batch
+*/
+typedef struct tagBlockBatch {
+	/// compressed data of each block, left empty when the block could not be compressed
+	std::vector<std::vector<BYTE> > blocks;
+	/// JPEG tables shared by the blocks (abbreviated JPEG streams)
+	std::vector<BYTE> jpegTables;
+} BlockBatch;
+
+/**
+Compress the strips or tiles [first, last[ of a batch with a private in-memory TIFF, 
+set up with the encoding of the output TIFF
+*/
+static void 
+CompressBlocks(const BlockCoding *coding, FIBITMAP *dib, const BYTE *bits, unsigned pitch, uint16 samplesperpixel, uint16 photometric, int flags, uint32 batch_first, uint32 first, uint32 last, BlockBatch *batch) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	FreeImageIO io;
+	SetMemoryIO(&io);
+	fi_TIFFIO fio = { &io, (fi_handle)hmem, NULL };
+
+	TIFF *tif = hmem ? TIFFFdOpen((thandle_t)&fio, "", "w") : NULL;
+	BYTE *block = (BYTE*)malloc(coding->blockSize * sizeof(BYTE));
+
+	BlockRows cache;
+	cache.line = (BYTE*)malloc(MAX(pitch, 2 * FreeImage_GetWidth(dib)) * sizeof(BYTE));
+	cache.rows = coding->tiled ? (BYTE*)malloc(coding->rowsperblock * coding->scanlineSize * sizeof(BYTE)) : NULL;
+	cache.first = (uint32)-1;
+
+	BOOL bResult = (tif && block && cache.line && (cache.rows || !coding->tiled)) ? TRUE : FALSE;
+
+	if(bResult) {
+		WriteBlockCoding(tif, coding);
+
+		for(uint32 index = first; (index < last) && bResult; index++) {
+			const tmsize_t size = FillBlock(coding, &cache, block, index, dib, bits, pitch, samplesperpixel, photometric, flags);
+
+			if(coding->tiled) {
+				bResult = (TIFFWriteEncodedTile(tif, index, block, size) >= 0);
+			} else {
+				bResult = (TIFFWriteEncodedStrip(tif, index, block, size) >= 0);
+			}
+		}
+	}
+
+	if(bResult) {
+		// the blocks are stored in the memory stream
+		uint64 *offsets = NULL;
+		uint64 *bytecounts = NULL;
+		BYTE *data = NULL;
+		DWORD size_in_bytes = 0;
+
+		TIFFGetField(tif, coding->tiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS, &offsets);
+		TIFFGetField(tif, coding->tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &bytecounts);
+		FreeImage_AcquireMemory(hmem, &data, &size_in_bytes);
+
+		for(uint32 index = first; (index < last) && offsets && bytecounts; index++) {
+			if(offsets[index] + bytecounts[index] <= size_in_bytes) {
+				batch->blocks[index - batch_first].assign(data + offsets[index], data + offsets[index] + bytecounts[index]);
+			}
+		}
+
+		if((first == batch_first) && (coding->compression == COMPRESSION_JPEG)) {
+			uint32 count = 0;
+			void *tables = NULL;
+			if(TIFFGetField(tif, TIFFTAG_JPEGTABLES, &count, &tables) && count) {
+				batch->jpegTables.assign((BYTE*)tables, (BYTE*)tables + count);
+			}
+		}
+	}
+
+	if(tif) {
+		// the directory of the private TIFF is never written
+		TIFFCleanup(tif);
+	}
+	free(cache.rows);
+	free(cache.line);
+	free(block);
+	FreeImage_CloseMemory(hmem);
+}
+
+/**
+Write the image as strips or tiles compressed in parallel by batches, each batch being written in order
+@param bits Pixels of dib: the worker threads never call FreeImage_GetScanLine, 
+which may copy pixels shared with copy-on-write clones
+@param pitch Pitch of dib
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL 
+WriteBlocks(TIFF *out, FIBITMAP *dib, const BYTE *bits, unsigned pitch, uint16 samplesperpixel, uint16 photometric, int flags) {
+	BlockCoding coding;
+	ReadBlockCoding(out, &coding);
+
+	if(!coding.blockCount || (coding.blockSize <= 0)) {
+		return FALSE;
+	}
+
+	const uint32 batchCount = MAX<uint32>((uint32)(TIFF_BATCH_SIZE / coding.blockSize), ThreadPool::instance().getThreadCount());
+
+	BlockBatch batch;
+
+	for(uint32 batch_first = 0; batch_first < coding.blockCount; batch_first += batchCount) {
+		const uint32 count = MIN(batchCount, coding.blockCount - batch_first);
+
+		batch.blocks.resize(count);
+
+		ThreadPool::instance().runBands(count, 1, [&](unsigned begin, unsigned end) {
+			CompressBlocks(&coding, dib, bits, pitch, samplesperpixel, photometric, flags, batch_first, batch_first + begin, batch_first + end, &batch);
+		});
+
+		if((batch_first == 0) && !batch.jpegTables.empty()) {
+			// the tables must be set before the first block is written
+			TIFFSetField(out, TIFFTAG_JPEGTABLES, (uint32)batch.jpegTables.size(), &batch.jpegTables[0]);
+		}
+
+		for(uint32 i = 0; i < count; i++) {
+			std::vector<BYTE> &block = batch.blocks[i];
+			if(block.empty()) {
+				return FALSE;
+			}
+
+			const tmsize_t written = coding.tiled ? 
+				TIFFWriteRawTile(out, batch_first + i, &block[0], (tmsize_t)block.size()) : 
+				TIFFWriteRawStrip(out, batch_first + i, &block[0], (tmsize_t)block.size());
+			if(written < 0) {
+				return FALSE;
+			}
+
+			// release the memory as soon as possible
+			std::vector<BYTE>().swap(block);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+Save a single image into a TIF
+
+@param io FreeImage IO
+@param dib The dib to be saved
+@param handle FreeImage handle
+@param page Page number
+@param flags FreeImage TIFF save flag
+@param data TIFF plugin context
+@param ifd TIFF Image File Directory (0 means save image, > 0 means save a SubIFD: thumbnail or pyramid level)
+@param ifdCount 1 + number of SubIFDs to save (thumbnail and pyramid levels)
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL 
+SaveOneTIFF(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data, unsigned ifd, unsigned ifdCount) {
+	if (!dib || !handle || !data) {
+		return FALSE;
+	} 
+	
+	try { 
+		fi_TIFFIO *fio = (fi_TIFFIO*)data;
+		TIFF *out = fio->tif;
+
+		const uint32 width = FreeImage_GetWidth(dib);
+		const uint32 height = FreeImage_GetHeight(dib);
+
+		uint16 samplesperpixel;
+		uint16 photometric;
+
+		WriteImageTags(out, dib, page, flags, ifd, ifdCount, &samplesperpixel, &photometric);
+
+		// read the DIB lines from bottom to top
+		// and save them in the TIF
+		// -------------------------------------
+		
+		uint16 compression = COMPRESSION_NONE;
+		TIFFGetFieldDefaulted(out, TIFFTAG_COMPRESSION, &compression);
+
+		// read-only access to the pixels, resolved once on this thread
+		const BYTE *bits = FreeImage_GetConstBits(dib);
+		const uint32 pitch = FreeImage_GetPitch(dib);
+
+		if(TIFFIsTiled(out) || ((compression != COMPRESSION_NONE) && (TIFFNumberOfStrips(out) > 1) && (ThreadPool::instance().getThreadCount() > 1))) {
+			// tiles, or strips compressed in parallel
+
+			if(!WriteBlocks(out, dib, bits, pitch, samplesperpixel, photometric, flags)) {
+				throw "Failed to write the TIFF strips or tiles";
+			}
+		} else {
+			BYTE *buffer = (BYTE *)malloc(MAX(pitch, 2 * width) * sizeof(BYTE));
+			if(buffer == NULL) {
+				throw FI_MSG_ERROR_MEMORY;
+			}
+
+			for (uint32 y = 0; y < height; y++) {
+				// convert the scanline
+				ConvertScanline(buffer, CalculateScanLine(bits, pitch, height - y - 1), dib, samplesperpixel, photometric, flags);
+				// write the scanline to disc
+				TIFFWriteScanline(out, buffer, y, 0);
+			}
+
+			free(buffer);
+		}
+
+		// write out the directory tag if we wrote a page other than -1 or if we have a SubIFD to write later
+
+		if( (page >= 0) || (ifd + 1 < ifdCount) ) {
+			TIFFWriteDirectory(out);
+			// else: TIFFClose will WriteDirectory
+		}
+
+		return TRUE;
+		
+	} catch(const char *text) {
+		FreeImage_OutputMessageProc(s_format_id, text);
+		return FALSE;
+	} 
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Scanline encoder state
+*/
+typedef struct tagScanlineEncoder {
+	/// TIFF plugin context
+	void *data;
+	/// image description, owned by the caller
+	FIBITMAP *header;
+	int page;
+	int flags;
+	uint16 samplesperpixel;
+	uint16 photometric;
+	/// scanline conversion buffer
+	BYTE *buffer;
+	/// number of rows written so far
+	uint32 rows;
+	/// TRUE once libtiff could not write a row
+	BOOL failed;
+} ScanlineEncoder;
+
+static void * DLL_CALLCONV
+CreateScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *header, int page, int flags, void *data) {
+	if (!header || !handle || !data) {
+		return NULL;
+	}
+
+	if ((flags & (TIFF_TILED | TIFF_PYRAMID)) != 0) {
+		// tiles need the whole image: let Save handle them
+		return NULL;
+	}
+
+	ScanlineEncoder *encoder = (ScanlineEncoder*)malloc(sizeof(ScanlineEncoder));
+	if (!encoder) {
+		return NULL;
+	}
+	memset(encoder, 0, sizeof(ScanlineEncoder));
+	encoder->data = data;
+	encoder->header = header;
+	encoder->page = page;
+	encoder->flags = flags;
+
+	encoder->buffer = (BYTE *)malloc(MAX(FreeImage_GetPitch(header), 2 * FreeImage_GetWidth(header)) * sizeof(BYTE));
+	if (!encoder->buffer) {
+		free(encoder);
+		return NULL;
+	}
+
+	// the tags are written with the directory, after the image data (see FinishScanlines)
+	TIFF *out = ((fi_TIFFIO*)data)->tif;
+	const unsigned ifdCount = (FreeImage_GetThumbnail(header) != NULL) ? 2 : 1;
+
+	try {
+		WriteImageTags(out, header, page, flags, 0, ifdCount, &encoder->samplesperpixel, &encoder->photometric);
+	} catch(const char *text) {
+		FreeImage_OutputMessageProc(s_format_id, text);
+		free(encoder->buffer);
+		free(encoder);
+		return NULL;
+	}
+
+	return encoder;
+}
+
+static unsigned DLL_CALLCONV
+WriteScanlines(FreeImageIO *io, fi_handle handle, void *writer, const BYTE *bits, unsigned pitch, unsigned count) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+	TIFF *out = ((fi_TIFFIO*)encoder->data)->tif;
+
+	const uint32 height = FreeImage_GetHeight(encoder->header);
+
+	unsigned rows = 0;
+
+	for (; (rows < count) && (encoder->rows < height) && !encoder->failed; rows++, encoder->rows++) {
+		ConvertScanline(encoder->buffer, bits + (size_t)rows * pitch, encoder->header, encoder->samplesperpixel, encoder->photometric, encoder->flags);
+
+		if (TIFFWriteScanline(out, encoder->buffer, encoder->rows, 0) < 0) {
+			encoder->failed = TRUE;
+			break;
+		}
+	}
+
+	return rows;
+}
+
+static BOOL DLL_CALLCONV
+FinishScanlines(FreeImageIO *io, fi_handle handle, void *writer) {
+	ScanlineEncoder *encoder = (ScanlineEncoder*)writer;
+	TIFF *out = ((fi_TIFFIO*)encoder->data)->tif;
+
+	BOOL bResult = (!encoder->failed && (encoder->rows == FreeImage_GetHeight(encoder->header))) ? TRUE : FALSE;
+
+	if (bResult) {
+		// same as Save: write the directory now if a page or a thumbnail follows
+		FIBITMAP *thumbnail = FreeImage_GetThumbnail(encoder->header);
+
+		if ((encoder->page >= 0) || thumbnail) {
+			TIFFWriteDirectory(out);
+			// else: TIFFClose will WriteDirectory
+		}
+		if (thumbnail) {
+			bResult = SaveOneTIFF(io, thumbnail, handle, encoder->page, encoder->flags, encoder->data, 1, 2);
+		}
+	}
+
+	free(encoder->buffer);
+	free(encoder);
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Number of half-size levels of a pyramid, the last one fitting in a single tile
+*/
+static unsigned 
+CountLevels(uint32 width, uint32 height, uint32 tileSize) {
+	unsigned count = 0;
+	while((width > tileSize) || (height > tileSize)) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		count++;
+	}
+	return count;
+}
+
+/**
+Returns TRUE if the pyramid levels of an image keep its layout. 
+The levels are reduced with FreeImage_RescaleRect, which doesn't handle every image type, 
+and which changes the bit depth of low bit depth and palettized images.
+*/
+static BOOL 
+CanSavePyramid(FIBITMAP *dib) {
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			switch(FreeImage_GetBPP(dib)) {
+				case 8:
+				{
+					// palettized and transparent images are reduced to true color images
+					const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(dib);
+					return ((color_type == FIC_MINISBLACK) || (color_type == FIC_MINISWHITE)) && !FreeImage_IsTransparent(dib);
+				}
+				case 24:
+				case 32:
+					return TRUE;
+				default:
+					// 1- and 4-bit images are reduced to 8-bit images, 16-bit images to 24-bit images
+					return FALSE;
+			}
+		case FIT_UINT16:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+		case FIT_FLOAT:
+		case FIT_RGBF:
+		case FIT_RGBAF:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+static BOOL DLL_CALLCONV
+Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
+	if (!dib) {
+		return FALSE;
+	}
+
+	// handle thumbnail and pyramid levels as SubIFDs, the thumbnail first (see ReadThumbnail)
+	FIBITMAP *thumbnail = FreeImage_GetThumbnail(dib);
+	const BOOL bPyramid = ((flags & TIFF_PYRAMID) == TIFF_PYRAMID);
+	const unsigned levelCount = bPyramid ? CountLevels(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), GetTileSize(flags)) : 0;
+	const unsigned ifdCount = 1 + (thumbnail ? 1 : 0) + levelCount;
+
+	if (bPyramid) {
+		// check before writing anything, so that no half-written file is left
+		if ((levelCount > 0) && !CanSavePyramid(dib)) {
+			FreeImage_OutputMessageProc(s_format_id, "TIFF_PYRAMID: unsupported image type or bit depth (use 8-bit greyscale, 24- or 32-bit, or a 16-bit or float type)");
+			return FALSE;
+		}
+		flags |= TIFF_TILED;
+	}
+
+	unsigned ifd = 0;
+
+	if (!SaveOneTIFF(io, dib, handle, page, flags, data, ifd++, ifdCount)) {
+		return FALSE;
+	}
+
+	// a thumbnail is saved as strips, telling it from the pyramid levels (see SelectLevel)
+	if (thumbnail && !SaveOneTIFF(io, thumbnail, handle, page, flags & ~TIFF_TILED, data, ifd++, ifdCount)) {
+		return FALSE;
+	}
+
+	// each level is the previous one reduced by a factor of 2: 
+	// a 2 x 2 box filter, and a third of the image resampling work for the whole pyramid
+	BOOL bResult = TRUE;
+	FIBITMAP *level = dib;
+
+	for (unsigned i = 0; (i < levelCount) && bResult; i++) {
+		const unsigned width = FreeImage_GetWidth(level);
+		const unsigned height = FreeImage_GetHeight(level);
+
+		FIBITMAP *reduced = FreeImage_RescaleRect(level, (width + 1) / 2, (height + 1) / 2, 0, 0, width, height, FILTER_BOX, FI_RESCALE_OMIT_METADATA);
+		if (reduced) {
+			FreeImage_SetDotsPerMeterX(reduced, FreeImage_GetDotsPerMeterX(level) / 2);
+			FreeImage_SetDotsPerMeterY(reduced, FreeImage_GetDotsPerMeterY(level) / 2);
+		}
+		if (level != dib) {
+			FreeImage_Unload(level);
+		}
+		level = reduced;
+
+		if (!level) {
+			FreeImage_OutputMessageProc(s_format_id, "Failed to compute the pyramid levels");
+			return FALSE;
+		}
+
+		bResult = SaveOneTIFF(io, level, handle, page, flags, data, ifd++, ifdCount);
+	}
+
+	if (level != dib) {
+		FreeImage_Unload(level);
+	}
+
 	return bResult;
 }
 
@@ -2672,4 +3881,16 @@ InitTIFF(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels; 
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_scaled_proc = LoadScaled;
+	plugin->open_scanlines_proc = OpenScanlines;
+	plugin->read_scanlines_proc = ReadScanlines;
+	plugin->close_scanlines_proc = CloseScanlines;
+	plugin->create_scanlines_proc = CreateScanlines;
+	plugin->write_scanlines_proc = WriteScanlines;
+	plugin->finish_scanlines_proc = FinishScanlines;
+	plugin->load_region_proc = LoadRegion;
+	plugin->open_tiles_proc = OpenTiles;
+	plugin->read_tile_proc = ReadTile;
+	plugin->close_tiles_proc = CloseTiles;
 }
@@ -27,6 +27,7 @@
 #include "../LibWebP/src/webp/decode.h"
 #include "../LibWebP/src/webp/encode.h"
 #include "../LibWebP/src/webp/mux.h"
+#include "../LibWebP/src/webp/demux.h"
 
 // ==========================================================
 // Plugin Interface
@@ -34,6 +35,34 @@
 
 static int s_format_id;
 
+// ----------------------------------------------------------
+//   Plugin data
+// ----------------------------------------------------------
+
+/**
+Data shared by the plugin functions between Open and Close
+*/
+typedef struct tagWebPInfo {
+	//! input file data, referenced by the read mux
+	WebPData bitstream;
+	//! MUX object of the input file, or of the output file
+	WebPMux *mux;
+
+	//! animation renderer used with WEBP_PLAYBACK, created on demand
+	WebPAnimDecoder *decoder;
+	//! last page rendered by the decoder (-1 if none)
+	int decoder_page;
+	//! canvas of the last page rendered by the decoder
+	uint8_t *decoder_canvas;
+
+	//! animation encoder used by multipage saving, created with the first page
+	WebPAnimEncoder *encoder;
+	//! 32-bit canvas the saved pages are drawn onto
+	FIBITMAP *canvas;
+	//! timestamp of the next saved page, in ms
+	int timestamp;
+} WebPInfo;
+
 // ----------------------------------------------------------
 //   Helpers for the load function
 // ----------------------------------------------------------
@@ -77,6 +106,66 @@ ReadFileToWebPData(FreeImageIO *io, fi_handle handle, WebPData * const bitstream
   }
 }
 
+/**
+Store an animation tag, using the same keys as the GIF plugin
+*/
+static void
+SetAnimationTag(FIBITMAP *dib, const char *key, WORD id, FREE_IMAGE_MDTYPE type, DWORD length, const void *value) {
+	FITAG *tag = FreeImage_CreateTag();
+	if(tag) {
+		FreeImage_SetTagKey(tag, key);
+		FreeImage_SetTagID(tag, id);
+		FreeImage_SetTagType(tag, type);
+		FreeImage_SetTagCount(tag, 1);
+		FreeImage_SetTagLength(tag, length);
+		FreeImage_SetTagValue(tag, value);
+		FreeImage_SetTagDescription(tag, TagLib::instance().getTagDescription(TagLib::ANIMATION, id));
+		FreeImage_SetMetadata(FIMD_ANIMATION, dib, key, tag);
+		FreeImage_DeleteTag(tag);
+	}
+}
+
+/**
+Render a page of an animation onto the full canvas (WEBP_PLAYBACK load flag).
+The decoder renders the frames in sequence and keeps its canvas,
+so that loading the pages in order decodes each frame once.
+@param info Plugin data
+@param page Page to render
+@return Returns the decoder canvas (BGRA, top-down) if successfull, returns NULL otherwise
+*/
+static const uint8_t *
+RenderAnimationPage(WebPInfo *info, int page) {
+	if(!info->decoder) {
+		WebPAnimDecoderOptions decoder_options;
+		if(!WebPAnimDecoderOptionsInit(&decoder_options)) {
+			return NULL;
+		}
+		decoder_options.color_mode = MODE_BGRA;
+		decoder_options.use_threads = 1;
+		info->decoder = WebPAnimDecoderNew(&info->bitstream, &decoder_options);
+		if(!info->decoder) {
+			return NULL;
+		}
+		info->decoder_page = -1;
+	}
+	if(page < info->decoder_page) {
+		// going backwards: restart from the first frame
+		WebPAnimDecoderReset(info->decoder);
+		info->decoder_page = -1;
+	}
+	while(info->decoder_page < page) {
+		int timestamp = 0;
+		if(!WebPAnimDecoderGetNext(info->decoder, &info->decoder_canvas, &timestamp)) {
+			WebPAnimDecoderReset(info->decoder);
+			info->decoder_page = -1;
+			return NULL;
+		}
+		info->decoder_page++;
+	}
+
+	return info->decoder_canvas;
+}
+
 // ----------------------------------------------------------
 //   Helpers for the save function
 // ----------------------------------------------------------
@@ -92,6 +181,70 @@ WebP_MemoryWriter(const BYTE *data, size_t data_size, const WebPPicture* const p
 	return data_size ? (FreeImage_WriteMemory(data, 1, (unsigned)data_size, hmem) == data_size) : 0;
 }
 
+/**
+Write the animation built by the multipage save (called by Close).
+The metadata chunks stored with the first page are added to the animation.
+@return Returns TRUE if successfull, returns FALSE otherwise
+*/
+static BOOL
+WriteAnimation(FreeImageIO *io, fi_handle handle, WebPInfo *info) {
+	static const char *chunk_ids[] = { "ICCP", "XMP ", "EXIF" };
+
+	WebPData anim_data = { 0 };
+	WebPData output_data = { 0 };
+	WebPMux *mux = NULL;
+
+	try {
+		// the last page lasts until the final timestamp
+		if(!WebPAnimEncoderAdd(info->encoder, NULL, info->timestamp, NULL)) {
+			throw WebPAnimEncoderGetError(info->encoder);
+		}
+		if(!WebPAnimEncoderAssemble(info->encoder, &anim_data)) {
+			throw WebPAnimEncoderGetError(info->encoder);
+		}
+
+		// add the metadata
+		mux = WebPMuxCreate(&anim_data, 0);
+		if(!mux) {
+			throw "Failed to create mux object from animation";
+		}
+		for(int i = 0; i < 3; i++) {
+			WebPData chunk;
+			if(WebPMuxGetChunk(info->mux, chunk_ids[i], &chunk) == WEBP_MUX_OK) {
+				if(WebPMuxSetChunk(mux, chunk_ids[i], &chunk, 0) != WEBP_MUX_OK) {
+					throw "Failed to set animation metadata";
+				}
+			}
+		}
+
+		// get data from mux in WebP RIFF format
+		if(WebPMuxAssemble(mux, &output_data) != WEBP_MUX_OK) {
+			throw "Failed to create webp output file";
+		}
+
+		// write the file to the output stream
+		if(io->write_proc((void*)output_data.bytes, 1, (unsigned)output_data.size, handle) != output_data.size) {
+			throw "Failed to write webp output file";
+		}
+
+		WebPDataClear(&output_data);
+		WebPMuxDelete(mux);
+		WebPDataClear(&anim_data);
+
+		return TRUE;
+
+	} catch(const char *text) {
+		WebPDataClear(&output_data);
+		WebPMuxDelete(mux);
+		WebPDataClear(&anim_data);
+
+		if(NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+		return FALSE;
+	}
+}
+
 // ==========================================================
 // Plugin Implementation
 // ==========================================================
@@ -138,6 +291,19 @@ Validate(FreeImageIO *io, fi_handle handle) {
 	return FALSE;
 }
 
+static const FIMAGICNUMBER * DLL_CALLCONV
+MagicNumbers(int *count) {
+	// RIFF chunk size (bytes 4 to 7) is ignored
+	static const BYTE riff_mask[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+	static const BYTE webp_signature[] = { 0x52, 0x49, 0x46, 0x46, 0, 0, 0, 0, 0x57, 0x45, 0x42, 0x50 };
+	static const FIMAGICNUMBER magic_numbers[] = {
+		{ sizeof(webp_signature), webp_signature, riff_mask }
+	};
+
+	*count = sizeof(magic_numbers) / sizeof(magic_numbers[0]);
+	return magic_numbers;
+}
+
 static BOOL DLL_CALLCONV
 SupportsExportDepth(int depth) {
 	return (
@@ -161,59 +327,112 @@ SupportsNoPixels() {
 	return TRUE;
 }
 
+/**
+Open reads the whole file and Load only picks frames from the mux object. 
+Keeping the data also keeps the WEBP_PLAYBACK decoder, which makes sequential playback linear.
+*/
+static BOOL DLL_CALLCONV
+KeepsLoadData() {
+	return TRUE;
+}
+
+/**
+WebP saves lossy 24- or 32-bit images by default, the pages added to a multipage bitmap are cached as PNG
+*/
+static FREE_IMAGE_FORMAT DLL_CALLCONV
+CacheFormat() {
+	return FIF_PNG;
+}
+
 // ----------------------------------------------------------
 
 static void * DLL_CALLCONV
 Open(FreeImageIO *io, fi_handle handle, BOOL read) {
-	WebPMux *mux = NULL;
-	int copy_data = 1;	// 1 : copy data into the mux, 0 : keep a link to local data
+	int copy_data = 0;	// 1 : copy data into the mux, 0 : keep a link to local data
+
+	WebPInfo *info = (WebPInfo*)malloc(sizeof(WebPInfo));
+	if(!info) {
+		return NULL;
+	}
+	memset(info, 0, sizeof(WebPInfo));
+	info->decoder_page = -1;
 
 	if(read) {
-		// create the MUX object from the input stream
-		WebPData bitstream;
 		// read the input file and put it in memory
-		if(!ReadFileToWebPData(io, handle, &bitstream)) {
+		// (kept until Close, the mux and the animation decoder refer to it)
+		if(!ReadFileToWebPData(io, handle, &info->bitstream)) {
+			free(info);
 			return NULL;
 		}
 		// create the MUX object
-		mux = WebPMuxCreate(&bitstream, copy_data);
-		// no longer needed since copy_data == 1
-		free((void*)bitstream.bytes);
-		if(mux == NULL) {
+		info->mux = WebPMuxCreate(&info->bitstream, copy_data);
+		if(info->mux == NULL) {
 			FreeImage_OutputMessageProc(s_format_id, "Failed to create mux object from file");
+			free((void*)info->bitstream.bytes);
+			free(info);
 			return NULL;
 		}
 	} else {
 		// creates an empty mux object
-		mux = WebPMuxNew();
-		if(mux == NULL) {
+		info->mux = WebPMuxNew();
+		if(info->mux == NULL) {
 			FreeImage_OutputMessageProc(s_format_id, "Failed to create empty mux object");
+			free(info);
 			return NULL;
 		}
 	}
-	
-	return mux;
+
+	return info;
 }
 
 static void DLL_CALLCONV
 Close(FreeImageIO *io, fi_handle handle, void *data) {
-	WebPMux *mux = (WebPMux*)data;
-	if(mux != NULL) {
+	WebPInfo *info = (WebPInfo*)data;
+	if(info != NULL) {
+		if(info->encoder) {
+			// multipage saving: write the animation
+			WriteAnimation(io, handle, info);
+			WebPAnimEncoderDelete(info->encoder);
+		}
+		if(info->canvas) {
+			FreeImage_Unload(info->canvas);
+		}
+		if(info->decoder) {
+			WebPAnimDecoderDelete(info->decoder);
+		}
 		// free the MUX object
-		WebPMuxDelete(mux);
+		WebPMuxDelete(info->mux);
+		free((void*)info->bitstream.bytes);
+		free(info);
 	}
 }
 
+static int DLL_CALLCONV
+PageCount(FreeImageIO *io, fi_handle handle, void *data) {
+	WebPInfo *info = (WebPInfo*)data;
+	if(info == NULL) {
+		return 0;
+	}
+	// a still image has no ANMF chunk
+	int frame_count = 0;
+	if((WebPMuxNumChunks(info->mux, WEBP_CHUNK_ANMF, &frame_count) == WEBP_MUX_OK) && (frame_count > 0)) {
+		return frame_count;
+	}
+	return 1;
+}
+
 // ----------------------------------------------------------
 
 /**
 Decode a WebP image and returns a FIBITMAP image
 @param webp_image Raw WebP image
 @param flags FreeImage load flags
+@param max_width Maximum output width (reduced-resolution loading), a value <= 0 leaves the width unconstrained
+@param max_height Maximum output height (reduced-resolution loading), a value <= 0 leaves the height unconstrained
 @return Returns a dib if successfull, returns NULL otherwise
 */
 static FIBITMAP *
-DecodeImage(WebPData *webp_image, int flags) {
+DecodeImage(WebPData *webp_image, int flags, int max_width, int max_height) {
 	FIBITMAP *dib = NULL;
 
 	const uint8_t* data = webp_image->bytes;	// raw image data
@@ -250,6 +469,12 @@ DecodeImage(WebPData *webp_image, int flags) {
 		unsigned width = (unsigned)bitstream->width;
 		unsigned height = (unsigned)bitstream->height;
 
+		// the decoder can resample the image to any size while decoding
+		const BOOL use_scaling = !header_only && (CalculateFitReduction(width, height, max_width, max_height) > 1);
+		if(use_scaling) {
+			CalculateFitSize(width, height, max_width, max_height, &width, &height);
+		}
+
 		dib = FreeImage_AllocateHeader(header_only, width, height, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(!dib) {
 			throw FI_MSG_ERROR_DIB_MEMORY;
@@ -264,6 +489,12 @@ DecodeImage(WebPData *webp_image, int flags) {
 
 		// use multi-threaded decoding
 		decoder_config.options.use_threads = 1;
+		// use scaled decoding
+		if(use_scaling) {
+			decoder_config.options.use_scaling = 1;
+			decoder_config.options.scaled_width = (int)width;
+			decoder_config.options.scaled_height = (int)height;
+		}
 		// set output color space
 		output_buffer->colorspace = bitstream->has_alpha ? MODE_BGRA : MODE_BGR;
 
@@ -330,8 +561,46 @@ DecodeImage(WebPData *webp_image, int flags) {
 	}
 }
 
+/**
+Copy the canvas rendered by the animation decoder into a 32-bit dib
+@param width Canvas width
+@param height Canvas height
+@param canvas Canvas pixels (BGRA, top-down)
+@param flags FreeImage load flags
+@return Returns a dib if successfull, returns NULL otherwise
+*/
+static FIBITMAP *
+CopyAnimationCanvas(unsigned width, unsigned height, const uint8_t *canvas, int flags) {
+	BOOL header_only = (flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
+
+	FIBITMAP *dib = FreeImage_AllocateHeader(header_only, width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+	if(!dib) {
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_DIB_MEMORY);
+		return NULL;
+	}
+	if(header_only) {
+		return dib;
+	}
+
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *src_bits = canvas + y * 4 * width;
+		BYTE *dst_bits = (BYTE*)FreeImage_GetScanLine(dib, height-1-y);
+		for(unsigned x = 0; x < width; x++) {
+			dst_bits[FI_RGBA_BLUE]	= src_bits[0];	// B
+			dst_bits[FI_RGBA_GREEN]	= src_bits[1];	// G
+			dst_bits[FI_RGBA_RED]	= src_bits[2];	// R
+			dst_bits[FI_RGBA_ALPHA]	= src_bits[3];	// A
+			src_bits += 4;
+			dst_bits += 4;
+		}
+	}
+
+	return dib;
+}
+
 static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+LoadScaled(FreeImageIO *io, fi_handle handle, int page, int flags, void *data, int max_width, int max_height) {
+	WebPInfo *info = NULL;
 	WebPMux *mux = NULL;
 	WebPMuxFrameInfo webp_frame = { 0 };	// raw image
 	WebPData color_profile;	// ICC raw data
@@ -346,11 +615,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 	try {
 		// get the MUX object
-		mux = (WebPMux*)data;
-		if(!mux) {
+		info = (WebPInfo*)data;
+		if(!info) {
 			throw (1);
 		}
-		
+		mux = info->mux;
+
 		// gets the feature flags from the mux object
 		uint32_t webp_flags = 0;
 		error_status = WebPMuxGetFeatures(mux, &webp_flags);
@@ -358,16 +628,70 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			throw (1);
 		}
 
+		const BOOL is_animation = (webp_flags & ANIMATION_FLAG) == ANIMATION_FLAG;
+
+		if(page < 0) {
+			page = 0;
+		}
+
 		// get image data
-		error_status = WebPMuxGetFrame(mux, 1, &webp_frame);
+		error_status = WebPMuxGetFrame(mux, page + 1, &webp_frame);
 
 		if(error_status == WEBP_MUX_OK) {
-			// decode the data (can be limited to the header if flags uses FIF_LOAD_NOPIXELS)
-			dib = DecodeImage(&webp_frame.bitstream, flags);
+			if(is_animation && ((flags & WEBP_PLAYBACK) == WEBP_PLAYBACK)) {
+				// render the page onto the full canvas
+				int canvas_width = 0;
+				int canvas_height = 0;
+				WebPMuxGetCanvasSize(mux, &canvas_width, &canvas_height);
+				const uint8_t *canvas = NULL;
+				if((flags & FIF_LOAD_NOPIXELS) != FIF_LOAD_NOPIXELS) {
+					canvas = RenderAnimationPage(info, page);
+					if(!canvas) {
+						FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_PARSING);
+						throw (1);
+					}
+				}
+				dib = CopyAnimationCanvas((unsigned)canvas_width, (unsigned)canvas_height, canvas, flags);
+			} else {
+				// animation frames are decoded at full size so that their offsets remain valid
+				if(is_animation) {
+					max_width = max_height = 0;
+				}
+				// decode the data (can be limited to the header if flags uses FIF_LOAD_NOPIXELS)
+				dib = DecodeImage(&webp_frame.bitstream, flags, max_width, max_height);
+			}
 			if(!dib) {
 				throw (1);
 			}
-			
+
+			if(is_animation) {
+				// store the animation metadata, using the same keys as the GIF plugin
+				if(page == 0) {
+					int canvas_width = 0;
+					int canvas_height = 0;
+					WebPMuxAnimParams anim_params;
+					WebPMuxGetCanvasSize(mux, &canvas_width, &canvas_height);
+					WORD logical_width = (WORD)canvas_width;
+					WORD logical_height = (WORD)canvas_height;
+					SetAnimationTag(dib, "LogicalWidth", ANIMTAG_LOGICALWIDTH, FIDT_SHORT, 2, &logical_width);
+					SetAnimationTag(dib, "LogicalHeight", ANIMTAG_LOGICALHEIGHT, FIDT_SHORT, 2, &logical_height);
+					if(WebPMuxGetAnimationParams(mux, &anim_params) == WEBP_MUX_OK) {
+						LONG loop = (LONG)anim_params.loop_count;
+						SetAnimationTag(dib, "Loop", ANIMTAG_LOOP, FIDT_LONG, 4, &loop);
+					}
+				}
+				const BOOL playback = (flags & WEBP_PLAYBACK) == WEBP_PLAYBACK;
+				WORD left = playback ? 0 : (WORD)webp_frame.x_offset;
+				WORD top = playback ? 0 : (WORD)webp_frame.y_offset;
+				LONG frame_time = (LONG)webp_frame.duration;
+				// WebP dispose none / background, as GIF disposal leave (1) / background (2)
+				BYTE disposal_method = (webp_frame.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) ? 2 : 1;
+				SetAnimationTag(dib, "FrameLeft", ANIMTAG_FRAMELEFT, FIDT_SHORT, 2, &left);
+				SetAnimationTag(dib, "FrameTop", ANIMTAG_FRAMETOP, FIDT_SHORT, 2, &top);
+				SetAnimationTag(dib, "FrameTime", ANIMTAG_FRAMETIME, FIDT_LONG, 4, &frame_time);
+				SetAnimationTag(dib, "DisposalMethod", ANIMTAG_DISPOSALMETHOD, FIDT_BYTE, 1, &disposal_method);
+			}
+
 			// get ICC profile
 			if(webp_flags & ICCP_FLAG) {
 				error_status = WebPMuxGetChunk(mux, "ICCP", &color_profile);
@@ -420,8 +744,65 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	}
 }
 
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return LoadScaled(io, handle, page, flags, data, 0, 0);
+}
+
 // --------------------------------------------------------------------------
 
+/**
+Set the encoding parameters from the FreeImage save flags
+@param config Coding parameters
+@param flags FreeImage save flags
+@return Returns TRUE if successfull, returns FALSE otherwise
+*/
+static BOOL
+SetEncoderConfig(WebPConfig *config, int flags) {
+	// Initialize encoding parameters to default values
+	WebPConfigInit(config);
+
+	// quality/speed trade-off (0=fast, 6=slower-better)
+	config->method = 6;
+	if((flags & 0x0E00) != 0) {
+		config->method = ((flags & 0x0E00) >> 9) - 1;
+	}
+
+	// number of segments, 0 means the default (4)
+	if((flags & 0x6000) != 0) {
+		config->segments = (flags & 0x6000) >> 13;
+	}
+
+	// pipelined encoding, same output as the single-threaded one
+	if(((flags & WEBP_THREADS) == WEBP_THREADS) && (FreeImage_GetThreadCount() > 1)) {
+		config->thread_level = 1;
+	}
+
+	if((flags & WEBP_EXACT) == WEBP_EXACT) {
+		config->exact = 1;
+	}
+
+	if((flags & WEBP_LOSSLESS) == WEBP_LOSSLESS) {
+		// lossless encoding
+		config->lossless = 1;
+		// near-lossless preprocessing, 100 (no preprocessing) by default
+		if((flags & (0x7F << 16)) != 0) {
+			config->near_lossless = 100 - ((flags >> 16) & 0x7F);
+		}
+	} else if((flags & 0x7F) > 0) {
+		// lossy encoding
+		config->lossless = 0;
+		// quality is between 1 (smallest file) and 100 (biggest) - default to 75
+		config->quality = (float)(flags & 0x7F);
+		if(config->quality > 100) {
+			config->quality = 100;
+		}
+	}
+
+	// validate encoding parameters
+	return (WebPValidateConfig(config) != 0) ? TRUE : FALSE;
+}
+
 /**
 Encode a FIBITMAP to a WebP image
 @param hmem Memory output stream, containing on return the encoded image
@@ -467,30 +848,13 @@ EncodeImage(FIMEMORY *hmem, FIBITMAP *dib, int flags) {
 
 		// --- Set encoding parameters ---
 
-		// Initialize encoding parameters to default values
-		WebPConfigInit(&config);
-
-		// quality/speed trade-off (0=fast, 6=slower-better)
-		config.method = 6;
-
-		if((flags & WEBP_LOSSLESS) == WEBP_LOSSLESS) {
-			// lossless encoding
-			config.lossless = 1;
-			picture.use_argb = 1;
-		} else if((flags & 0x7F) > 0) {
-			// lossy encoding
-			config.lossless = 0;
-			// quality is between 1 (smallest file) and 100 (biggest) - default to 75
-			config.quality = (float)(flags & 0x7F);
-			if(config.quality > 100) {
-				config.quality = 100;
-			}
-		}
-
-		// validate encoding parameters
-		if(WebPValidateConfig(&config) == 0) {
+		// Initialize encoding parameters from the save flags
+		if(!SetEncoderConfig(&config, flags)) {
 			throw "Failed to initialize encoder";
 		}
+		if(config.lossless) {
+			picture.use_argb = 1;
+		}
 
 		// --- Perform encoding ---
 		
@@ -500,7 +864,7 @@ EncodeImage(FIMEMORY *hmem, FIBITMAP *dib, int flags) {
 
 		// convert dib buffer to output stream
 
-		const BYTE *bits = FreeImage_GetBits(dib);
+		const BYTE *bits = FreeImage_GetConstBits(dib);
 
 #if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
 		switch(bpp) {
@@ -553,6 +917,224 @@ EncodeImage(FIMEMORY *hmem, FIBITMAP *dib, int flags) {
 	return FALSE;
 }
 
+/**
+Store the ICC profile, the XMP and the Exif metadata of a dib as mux chunks
+@param mux Output MUX object
+@param dib Source image
+@return Returns TRUE if successfull, returns FALSE otherwise
+*/
+static BOOL
+SetMetadataChunks(WebPMux *mux, FIBITMAP *dib) {
+	WebPMuxError error_status;
+
+	int copy_data = 1;	// 1 : copy data into the mux, 0 : keep a link to local data
+
+	// set ICC color profile
+	{
+		FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
+		if (iccProfile->size && iccProfile->data) {
+			WebPData icc_profile;
+			icc_profile.bytes = (uint8_t*)iccProfile->data;
+			icc_profile.size = (size_t)iccProfile->size;
+			error_status = WebPMuxSetChunk(mux, "ICCP", &icc_profile, copy_data);
+			if(error_status != WEBP_MUX_OK) {
+				return FALSE;
+			}
+		}
+	}
+
+	// set XMP metadata
+	{
+		FITAG *tag = NULL;
+		if(FreeImage_GetMetadata(FIMD_XMP, dib, g_TagLib_XMPFieldName, &tag)) {
+			WebPData xmp_profile;
+			xmp_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
+			xmp_profile.size = (size_t)FreeImage_GetTagLength(tag);
+			error_status = WebPMuxSetChunk(mux, "XMP ", &xmp_profile, copy_data);
+			if(error_status != WEBP_MUX_OK) {
+				return FALSE;
+			}
+		}
+	}
+
+	// set Exif metadata
+	{
+		FITAG *tag = NULL;
+		if(FreeImage_GetMetadata(FIMD_EXIF_RAW, dib, g_TagLib_ExifRawFieldName, &tag)) {
+			WebPData exif_profile;
+			exif_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
+			exif_profile.size = (size_t)FreeImage_GetTagLength(tag);
+			error_status = WebPMuxSetChunk(mux, "EXIF", &exif_profile, copy_data);
+			if(error_status != WEBP_MUX_OK) {
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+Add a page to the animation built by the multipage save.
+The pages are drawn onto a canvas whose size is given by the first page
+(or by its LogicalWidth / LogicalHeight animation tags). A page smaller than
+the canvas is drawn over the previous ones at its FrameLeft / FrameTop position,
+its transparent pixels leaving the canvas unchanged.
+The page lasts FrameTime ms (100 ms when the tag is missing).
+@param info Plugin data
+@param dib The page to add
+@param flags FreeImage save flags
+@return Returns TRUE if successfull, returns FALSE otherwise
+*/
+static BOOL
+AddAnimationFrame(WebPInfo *info, FIBITMAP *dib, int flags) {
+	WebPPicture picture;	// Input buffer
+	WebPConfig config;		// Coding parameters
+	FIBITMAP *frame = NULL;
+	FITAG *tag = NULL;
+
+	BOOL bIsFlipped = FALSE;
+
+	if(!WebPPictureInit(&picture)) {
+		return FALSE;
+	}
+
+	try {
+		if(FreeImage_GetImageType(dib) != FIT_BITMAP) {
+			throw FI_MSG_ERROR_UNSUPPORTED_FORMAT;
+		}
+		if(!SetEncoderConfig(&config, flags)) {
+			throw "Failed to initialize encoder";
+		}
+		if((flags & 0x0E00) == 0) {
+			// default to the libwebp method: the animation encoder encodes each page
+			// several times and method 6 makes it many times slower for a small gain
+			config.method = 4;
+		}
+
+		if(!info->encoder) {
+			// the first page gives the canvas size, the loop count and the file metadata
+			unsigned width = FreeImage_GetWidth(dib);
+			unsigned height = FreeImage_GetHeight(dib);
+			if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "LogicalWidth", &tag) && (FreeImage_GetTagType(tag) == FIDT_SHORT)) {
+				width = *(WORD*)FreeImage_GetTagValue(tag);
+			}
+			if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "LogicalHeight", &tag) && (FreeImage_GetTagType(tag) == FIDT_SHORT)) {
+				height = *(WORD*)FreeImage_GetTagValue(tag);
+			}
+			if((width == 0) || (height == 0) || (MAX(width, height) > WEBP_MAX_DIMENSION)) {
+				FreeImage_OutputMessageProc(s_format_id, "Unsupported image size: width x height = %d x %d", width, height);
+				throw (const char*)NULL;
+			}
+
+			WebPAnimEncoderOptions encoder_options;
+			if(!WebPAnimEncoderOptionsInit(&encoder_options)) {
+				throw "Library version mismatch";
+			}
+			if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "Loop", &tag) && (FreeImage_GetTagType(tag) == FIDT_LONG)) {
+				encoder_options.anim_params.loop_count = (int)*(LONG*)FreeImage_GetTagValue(tag);
+			}
+			info->encoder = WebPAnimEncoderNew((int)width, (int)height, &encoder_options);
+			if(!info->encoder) {
+				throw "Failed to initialize animation encoder";
+			}
+			info->canvas = FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+			if(!info->canvas) {
+				throw FI_MSG_ERROR_DIB_MEMORY;
+			}
+			if(!SetMetadataChunks(info->mux, dib)) {
+				throw "Failed to set animation metadata";
+			}
+		}
+
+		// --- draw the page onto the canvas ---
+
+		frame = (FreeImage_GetBPP(dib) == 32) ? dib : FreeImage_ConvertTo32Bits(dib);
+		if(!frame) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+
+		const unsigned canvas_width = FreeImage_GetWidth(info->canvas);
+		const unsigned canvas_height = FreeImage_GetHeight(info->canvas);
+		const unsigned width = FreeImage_GetWidth(frame);
+		const unsigned height = FreeImage_GetHeight(frame);
+
+		if((width == canvas_width) && (height == canvas_height)) {
+			memcpy(FreeImage_GetBits(info->canvas), FreeImage_GetConstBits(frame), FreeImage_GetPitch(frame) * height);
+		} else {
+			unsigned left = 0;
+			unsigned top = 0;
+			if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameLeft", &tag) && (FreeImage_GetTagType(tag) == FIDT_SHORT)) {
+				left = *(WORD*)FreeImage_GetTagValue(tag);
+			}
+			if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameTop", &tag) && (FreeImage_GetTagType(tag) == FIDT_SHORT)) {
+				top = *(WORD*)FreeImage_GetTagValue(tag);
+			}
+			for(unsigned y = 0; (y < height) && (top + y < canvas_height); y++) {
+				const BYTE *src_bits = FreeImage_GetConstScanLine(frame, height - 1 - y);
+				BYTE *dst_bits = FreeImage_GetScanLine(info->canvas, canvas_height - 1 - (top + y)) + 4 * left;
+				for(unsigned x = 0; (x < width) && (left + x < canvas_width); x++) {
+					if(src_bits[FI_RGBA_ALPHA] != 0) {
+						*(DWORD*)dst_bits = *(const DWORD*)src_bits;
+					}
+					src_bits += 4;
+					dst_bits += 4;
+				}
+			}
+		}
+
+		if(frame != dib) {
+			FreeImage_Unload(frame);
+		}
+		frame = NULL;
+
+		// --- encode the canvas ---
+
+		picture.width = (int)canvas_width;
+		picture.height = (int)canvas_height;
+		// the animation encoder works on ARGB samples
+		picture.use_argb = 1;
+
+		bIsFlipped = FreeImage_FlipVertical(info->canvas);
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+		WebPPictureImportBGRA(&picture, FreeImage_GetBits(info->canvas), FreeImage_GetPitch(info->canvas));
+#else
+		WebPPictureImportRGBA(&picture, FreeImage_GetBits(info->canvas), FreeImage_GetPitch(info->canvas));
+#endif // FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+
+		if(bIsFlipped) {
+			FreeImage_FlipVertical(info->canvas);
+		}
+
+		if(!WebPAnimEncoderAdd(info->encoder, &picture, info->timestamp, &config)) {
+			throw WebPAnimEncoderGetError(info->encoder);
+		}
+
+		WebPPictureFree(&picture);
+
+		// the next page starts when this one ends
+		LONG frame_time = 100;
+		if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameTime", &tag) && (FreeImage_GetTagType(tag) == FIDT_LONG)) {
+			frame_time = *(LONG*)FreeImage_GetTagValue(tag);
+		}
+		info->timestamp += (int)frame_time;
+
+		return TRUE;
+
+	} catch (const char* text) {
+		WebPPictureFree(&picture);
+		if(frame && (frame != dib)) {
+			FreeImage_Unload(frame);
+		}
+		if(NULL != text) {
+			FreeImage_OutputMessageProc(s_format_id, text);
+		}
+	}
+
+	return FALSE;
+}
+
 static BOOL DLL_CALLCONV
 Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
 	WebPMux *mux = NULL;
@@ -569,8 +1151,13 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 	try {
 
+		if(page >= 0) {
+			// multipage saving: the pages are added to an animation written by Close
+			return AddAnimationFrame((WebPInfo*)data, dib, flags);
+		}
+
 		// get the MUX object
-		mux = (WebPMux*)data;
+		mux = ((WebPInfo*)data)->mux;
 		if(!mux) {
 			return FALSE;
 		}
@@ -597,49 +1184,11 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		}
 
 		// --- set metadata ---
-		
-		// set ICC color profile
-		{
-			FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
-			if (iccProfile->size && iccProfile->data) {
-				WebPData icc_profile;
-				icc_profile.bytes = (uint8_t*)iccProfile->data;
-				icc_profile.size = (size_t)iccProfile->size;
-				error_status = WebPMuxSetChunk(mux, "ICCP", &icc_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
-				}
-			}
-		}
 
-		// set XMP metadata
-		{
-			FITAG *tag = NULL;
-			if(FreeImage_GetMetadata(FIMD_XMP, dib, g_TagLib_XMPFieldName, &tag)) {
-				WebPData xmp_profile;
-				xmp_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
-				xmp_profile.size = (size_t)FreeImage_GetTagLength(tag);
-				error_status = WebPMuxSetChunk(mux, "XMP ", &xmp_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
-				}
-			}
+		if(!SetMetadataChunks(mux, dib)) {
+			throw (1);
 		}
 
-		// set Exif metadata
-		{
-			FITAG *tag = NULL;
-			if(FreeImage_GetMetadata(FIMD_EXIF_RAW, dib, g_TagLib_ExifRawFieldName, &tag)) {
-				WebPData exif_profile;
-				exif_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
-				exif_profile.size = (size_t)FreeImage_GetTagLength(tag);
-				error_status = WebPMuxSetChunk(mux, "EXIF", &exif_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
-				}
-			}
-		}
-		
 		// get data from mux in WebP RIFF format
 		error_status = WebPMuxAssemble(mux, &output_data);
 		if(error_status != WEBP_MUX_OK) {
@@ -683,7 +1232,7 @@ InitWEBP(Plugin *plugin, int format_id) {
 	plugin->regexpr_proc = RegExpr;
 	plugin->open_proc = Open;
 	plugin->close_proc = Close;
-	plugin->pagecount_proc = NULL;
+	plugin->pagecount_proc = PageCount;
 	plugin->pagecapability_proc = NULL;
 	plugin->load_proc = Load;
 	plugin->save_proc = Save;
@@ -693,5 +1242,9 @@ InitWEBP(Plugin *plugin, int format_id) {
 	plugin->supports_export_type_proc = SupportsExportType;
 	plugin->supports_icc_profiles_proc = SupportsICCProfiles;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
+	plugin->magic_number_proc = MagicNumbers;
+	plugin->load_scaled_proc = LoadScaled;
+	plugin->keeps_load_data_proc = KeepsLoadData;
+	plugin->cache_format_proc = CacheFormat;
 }
 
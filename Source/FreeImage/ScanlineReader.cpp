@@ -0,0 +1,262 @@
+// ==========================================================
+// Scanline streaming interface
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "FreeImageIO.h"
+#include "Plugin.h"
+
+// ==========================================================
+// Internal definitions
+// ==========================================================
+
+namespace {
+
+struct SCANLINEREADERHEADER {
+	PluginNode *node;
+	FREE_IMAGE_FORMAT fif;
+	/// the plugins keep a pointer to this IO structure
+	FreeImageIO io;
+	fi_handle handle;
+	/// file opened by the reader, NULL when reading from a user handle
+	FILE *file;
+	/// plugin data returned by FreeImage_Open
+	void *data;
+	/// plugin scanline decoder, NULL when the image was fully decoded
+	void *decoder;
+	/// image description (the whole image when fully decoded)
+	FIBITMAP *dib;
+	/// next row to be read, 0 being the top row
+	unsigned position;
+};
+
+} // namespace
+
+// ==========================================================
+// Internal functions
+// ==========================================================
+
+/**
+Start decoding an image, using the plugin scanline decoder when available
+@return Returns the reader if successful, returns NULL otherwise. The file, if any, is closed on error.
+*/
+static FISCANLINEREADER *
+OpenReader(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, FILE *file, int flags) {
+	PluginNode *node = NULL;
+
+	if ((fif >= 0) && (fif < FreeImage_GetFIFCount())) {
+		node = FreeImage_GetPluginList()->FindNodeFromFIF(fif);
+	}
+
+	if (node && node->m_plugin->load_proc) {
+		FISCANLINEREADER *reader = new(std::nothrow) FISCANLINEREADER;
+		SCANLINEREADERHEADER *header = new(std::nothrow) SCANLINEREADERHEADER;
+
+		if (reader && header) {
+			memset(header, 0, sizeof(SCANLINEREADERHEADER));
+			reader->data = header;
+
+			header->node = node;
+			header->fif = fif;
+			header->io = *io;
+			header->handle = handle;
+			header->file = file;
+
+			const long start = io->tell_proc(handle);
+
+			header->data = FreeImage_Open(node, &header->io, handle, TRUE);
+
+			if (node->m_plugin->open_scanlines_proc) {
+				header->decoder = node->m_plugin->open_scanlines_proc(&header->io, handle, -1, flags, header->data, &header->dib);
+
+				if (!header->decoder) {
+					// the plugin can't stream this image: start again from the beginning of the stream
+					if (header->dib) {
+						FreeImage_Unload(header->dib);
+						header->dib = NULL;
+					}
+					FreeImage_Close(node, &header->io, handle, header->data);
+					io->seek_proc(handle, start, SEEK_SET);
+					header->data = FreeImage_Open(node, &header->io, handle, TRUE);
+				}
+			}
+
+			if (!header->decoder) {
+				// no streaming decoder: decode the whole image and deliver its rows
+				header->dib = node->m_plugin->load_proc(&header->io, handle, -1, flags, header->data);
+			}
+
+			if (header->dib) {
+				return reader;
+			}
+
+			if (header->decoder) {
+				node->m_plugin->close_scanlines_proc(&header->io, handle, header->decoder);
+			}
+			FreeImage_Close(node, &header->io, handle, header->data);
+		}
+
+		delete header;
+		delete reader;
+	}
+
+	if (file) {
+		fclose(file);
+	}
+
+	return NULL;
+}
+
+// ==========================================================
+// Scanline reader
+// ==========================================================
+
+FISCANLINEREADER * DLL_CALLCONV
+FreeImage_OpenScanlineReaderFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int flags) {
+	if (io && handle) {
+		return OpenReader(fif, io, handle, NULL, flags);
+	}
+
+	return NULL;
+}
+
+FISCANLINEREADER * DLL_CALLCONV
+FreeImage_OpenScanlineReader(FREE_IMAGE_FORMAT fif, const char *filename, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = fopen(filename, "rb");
+
+	if (handle) {
+		return OpenReader(fif, &io, (fi_handle)handle, handle, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenScanlineReader: failed to open file %s", filename);
+	}
+
+	return NULL;
+}
+
+FISCANLINEREADER * DLL_CALLCONV
+FreeImage_OpenScanlineReaderU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int flags) {
+#ifdef _WIN32
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = _wfopen(filename, L"rb");
+
+	if (handle) {
+		return OpenReader(fif, &io, (fi_handle)handle, handle, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenScanlineReaderU: failed to open input file");
+	}
+#endif
+	return NULL;
+}
+
+FISCANLINEREADER * DLL_CALLCONV
+FreeImage_OpenScanlineReaderFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags) {
+	if (stream && stream->data) {
+		FreeImageIO io;
+		SetMemoryIO(&io);
+
+		return OpenReader(fif, &io, (fi_handle)stream, NULL, flags);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_GetScanlineReaderInfo(FISCANLINEREADER *reader) {
+	if (reader) {
+		return ((SCANLINEREADERHEADER *)reader->data)->dib;
+	}
+
+	return NULL;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_IsScanlineReaderStreaming(FISCANLINEREADER *reader) {
+	if (reader) {
+		return (((SCANLINEREADERHEADER *)reader->data)->decoder != NULL) ? TRUE : FALSE;
+	}
+
+	return FALSE;
+}
+
+unsigned DLL_CALLCONV
+FreeImage_GetScanlineReaderPosition(FISCANLINEREADER *reader) {
+	if (reader) {
+		return ((SCANLINEREADERHEADER *)reader->data)->position;
+	}
+
+	return 0;
+}
+
+unsigned DLL_CALLCONV
+FreeImage_ReadScanlines(FISCANLINEREADER *reader, BYTE *bits, unsigned pitch, unsigned count) {
+	if (!reader || !bits) {
+		return 0;
+	}
+
+	SCANLINEREADERHEADER *header = (SCANLINEREADERHEADER *)reader->data;
+
+	const unsigned height = FreeImage_GetHeight(header->dib);
+	const unsigned line = FreeImage_GetLine(header->dib);
+
+	count = MIN(count, height - header->position);
+
+	if ((count == 0) || (pitch < line)) {
+		return 0;
+	}
+
+	unsigned rows = 0;
+
+	if (header->decoder) {
+		rows = header->node->m_plugin->read_scanlines_proc(&header->io, header->handle, header->decoder, bits, pitch, count);
+	} else if (FreeImage_HasPixels(header->dib)) {
+		// bitmaps are stored upside down
+		for (; rows < count; rows++) {
+			memcpy(bits + (size_t)rows * pitch, FreeImage_GetScanLine(header->dib, height - 1 - header->position - rows), line);
+		}
+	}
+
+	header->position += rows;
+
+	return rows;
+}
+
+void DLL_CALLCONV
+FreeImage_CloseScanlineReader(FISCANLINEREADER *reader) {
+	if (reader) {
+		SCANLINEREADERHEADER *header = (SCANLINEREADERHEADER *)reader->data;
+
+		if (header->decoder) {
+			header->node->m_plugin->close_scanlines_proc(&header->io, header->handle, header->decoder);
+		}
+		FreeImage_Close(header->node, &header->io, header->handle, header->data);
+
+		if (header->file) {
+			fclose(header->file);
+		}
+
+		FreeImage_Unload(header->dib);
+
+		delete header;
+		delete reader;
+	}
+}
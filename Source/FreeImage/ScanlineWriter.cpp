@@ -0,0 +1,315 @@
+// ==========================================================
+// Scanline streaming interface
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "FreeImageIO.h"
+#include "Plugin.h"
+
+// ==========================================================
+// Internal definitions
+// ==========================================================
+
+namespace {
+
+struct SCANLINEWRITERHEADER {
+	PluginNode *node;
+	FREE_IMAGE_FORMAT fif;
+	/// the plugins keep a pointer to this IO structure
+	FreeImageIO io;
+	fi_handle handle;
+	/// file opened by the writer, NULL when writing to a user handle
+	FILE *file;
+	/// plugin data returned by FreeImage_Open
+	void *data;
+	/// save flags
+	int flags;
+	/// plugin scanline encoder, NULL when the image is saved as a whole
+	void *encoder;
+	/// image description (the whole image when saved as a whole)
+	FIBITMAP *dib;
+	/// next row to be written, 0 being the top row
+	unsigned position;
+};
+
+} // namespace
+
+// ==========================================================
+// Internal functions
+// ==========================================================
+
+/**
+Copy the description of an image (palette, transparency, background color, ICC profile, metadata and thumbnail)
+@param src Source image, its pixels are never read
+@param header_only If TRUE, allocate a header only image, otherwise allocate the pixels
+@return Returns the new image if successful, returns NULL otherwise
+*/
+static FIBITMAP *
+CloneImageHeader(FIBITMAP *src, BOOL header_only) {
+	FIBITMAP *dib = FreeImage_AllocateHeaderT(header_only, FreeImage_GetImageType(src), FreeImage_GetWidth(src), FreeImage_GetHeight(src), FreeImage_GetBPP(src),
+		FreeImage_GetRedMask(src), FreeImage_GetGreenMask(src), FreeImage_GetBlueMask(src));
+
+	if (dib) {
+		// palette and transparency
+		const unsigned colors = FreeImage_GetColorsUsed(src);
+		if (colors && FreeImage_GetPalette(src)) {
+			memcpy(FreeImage_GetPalette(dib), FreeImage_GetPalette(src), colors * sizeof(RGBQUAD));
+		}
+		if (FreeImage_GetTransparencyCount(src) > 0) {
+			FreeImage_SetTransparencyTable(dib, FreeImage_GetTransparencyTable(src), FreeImage_GetTransparencyCount(src));
+		}
+		FreeImage_SetTransparent(dib, FreeImage_IsTransparent(src));
+
+		RGBQUAD bkcolor;
+		if (FreeImage_GetBackgroundColor(src, &bkcolor)) {
+			FreeImage_SetBackgroundColor(dib, &bkcolor);
+		}
+
+		// ICC profile
+		FIICCPROFILE *src_profile = FreeImage_GetICCProfile(src);
+		if (src_profile->data && src_profile->size) {
+			FIICCPROFILE *dst_profile = FreeImage_CreateICCProfile(dib, src_profile->data, src_profile->size);
+			if (dst_profile) {
+				dst_profile->flags = src_profile->flags;
+			}
+		}
+
+		// metadata (including the resolution) and thumbnail
+		FreeImage_CloneMetadata(dib, src);
+		FreeImage_SetThumbnail(dib, FreeImage_GetThumbnail(src));
+	}
+
+	return dib;
+}
+
+/**
+Start encoding an image, using the plugin scanline encoder when available
+@return Returns the writer if successful, returns NULL otherwise. The file, if any, is closed on error.
+*/
+static FISCANLINEWRITER *
+OpenWriter(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, FreeImageIO *io, fi_handle handle, FILE *file, int flags) {
+	PluginNode *node = NULL;
+
+	if ((fif >= 0) && (fif < FreeImage_GetFIFCount())) {
+		node = FreeImage_GetPluginList()->FindNodeFromFIF(fif);
+	}
+
+	if (node && node->m_plugin->save_proc && dib && FreeImage_GetWidth(dib) && FreeImage_GetHeight(dib)) {
+		FISCANLINEWRITER *writer = new(std::nothrow) FISCANLINEWRITER;
+		SCANLINEWRITERHEADER *header = new(std::nothrow) SCANLINEWRITERHEADER;
+
+		if (writer && header) {
+			memset(header, 0, sizeof(SCANLINEWRITERHEADER));
+			writer->data = header;
+
+			header->node = node;
+			header->fif = fif;
+			header->io = *io;
+			header->handle = handle;
+			header->file = file;
+			header->flags = flags;
+
+			header->data = FreeImage_Open(node, &header->io, handle, FALSE);
+
+			if (node->m_plugin->create_scanlines_proc) {
+				header->dib = CloneImageHeader(dib, TRUE);
+
+				if (header->dib) {
+					header->encoder = node->m_plugin->create_scanlines_proc(&header->io, handle, header->dib, -1, flags, header->data);
+				}
+				if (!header->encoder) {
+					// the plugin can't stream this image (nothing has been written yet)
+					FreeImage_Unload(header->dib);
+					header->dib = NULL;
+				}
+			}
+
+			if (!header->encoder) {
+				// no streaming encoder: collect the rows and save the whole image when the writer is closed
+				header->dib = CloneImageHeader(dib, FALSE);
+				if (!header->dib) {
+					FreeImage_OutputMessageProc((int)fif, FI_MSG_ERROR_MEMORY);
+				}
+			}
+
+			if (header->dib) {
+				return writer;
+			}
+
+			FreeImage_Close(node, &header->io, handle, header->data);
+		}
+
+		delete header;
+		delete writer;
+	}
+
+	if (file) {
+		fclose(file);
+	}
+
+	return NULL;
+}
+
+// ==========================================================
+// Scanline writer
+// ==========================================================
+
+FISCANLINEWRITER * DLL_CALLCONV
+FreeImage_OpenScanlineWriterToHandle(FREE_IMAGE_FORMAT fif, FIBITMAP *header, FreeImageIO *io, fi_handle handle, int flags) {
+	if (io && handle) {
+		return OpenWriter(fif, header, io, handle, NULL, flags);
+	}
+
+	return NULL;
+}
+
+FISCANLINEWRITER * DLL_CALLCONV
+FreeImage_OpenScanlineWriter(FREE_IMAGE_FORMAT fif, FIBITMAP *header, const char *filename, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = fopen(filename, "w+b");
+
+	if (handle) {
+		return OpenWriter(fif, header, &io, (fi_handle)handle, handle, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenScanlineWriter: failed to open file %s", filename);
+	}
+
+	return NULL;
+}
+
+FISCANLINEWRITER * DLL_CALLCONV
+FreeImage_OpenScanlineWriterU(FREE_IMAGE_FORMAT fif, FIBITMAP *header, const wchar_t *filename, int flags) {
+#ifdef _WIN32
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = _wfopen(filename, L"w+b");
+
+	if (handle) {
+		return OpenWriter(fif, header, &io, (fi_handle)handle, handle, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenScanlineWriterU: failed to open output file");
+	}
+#endif
+	return NULL;
+}
+
+FISCANLINEWRITER * DLL_CALLCONV
+FreeImage_OpenScanlineWriterToMemory(FREE_IMAGE_FORMAT fif, FIBITMAP *header, FIMEMORY *stream, int flags) {
+	if (stream && stream->data) {
+		if (!IsMemoryIOWritable(stream)) {
+			// do not write in a read-only user buffer or in a mapped file
+			FreeImage_OutputMessageProc((int)fif, "Memory buffer is read only");
+			return NULL;
+		}
+
+		FreeImageIO io;
+		SetMemoryIO(&io);
+
+		return OpenWriter(fif, header, &io, (fi_handle)stream, NULL, flags);
+	}
+
+	return NULL;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_IsScanlineWriterStreaming(FISCANLINEWRITER *writer) {
+	if (writer) {
+		return (((SCANLINEWRITERHEADER *)writer->data)->encoder != NULL) ? TRUE : FALSE;
+	}
+
+	return FALSE;
+}
+
+unsigned DLL_CALLCONV
+FreeImage_GetScanlineWriterPosition(FISCANLINEWRITER *writer) {
+	if (writer) {
+		return ((SCANLINEWRITERHEADER *)writer->data)->position;
+	}
+
+	return 0;
+}
+
+unsigned DLL_CALLCONV
+FreeImage_WriteScanlines(FISCANLINEWRITER *writer, const BYTE *bits, unsigned pitch, unsigned count) {
+	if (!writer || !bits) {
+		return 0;
+	}
+
+	SCANLINEWRITERHEADER *header = (SCANLINEWRITERHEADER *)writer->data;
+
+	const unsigned height = FreeImage_GetHeight(header->dib);
+	const unsigned line = FreeImage_GetLine(header->dib);
+
+	count = MIN(count, height - header->position);
+
+	if ((count == 0) || (pitch < line)) {
+		return 0;
+	}
+
+	unsigned rows = 0;
+
+	if (header->encoder) {
+		rows = header->node->m_plugin->write_scanlines_proc(&header->io, header->handle, header->encoder, bits, pitch, count);
+	} else {
+		// bitmaps are stored upside down
+		for (; rows < count; rows++) {
+			memcpy(FreeImage_GetScanLine(header->dib, height - 1 - header->position - rows), bits + (size_t)rows * pitch, line);
+		}
+	}
+
+	header->position += rows;
+
+	return rows;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_CloseScanlineWriter(FISCANLINEWRITER *writer) {
+	BOOL bResult = FALSE;
+
+	if (writer) {
+		SCANLINEWRITERHEADER *header = (SCANLINEWRITERHEADER *)writer->data;
+
+		const unsigned height = FreeImage_GetHeight(header->dib);
+
+		if (header->position < height) {
+			FreeImage_OutputMessageProc((int)header->fif, "FreeImage_CloseScanlineWriter: only %d of %d rows were written", (int)header->position, (int)height);
+		}
+
+		if (header->encoder) {
+			// the encoder is always released
+			bResult = header->node->m_plugin->finish_scanlines_proc(&header->io, header->handle, header->encoder);
+		} else if (header->position == height) {
+			bResult = header->node->m_plugin->save_proc(&header->io, header->dib, header->handle, -1, header->flags, header->data);
+		}
+		FreeImage_Close(header->node, &header->io, header->handle, header->data);
+
+		if (header->file) {
+			fclose(header->file);
+		}
+
+		FreeImage_Unload(header->dib);
+
+		delete header;
+		delete writer;
+	}
+
+	return bResult;
+}
@@ -0,0 +1,216 @@
+// ==========================================================
+// Internal worker thread pool
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "ThreadPool.h"
+
+// ==========================================================
+// ThreadPool
+// ==========================================================
+
+ThreadPool&
+ThreadPool::instance() {
+	static ThreadPool s_pool;
+	return s_pool;
+}
+
+ThreadPool::ThreadPool()
+: m_thread_count(1), m_task(NULL), m_task_count(0), m_next_task(0), m_pending_tasks(0), m_generation(0), m_stop(FALSE) {
+}
+
+ThreadPool::~ThreadPool() {
+	stopWorkers();
+}
+
+void
+ThreadPool::setThreadCount(unsigned count) {
+	std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+	if (count != m_thread_count) {
+		// the workers are restarted with the new size on the next parallel run
+		stopWorkers();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_thread_count = count;
+	}
+}
+
+unsigned
+ThreadPool::getThreadCount() {
+	unsigned count;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		count = m_thread_count;
+	}
+	if (count == 0) {
+		count = std::thread::hardware_concurrency();
+	}
+	return MAX(1U, count);
+}
+
+void
+ThreadPool::shutdown() {
+	std::lock_guard<std::mutex> run_lock(m_run_mutex);
+	stopWorkers();
+}
+
+void
+ThreadPool::startWorkers() {
+	// the calling thread is one of the pool threads
+	const unsigned count = getThreadCount() - 1;
+
+	m_workers.reserve(count);
+	for (unsigned i = 0; i < count; i++) {
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+void
+ThreadPool::stopWorkers() {
+	if (m_workers.empty()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = TRUE;
+	}
+	m_work_cv.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++) {
+		m_workers[i].join();
+	}
+	m_workers.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stop = FALSE;
+}
+
+void
+ThreadPool::drain() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_task && (m_next_task < m_task_count)) {
+		const std::function<void(unsigned)> *task = m_task;
+		const unsigned index = m_next_task++;
+
+		lock.unlock();
+		(*task)(index);
+		lock.lock();
+
+		if (--m_pending_tasks == 0) {
+			m_done_cv.notify_all();
+		}
+	}
+}
+
+void
+ThreadPool::workerLoop() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	unsigned generation = m_generation;
+
+	for (;;) {
+		while (!m_stop && (generation == m_generation)) {
+			m_work_cv.wait(lock);
+		}
+		if (m_stop) {
+			break;
+		}
+		generation = m_generation;
+
+		lock.unlock();
+		drain();
+		lock.lock();
+	}
+}
+
+void
+ThreadPool::run(unsigned count, const std::function<void(unsigned)>& task) {
+	if (count == 0) {
+		return;
+	}
+
+	// a run already in progress (or a nested run) is executed serially
+	std::unique_lock<std::mutex> run_lock(m_run_mutex, std::try_to_lock);
+
+	if ((count == 1) || !run_lock.owns_lock() || (getThreadCount() == 1)) {
+		for (unsigned i = 0; i < count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	if (m_workers.empty()) {
+		startWorkers();
+	}
+
+	// publish the job
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_task_count = count;
+		m_next_task = 0;
+		m_pending_tasks = count;
+		m_generation++;
+	}
+	m_work_cv.notify_all();
+
+	// take part in the job, then wait for the tasks still running on the workers
+	drain();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_pending_tasks != 0) {
+		m_done_cv.wait(lock);
+	}
+	m_task = NULL;
+}
+
+void
+ThreadPool::runBands(unsigned length, unsigned min_band, const std::function<void(unsigned, unsigned)>& task) {
+	if (length == 0) {
+		return;
+	}
+
+	// use a few bands per thread, so that uneven bands are balanced
+	const unsigned max_bands = getThreadCount() * 4;
+	const unsigned band_count = MIN(max_bands, MAX(1U, length / MAX(1U, min_band)));
+
+	if (band_count <= 1) {
+		task(0, length);
+		return;
+	}
+
+	const unsigned band = (length + band_count - 1) / band_count;
+
+	run((length + band - 1) / band, [&](unsigned index) {
+		const unsigned begin = index * band;
+		task(begin, MIN(begin + band, length));
+	});
+}
+
+// ==========================================================
+// Multi-threading routines
+// ==========================================================
+
+void DLL_CALLCONV
+FreeImage_SetThreadCount(int count) {
+	ThreadPool::instance().setThreadCount((count > 0) ? (unsigned)count : 0);
+}
+
+int DLL_CALLCONV
+FreeImage_GetThreadCount() {
+	return (int)ThreadPool::instance().getThreadCount();
+}
@@ -0,0 +1,401 @@
+// ==========================================================
+// Tile access interface
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "FreeImageIO.h"
+#include "Plugin.h"
+
+// ==========================================================
+// Internal definitions
+// ==========================================================
+
+/// number of decoded tiles kept by a new reader
+static const unsigned TILE_CACHE_SIZE = 16;
+
+namespace {
+
+struct Tile {
+	unsigned column;
+	unsigned row;
+	BYTE *bits;
+};
+
+typedef std::list<Tile> TileCache;
+typedef std::list<Tile>::iterator TileCacheIt;
+typedef std::map<unsigned, TileCacheIt> TileMap;
+typedef std::map<unsigned, TileCacheIt>::iterator TileMapIt;
+
+struct TILEREADERHEADER {
+	PluginNode *node;
+	FREE_IMAGE_FORMAT fif;
+	/// the plugins keep a pointer to this IO structure
+	FreeImageIO io;
+	fi_handle handle;
+	/// file opened by the reader, NULL when reading from a user handle
+	FILE *file;
+	/// plugin data returned by FreeImage_Open
+	void *data;
+	/// plugin tile decoder, NULL when the image was fully decoded (the image is then a single tile)
+	void *decoder;
+	/// image description (the whole image when fully decoded)
+	FIBITMAP *dib;
+	/// tile grid
+	unsigned tile_width;
+	unsigned tile_height;
+	unsigned columns;
+	unsigned rows;
+	/// size in bytes of a row of a tile
+	unsigned tile_line;
+	/// decoded tiles, most recently used first
+	TileCache cache;
+	TileMap map;
+	unsigned cache_size;
+};
+
+} // namespace
+
+// ==========================================================
+// Internal functions
+// ==========================================================
+
+/**
+Release the least recently used tiles until the cache holds at most max_tiles tiles
+*/
+static void
+TrimCache(TILEREADERHEADER *header, unsigned max_tiles) {
+	while (header->cache.size() > max_tiles) {
+		Tile &tile = header->cache.back();
+		header->map.erase(tile.row * header->columns + tile.column);
+		free(tile.bits);
+		header->cache.pop_back();
+	}
+}
+
+/**
+Get a decoded tile (tile_height rows of tile_line bytes, top row first), decoding it if not in the cache
+@return Returns the tile if successful, returns NULL otherwise
+*/
+static const BYTE *
+GetTile(TILEREADERHEADER *header, unsigned column, unsigned row) {
+	const unsigned key = row * header->columns + column;
+
+	TileMapIt it = header->map.find(key);
+
+	if (it != header->map.end()) {
+		// move the tile in front of the cache
+		header->cache.splice(header->cache.begin(), header->cache, it->second);
+		return header->cache.front().bits;
+	}
+
+	// make room for the new tile, reusing the buffer of the least recently used tile
+	TrimCache(header, MAX(header->cache_size, 1U));
+
+	Tile tile = { column, row, NULL };
+
+	if (header->cache.size() == MAX(header->cache_size, 1U)) {
+		tile.bits = header->cache.back().bits;
+		header->map.erase(header->cache.back().row * header->columns + header->cache.back().column);
+		header->cache.pop_back();
+	} else {
+		tile.bits = (BYTE*)malloc(header->tile_line * header->tile_height * sizeof(BYTE));
+		if (!tile.bits) {
+			FreeImage_OutputMessageProc((int)header->fif, FI_MSG_ERROR_MEMORY);
+			return NULL;
+		}
+	}
+
+	// the pixels outside of the image are black
+	memset(tile.bits, 0, header->tile_line * header->tile_height);
+
+	if (!header->node->m_plugin->read_tile_proc(&header->io, header->handle, header->decoder, column, row, tile.bits, header->tile_line)) {
+		free(tile.bits);
+		return NULL;
+	}
+
+	header->cache.push_front(tile);
+	header->map[key] = header->cache.begin();
+
+	return tile.bits;
+}
+
+/**
+Start decoding an image, using the plugin tile decoder when available
+@return Returns the reader if successful, returns NULL otherwise. The file, if any, is closed on error.
+*/
+static FITILEREADER *
+OpenReader(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, FILE *file, int page, int flags) {
+	PluginNode *node = NULL;
+
+	if ((fif >= 0) && (fif < FreeImage_GetFIFCount())) {
+		node = FreeImage_GetPluginList()->FindNodeFromFIF(fif);
+	}
+
+	if (node && node->m_plugin->load_proc) {
+		FITILEREADER *reader = new(std::nothrow) FITILEREADER;
+		TILEREADERHEADER *header = new(std::nothrow) TILEREADERHEADER;
+
+		if (reader && header) {
+			reader->data = header;
+
+			header->node = node;
+			header->fif = fif;
+			header->io = *io;
+			header->handle = handle;
+			header->file = file;
+			header->decoder = NULL;
+			header->dib = NULL;
+			header->tile_width = 0;
+			header->tile_height = 0;
+			header->cache_size = TILE_CACHE_SIZE;
+
+			// a region is always loaded with its pixels
+			flags &= ~FIF_LOAD_NOPIXELS;
+
+			const long start = io->tell_proc(handle);
+
+			header->data = FreeImage_Open(node, &header->io, handle, TRUE);
+
+			if (node->m_plugin->open_tiles_proc) {
+				header->decoder = node->m_plugin->open_tiles_proc(&header->io, handle, page, flags, header->data, &header->dib, &header->tile_width, &header->tile_height);
+
+				if (!header->decoder) {
+					// the plugin can't decode the tiles of this image: start again from the beginning of the stream
+					if (header->dib) {
+						FreeImage_Unload(header->dib);
+						header->dib = NULL;
+					}
+					FreeImage_Close(node, &header->io, handle, header->data);
+					io->seek_proc(handle, start, SEEK_SET);
+					header->data = FreeImage_Open(node, &header->io, handle, TRUE);
+				}
+			}
+
+			if (!header->decoder) {
+				// no tile decoder: decode the whole image, delivered as a single tile
+				header->dib = node->m_plugin->load_proc(&header->io, handle, page, flags, header->data);
+				if (header->dib) {
+					header->tile_width = FreeImage_GetWidth(header->dib);
+					header->tile_height = FreeImage_GetHeight(header->dib);
+				}
+			}
+
+			if (header->dib && header->tile_width && header->tile_height) {
+				const unsigned width = FreeImage_GetWidth(header->dib);
+				const unsigned height = FreeImage_GetHeight(header->dib);
+
+				header->columns = (width + header->tile_width - 1) / header->tile_width;
+				header->rows = (height + header->tile_height - 1) / header->tile_height;
+				header->tile_line = (header->tile_width * FreeImage_GetBPP(header->dib) + 7) / 8;
+
+				return reader;
+			}
+
+			if (header->decoder) {
+				node->m_plugin->close_tiles_proc(&header->io, handle, header->decoder);
+			}
+			if (header->dib) {
+				FreeImage_Unload(header->dib);
+			}
+			FreeImage_Close(node, &header->io, handle, header->data);
+		}
+
+		delete header;
+		delete reader;
+	}
+
+	if (file) {
+		fclose(file);
+	}
+
+	return NULL;
+}
+
+// ==========================================================
+// Tile reader
+// ==========================================================
+
+FITILEREADER * DLL_CALLCONV
+FreeImage_OpenTileReaderFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_handle handle, int page, int flags) {
+	if (io && handle) {
+		return OpenReader(fif, io, handle, NULL, page, flags);
+	}
+
+	return NULL;
+}
+
+FITILEREADER * DLL_CALLCONV
+FreeImage_OpenTileReader(FREE_IMAGE_FORMAT fif, const char *filename, int page, int flags) {
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = fopen(filename, "rb");
+
+	if (handle) {
+		return OpenReader(fif, &io, (fi_handle)handle, handle, page, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenTileReader: failed to open file %s", filename);
+	}
+
+	return NULL;
+}
+
+FITILEREADER * DLL_CALLCONV
+FreeImage_OpenTileReaderU(FREE_IMAGE_FORMAT fif, const wchar_t *filename, int page, int flags) {
+#ifdef _WIN32
+	FreeImageIO io;
+	SetDefaultIO(&io);
+
+	FILE *handle = _wfopen(filename, L"rb");
+
+	if (handle) {
+		return OpenReader(fif, &io, (fi_handle)handle, handle, page, flags);
+	} else {
+		FreeImage_OutputMessageProc((int)fif, "FreeImage_OpenTileReaderU: failed to open input file");
+	}
+#endif
+	return NULL;
+}
+
+FITILEREADER * DLL_CALLCONV
+FreeImage_OpenTileReaderFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int page, int flags) {
+	if (stream && stream->data) {
+		FreeImageIO io;
+		SetMemoryIO(&io);
+
+		return OpenReader(fif, &io, (fi_handle)stream, NULL, page, flags);
+	}
+
+	return NULL;
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_GetTileReaderInfo(FITILEREADER *reader) {
+	if (reader) {
+		return ((TILEREADERHEADER *)reader->data)->dib;
+	}
+
+	return NULL;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_IsTileReaderStreaming(FITILEREADER *reader) {
+	if (reader) {
+		return (((TILEREADERHEADER *)reader->data)->decoder != NULL) ? TRUE : FALSE;
+	}
+
+	return FALSE;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_GetTileReaderGrid(FITILEREADER *reader, unsigned *tile_width, unsigned *tile_height, unsigned *columns, unsigned *rows) {
+	if (reader) {
+		TILEREADERHEADER *header = (TILEREADERHEADER *)reader->data;
+
+		if (tile_width) *tile_width = header->tile_width;
+		if (tile_height) *tile_height = header->tile_height;
+		if (columns) *columns = header->columns;
+		if (rows) *rows = header->rows;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void DLL_CALLCONV
+FreeImage_SetTileReaderCacheSize(FITILEREADER *reader, unsigned tiles) {
+	if (reader) {
+		TILEREADERHEADER *header = (TILEREADERHEADER *)reader->data;
+
+		header->cache_size = tiles;
+		TrimCache(header, tiles);
+	}
+}
+
+BOOL DLL_CALLCONV
+FreeImage_ReadTiles(FITILEREADER *reader, unsigned first_column, unsigned first_row, unsigned columns, unsigned rows, BYTE *bits, unsigned pitch) {
+	if (!reader || !bits || !columns || !rows) {
+		return FALSE;
+	}
+
+	TILEREADERHEADER *header = (TILEREADERHEADER *)reader->data;
+
+	if ((first_column >= header->columns) || (columns > header->columns - first_column) || (first_row >= header->rows) || (rows > header->rows - first_row)) {
+		return FALSE;
+	}
+
+	const unsigned bpp = FreeImage_GetBPP(header->dib);
+
+	if (pitch < ((size_t)columns * header->tile_width * bpp + 7) / 8) {
+		return FALSE;
+	}
+
+	if (!header->decoder) {
+		// the whole image is a single tile, bitmaps are stored upside down
+		const unsigned height = FreeImage_GetHeight(header->dib);
+		for (unsigned y = 0; y < height; y++) {
+			memcpy(bits + (size_t)y * pitch, FreeImage_GetScanLine(header->dib, height - 1 - y), header->tile_line);
+		}
+		return TRUE;
+	}
+
+	for (unsigned row = 0; row < rows; row++) {
+		for (unsigned column = 0; column < columns; column++) {
+			const BYTE *tile = GetTile(header, first_column + column, first_row + row);
+			if (!tile) {
+				return FALSE;
+			}
+
+			BYTE *dst = bits + (size_t)row * header->tile_height * pitch;
+			for (unsigned y = 0; y < header->tile_height; y++, dst += pitch, tile += header->tile_line) {
+				CopyPixelRun(dst, column * header->tile_width, tile, 0, header->tile_width, bpp);
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_ReadTile(FITILEREADER *reader, unsigned column, unsigned row, BYTE *bits, unsigned pitch) {
+	return FreeImage_ReadTiles(reader, column, row, 1, 1, bits, pitch);
+}
+
+void DLL_CALLCONV
+FreeImage_CloseTileReader(FITILEREADER *reader) {
+	if (reader) {
+		TILEREADERHEADER *header = (TILEREADERHEADER *)reader->data;
+
+		TrimCache(header, 0);
+
+		if (header->decoder) {
+			header->node->m_plugin->close_tiles_proc(&header->io, header->handle, header->decoder);
+		}
+		FreeImage_Close(header->node, &header->io, header->handle, header->data);
+
+		if (header->file) {
+			fclose(header->file);
+		}
+
+		FreeImage_Unload(header->dib);
+
+		delete header;
+		delete reader;
+	}
+}
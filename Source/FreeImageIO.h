@@ -54,10 +54,43 @@ FI_STRUCT (FIMEMORYHEADER) {
 	Current position into the memory stream
 	*/
 	long current_position;
+	/**
+	TRUE when 'data' is a read-only view of a memory mapped file, 
+	which must be unmapped when the memory stream is closed.
+	*/
+	BOOL mapped_file;
+	/**
+	Grow callback of a writable user buffer (see FreeImage_OpenMemoryBuffer), NULL otherwise. 
+	A writable user buffer is never deleted, it is grown using this callback when set.
+	*/
+	FI_MemoryGrowProc grow_proc;
+	/**
+	User data passed to grow_proc
+	*/
+	void *grow_data;
+	/**
+	TRUE when 'data' is a writable user buffer
+	*/
+	BOOL user_buffer;
+	/**
+	Chunked storage (see FreeImage_OpenMemoryChunked), NULL otherwise. 
+	The stream is stored in chunk_count blocks of chunk_size bytes (data is not used), 
+	blocks are never moved once allocated.
+	*/
+	BYTE **chunks;
+	unsigned chunk_count;
+	unsigned chunk_capacity;
+	long chunk_size;
 };
 
 void SetDefaultIO(FreeImageIO *io);
 
 void SetMemoryIO(FreeImageIO *io);
 
+BOOL GetMemoryIOBuffer(FreeImageIO *io, fi_handle handle, void **data, long *size_in_bytes);
+
+BOOL IsMemoryIOWritable(FIMEMORY *stream);
+
+BOOL FlattenMemoryIOChunks(FIMEMORY *stream);
+
 #endif // !FREEIMAGE_IO_H
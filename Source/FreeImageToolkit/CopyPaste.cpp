@@ -69,7 +69,7 @@ Combine1(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib));
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	// combine images
 	for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
@@ -137,7 +137,7 @@ Combine4(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) *	FreeImage_GetPitch(dst_dib)) + (x >> 1);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);    
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);    
 
 	// combine images
 
@@ -206,7 +206,7 @@ Combine8(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib)) + (x);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	if(alpha > 255) {
 		// combine images
@@ -248,7 +248,7 @@ Combine16_555(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsi
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib)) + (x * 2);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	if (alpha > 255) {
 		for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
@@ -308,7 +308,7 @@ Combine16_565(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsi
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib)) + (x * 2);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	if (alpha > 255) {
 		for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
@@ -372,7 +372,7 @@ Combine24(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib)) + (x * 3);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	if(alpha > 255) {
 		// combine images
@@ -414,7 +414,7 @@ Combine32(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	}
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((FreeImage_GetHeight(dst_dib) - FreeImage_GetHeight(src_dib) - y) * FreeImage_GetPitch(dst_dib)) + (x * 4);
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	if (alpha > 255) {
 		// combine images
@@ -464,7 +464,7 @@ CombineSameType(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y) {
 	}	
 
 	BYTE *dst_bits = FreeImage_GetBits(dst_dib) + ((dst_height - src_height - y) * dst_pitch) + (x * (src_line / src_width));
-	BYTE *src_bits = FreeImage_GetBits(src_dib);	
+	const BYTE *src_bits = FreeImage_GetConstBits(src_dib);	
 
 	// combine images	
 	for(unsigned rows = 0; rows < src_height; rows++) {
@@ -477,6 +477,60 @@ CombineSameType(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y) {
 	return TRUE;
 }
 
+// ----------------------------------------------------------
+//   Region helpers
+// ----------------------------------------------------------
+
+FIBITMAP* 
+AllocateRegion(FIBITMAP *src, unsigned width, unsigned height) {
+	FIBITMAP *dst = FreeImage_AllocateT(FreeImage_GetImageType(src), width, height, FreeImage_GetBPP(src), 
+		FreeImage_GetRedMask(src), FreeImage_GetGreenMask(src), FreeImage_GetBlueMask(src));
+
+	if(NULL == dst) return NULL;
+
+	// same description as FreeImage_Copy
+	memcpy(FreeImage_GetPalette(dst), FreeImage_GetPalette(src), FreeImage_GetColorsUsed(src) * sizeof(RGBQUAD));
+
+	FreeImage_CloneMetadata(dst, src);
+
+	FreeImage_SetTransparencyTable(dst, FreeImage_GetTransparencyTable(src), FreeImage_GetTransparencyCount(src));
+
+	RGBQUAD bkcolor; 
+	if( FreeImage_GetBackgroundColor(src, &bkcolor) ) {
+		FreeImage_SetBackgroundColor(dst, &bkcolor); 
+	}
+
+	FreeImage_SetDotsPerMeterX(dst, FreeImage_GetDotsPerMeterX(src)); 
+	FreeImage_SetDotsPerMeterY(dst, FreeImage_GetDotsPerMeterY(src)); 
+
+	FIICCPROFILE *src_profile = FreeImage_GetICCProfile(src); 
+	FIICCPROFILE *dst_profile = FreeImage_CreateICCProfile(dst, src_profile->data, src_profile->size); 
+	dst_profile->flags = src_profile->flags; 
+
+	return dst;
+}
+
+void 
+CopyPixelRun(BYTE *dst, unsigned dst_x, const BYTE *src, unsigned src_x, unsigned count, unsigned bpp) {
+	if((bpp & 7) == 0) {
+		const unsigned bytespp = bpp / 8;
+		memcpy(dst + dst_x * bytespp, src + src_x * bytespp, count * bytespp);
+	} else {
+		// pixels are packed most significant bit first
+		const unsigned src_bit = src_x * bpp;
+		const unsigned dst_bit = dst_x * bpp;
+		for(unsigned i = 0; i < count * bpp; i++) {
+			const unsigned s = src_bit + i;
+			const unsigned d = dst_bit + i;
+			if(src[s >> 3] & (0x80 >> (s & 0x07))) {
+				dst[d >> 3] |= (BYTE)(0x80 >> (d & 0x07));
+			} else {
+				dst[d >> 3] &= (BYTE)~(0x80 >> (d & 0x07));
+			}
+		}
+	}
+}
+
 // ----------------------------------------------------------
 //   FreeImage interface
 // ----------------------------------------------------------
@@ -531,7 +585,7 @@ FreeImage_Copy(FIBITMAP *src, int left, int top, int right, int bottom) {
 
 	// get the pointers to the bits and such
 
-	BYTE *src_bits = FreeImage_GetScanLine(src, src_height - top - dst_height);
+	const BYTE *src_bits = FreeImage_GetConstScanLine(src, src_height - top - dst_height);
 	switch(bpp) {
 		case 1:
 			// point to x = 0
@@ -593,9 +593,8 @@ getMemIO(FIMEMORY* src_stream, FIMEMORY* dst_stream, FreeImageIO* dst_io, fi_han
 	SetMemoryIO (&io);
 
 	if(dst_stream) {
-		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(dst_stream->data);
-		if(mem_header->delete_me != TRUE) {
-			// do not save in a user buffer
+		if(!IsMemoryIOWritable(dst_stream)) {
+			// do not save in a read-only user buffer
 			FreeImage_OutputMessageProc(FIF_JPEG, "Destination memory buffer is read only");
 			return FALSE;
 		}
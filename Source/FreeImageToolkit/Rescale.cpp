@@ -22,6 +22,29 @@
 
 #include "Resize.h"
 
+/**
+Create the filter object of a FREE_IMAGE_FILTER
+@return Returns the filter (to be deleted by the caller), or NULL if the filter type is unknown
+*/
+static CGenericFilter *
+CreateFilter(FREE_IMAGE_FILTER filter) {
+	switch (filter) {
+		case FILTER_BOX:
+			return new(std::nothrow) CBoxFilter();
+		case FILTER_BICUBIC:
+			return new(std::nothrow) CBicubicFilter();
+		case FILTER_BILINEAR:
+			return new(std::nothrow) CBilinearFilter();
+		case FILTER_BSPLINE:
+			return new(std::nothrow) CBSplineFilter();
+		case FILTER_CATMULLROM:
+			return new(std::nothrow) CCatmullRomFilter();
+		case FILTER_LANCZOS3:
+			return new(std::nothrow) CLanczos3Filter();
+	}
+	return NULL;
+}
+
 FIBITMAP * DLL_CALLCONV
 FreeImage_RescaleRect(FIBITMAP *src, int dst_width, int dst_height, int src_left, int src_top, int src_right, int src_bottom, FREE_IMAGE_FILTER filter, unsigned flags) {
 	FIBITMAP *dst = NULL;
@@ -47,33 +70,12 @@ FreeImage_RescaleRect(FIBITMAP *src, int dst_width, int dst_height, int src_left
 	}
 
 	// select the filter
-	CGenericFilter *pFilter = NULL;
-	switch (filter) {
-		case FILTER_BOX:
-			pFilter = new(std::nothrow) CBoxFilter();
-			break;
-		case FILTER_BICUBIC:
-			pFilter = new(std::nothrow) CBicubicFilter();
-			break;
-		case FILTER_BILINEAR:
-			pFilter = new(std::nothrow) CBilinearFilter();
-			break;
-		case FILTER_BSPLINE:
-			pFilter = new(std::nothrow) CBSplineFilter();
-			break;
-		case FILTER_CATMULLROM:
-			pFilter = new(std::nothrow) CCatmullRomFilter();
-			break;
-		case FILTER_LANCZOS3:
-			pFilter = new(std::nothrow) CLanczos3Filter();
-			break;
-	}
-
+	CGenericFilter *pFilter = CreateFilter(filter);
 	if (!pFilter) {
 		return NULL;
 	}
 
-	CResizeEngine Engine(pFilter);
+	CResizeEngine Engine(pFilter, filter);
 
 	dst = Engine.scale(src, dst_width, dst_height, src_left, src_top,
 			src_right - src_left, src_bottom - src_top, flags);
@@ -93,6 +95,41 @@ FreeImage_Rescale(FIBITMAP *src, int dst_width, int dst_height, FREE_IMAGE_FILTE
 	return FreeImage_RescaleRect(src, dst_width, dst_height, 0, 0, FreeImage_GetWidth(src), FreeImage_GetHeight(src), filter, FI_RESCALE_DEFAULT);
 }
 
+// --------------------------------------------------------------------------
+// Weights table cache
+
+void DLL_CALLCONV
+FreeImage_SetRescaleCacheSize(size_t max_bytes) {
+	CWeightsTableCache::instance().setMaxBytes(max_bytes);
+}
+
+BOOL DLL_CALLCONV
+FreeImage_PrewarmRescaleCache(int src_width, int src_height, int dst_width, int dst_height, FREE_IMAGE_FILTER filter) {
+	if ((src_width <= 0) || (src_height <= 0) || (dst_width <= 0) || (dst_height <= 0)) {
+		return FALSE;
+	}
+
+	CGenericFilter *pFilter = CreateFilter(filter);
+	if (!pFilter) {
+		return FALSE;
+	}
+
+	// tables of the horizontal and vertical filter passes
+	CWeightsTableCache& cache = CWeightsTableCache::instance();
+	const BOOL bResult = (cache.get(filter, pFilter, dst_width, src_width) && cache.get(filter, pFilter, dst_height, src_height)) ? TRUE : FALSE;
+
+	delete pFilter;
+
+	return bResult;
+}
+
+void DLL_CALLCONV
+FreeImage_ClearRescaleCache() {
+	CWeightsTableCache::instance().clear();
+}
+
+// --------------------------------------------------------------------------
+
 FIBITMAP * DLL_CALLCONV
 FreeImage_MakeThumbnail(FIBITMAP *dib, int max_pixel_size, BOOL convert) {
 	FIBITMAP *thumbnail = NULL;
@@ -22,6 +22,12 @@
 // ==========================================================
 
 #include "Resize.h"
+#include "ThreadPool.h"
+
+/// Minimum number of rows filtered by a thread in the horizontal pass
+#define RESIZE_MIN_BAND_ROWS		16
+/// Minimum number of columns filtered by a thread in the vertical pass
+#define RESIZE_MIN_BAND_COLUMNS		64
 
 /**
 Returns the color type of a bitmap. In contrast to FreeImage_GetColorType,
@@ -162,6 +168,10 @@ CWeightsTable::CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigne
 	m_WindowSize = 2 * (int)ceil(dWidth) + 1; 
 	// length of dst line (no. of rows / cols) 
 	m_LineLength = uDstSize; 
+	// fixed-point weights are built on demand
+	m_FixedWeights = NULL;
+	m_FixedSums = NULL;
+	m_FixedStride = 0;
 
 	 // allocate list of contributions 
 	m_WeightTable = (Contribution*)malloc(m_LineLength * sizeof(Contribution));
@@ -225,12 +235,176 @@ CWeightsTable::~CWeightsTable() {
 	}
 	// free list of pixels contributions
 	free(m_WeightTable);
+	// free fixed-point weights
+	free(m_FixedWeights);
+	free(m_FixedSums);
+}
+
+BOOL CWeightsTable::buildFixedWeights() {
+	if (m_FixedWeights) {
+		return TRUE;
+	}
+
+	const double dOne = (double)(1 << FI_RESIZE_FIXED_BITS);
+
+	// pad the weights of each pixel to a multiple of 8 (one SIMD register)
+	const unsigned stride = (m_WindowSize + 7) & ~7;
+
+	short *weights = (short*)calloc(m_LineLength * stride, sizeof(short));
+	int *sums = (int*)malloc(m_LineLength * sizeof(int));
+	if (!weights || !sums) {
+		free(weights);
+		free(sums);
+		return FALSE;
+	}
+
+	for (unsigned u = 0; u < m_LineLength; u++) {
+		const Contribution& contribution = m_WeightTable[u];
+		const int iLimit = (int)(contribution.Right - contribution.Left);
+		short *fixed = weights + u * stride;
+
+		double dTotalWeight = 0;
+		int iTotal = 0;
+		int iAbsTotal = 0;
+		int iMax = 0;
+		for (int i = 0; i < iLimit; i++) {
+			const double dWeight = contribution.Weights[i] * dOne;
+			if (fabs(dWeight) >= 32767) {
+				// out of range weight: the kernels would overflow
+				free(weights);
+				free(sums);
+				return FALSE;
+			}
+			fixed[i] = (short)floor(dWeight + 0.5);
+			dTotalWeight += dWeight;
+			iTotal += fixed[i];
+			iAbsTotal += abs(fixed[i]);
+			if (abs(fixed[i]) > abs(fixed[iMax])) {
+				iMax = i;
+			}
+		}
+
+		// give the rounding error to the largest weight so that the sum of the
+		// weights is preserved (a flat area keeps its value)
+		if (iLimit > 0) {
+			const int iError = (int)floor(dTotalWeight + 0.5) - iTotal;
+			if (abs(fixed[iMax] + iError) >= 32767) {
+				free(weights);
+				free(sums);
+				return FALSE;
+			}
+			fixed[iMax] = (short)(fixed[iMax] + iError);
+			iTotal += iError;
+			iAbsTotal += abs(iError);
+		}
+
+		// keep the accumulators of the kernels within 32-bit:
+		// 32768 * (sum of absolute weights) + 32768 * (sum of weights) < 2^31
+		if (iAbsTotal > (2 << FI_RESIZE_FIXED_BITS)) {
+			free(weights);
+			free(sums);
+			return FALSE;
+		}
+		sums[u] = iTotal;
+	}
+
+	m_FixedWeights = weights;
+	m_FixedSums = sums;
+	m_FixedStride = stride;
+
+	return TRUE;
+}
+
+size_t CWeightsTable::getMemorySize() const {
+	size_t size = sizeof(CWeightsTable) + m_LineLength * (sizeof(Contribution) + m_WindowSize * sizeof(double));
+	if (m_FixedWeights) {
+		size += m_LineLength * (m_FixedStride * sizeof(short) + sizeof(int));
+	}
+	return size;
+}
+
+// --------------------------------------------------------------------------
+
+/// Default memory limit of the weights table cache
+#define DEFAULT_WEIGHTS_CACHE_SIZE	(4 * 1024 * 1024)
+
+CWeightsTableCache::CWeightsTableCache() : m_bytes(0), m_max_bytes(DEFAULT_WEIGHTS_CACHE_SIZE) {
+}
+
+CWeightsTableCache& CWeightsTableCache::instance() {
+	static CWeightsTableCache s_cache;
+	return s_cache;
+}
+
+WeightsTablePtr CWeightsTableCache::get(int filter_type, CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize) {
+	const Key key(filter_type, std::make_pair(uDstSize, uSrcSize));
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<Key, LRUList::iterator>::iterator it = m_index.find(key);
+		if (it != m_index.end()) {
+			// move the table to the front of the LRU list
+			m_tables.splice(m_tables.begin(), m_tables, it->second);
+			return it->second->second;
+		}
+	}
+
+	// cache miss: compute the table outside of the lock
+	WeightsTablePtr table(new(std::nothrow) CWeightsTable(pFilter, uDstSize, uSrcSize));
+	if (!table) {
+		return table;
+	}
+	// shared tables must not be modified: build the fixed-point weights now
+	// (failure only means that the double precision filter will be used)
+	table->buildFixedWeights();
+
+	const size_t size = table->getMemorySize();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if ((size <= m_max_bytes) && (m_index.find(key) == m_index.end())) {
+		trim(m_max_bytes - size);
+		m_tables.push_front(std::make_pair(key, table));
+		m_index[key] = m_tables.begin();
+		m_bytes += size;
+	}
+	return table;
+}
+
+void CWeightsTableCache::trim(size_t max_bytes) {
+	while (!m_tables.empty() && (m_bytes > max_bytes)) {
+		// tables still used by a filter pass are released by their last user
+		m_bytes -= m_tables.back().second->getMemorySize();
+		m_index.erase(m_tables.back().first);
+		m_tables.pop_back();
+	}
+}
+
+void CWeightsTableCache::setMaxBytes(size_t max_bytes) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_max_bytes = max_bytes;
+	trim(m_max_bytes);
+}
+
+void CWeightsTableCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	trim(0);
+}
+
+// --------------------------------------------------------------------------
+
+WeightsTablePtr CResizeEngine::getWeightsTable(unsigned uDstSize, unsigned uSrcSize) {
+	if (m_iFilterType >= 0) {
+		return CWeightsTableCache::instance().get(m_iFilterType, m_pFilter, uDstSize, uSrcSize);
+	}
+	return WeightsTablePtr(new(std::nothrow) CWeightsTable(m_pFilter, uDstSize, uSrcSize));
 }
 
 // --------------------------------------------------------------------------
 
 FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_height, unsigned src_left, unsigned src_top, unsigned src_width, unsigned src_height, unsigned flags) {
 
+	m_bFixedPoint = ((flags & FI_RESCALE_FIXED_POINT) == FI_RESCALE_FIXED_POINT);
+
 	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
 	const unsigned src_bpp = FreeImage_GetBPP(src);
 
@@ -507,8 +681,32 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 
 void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width) {
 
-	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_width, src_width);
+	// allocate and calculate the contributions (or retrieve them from the cache)
+	WeightsTablePtr table = getWeightsTable(dst_width, src_width);
+	if (!table) {
+		return;
+	}
+	CWeightsTable& weightsTable = *table;
+
+	// resolve any copy-on-write sharing before the bands access the pixels concurrently
+	if (!FreeImage_GetConstBits(src) || !FreeImage_GetBits(dst)) {
+		return;
+	}
+
+	// rows are independent of each other: filter them in bands
+	if (isFixedPointFilter(src, src_pal, dst) && weightsTable.buildFixedWeights()) {
+		ThreadPool::instance().runBands(height, RESIZE_MIN_BAND_ROWS, [&](unsigned y_begin, unsigned y_end) {
+			horizontalFilterFixed(weightsTable, src, src_offset_x, src_offset_y, dst, dst_width, y_begin, y_end);
+		});
+	} else {
+		ThreadPool::instance().runBands(height, RESIZE_MIN_BAND_ROWS, [&](unsigned y_begin, unsigned y_end) {
+			horizontalFilterRows(weightsTable, src, src_width, src_offset_x, src_offset_y, src_pal, dst, dst_width, y_begin, y_end);
+		});
+	}
+}
+
+/// Performs horizontal image filtering on rows [y_begin, y_end)
+void CResizeEngine::horizontalFilterRows(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width, unsigned y_begin, unsigned y_end) {
 
 	// step through rows
 	switch(FreeImage_GetImageType(src)) {
@@ -524,9 +722,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							src_offset_x >>= 3;
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -548,9 +746,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -581,9 +779,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							src_offset_x >>= 3;
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -612,9 +810,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -649,9 +847,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette here
 							src_offset_x >>= 3;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
-								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+								const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 								for (unsigned x = 0; x < dst_width; x++) {
@@ -695,9 +893,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
-								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+								const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
 
 								for (unsigned x = 0; x < dst_width; x++) {
@@ -726,9 +924,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
-								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+								const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 								for (unsigned x = 0; x < dst_width; x++) {
@@ -764,9 +962,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
-								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+								const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 								for (unsigned x = 0; x < dst_width; x++) {
@@ -810,9 +1008,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// into an 8 bpp destination image
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -835,9 +1033,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -867,9 +1065,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// transparently convert the non-transparent 8-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -899,9 +1097,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
-									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+									const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 									for (unsigned x = 0; x < dst_width; x++) {
@@ -935,9 +1133,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						{
 							// transparently convert the transparent 8-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
-								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+								const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 								for (unsigned x = 0; x < dst_width; x++) {
@@ -978,9 +1176,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 					// transparently convert the 16-bit non-transparent image to 24 bpp
 					if (IS_FORMAT_RGB565(src)) {
 						// image has 565 format
-						for (unsigned y = 0; y < height; y++) {
+						for (unsigned y = y_begin; y < y_end; y++) {
 							// scale each row
-							const WORD * const src_bits = (WORD *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+							const WORD * const src_bits = (const WORD *)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 							BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 							for (unsigned x = 0; x < dst_width; x++) {
@@ -1010,9 +1208,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						}
 					} else {
 						// image has 555 format
-						for (unsigned y = 0; y < height; y++) {
+						for (unsigned y = y_begin; y < y_end; y++) {
 							// scale each row
-							const WORD * const src_bits = (WORD *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
+							const WORD * const src_bits = (const WORD *)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x;
 							BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 							for (unsigned x = 0; x < dst_width; x++) {
@@ -1047,9 +1245,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 				case 24:
 				{
 					// scale the 24-bit non-transparent image into a 24 bpp destination image
-					for (unsigned y = 0; y < height; y++) {
+					for (unsigned y = y_begin; y < y_end; y++) {
 						// scale each row
-						const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * 3;
+						const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * 3;
 						BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 						for (unsigned x = 0; x < dst_width; x++) {
@@ -1083,9 +1281,9 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 				case 32:
 				{
 					// scale the 32-bit transparent image into a 32 bpp destination image
-					for (unsigned y = 0; y < height; y++) {
+					for (unsigned y = y_begin; y < y_end; y++) {
 						// scale each row
-						const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * 4;
+						const BYTE * const src_bits = FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * 4;
 						BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
 
 						for (unsigned x = 0; x < dst_width; x++) {
@@ -1124,11 +1322,11 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		case FIT_UINT16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (const WORD*)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1158,11 +1356,11 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		case FIT_RGB16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (const WORD*)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1196,11 +1394,11 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		case FIT_RGBA16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (const WORD*)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1238,11 +1436,11 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		case FIT_RGBAF:
 		{
 			// Calculate the number of floats per pixel (1 for 32-bit, 3 for 96-bit or 4 for 128-bit)
-			const unsigned floatspp = (FreeImage_GetLine(src) / src_width) / sizeof(float);
+			const unsigned floatspp = FreeImage_GetBPP(src) / 32;
 
-			for(unsigned y = 0; y < height; y++) {
+			for(unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
-				const float *src_bits = (float*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(float);
+				const float *src_bits = (const float*)FreeImage_GetConstScanLine(src, y + src_offset_y) + src_offset_x * floatspp;
 				float *dst_bits = (float*)FreeImage_GetScanLine(dst, y);
 
 				for(unsigned x = 0; x < dst_width; x++) {
@@ -1278,8 +1476,33 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 /// Performs vertical image filtering
 void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height) {
 
-	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_height, src_height);
+	// allocate and calculate the contributions (or retrieve them from the cache)
+	WeightsTablePtr table = getWeightsTable(dst_height, src_height);
+	if (!table) {
+		return;
+	}
+	CWeightsTable& weightsTable = *table;
+
+	// resolve any copy-on-write sharing before the bands access the pixels concurrently
+	if (!FreeImage_GetConstBits(src) || !FreeImage_GetBits(dst)) {
+		return;
+	}
+
+	// columns are independent of each other and the destination image has at
+	// least 8 bpp (no two columns share a byte): filter them in bands
+	if (isFixedPointFilter(src, src_pal, dst) && weightsTable.buildFixedWeights()) {
+		ThreadPool::instance().runBands(width, RESIZE_MIN_BAND_COLUMNS, [&](unsigned x_begin, unsigned x_end) {
+			verticalFilterFixed(weightsTable, src, src_offset_x, src_offset_y, dst, dst_height, x_begin, x_end);
+		});
+	} else {
+		ThreadPool::instance().runBands(width, RESIZE_MIN_BAND_COLUMNS, [&](unsigned x_begin, unsigned x_end) {
+			verticalFilterColumns(weightsTable, src, src_height, src_offset_x, src_offset_y, src_pal, dst, dst_height, x_begin, x_end);
+		});
+	}
+}
+
+/// Performs vertical image filtering on columns [x_begin, x_end)
+void CResizeEngine::verticalFilterColumns(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height, unsigned x_begin, unsigned x_end) {
 
 	// step through columns
 	switch(FreeImage_GetImageType(src)) {
@@ -1292,7 +1515,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				case 1:
 				{
 					const unsigned src_pitch = FreeImage_GetPitch(src);
-					const BYTE * const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + (src_offset_x >> 3);
+					const BYTE * const src_base = FreeImage_GetConstBits(src) + src_offset_y * src_pitch + (src_offset_x >> 3);
 
 					switch(FreeImage_GetBPP(dst)) {
 						case 8:
@@ -1300,7 +1523,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the 1-bit non-transparent greyscale image to 8 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 									const unsigned index = x >> 3;
@@ -1330,7 +1553,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 									const unsigned index = x >> 3;
@@ -1366,7 +1589,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the non-transparent 1-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 									const unsigned index = x >> 3;
@@ -1401,7 +1624,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 									const unsigned index = x >> 3;
@@ -1439,7 +1662,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 1-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 								const unsigned index = x >> 3;
@@ -1483,14 +1706,14 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				case 4:
 				{
 					const unsigned src_pitch = FreeImage_GetPitch(src);
-					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + (src_offset_x >> 1);
+					const BYTE *const src_base = FreeImage_GetConstBits(src) + src_offset_y * src_pitch + (src_offset_x >> 1);
 
 					switch(FreeImage_GetBPP(dst)) {
 						case 8:
 						{
 							// transparently convert the non-transparent 4-bit greyscale image to 8 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x;
 								const unsigned index = x >> 1;
@@ -1523,7 +1746,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the non-transparent 4-bit image to 24 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 3;
 								const unsigned index = x >> 1;
@@ -1562,7 +1785,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 4-bit image to 32 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 								const unsigned index = x >> 1;
@@ -1605,7 +1828,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				case 8:
 				{
 					const unsigned src_pitch = FreeImage_GetPitch(src);
-					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x;
+					const BYTE *const src_base = FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x;
 
 					switch(FreeImage_GetBPP(dst)) {
 						case 8:
@@ -1613,7 +1836,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// scale the 8-bit non-transparent greyscale image into an 8 bpp destination image
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 
@@ -1639,7 +1862,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 
@@ -1672,7 +1895,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the non-transparent 8-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 
@@ -1704,7 +1927,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 
@@ -1739,7 +1962,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 8-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 
@@ -1781,11 +2004,11 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				{
 					// transparently convert the 16-bit non-transparent image to 24 bpp
 					const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
-					const WORD *const src_base = (WORD *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x;
+					const WORD *const src_base = (const WORD *)FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x;
 
 					if (IS_FORMAT_RGB565(src)) {
 						// image has 565 format
-						for (unsigned x = 0; x < width; x++) {
+						for (unsigned x = x_begin; x < x_end; x++) {
 							// work on column x in dst
 							BYTE *dst_bits = dst_base + x * 3;
 
@@ -1816,7 +2039,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						}
 					} else {
 						// image has 555 format
-						for (unsigned x = 0; x < width; x++) {
+						for (unsigned x = x_begin; x < x_end; x++) {
 							// work on column x in dst
 							BYTE *dst_bits = dst_base + x * 3;
 
@@ -1853,9 +2076,9 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				{
 					// scale the 24-bit transparent image into a 24 bpp destination image
 					const unsigned src_pitch = FreeImage_GetPitch(src);
-					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * 3;
+					const BYTE *const src_base = FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * 3;
 
-					for (unsigned x = 0; x < width; x++) {
+					for (unsigned x = x_begin; x < x_end; x++) {
 						// work on column x in dst
 						const unsigned index = x * 3;
 						BYTE *dst_bits = dst_base + index;
@@ -1892,9 +2115,9 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 				{
 					// scale the 32-bit transparent image into a 32 bpp destination image
 					const unsigned src_pitch = FreeImage_GetPitch(src);
-					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * 4;
+					const BYTE *const src_base = FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * 4;
 
-					for (unsigned x = 0; x < width; x++) {
+					for (unsigned x = x_begin; x < x_end; x++) {
 						// work on column x in dst
 						const unsigned index = x * 4;
 						BYTE *dst_bits = dst_base + index;
@@ -1935,15 +2158,15 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		case FIT_UINT16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
 			const unsigned dst_pitch = FreeImage_GetPitch(dst) / sizeof(WORD);
 			WORD *const dst_base = (WORD *)FreeImage_GetBits(dst);
 
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
-			const WORD *const src_base = (WORD *)FreeImage_GetBits(src)	+ src_offset_y * src_pitch + src_offset_x * wordspp;
+			const WORD *const src_base = (const WORD *)FreeImage_GetConstBits(src)	+ src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -1976,15 +2199,15 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		case FIT_RGB16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
 			const unsigned dst_pitch = FreeImage_GetPitch(dst) / sizeof(WORD);
 			WORD *const dst_base = (WORD *)FreeImage_GetBits(dst);
 
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
-			const WORD *const src_base = (WORD *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
+			const WORD *const src_base = (const WORD *)FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -2022,15 +2245,15 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		case FIT_RGBA16:
 		{
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
-			const unsigned wordspp = (FreeImage_GetLine(src) / width) / sizeof(WORD);
+			const unsigned wordspp = FreeImage_GetBPP(src) / 16;
 
 			const unsigned dst_pitch = FreeImage_GetPitch(dst) / sizeof(WORD);
 			WORD *const dst_base = (WORD *)FreeImage_GetBits(dst);
 
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
-			const WORD *const src_base = (WORD *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
+			const WORD *const src_base = (const WORD *)FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -2072,15 +2295,15 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		case FIT_RGBAF:
 		{
 			// Calculate the number of floats per pixel (1 for 32-bit, 3 for 96-bit or 4 for 128-bit)
-			const unsigned floatspp = (FreeImage_GetLine(src) / width) / sizeof(float);
+			const unsigned floatspp = FreeImage_GetBPP(src) / 32;
 
 			const unsigned dst_pitch = FreeImage_GetPitch(dst) / sizeof(float);
 			float *const dst_base = (float *)FreeImage_GetBits(dst);
 
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(float);
-			const float *const src_base = (float *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * floatspp;
+			const float *const src_base = (const float *)FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * floatspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * floatspp;	// pixel index
 				float *dst_bits = (float *)dst_base + index;
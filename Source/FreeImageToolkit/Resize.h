@@ -28,6 +28,14 @@
 #include "Utilities.h"
 #include "Filters.h" 
 
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/// Number of fractional bits of the fixed-point filter weights
+#define FI_RESIZE_FIXED_BITS	14
+
 /**
   Filter weights table.<br>
   This class stores contribution information for an entire line (row or column).
@@ -52,6 +60,12 @@ private:
 	unsigned m_WindowSize;
 	/// Length of line (no. of rows / cols) 
 	unsigned m_LineLength;
+	/// Fixed-point weights (m_FixedStride weights per pixel, zero padded), NULL until built
+	short *m_FixedWeights;
+	/// Sum of the fixed-point weights of each pixel
+	int *m_FixedSums;
+	/// Distance between the fixed-point weights of two pixels
+	unsigned m_FixedStride;
 
 public:
 	/** 
@@ -93,6 +107,86 @@ public:
 	unsigned getRightBoundary(unsigned dst_pos) {
 		return m_WeightTable[dst_pos].Right;
 	}
+
+	/** Compute the fixed-point weights (FI_RESIZE_FIXED_BITS fractional bits).<br>
+	The weights of each pixel are rounded so that they keep their sum and are padded 
+	with zeros up to a multiple of 8 weights.
+	@return Returns FALSE if the weights do not fit the 16-bit fixed-point format
+	*/
+	BOOL buildFixedWeights();
+
+	/** Retrieve the fixed-point weights of a pixel (built by buildFixedWeights)
+	@param dst_pos Pixel position in destination line buffer
+	@return Returns the weights of the source pixels from the left boundary on
+	*/
+	const short* getFixedWeights(unsigned dst_pos) {
+		return m_FixedWeights + dst_pos * m_FixedStride;
+	}
+
+	/** Retrieve the sum of the fixed-point weights of a pixel (built by buildFixedWeights)
+	@param dst_pos Pixel position in destination line buffer
+	@return Returns the sum of the fixed-point weights
+	*/
+	int getFixedWeightSum(unsigned dst_pos) {
+		return m_FixedSums[dst_pos];
+	}
+
+	/// Returns the number of bytes used by the table
+	size_t getMemorySize() const;
+};
+
+/// Weights table shared between the cache and the filter passes using it
+typedef std::shared_ptr<CWeightsTable> WeightsTablePtr;
+
+/**
+  Weights table cache.<br>
+  Process wide LRU cache of weights tables, keyed by filter type and line sizes, 
+  so that repeated rescaling with the same geometry does not recompute the filter 
+  weights. The cache is bounded by a memory limit (FreeImage_SetRescaleCacheSize); 
+  a table larger than the limit is never cached. The cached tables include their 
+  fixed-point weights, so that they are read-only once published.
+*/
+class CWeightsTableCache
+{
+private:
+	/// Cache key: filter type, destination and source line sizes
+	typedef std::pair<int, std::pair<unsigned, unsigned> > Key;
+	typedef std::list<std::pair<Key, WeightsTablePtr> > LRUList;
+
+	std::mutex m_mutex;
+	/// Tables, most recently used first
+	LRUList m_tables;
+	/// Index of the tables
+	std::map<Key, LRUList::iterator> m_index;
+	/// Memory used by the cached tables
+	size_t m_bytes;
+	/// Memory limit
+	size_t m_max_bytes;
+
+	CWeightsTableCache();
+
+	/// Remove the least recently used tables until the cache fits in max_bytes (m_mutex must be locked)
+	void trim(size_t max_bytes);
+
+public:
+	/// Returns the process wide cache
+	static CWeightsTableCache& instance();
+
+	/**
+	Retrieve a weights table, computing and caching it if needed
+	@param filter_type Filter type (FREE_IMAGE_FILTER)
+	@param pFilter Filter used to compute a missing table
+	@param uDstSize Length (in pixels) of the destination line buffer
+	@param uSrcSize Length (in pixels) of the source line buffer
+	@return Returns the table, or an empty pointer if out of memory
+	*/
+	WeightsTablePtr get(int filter_type, CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize);
+
+	/// Set the memory limit (0 disables the cache)
+	void setMaxBytes(size_t max_bytes);
+
+	/// Release all cached tables
+	void clear();
 };
 
 // ---------------------------------------------
@@ -102,7 +196,11 @@ public:
  This class performs filtered zoom. It scales an image to the desired dimensions with 
  any of the CGenericFilter derived filter class.<br>
  It works with FIT_BITMAP buffers, WORD buffers (FIT_UINT16, FIT_RGB16, FIT_RGBA16) 
- and float buffers (FIT_FLOAT, FIT_RGBF, FIT_RGBAF).<br><br>
+ and float buffers (FIT_FLOAT, FIT_RGBF, FIT_RGBAF).<br>
+ Greyscale, 24- and 32-bit FIT_BITMAP images as well as WORD buffers are filtered with 
+ fixed-point weights by SIMD kernels (see ResizeKernels.cpp) when the flag 
+ FI_RESCALE_FIXED_POINT is set. The double precision filter is the reference 
+ implementation, used by default and for all other cases.<br><br>
 
  <b>References</b> : <br>
  [1] Paul Heckbert, C code to zoom raster images up or down, with nice filtering. 
@@ -116,14 +214,19 @@ class CResizeEngine
 private:
 	/// Pointer to the FIR / IIR filter
 	CGenericFilter* m_pFilter;
+	/// Filter type (FREE_IMAGE_FILTER) used to cache the weights tables, -1 if not cacheable
+	int m_iFilterType;
+	/// TRUE to use the fixed-point filter whenever the image format allows it
+	BOOL m_bFixedPoint;
 
 public:
 
 	/**
 	Constructor
 	@param filter FIR /IIR filter to be used
+	@param filter_type FREE_IMAGE_FILTER matching the filter, enables the weights table cache
 	*/
-	CResizeEngine(CGenericFilter* filter):m_pFilter(filter) {}
+	CResizeEngine(CGenericFilter* filter, int filter_type = -1):m_pFilter(filter), m_iFilterType(filter_type), m_bFixedPoint(FALSE) {}
 
 	/// Destructor
 	virtual ~CResizeEngine() {}
@@ -161,6 +264,14 @@ public:
 
 private:
 
+	/**
+	Retrieve the weights table of a filter pass, from the cache if possible
+	@param uDstSize Length (in pixels) of the destination line buffer
+	@param uSrcSize Length (in pixels) of the source line buffer
+	@return Returns the table, or an empty pointer if out of memory
+	*/
+	WeightsTablePtr getWeightsTable(unsigned uDstSize, unsigned uSrcSize);
+
 	/**
 	Performs horizontal image filtering
 
@@ -191,6 +302,54 @@ private:
 	void verticalFilter(FIBITMAP * const src, const unsigned width, const unsigned src_height,
 			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
 			FIBITMAP * const dst, const unsigned dst_height);
+
+	/**
+	Performs horizontal image filtering on a band of rows.<br>
+	Bands do not overlap, so that they may be filtered concurrently.
+	@param weightsTable Contributions of the source pixels
+	@param y_begin First row of the band
+	@param y_end Row following the last row of the band
+	@see horizontalFilter
+	*/
+	void horizontalFilterRows(CWeightsTable& weightsTable, FIBITMAP * const src, const unsigned src_width,
+			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
+			FIBITMAP * const dst, const unsigned dst_width, const unsigned y_begin, const unsigned y_end);
+
+	/**
+	Performs vertical image filtering on a band of columns.<br>
+	Bands do not overlap, so that they may be filtered concurrently.
+	@param weightsTable Contributions of the source pixels
+	@param x_begin First column of the band
+	@param x_end Column following the last column of the band
+	@see verticalFilter
+	*/
+	void verticalFilterColumns(CWeightsTable& weightsTable, FIBITMAP * const src, const unsigned src_height,
+			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
+			FIBITMAP * const dst, const unsigned dst_height, const unsigned x_begin, const unsigned x_end);
+
+	/**
+	Returns TRUE if a filter pass from src to dst can use the fixed-point filter
+	@param src Source image
+	@param src_pal Source palette (fixed-point filtering does not support palette lookups)
+	@param dst Destination image
+	*/
+	BOOL isFixedPointFilter(FIBITMAP * const src, const RGBQUAD * const src_pal, FIBITMAP * const dst);
+
+	/**
+	Performs fixed-point horizontal image filtering on a band of rows
+	@see horizontalFilterRows
+	*/
+	void horizontalFilterFixed(CWeightsTable& weightsTable, FIBITMAP * const src,
+			const unsigned src_offset_x, const unsigned src_offset_y,
+			FIBITMAP * const dst, const unsigned dst_width, const unsigned y_begin, const unsigned y_end);
+
+	/**
+	Performs fixed-point vertical image filtering on a band of columns
+	@see verticalFilterColumns
+	*/
+	void verticalFilterFixed(CWeightsTable& weightsTable, FIBITMAP * const src,
+			const unsigned src_offset_x, const unsigned src_offset_y,
+			FIBITMAP * const dst, const unsigned dst_height, const unsigned x_begin, const unsigned x_end);
 };
 
 #endif //   _RESIZE_H_
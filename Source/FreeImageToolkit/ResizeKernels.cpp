@@ -0,0 +1,509 @@
+// ==========================================================
+// Upsampling / downsampling fixed-point kernels
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "Resize.h"
+
+/*
+The fixed-point filter works on 8-bit (BYTE) and 16-bit (WORD) channels with 16-bit
+weights having FI_RESIZE_FIXED_BITS fractional bits. Samples are accumulated in 32-bit
+integers: WORD samples are biased by -32768 so that they fit a signed 16-bit integer
+(the bias is added back as 32768 * sum of weights), which lets the SSE2 / AVX2 kernels
+multiply and add pairs of samples with a single pmaddwd instruction.
+
+All kernels (plain C++, SSE2 and AVX2) compute exactly the same integer result, so the
+output does not depend on the CPU the code runs on.
+*/
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define FI_RESIZE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define FI_RESIZE_AVX2
+#define FI_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (_MSC_VER >= 1700)
+#define FI_RESIZE_AVX2
+#define FI_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif // SSE2
+
+// ----------------------------------------------------------
+//   Sample traits
+// ----------------------------------------------------------
+
+/// Rounding constant of the fixed-point accumulators
+static const int FIXED_ROUND = 1 << (FI_RESIZE_FIXED_BITS - 1);
+
+template <class T> struct FixedSample;
+
+template <> struct FixedSample<BYTE> {
+	static const int bias = 0;
+	static const int max_value = 0xFF;
+};
+
+template <> struct FixedSample<WORD> {
+	static const int bias = 0x8000;
+	static const int max_value = 0xFFFF;
+};
+
+/// Convert an accumulator (sum of weight * (sample - bias)) into a sample
+template <class T> static inline T
+FixedToSample(int acc, int weight_sum) {
+	const int value = (acc + FixedSample<T>::bias * weight_sum + FIXED_ROUND) >> FI_RESIZE_FIXED_BITS;
+	return (T)CLAMP<int>(value, 0, FixedSample<T>::max_value);
+}
+
+// ----------------------------------------------------------
+//   Plain C++ kernels (reference for the SIMD kernels)
+// ----------------------------------------------------------
+
+/**
+Filter one row horizontally
+@param src Source row, starting at the first source pixel of the line
+@param src_end End of the source row (first sample after the row)
+@param dst Destination row
+@param table Weights table, with fixed-point weights
+@param dst_width Destination width
+*/
+template <class T, unsigned C> static void
+HorizontalRowC(const T *src, const T *src_end, T *dst, CWeightsTable& table, unsigned dst_width) {
+	for (unsigned x = 0; x < dst_width; x++) {
+		const unsigned iLeft = table.getLeftBoundary(x);
+		const unsigned iLimit = table.getRightBoundary(x) - iLeft;
+		const short *weights = table.getFixedWeights(x);
+		const T *pixel = src + iLeft * C;
+		int acc[C] = { 0 };
+
+		for (unsigned i = 0; i < iLimit; i++) {
+			for (unsigned c = 0; c < C; c++) {
+				acc[c] += weights[i] * ((int)pixel[c] - FixedSample<T>::bias);
+			}
+			pixel += C;
+		}
+
+		const int weight_sum = table.getFixedWeightSum(x);
+		for (unsigned c = 0; c < C; c++) {
+			dst[c] = FixedToSample<T>(acc[c], weight_sum);
+		}
+		dst += C;
+	}
+}
+
+/**
+Filter samples [begin, end) of one row vertically
+@param src Source sample at the left boundary of the column window (row iLeft)
+@param src_pitch Source pitch, in samples
+@param dst Destination row
+@param weights Fixed-point weights of the row
+@param taps Number of weights
+@param weight_sum Sum of the weights
+@param begin First sample
+@param end Sample following the last sample
+*/
+template <class T> static void
+VerticalRowC(const T *src, unsigned src_pitch, T *dst, const short *weights, unsigned taps, int weight_sum, unsigned begin, unsigned end) {
+	for (unsigned k = begin; k < end; k++) {
+		const T *sample = src + k;
+		int acc = 0;
+		for (unsigned i = 0; i < taps; i++) {
+			acc += weights[i] * ((int)*sample - FixedSample<T>::bias);
+			sample += src_pitch;
+		}
+		dst[k] = FixedToSample<T>(acc, weight_sum);
+	}
+}
+
+#ifdef FI_RESIZE_SSE2
+
+// ----------------------------------------------------------
+//   SSE2 kernels
+// ----------------------------------------------------------
+
+/// Load 8 samples as signed 16-bit integers
+static inline __m128i
+Load8(const BYTE *p) {
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+}
+
+static inline __m128i
+Load8(const WORD *p) {
+	return _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi16((short)0x8000));
+}
+
+/// Broadcast a pair of weights to the 4 32-bit lanes
+static inline __m128i
+WeightPair(short w0, short w1) {
+	return _mm_set1_epi32((int)(unsigned short)w0 | ((int)w1 << 16));
+}
+
+/// Convert 8 accumulators (acc_lo: samples 0-3, acc_hi: samples 4-7) and store them
+static inline void
+Store8(BYTE *dst, __m128i acc_lo, __m128i acc_hi, int weight_sum) {
+	const __m128i round = _mm_set1_epi32(FixedSample<BYTE>::bias * weight_sum + FIXED_ROUND);
+	acc_lo = _mm_srai_epi32(_mm_add_epi32(acc_lo, round), FI_RESIZE_FIXED_BITS);
+	acc_hi = _mm_srai_epi32(_mm_add_epi32(acc_hi, round), FI_RESIZE_FIXED_BITS);
+	const __m128i v = _mm_packs_epi32(acc_lo, acc_hi);
+	_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(v, v));
+}
+
+static inline void
+Store8(WORD *dst, __m128i acc_lo, __m128i acc_hi, int weight_sum) {
+	// add the bias back, then saturate to [-32768, 32767] and flip back to [0, 65535]
+	const __m128i round = _mm_set1_epi32(FixedSample<WORD>::bias * weight_sum + FIXED_ROUND);
+	const __m128i bias = _mm_set1_epi32(FixedSample<WORD>::bias);
+	acc_lo = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(acc_lo, round), FI_RESIZE_FIXED_BITS), bias);
+	acc_hi = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(acc_hi, round), FI_RESIZE_FIXED_BITS), bias);
+	const __m128i v = _mm_packs_epi32(acc_lo, acc_hi);
+	_mm_storeu_si128((__m128i*)dst, _mm_xor_si128(v, _mm_set1_epi16((short)0x8000)));
+}
+
+/**
+Filter taps [i, iLimit) of one destination pixel and store it
+@param pixel Source pixel at the left boundary of the window
+@param src_end End of the source row
+@param weights Fixed-point weights of the pixel
+@param i First tap to filter
+@param iLimit Number of weights
+@param acc Partial sums of taps [0, i): one sum per channel, or 4 partial sums when C == 1
+@param dst Destination pixel
+@param weight_sum Sum of the weights
+*/
+template <class T, unsigned C> static inline void
+HorizontalTapsSSE2(const T *pixel, const T *src_end, const short *weights, unsigned i, unsigned iLimit, __m128i acc, T *dst, int weight_sum) {
+	if (C == 1) {
+		// 8 taps at a time (the weights are zero padded to a multiple of 8)
+		for (; (i < iLimit) && (pixel + i + 8 <= src_end); i += 8) {
+			const __m128i w = _mm_loadu_si128((const __m128i*)(weights + i));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(Load8(pixel + i), w));
+		}
+		// sum up the 4 partial sums into lane 0
+		acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+		acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+	} else {
+		// 2 taps at a time: interleave the channels of 2 pixels, [c0 c0' c1 c1' c2 c2' ...]
+		for (; (i + 2 <= iLimit) && (pixel + i * C + 8 <= src_end); i += 2) {
+			const __m128i v = Load8(pixel + i * C);
+			const __m128i pair = _mm_unpacklo_epi16(v, _mm_srli_si128(v, C * 2));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(pair, WeightPair(weights[i], weights[i + 1])));
+		}
+	}
+
+	int sums[4];
+	_mm_storeu_si128((__m128i*)sums, acc);
+
+	// remaining taps
+	for (; i < iLimit; i++) {
+		for (unsigned c = 0; c < C; c++) {
+			sums[c] += weights[i] * ((int)pixel[i * C + c] - FixedSample<T>::bias);
+		}
+	}
+
+	for (unsigned c = 0; c < C; c++) {
+		dst[c] = FixedToSample<T>(sums[c], weight_sum);
+	}
+}
+
+template <class T, unsigned C> static void
+HorizontalRowSSE2(const T *src, const T *src_end, T *dst, CWeightsTable& table, unsigned dst_width) {
+	for (unsigned x = 0; x < dst_width; x++) {
+		const unsigned iLeft = table.getLeftBoundary(x);
+		const unsigned iLimit = table.getRightBoundary(x) - iLeft;
+		HorizontalTapsSSE2<T, C>(src + iLeft * C, src_end, table.getFixedWeights(x), 0, iLimit, _mm_setzero_si128(), dst, table.getFixedWeightSum(x));
+		dst += C;
+	}
+}
+
+template <class T> static void
+VerticalRowSSE2(const T *src, unsigned src_pitch, T *dst, const short *weights, unsigned taps, int weight_sum, unsigned begin, unsigned end) {
+	unsigned k = begin;
+
+	for (; k + 8 <= end; k += 8) {
+		__m128i acc_lo = _mm_setzero_si128();
+		__m128i acc_hi = _mm_setzero_si128();
+		const T *sample = src + k;
+
+		for (unsigned i = 0; i < taps; i += 2) {
+			// an odd last tap is paired with itself and a zero weight
+			const BOOL bPair = (i + 1 < taps);
+			const __m128i a = Load8(sample);
+			const __m128i b = bPair ? Load8(sample + src_pitch) : a;
+			const __m128i w = WeightPair(weights[i], bPair ? weights[i + 1] : 0);
+			acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+			acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+			sample += 2 * src_pitch;
+		}
+
+		Store8(dst + k, acc_lo, acc_hi, weight_sum);
+	}
+
+	VerticalRowC<T>(src, src_pitch, dst, weights, taps, weight_sum, k, end);
+}
+
+#ifdef FI_RESIZE_AVX2
+
+// ----------------------------------------------------------
+//   AVX2 kernels
+// ----------------------------------------------------------
+
+/// Load 16 samples as signed 16-bit integers
+FI_TARGET_AVX2 static inline __m256i
+Load16(const BYTE *p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+FI_TARGET_AVX2 static inline __m256i
+Load16(const WORD *p) {
+	return _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi16((short)0x8000));
+}
+
+/// Convert 16 accumulators (per 128-bit lane, acc_lo: samples 0-3, acc_hi: samples 4-7) and store them
+FI_TARGET_AVX2 static inline void
+Store16(BYTE *dst, __m256i acc_lo, __m256i acc_hi, int weight_sum) {
+	const __m256i round = _mm256_set1_epi32(FixedSample<BYTE>::bias * weight_sum + FIXED_ROUND);
+	acc_lo = _mm256_srai_epi32(_mm256_add_epi32(acc_lo, round), FI_RESIZE_FIXED_BITS);
+	acc_hi = _mm256_srai_epi32(_mm256_add_epi32(acc_hi, round), FI_RESIZE_FIXED_BITS);
+	const __m256i v = _mm256_packs_epi32(acc_lo, acc_hi);
+	// each 128-bit lane holds 8 bytes twice: gather the lower halves
+	const __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+	_mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(b));
+}
+
+FI_TARGET_AVX2 static inline void
+Store16(WORD *dst, __m256i acc_lo, __m256i acc_hi, int weight_sum) {
+	const __m256i round = _mm256_set1_epi32(FixedSample<WORD>::bias * weight_sum + FIXED_ROUND);
+	const __m256i bias = _mm256_set1_epi32(FixedSample<WORD>::bias);
+	acc_lo = _mm256_sub_epi32(_mm256_srai_epi32(_mm256_add_epi32(acc_lo, round), FI_RESIZE_FIXED_BITS), bias);
+	acc_hi = _mm256_sub_epi32(_mm256_srai_epi32(_mm256_add_epi32(acc_hi, round), FI_RESIZE_FIXED_BITS), bias);
+	const __m256i v = _mm256_packs_epi32(acc_lo, acc_hi);
+	_mm256_storeu_si256((__m256i*)dst, _mm256_xor_si256(v, _mm256_set1_epi16((short)0x8000)));
+}
+
+template <class T, unsigned C> FI_TARGET_AVX2 static void
+HorizontalRowAVX2(const T *src, const T *src_end, T *dst, CWeightsTable& table, unsigned dst_width) {
+	for (unsigned x = 0; x < dst_width; x++) {
+		const unsigned iLeft = table.getLeftBoundary(x);
+		const unsigned iLimit = table.getRightBoundary(x) - iLeft;
+		const short *weights = table.getFixedWeights(x);
+		const T *pixel = src + iLeft * C;
+		__m256i acc = _mm256_setzero_si256();
+		unsigned i = 0;
+
+		if (C == 1) {
+			// 16 taps at a time, as long as the zero padded weights cover them
+			for (; (i + 8 < iLimit) && (pixel + i + 16 <= src_end); i += 16) {
+				const __m256i w = _mm256_loadu_si256((const __m256i*)(weights + i));
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(Load16(pixel + i), w));
+			}
+		} else {
+			// 4 taps at a time: pixels i, i+1 in the low lane and i+2, i+3 in the high lane
+			for (; (i + 4 <= iLimit) && (pixel + (i + 2) * C + 8 <= src_end); i += 4) {
+				const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(Load8(pixel + i * C)), Load8(pixel + (i + 2) * C), 1);
+				const __m256i pair = _mm256_unpacklo_epi16(v, _mm256_srli_si256(v, C * 2));
+				const int w01 = (int)(unsigned short)weights[i] | ((int)weights[i + 1] << 16);
+				const int w23 = (int)(unsigned short)weights[i + 2] | ((int)weights[i + 3] << 16);
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pair, _mm256_setr_epi32(w01, w01, w01, w01, w23, w23, w23, w23)));
+			}
+		}
+
+		// fold the two lanes and let the SSE2 kernel filter the remaining taps
+		const __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		HorizontalTapsSSE2<T, C>(pixel, src_end, weights, i, iLimit, acc128, dst, table.getFixedWeightSum(x));
+		dst += C;
+	}
+}
+
+template <class T> FI_TARGET_AVX2 static void
+VerticalRowAVX2(const T *src, unsigned src_pitch, T *dst, const short *weights, unsigned taps, int weight_sum, unsigned begin, unsigned end) {
+	unsigned k = begin;
+
+	for (; k + 16 <= end; k += 16) {
+		__m256i acc_lo = _mm256_setzero_si256();
+		__m256i acc_hi = _mm256_setzero_si256();
+		const T *sample = src + k;
+
+		for (unsigned i = 0; i < taps; i += 2) {
+			const BOOL bPair = (i + 1 < taps);
+			const __m256i a = Load16(sample);
+			const __m256i b = bPair ? Load16(sample + src_pitch) : a;
+			const __m256i w = _mm256_set1_epi32((int)(unsigned short)weights[i] | ((int)(bPair ? weights[i + 1] : 0) << 16));
+			acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+			acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+			sample += 2 * src_pitch;
+		}
+
+		Store16(dst + k, acc_lo, acc_hi, weight_sum);
+	}
+
+	VerticalRowSSE2<T>(src, src_pitch, dst, weights, taps, weight_sum, k, end);
+}
+
+#endif // FI_RESIZE_AVX2
+
+#endif // FI_RESIZE_SSE2
+
+// ----------------------------------------------------------
+//   Runtime dispatch
+// ----------------------------------------------------------
+
+/// Returns TRUE if the CPU and the OS support AVX2
+static BOOL
+HasAVX2() {
+#if defined(FI_RESIZE_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#elif defined(FI_RESIZE_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return FALSE;
+	}
+	__cpuid(info, 1);
+	// OSXSAVE and AVX
+	if ((info[2] & 0x18000000) != 0x18000000) {
+		return FALSE;
+	}
+	// the OS saves the YMM registers
+	if ((_xgetbv(0) & 6) != 6) {
+		return FALSE;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & 0x20) ? TRUE : FALSE;
+#else
+	return FALSE;
+#endif
+}
+
+/// Kernels selected for the running CPU
+template <class T> struct FixedKernels {
+	typedef void (*HorizontalRowProc)(const T *src, const T *src_end, T *dst, CWeightsTable& table, unsigned dst_width);
+	typedef void (*VerticalRowProc)(const T *src, unsigned src_pitch, T *dst, const short *weights, unsigned taps, int weight_sum, unsigned begin, unsigned end);
+
+	/// horizontal kernels for 1, 3 and 4 channels
+	HorizontalRowProc horizontal[5];
+	VerticalRowProc vertical;
+
+	FixedKernels() {
+		memset(horizontal, 0, sizeof(horizontal));
+#ifdef FI_RESIZE_SSE2
+		horizontal[1] = HorizontalRowSSE2<T, 1>;
+		horizontal[3] = HorizontalRowSSE2<T, 3>;
+		horizontal[4] = HorizontalRowSSE2<T, 4>;
+		vertical = VerticalRowSSE2<T>;
+#ifdef FI_RESIZE_AVX2
+		if (HasAVX2()) {
+			horizontal[1] = HorizontalRowAVX2<T, 1>;
+			horizontal[3] = HorizontalRowAVX2<T, 3>;
+			horizontal[4] = HorizontalRowAVX2<T, 4>;
+			vertical = VerticalRowAVX2<T>;
+		}
+#endif
+#else
+		horizontal[1] = HorizontalRowC<T, 1>;
+		horizontal[3] = HorizontalRowC<T, 3>;
+		horizontal[4] = HorizontalRowC<T, 4>;
+		vertical = VerticalRowC<T>;
+#endif
+	}
+
+	static const FixedKernels& instance() {
+		static FixedKernels s_kernels;
+		return s_kernels;
+	}
+};
+
+// ----------------------------------------------------------
+//   CResizeEngine fixed-point filters
+// ----------------------------------------------------------
+
+BOOL CResizeEngine::isFixedPointFilter(FIBITMAP *const src, const RGBQUAD *const src_pal, FIBITMAP *const dst) {
+	if (!m_bFixedPoint) {
+		return FALSE;
+	}
+
+	// select the kernels before the filter bands run concurrently
+	FixedKernels<BYTE>::instance();
+	FixedKernels<WORD>::instance();
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	const unsigned bpp = FreeImage_GetBPP(src);
+
+	// the kernels do not convert samples: both images must have the same format
+	if ((image_type != FreeImage_GetImageType(dst)) || (bpp != FreeImage_GetBPP(dst))) {
+		return FALSE;
+	}
+
+	switch (image_type) {
+		case FIT_BITMAP:
+			// 8-bit images must be greyscale (no palette lookup)
+			return ((bpp == 8) && !src_pal) || (bpp == 24) || (bpp == 32);
+		case FIT_UINT16:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/// Fixed-point horizontal filtering of rows [y_begin, y_end) for sample type T
+template <class T> static void
+HorizontalFilterFixed(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_width, unsigned y_begin, unsigned y_end) {
+	const unsigned channels = FreeImage_GetBPP(src) / (8 * sizeof(T));
+	const unsigned src_line = FreeImage_GetLine(src) / sizeof(T);
+	typename FixedKernels<T>::HorizontalRowProc filter = FixedKernels<T>::instance().horizontal[channels];
+
+	for (unsigned y = y_begin; y < y_end; y++) {
+		const T *src_row = (const T*)FreeImage_GetConstScanLine(src, y + src_offset_y);
+		filter(src_row + src_offset_x * channels, src_row + src_line, (T*)FreeImage_GetScanLine(dst, y), weightsTable, dst_width);
+	}
+}
+
+/// Fixed-point vertical filtering of columns [x_begin, x_end) for sample type T
+template <class T> static void
+VerticalFilterFixed(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_height, unsigned x_begin, unsigned x_end) {
+	const unsigned channels = FreeImage_GetBPP(src) / (8 * sizeof(T));
+	const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(T);
+	typename FixedKernels<T>::VerticalRowProc filter = FixedKernels<T>::instance().vertical;
+
+	// row by row, so that the source rows are read sequentially
+	const T *const src_base = (const T*)FreeImage_GetConstBits(src) + src_offset_y * src_pitch + src_offset_x * channels;
+
+	for (unsigned y = 0; y < dst_height; y++) {
+		const unsigned iLeft = weightsTable.getLeftBoundary(y);
+		const unsigned iLimit = weightsTable.getRightBoundary(y) - iLeft;
+		filter(src_base + iLeft * src_pitch, src_pitch, (T*)FreeImage_GetScanLine(dst, y), weightsTable.getFixedWeights(y), iLimit, weightsTable.getFixedWeightSum(y), x_begin * channels, x_end * channels);
+	}
+}
+
+void CResizeEngine::horizontalFilterFixed(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_width, unsigned y_begin, unsigned y_end) {
+	if (FreeImage_GetImageType(src) == FIT_BITMAP) {
+		HorizontalFilterFixed<BYTE>(weightsTable, src, src_offset_x, src_offset_y, dst, dst_width, y_begin, y_end);
+	} else {
+		HorizontalFilterFixed<WORD>(weightsTable, src, src_offset_x, src_offset_y, dst, dst_width, y_begin, y_end);
+	}
+}
+
+void CResizeEngine::verticalFilterFixed(CWeightsTable& weightsTable, FIBITMAP *const src, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_height, unsigned x_begin, unsigned x_end) {
+	if (FreeImage_GetImageType(src) == FIT_BITMAP) {
+		VerticalFilterFixed<BYTE>(weightsTable, src, src_offset_x, src_offset_y, dst, dst_height, x_begin, x_end);
+	} else {
+		VerticalFilterFixed<WORD>(weightsTable, src, src_offset_x, src_offset_y, dst, dst_height, x_begin, x_end);
+	}
+}
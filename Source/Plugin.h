@@ -34,6 +34,9 @@
 
 struct Plugin;
 
+/** size of the file header used to match plugin magic numbers */
+#define FI_MAGIC_HEADER_SIZE 64
+
 // =====================================================================
 //  Plugin Node
 // =====================================================================
@@ -56,6 +59,8 @@ FI_STRUCT (PluginNode) {
 	const char *m_extension;
 	/** optional regular expression to help	software identifying a bitmap type */
 	const char *m_regexpr;
+	/** TRUE if the plugin magic numbers are indexed in the plugin list */
+	BOOL m_magic_indexed;
 };
 
 // =====================================================================
@@ -71,13 +76,22 @@ public :
 	PluginNode *FindNodeFromFormat(const char *format);
 	PluginNode *FindNodeFromMime(const char *mime);
 	PluginNode *FindNodeFromFIF(int node_id);
+	void FindNodesFromMagicNumber(const BYTE *header, std::vector<int> &node_ids);
 
 	int Size() const;
 	BOOL IsEmpty() const;
 
 private :
+	BOOL IndexMagicNumbers(PluginNode *node);
+
+private :
+	/** magic number of a plugin */
+	typedef std::pair<int, const FIMAGICNUMBER *> MAGICENTRY;
+
 	std::map<int, PluginNode *> m_plugin_map;
 	int m_node_count;
+	/** plugin magic numbers, indexed by the value of their first byte */
+	std::vector<MAGICENTRY> m_magic_table[256];
 };
 
 // ==========================================================
@@ -0,0 +1,101 @@
+// ==========================================================
+// Internal worker thread pool
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#ifndef FREEIMAGE_THREAD_POOL_H
+#define FREEIMAGE_THREAD_POOL_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+Process wide pool of worker threads.<br>
+The pool is sized with FreeImage_SetThreadCount (the calling thread counts as
+one of the threads) and its workers are started lazily, on the first parallel run.
+Only one parallel run is executed at a time: a run requested while another one is
+in progress (including a nested run issued from inside a task) is executed serially
+by the calling thread, so tasks never wait for each other.
+*/
+class ThreadPool {
+public:
+	/// Returns the process wide thread pool
+	static ThreadPool& instance();
+
+	/**
+	Set the number of threads used for parallel runs
+	@param count Number of threads, 0 means one thread per hardware thread
+	*/
+	void setThreadCount(unsigned count);
+
+	/// Returns the number of threads used for parallel runs (always >= 1)
+	unsigned getThreadCount();
+
+	/**
+	Execute task(index) for every index in [0, count) and wait for completion.<br>
+	Tasks must be independent of each other, they are executed in no particular order.
+	@param count Number of tasks
+	@param task Task function, called with the task index
+	*/
+	void run(unsigned count, const std::function<void(unsigned)>& task);
+
+	/**
+	Split the range [0, length) into bands of at least min_band items and
+	execute task(begin, end) for every band, possibly in parallel.
+	@param length Length of the range
+	@param min_band Minimum band length
+	@param task Band function, called with the band bounds
+	*/
+	void runBands(unsigned length, unsigned min_band, const std::function<void(unsigned, unsigned)>& task);
+
+	/// Stop and join the worker threads (they are restarted on demand)
+	void shutdown();
+
+private:
+	ThreadPool();
+	~ThreadPool();
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void stopWorkers();
+	void startWorkers();
+	void workerLoop();
+	void drain();
+
+private:
+	/// serializes parallel runs and pool resizing
+	std::mutex m_run_mutex;
+	/// protects the job state below
+	std::mutex m_mutex;
+	std::condition_variable m_work_cv;
+	std::condition_variable m_done_cv;
+	std::vector<std::thread> m_workers;
+	/// requested number of threads (0 = hardware concurrency)
+	unsigned m_thread_count;
+	/// current job
+	const std::function<void(unsigned)> *m_task;
+	unsigned m_task_count;
+	unsigned m_next_task;
+	unsigned m_pending_tasks;
+	/// incremented for each job, wakes up the workers
+	unsigned m_generation;
+	BOOL m_stop;
+};
+
+#endif // FREEIMAGE_THREAD_POOL_H
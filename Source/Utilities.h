@@ -68,37 +68,6 @@ void FreeImage_Aligned_Free(void* mem);
 extern "C" {
 #endif
 
-/**
-Allocate a FIBITMAP with possibly no pixel data 
-(i.e. only header data and some or all metadata)
-@param header_only If TRUE, allocate a 'header only' FIBITMAP, otherwise allocate a full FIBITMAP
-@param type Image type
-@param width Image width
-@param height Image height
-@param bpp Number of bits per pixel
-@param red_mask Image red mask 
-@param green_mask Image green mask
-@param blue_mask Image blue mask
-@return Returns the allocated FIBITMAP
-@see FreeImage_AllocateT
-*/
-DLL_API FIBITMAP * DLL_CALLCONV FreeImage_AllocateHeaderT(BOOL header_only, FREE_IMAGE_TYPE type, int width, int height, int bpp FI_DEFAULT(8), unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
-
-/**
-Allocate a FIBITMAP of type FIT_BITMAP, with possibly no pixel data 
-(i.e. only header data and some or all metadata)
-@param header_only If TRUE, allocate a 'header only' FIBITMAP, otherwise allocate a full FIBITMAP
-@param width Image width
-@param height Image height
-@param bpp Number of bits per pixel
-@param red_mask Image red mask 
-@param green_mask Image green mask
-@param blue_mask Image blue mask
-@return Returns the allocated FIBITMAP
-@see FreeImage_Allocate
-*/
-DLL_API FIBITMAP * DLL_CALLCONV FreeImage_AllocateHeader(BOOL header_only, int width, int height, int bpp, unsigned red_mask FI_DEFAULT(0), unsigned green_mask FI_DEFAULT(0), unsigned blue_mask FI_DEFAULT(0));
-
 /**
 Allocate a FIBITMAP with no pixel data and wrap a user provided pixel buffer
 @param ext_bits Pointer to external user's pixel buffer
@@ -121,6 +90,20 @@ Helper for 16-bit FIT_BITMAP
 */
 DLL_API BOOL DLL_CALLCONV FreeImage_HasRGBMasks(FIBITMAP *dib);
 
+/**
+Read-only access to the pixels of a FIBITMAP. 
+Unlike FreeImage_GetBits, pixels shared with copy-on-write clones are not copied, 
+so several threads may read the same image at the same time.
+@see FreeImage_GetBits, FreeImage_SetCopyOnWrite
+*/
+DLL_API const BYTE * DLL_CALLCONV FreeImage_GetConstBits(FIBITMAP *dib);
+
+/**
+Read-only access to a scanline of a FIBITMAP
+@see FreeImage_GetConstBits, FreeImage_GetScanLine
+*/
+DLL_API const BYTE * DLL_CALLCONV FreeImage_GetConstScanLine(FIBITMAP *dib, int scanline);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -299,6 +282,71 @@ CalculateScanLine(BYTE *bits, const unsigned pitch, const int scanline) {
 	return bits ? (bits + ((size_t)pitch * scanline)) : NULL;
 }
 
+inline const BYTE*
+CalculateScanLine(const BYTE *bits, const unsigned pitch, const int scanline) {
+	return bits ? (bits + ((size_t)pitch * scanline)) : NULL;
+}
+
+/**
+Compute the reduction factor needed to fit an image inside a bounding box, keeping its aspect ratio
+@param width Image width
+@param height Image height
+@param max_width Box width, a value <= 0 leaves the width unconstrained
+@param max_height Box height, a value <= 0 leaves the height unconstrained
+@return Returns a factor >= 1 (1 when the image already fits inside the box)
+*/
+inline double
+CalculateFitReduction(const unsigned width, const unsigned height, const int max_width, const int max_height) {
+	double factor = 1;
+	if ((max_width > 0) && (width > (unsigned)max_width)) {
+		factor = MAX(factor, (double)width / (double)max_width);
+	}
+	if ((max_height > 0) && (height > (unsigned)max_height)) {
+		factor = MAX(factor, (double)height / (double)max_height);
+	}
+	return factor;
+}
+
+/**
+Compute the size of an image fitted inside a bounding box (images are never enlarged)
+@see CalculateFitReduction
+*/
+inline void
+CalculateFitSize(const unsigned width, const unsigned height, const int max_width, const int max_height, unsigned *fit_width, unsigned *fit_height) {
+	const double factor = CalculateFitReduction(width, height, max_width, max_height);
+	*fit_width = MAX(1U, (unsigned)(width / factor + 0.5));
+	*fit_height = MAX(1U, (unsigned)(height / factor + 0.5));
+}
+
+/**
+Compute the largest power of two reduction level (image sides divided by 2^level) 
+whose result still covers the size of the image fitted inside a bounding box
+@param max_level Highest level supported by the caller
+@see CalculateFitReduction
+*/
+inline unsigned
+CalculateFitReductionLevel(const unsigned width, const unsigned height, const int max_width, const int max_height, const unsigned max_level) {
+	const double factor = CalculateFitReduction(width, height, max_width, max_height);
+	unsigned level = 0;
+	while ((level < max_level) && ((double)(2U << level) <= factor)) {
+		level++;
+	}
+	return level;
+}
+
+/**
+Clip a region (right and bottom being exclusive, left <= right and top <= bottom) to the bounds of an image
+@return Returns FALSE if the region doesn't intersect the image
+*/
+inline BOOL
+ClipRegion(const unsigned width, const unsigned height, int *left, int *top, int *right, int *bottom) {
+	*left = MAX(*left, 0);
+	*top = MAX(*top, 0);
+	*right = MIN(*right, (int)width);
+	*bottom = MIN(*bottom, (int)height);
+	return ((*left < *right) && (*top < *bottom)) ? TRUE : FALSE;
+}
+
 // ----------------------------------------------------------
 
 /**
@@ -392,6 +440,26 @@ Rotate a dib according to Exif info
 */
 void RotateExif(FIBITMAP **dib);
 
+/**
+Allocate an image with the type, palette, transparency, background color, resolution, metadata and ICC profile 
+of another image (used to hold a region of this image)
+@see CopyPaste.cpp
+*/
+FIBITMAP* AllocateRegion(FIBITMAP *src, unsigned width, unsigned height);
+
+/**
+Copy a run of pixels between two scanlines (any bitdepth, 1- and 4-bit pixels need not be byte aligned)
+@see CopyPaste.cpp
+*/
+void CopyPixelRun(BYTE *dst, unsigned dst_x, const BYTE *src, unsigned src_x, unsigned count, unsigned bpp);
+
+/**
+Test hook: make the next count copy-on-write clones fail to share the metadata of their source, 
+so that they fall back to a copy of the metadata
+@see BitmapAccess.cpp
+*/
+void FreeImage_FailMetadataShares(unsigned count);
+
 
 // ==========================================================
 //   Big Endian / Little Endian utility functions
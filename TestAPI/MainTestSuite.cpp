@@ -65,6 +65,9 @@ int main(int argc, char *argv[]) {
 	// test plugins capabilities
 	showPlugins();
 
+	// test file type identification
+	testFileType();
+
 	// test the clone function
 	testAllocateCloneUnload("exif.jpg");
 
@@ -74,6 +77,39 @@ int main(int argc, char *argv[]) {
 	// test loading / saving / converting image types using the TIFF plugin
 	testImageTypeTIFF(width, height);
 
+	// test the bitmap memory pool
+	testBitmapPool(width, height);
+
+	// test copy-on-write clones
+	testCopyOnWriteClone(width, height);
+
+	// test copy-on-write clones used from several threads
+	testCopyOnWriteThreads(width, height);
+
+	// test multi-threaded rescaling
+	testRescaleThreads(width, height);
+
+	// test fixed-point rescaling against the double precision filter
+	testRescaleFixedPoint(width, height);
+
+	// test the rescale weights table cache
+	testRescaleCache(width, height);
+
+	// test tiled and multi-threaded TIFF saving
+	testSaveTIFFThreads(width, height);
+
+	// test multi-threaded PNG compression
+	testSavePNGThreads(width, height);
+
+	// test WebP encoder settings
+	testSaveWebPOptions(width, height);
+
+	// test animated WebP loading & saving
+	testWebPAnimation(width, height);
+
+	// test multi-threaded and reduced-resolution JPEG-2000 loading
+	testLoadJ2KThreads(width, height);
+
 	// test memory IO
 	testMemIO("sample.png");
 	testMemIO("exif.jxr");
@@ -99,9 +135,33 @@ int main(int argc, char *argv[]) {
 	// test Exif raw metadata loading & saving
 	testExifRaw();
 
+	// test metadata enumeration & cloning
+	testMetadataIteration(20000);
+
 	// test thumbnail functions
 	testThumbnail("exif.jpg", 0);
 
+	// test reduced-resolution loading
+	testLoadScaled(width, height);
+
+	// test scanline streaming
+	testScanlineReader(width, height);
+	testScanlineWriter(width, height);
+
+	// test region-of-interest loading
+	testLoadRegion(width, height);
+
+	// test random-access tile reading
+	testTileReader(width, height);
+
+	// test tiled TIFF pyramids
+	testTIFFPyramid(width, height);
+
+	// test GIF LZW encoding / decoding
+	testGIFCodec(width, height);
+	testGIFPlayback(width, height);
+	testGIFOptimize(width, height);
+
 	// test wrapped user buffer
 	testWrappedBuffer("exif.jpg", 0);
 
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if (defined(WIN32) || defined(__WIN32__))
 #if (defined(_DEBUG))
@@ -40,10 +41,14 @@
 // Some useful tools
 // ==========================================================
 FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale);
+BOOL isSameImage(FIBITMAP *dib1, FIBITMAP *dib2);
+FIBITMAP* saveLoadThreads(FREE_IMAGE_FORMAT fif, FIBITMAP *src, int flags, BOOL same_file);
+FIBITMAP* createScanlineImage(FREE_IMAGE_TYPE type, unsigned width, unsigned height, unsigned bpp);
 
 // Test plugins capabilities
 // ==========================================================
 void showPlugins();
+void testFileType();
 
 // Image types test suite
 // ==========================================================
@@ -52,6 +57,15 @@ BOOL testAllocateCloneUnloadType(FREE_IMAGE_TYPE image_type, unsigned width, uns
 void testImageType(unsigned width, unsigned height);
 void testImageTypeTIFF(unsigned width, unsigned height);
 
+// Bitmap allocator test suite
+// ==========================================================
+void testBitmapPool(unsigned width, unsigned height);
+
+// Copy-on-write test suite
+// ==========================================================
+void testCopyOnWriteClone(unsigned width, unsigned height);
+void testCopyOnWriteThreads(unsigned width, unsigned height);
+
 // Header loading test suite
 // ==========================================================
 void testHeaderOnly();
@@ -60,6 +74,10 @@ void testHeaderOnly();
 // ==========================================================
 void testExifRaw();
 
+// Metadata test suite
+// ==========================================================
+void testMetadataIteration(unsigned tag_count);
+
 // IO test suite
 // ==========================================================
 
@@ -72,6 +90,10 @@ void testMultiPage(const char *lpszPathName);
 void testStreamMultiPage(const char *lpszPathName);
 void testMultiPageMemory(const char *lpszPathName);
 
+// JPEG-2000 test suite
+// ==========================================================
+void testLoadJ2KThreads(unsigned width, unsigned height);
+
 // JPEG test suite
 // ==========================================================
 
@@ -86,6 +108,43 @@ void testImageChannels(unsigned width, unsigned height);
 // Thumbnails test suite
 // ==========================================================
 void testThumbnail(const char *lpszPathName, int flags);
+void testLoadScaled(unsigned width, unsigned height);
+
+// Rescale test suite
+// ==========================================================
+void testRescaleThreads(unsigned width, unsigned height);
+void testRescaleFixedPoint(unsigned width, unsigned height);
+void testRescaleCache(unsigned width, unsigned height);
+
+// Scanline streaming test suite
+// ==========================================================
+void testScanlineReader(unsigned width, unsigned height);
+void testScanlineWriter(unsigned width, unsigned height);
+
+// Region-of-interest loading test suite
+// ==========================================================
+void testLoadRegion(unsigned width, unsigned height);
+
+// GIF codec test suite
+// ==========================================================
+void testGIFCodec(unsigned width, unsigned height);
+void testGIFPlayback(unsigned width, unsigned height);
+void testGIFOptimize(unsigned width, unsigned height);
+
+// PNG test suite
+// ==========================================================
+void testSavePNGThreads(unsigned width, unsigned height);
+
+// TIFF test suite
+// ==========================================================
+void testSaveTIFFThreads(unsigned width, unsigned height);
+void testTileReader(unsigned width, unsigned height);
+void testTIFFPyramid(unsigned width, unsigned height);
+
+// WebP test suite
+// ==========================================================
+void testSaveWebPOptions(unsigned width, unsigned height);
+void testWebPAnimation(unsigned width, unsigned height);
 
 // Wrapped buffer test suite
 // ==========================================================
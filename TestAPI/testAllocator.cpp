@@ -0,0 +1,102 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+static int s_counted_blocks = 0;
+
+static void * DLL_CALLCONV countingAllocateProc(size_t size, size_t alignment) {
+#ifdef _WIN32
+	void *mem = _aligned_malloc(size, alignment);
+#else
+	void *mem = NULL;
+	if(posix_memalign(&mem, alignment, size) != 0) {
+		mem = NULL;
+	}
+#endif
+	if(mem) {
+		s_counted_blocks++;
+	}
+	return mem;
+}
+
+static void DLL_CALLCONV countingFreeProc(void *mem) {
+	s_counted_blocks--;
+#ifdef _WIN32
+	_aligned_free(mem);
+#else
+	free(mem);
+#endif
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testBitmapPool(unsigned width, unsigned height) {
+	FIPOOLSTATS stats;
+
+	printf("testBitmapPool (%d x %d) ...\n", width, height);
+
+	// the allocator can only be changed while no image is allocated
+	assert(FreeImage_SetAllocator(countingAllocateProc, countingFreeProc));
+	FIBITMAP *counted = FreeImage_Allocate(width, height, 8);
+	assert(counted && (s_counted_blocks == 1));
+	assert(!FreeImage_SetAllocator(NULL, NULL));
+	FreeImage_Unload(counted);
+	assert(s_counted_blocks == 0);
+	assert(FreeImage_SetAllocator(NULL, NULL));
+
+	// enable the pool
+	FreeImage_SetBitmapPoolSize(64 * 1024 * 1024);
+
+	// first allocation always goes to the allocator
+	FIBITMAP *dib = FreeImage_Allocate(width, height, 24);
+	assert(dib);
+	FreeImage_Unload(dib);
+
+	FreeImage_GetBitmapPoolStats(&stats);
+	assert(stats.blocks_retained == 1);
+	assert(stats.bytes_retained > 0);
+	const UINT64 hits = stats.hits;
+
+	// same dimensions : the block must be recycled
+	dib = FreeImage_Allocate(width, height, 24);
+	assert(dib);
+	FreeImage_GetBitmapPoolStats(&stats);
+	assert(stats.hits == hits + 1);
+	assert(stats.blocks_retained == 0);
+
+	// recycled pixels must be cleared
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < FreeImage_GetLine(dib); x++) {
+			assert(bits[x] == 0);
+		}
+	}
+	FreeImage_Unload(dib);
+
+	// disable the pool : all retained blocks are released
+	FreeImage_SetBitmapPoolSize(0);
+	FreeImage_GetBitmapPoolStats(&stats);
+	assert(stats.blocks_retained == 0);
+	assert(stats.bytes_retained == 0);
+}
@@ -0,0 +1,167 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+#include <thread>
+#include <vector>
+
+// test hook of the library (see Utilities.h)
+void FreeImage_FailMetadataShares(unsigned count);
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testCopyOnWriteClone(unsigned width, unsigned height) {
+	printf("testCopyOnWriteClone (%d x %d) ...\n", width, height);
+
+	FreeImage_SetCopyOnWrite(TRUE);
+
+	FIBITMAP *src = FreeImage_Allocate(width, height, 8);
+	assert(src);
+	memset(FreeImage_GetScanLine(src, 0), 0x55, FreeImage_GetLine(src));
+	assert(FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, src, "Comment", "copy-on-write"));
+
+	FIBITMAP *clone = FreeImage_Clone(src);
+	assert(clone);
+	assert(FreeImage_GetPitch(clone) == FreeImage_GetPitch(src));
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone) == 1);
+
+	// writing to the clone must not change the source image
+	BYTE *bits = FreeImage_GetScanLine(clone, 0);
+	assert(bits[0] == 0x55);
+	memset(bits, 0xAA, FreeImage_GetLine(clone));
+	assert(FreeImage_GetScanLine(src, 0)[0] == 0x55);
+	assert(FreeImage_GetScanLine(clone, 0)[0] == 0xAA);
+
+	// writing to the source must not change a second clone
+	FIBITMAP *clone2 = FreeImage_Clone(src);
+	assert(clone2);
+	memset(FreeImage_GetScanLine(src, 0), 0x33, FreeImage_GetLine(src));
+	assert(FreeImage_GetScanLine(clone2, 0)[0] == 0x55);
+
+	// metadata changes are private to each image
+	assert(FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, clone, "Title", "clone"));
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone) == 2);
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, src) == 1);
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone2) == 1);
+
+	// the metadata can't be shared: the clone gets a copy of the source metadata
+	FreeImage_FailMetadataShares(1);
+	FIBITMAP *clone3 = FreeImage_Clone(clone);
+	FreeImage_FailMetadataShares(0);
+	assert(clone3);
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone3) == 2);
+	assert(FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, clone3, "Title", "clone3"));
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone3) == 2);
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, clone) == 2);
+	FreeImage_Unload(clone3);
+
+	// any unload order is valid
+	FreeImage_Unload(src);
+	assert(FreeImage_GetScanLine(clone2, 0)[0] == 0x55);
+	FreeImage_Unload(clone2);
+	FreeImage_Unload(clone);
+
+	FreeImage_SetCopyOnWrite(FALSE);
+}
+
+void testCopyOnWriteThreads(unsigned width, unsigned height) {
+	printf("testCopyOnWriteThreads (%d x %d) ...\n", width, height);
+
+	const unsigned thread_count = 4;
+
+	FreeImage_SetCopyOnWrite(TRUE);
+
+	FIBITMAP *zone = createZonePlateImage(width, height, 128);
+	FIBITMAP *src = FreeImage_ConvertTo24Bits(zone);
+	assert(zone && src);
+	const unsigned line = FreeImage_GetLine(src);
+
+	// several threads cloning the same source, then reading and writing their clone
+	std::vector<std::thread> threads;
+	std::vector<int> errors(thread_count, 0);
+	for(unsigned t = 0; t < thread_count; t++) {
+		threads.push_back(std::thread([src, line, height, &errors, t]() {
+			for(int i = 0; i < 20; i++) {
+				FIBITMAP *clone = FreeImage_Clone(src);
+				if(!clone) {
+					errors[t]++;
+					continue;
+				}
+				RGBQUAD color, src_color;
+				FreeImage_GetPixelColor(clone, 1, height / 2, &color);
+				FreeImage_GetPixelColor(src, 1, height / 2, &src_color);
+				if(memcmp(&color, &src_color, 3) != 0) {
+					errors[t]++;
+				}
+				BYTE *bits = FreeImage_GetScanLine(clone, 0);
+				memset(bits, t, line);
+				FreeImage_Unload(clone);
+			}
+		}));
+	}
+	for(unsigned t = 0; t < thread_count; t++) {
+		threads[t].join();
+		assert(errors[t] == 0);
+	}
+	threads.clear();
+
+	// several threads asking for write access to the same shared clone: 
+	// the pixels are copied once and every thread gets the same copy
+	FIBITMAP *clone = FreeImage_Clone(src);
+	assert(clone);
+	std::vector<BYTE*> bits(thread_count, (BYTE*)NULL);
+	for(unsigned t = 0; t < thread_count; t++) {
+		threads.push_back(std::thread([clone, &bits, t]() {
+			bits[t] = FreeImage_GetBits(clone);
+		}));
+	}
+	for(unsigned t = 0; t < thread_count; t++) {
+		threads[t].join();
+		assert(bits[t] && (bits[t] == bits[0]));
+	}
+	threads.clear();
+	assert(bits[0] != FreeImage_GetBits(src));
+	for(unsigned y = 0; y < height; y++) {
+		assert(memcmp(FreeImage_GetScanLine(clone, y), FreeImage_GetScanLine(src, y), line) == 0);
+	}
+
+	// multi-threaded rescaling of a shared clone does not copy the source pixels
+	FIBITMAP *clone2 = FreeImage_Clone(src);
+	assert(clone2);
+	const unsigned clone_size = FreeImage_GetMemorySize(clone2);
+	assert(clone_size < line * height);
+	const int pool_threads = FreeImage_GetThreadCount();
+	FreeImage_SetThreadCount(thread_count);
+	FIBITMAP *rescaled = FreeImage_Rescale(clone2, width / 2, height / 2, FILTER_BICUBIC);
+	assert(rescaled);
+	FreeImage_SetThreadCount(pool_threads);
+	FreeImage_Unload(rescaled);
+	assert(FreeImage_GetMemorySize(clone2) == clone_size);
+	assert(FreeImage_GetMemorySize(clone) > line * height);
+
+	FreeImage_Unload(src);
+	FreeImage_Unload(zone);
+	assert(memcmp(FreeImage_GetScanLine(clone2, 0), FreeImage_GetScanLine(clone, 0), line) == 0);
+	FreeImage_Unload(clone2);
+	FreeImage_Unload(clone);
+
+	FreeImage_SetCopyOnWrite(FALSE);
+}
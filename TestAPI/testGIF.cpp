@@ -0,0 +1,401 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Compare the palette indices of two palettized images
+*/
+static BOOL isSameIndices(FIBITMAP *dib1, FIBITMAP *dib2) {
+	const unsigned width = FreeImage_GetWidth(dib1);
+	const unsigned height = FreeImage_GetHeight(dib1);
+	if((width != FreeImage_GetWidth(dib2)) || (height != FreeImage_GetHeight(dib2))) {
+		return FALSE;
+	}
+	for(unsigned y = 0; y < height; y++) {
+		for(unsigned x = 0; x < width; x++) {
+			BYTE i1 = 0, i2 = 0;
+			FreeImage_GetPixelIndex(dib1, x, y, &i1);
+			FreeImage_GetPixelIndex(dib2, x, y, &i2);
+			if(i1 != i2) {
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+Save an image as GIF to memory, load it back and compare the indices
+*/
+static BOOL testGIFRoundTrip(FIBITMAP *dib, int save_flags) {
+	BOOL bResult = FALSE;
+
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	if(FreeImage_SaveToMemory(FIF_GIF, dib, hmem, save_flags)) {
+		FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+		FIBITMAP *check = FreeImage_LoadFromMemory(FIF_GIF, hmem, 0);
+		if(check) {
+			bResult = isSameIndices(dib, check);
+			FreeImage_Unload(check);
+		}
+	}
+	FreeImage_CloseMemory(hmem);
+
+	return bResult;
+}
+
+/**
+Create a palettized image filled with pseudo-random indices.
+Such an image fills the LZW string table quickly and forces clear codes.
+*/
+static FIBITMAP* createNoiseImage(unsigned width, unsigned height, unsigned bpp) {
+	FIBITMAP *dib = FreeImage_Allocate(width, height, bpp);
+	if(dib) {
+		const unsigned ncolors = FreeImage_GetColorsUsed(dib);
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+		for(unsigned i = 0; i < ncolors; i++) {
+			pal[i].rgbRed = pal[i].rgbGreen = pal[i].rgbBlue = (BYTE)(i * 255 / (ncolors - 1));
+		}
+		unsigned seed = 12345;
+		for(unsigned y = 0; y < height; y++) {
+			for(unsigned x = 0; x < width; x++) {
+				seed = seed * 1103515245 + 12345;
+				BYTE index = (BYTE)((seed >> 16) % ncolors);
+				FreeImage_SetPixelIndex(dib, x, y, &index);
+			}
+		}
+	}
+	return dib;
+}
+
+/**
+Set a single value FIMD_ANIMATION tag
+*/
+static void setAnimationTag(FIBITMAP *dib, const char *key, FREE_IMAGE_MDTYPE type, DWORD length, const void *value) {
+	FITAG *tag = FreeImage_CreateTag();
+	if(tag) {
+		FreeImage_SetTagKey(tag, key);
+		FreeImage_SetTagType(tag, type);
+		FreeImage_SetTagCount(tag, 1);
+		FreeImage_SetTagLength(tag, length);
+		FreeImage_SetTagValue(tag, value);
+		FreeImage_SetMetadata(FIMD_ANIMATION, dib, key, tag);
+		FreeImage_DeleteTag(tag);
+	}
+}
+
+/**
+Build an animation of partial, partly transparent frames using every disposal method
+*/
+static BOOL buildPlaybackGIF(const char *lpszPathName, unsigned width, unsigned height, unsigned frame_count) {
+	FIMULTIBITMAP *out = FreeImage_OpenMultiBitmap(FIF_GIF, lpszPathName, TRUE, FALSE, FALSE);
+	if(!out) {
+		return FALSE;
+	}
+	for(unsigned i = 0; i < frame_count; i++) {
+		// the first frame covers the logical screen
+		const unsigned w = (i == 0) ? width : width / 2 - (i % 5) * 4;
+		const unsigned h = (i == 0) ? height : height / 3 + (i % 3) * 8;
+		WORD left = (WORD)((i * 7) % (width - w + 1));
+		WORD top = (WORD)((i * 13) % (height - h + 1));
+		BYTE disposal = (BYTE)(i % 4);
+
+		FIBITMAP *frame = createNoiseImage(w, h, 8);
+		if(!frame) {
+			FreeImage_CloseMultiBitmap(out, 0);
+			return FALSE;
+		}
+		// give each frame its own colors
+		RGBQUAD *pal = FreeImage_GetPalette(frame);
+		for(unsigned k = 0; k < 256; k++) {
+			pal[k].rgbRed = (BYTE)(k + i * 40);
+			pal[k].rgbBlue = (BYTE)(255 - k);
+		}
+		if(i % 3 != 2) {
+			FreeImage_SetTransparentIndex(frame, 0);
+		}
+		setAnimationTag(frame, "FrameLeft", FIDT_SHORT, 2, &left);
+		setAnimationTag(frame, "FrameTop", FIDT_SHORT, 2, &top);
+		setAnimationTag(frame, "DisposalMethod", FIDT_BYTE, 1, &disposal);
+		FreeImage_AppendPage(out, frame);
+		FreeImage_Unload(frame);
+	}
+	return FreeImage_CloseMultiBitmap(out, 0);
+}
+
+/**
+Compare two 32-bit composited frames
+*/
+static BOOL isSameCanvas(FIBITMAP *dib1, FIBITMAP *dib2) {
+	const unsigned width = FreeImage_GetWidth(dib1);
+	const unsigned height = FreeImage_GetHeight(dib1);
+	if((FreeImage_GetBPP(dib1) != 32) || (FreeImage_GetBPP(dib2) != 32) || (width != FreeImage_GetWidth(dib2)) || (height != FreeImage_GetHeight(dib2))) {
+		return FALSE;
+	}
+	for(unsigned y = 0; y < height; y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), width * 4) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Compare a composited 32-bit frame with the colors of a palettized page
+*/
+static BOOL isSameColors(FIBITMAP *canvas, FIBITMAP *dib) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	if((FreeImage_GetBPP(canvas) != 32) || (width != FreeImage_GetWidth(canvas)) || (height != FreeImage_GetHeight(canvas))) {
+		return FALSE;
+	}
+	RGBQUAD *pal = FreeImage_GetPalette(dib);
+	for(unsigned y = 0; y < height; y++) {
+		RGBQUAD *pixel = (RGBQUAD*)FreeImage_GetScanLine(canvas, y);
+		for(unsigned x = 0; x < width; x++) {
+			BYTE index = 0;
+			FreeImage_GetPixelIndex(dib, x, y, &index);
+			if((pixel[x].rgbRed != pal[index].rgbRed) || (pixel[x].rgbGreen != pal[index].rgbGreen) || (pixel[x].rgbBlue != pal[index].rgbBlue)) {
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+Save pages as a multipage GIF and return the file size
+*/
+static long saveAnimation(const char *lpszPathName, FIBITMAP **pages, unsigned page_count, int flags) {
+	FIMULTIBITMAP *out = FreeImage_OpenMultiBitmap(FIF_GIF, lpszPathName, TRUE, FALSE, TRUE);
+	if(!out) {
+		return 0;
+	}
+	for(unsigned i = 0; i < page_count; i++) {
+		FreeImage_AppendPage(out, pages[i]);
+	}
+	if(!FreeImage_CloseMultiBitmap(out, flags)) {
+		return 0;
+	}
+	struct stat buf;
+	return (stat(lpszPathName, &buf) == 0) ? (long)buf.st_size : 0;
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testGIFCodec(unsigned width, unsigned height) {
+	printf("testGIFCodec (%u x %u) ...\n", width, height);
+
+	// smooth content : long strings, few clear codes
+	FIBITMAP *dib8 = createZonePlateImage(width, height, 128);
+	assert(dib8 != NULL);
+	assert(testGIFRoundTrip(dib8, 0));
+	assert(testGIFRoundTrip(dib8, GIF_DEFAULT));
+
+	FIBITMAP *dib4 = FreeImage_ConvertTo4Bits(dib8);
+	assert(dib4 != NULL);
+	assert(testGIFRoundTrip(dib4, 0));
+	FreeImage_Unload(dib4);
+
+	FIBITMAP *dib1 = FreeImage_Threshold(dib8, 128);
+	assert(dib1 != NULL);
+	assert(testGIFRoundTrip(dib1, 0));
+	FreeImage_Unload(dib1);
+
+	FreeImage_Unload(dib8);
+
+	// noisy content : short strings, frequent clear codes
+	const unsigned bpps[] = { 1, 4, 8 };
+	for(unsigned i = 0; i < sizeof(bpps) / sizeof(bpps[0]); i++) {
+		FIBITMAP *noise = createNoiseImage(width, height, bpps[i]);
+		assert(noise != NULL);
+		assert(testGIFRoundTrip(noise, 0));
+		FreeImage_Unload(noise);
+	}
+
+	// degenerate sizes
+	FIBITMAP *tiny = createNoiseImage(1, 1, 8);
+	assert(testGIFRoundTrip(tiny, 0));
+	FreeImage_Unload(tiny);
+	FIBITMAP *line = createNoiseImage(width * 8, 1, 8);
+	assert(testGIFRoundTrip(line, 0));
+	FreeImage_Unload(line);
+
+	// corrupted streams : a LZW minimum code size above 11 is rejected
+	for(BYTE code_size = 11; code_size <= 13; code_size++) {
+		BYTE gif[] = {
+			'G', 'I', 'F', '8', '9', 'a', 1, 0, 1, 0, 0x80, 0, 0,	// header, 2 colors global palette
+			0, 0, 0, 255, 255, 255,									// palette
+			0x2C, 0, 0, 0, 0, 1, 0, 1, 0, 0,						// image descriptor
+			code_size, 2, 0xFF, 0xFF, 0,							// image data
+			0x3B													// trailer
+		};
+		FIMEMORY *hmem = FreeImage_OpenMemory(gif, sizeof(gif));
+		FIBITMAP *check = FreeImage_LoadFromMemory(FIF_GIF, hmem, 0);
+		assert((code_size <= 11) == (check != NULL));
+		FreeImage_Unload(check);
+		FreeImage_CloseMemory(hmem);
+	}
+}
+
+void testGIFOptimize(unsigned width, unsigned height) {
+	const unsigned page_count = 12;
+	FIBITMAP *pages[page_count];
+
+	printf("testGIFOptimize (%u x %u) ...\n", width, height);
+
+	// a screen recording : small changes over a still background
+	pages[0] = createZonePlateImage(width, height, 128);
+	assert(pages[0] != NULL);
+	for(unsigned i = 1; i < 10; i++) {
+		pages[i] = FreeImage_Clone(pages[i - 1]);
+		assert(pages[i] != NULL);
+		FreeImage_SetTransparencyTable(pages[i], NULL, 0);
+		if(i == 4) {
+			// unchanged page
+			continue;
+		}
+		if(i == 6) {
+			// same colors through another palette : only the changed pixels must be written
+			RGBQUAD *pal = FreeImage_GetPalette(pages[i]);
+			for(unsigned k = 0; k < 256; k++) {
+				pal[k].rgbRed = pal[k].rgbGreen = pal[k].rgbBlue = (BYTE)(255 - k);
+			}
+			FreeImage_Invert(pages[i]);
+		}
+		if(i == 8) {
+			// a page with transparency is written as is
+			FreeImage_SetTransparentIndex(pages[i], 0);
+		}
+		const unsigned x0 = (i * 37) % (width / 2), y0 = (i * 53) % (height / 2);
+		for(unsigned y = y0; y < y0 + height / 8; y++) {
+			BYTE *bits = FreeImage_GetScanLine(pages[i], y);
+			for(unsigned x = x0; x < x0 + width / 6; x++) {
+				bits[x] = (BYTE)(x * y + i);
+			}
+		}
+	}
+	// a partial frame drawn after a full screen page cleared to the background color
+	pages[10] = createNoiseImage(width / 4, height / 4, 8);
+	assert(pages[10] != NULL);
+	const WORD left = (WORD)(width / 3), top = (WORD)(height / 5);
+	setAnimationTag(pages[10], "FrameLeft", FIDT_SHORT, 2, &left);
+	setAnimationTag(pages[10], "FrameTop", FIDT_SHORT, 2, &top);
+	pages[11] = FreeImage_Clone(pages[9]);
+	assert(pages[11] != NULL);
+	memset(FreeImage_GetScanLine(pages[11], height / 2), 0, width / 3);
+
+	const long full_size = saveAnimation("optimize_full.gif", pages, page_count, GIF_DEFAULT);
+	const long optimized_size = saveAnimation("optimize.gif", pages, page_count, GIF_OPTIMIZE);
+	assert(full_size > 0);
+	assert(optimized_size > 0);
+	assert(optimized_size < full_size / 2);
+
+	// playback must give the original pages (page 8 is transparent and page 10 is a partial frame), 
+	// and the same screens as the plain save
+	FIMULTIBITMAP *src = FreeImage_OpenMultiBitmap(FIF_GIF, "optimize.gif", FALSE, TRUE, FALSE, GIF_PLAYBACK);
+	FIMULTIBITMAP *ref = FreeImage_OpenMultiBitmap(FIF_GIF, "optimize_full.gif", FALSE, TRUE, FALSE, GIF_PLAYBACK);
+	assert((src != NULL) && (ref != NULL));
+	assert(FreeImage_GetPageCount(src) == (int)page_count);
+	for(unsigned i = 0; i < page_count; i++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		FIBITMAP *check = FreeImage_LockPage(ref, i);
+		assert((dib != NULL) && (check != NULL));
+		if((i != 8) && (i != 10)) {
+			assert(isSameColors(dib, pages[i]));
+		}
+		assert(isSameCanvas(dib, check));
+		FreeImage_UnlockPage(ref, check, FALSE);
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(ref, 0);
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// a single page is written by FreeImage_Save itself : a write error is reported
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(FIF_GIF, pages[0], hmem, GIF_OPTIMIZE));
+	BYTE *data = NULL;
+	DWORD size_in_bytes = 0;
+	assert(FreeImage_AcquireMemory(hmem, &data, &size_in_bytes));
+	BYTE *buffer = (BYTE*)malloc(size_in_bytes);
+	assert(buffer != NULL);
+	FIMEMORY *hfixed = FreeImage_OpenMemoryBuffer(buffer, size_in_bytes);
+	assert(FreeImage_SaveToMemory(FIF_GIF, pages[0], hfixed, GIF_OPTIMIZE));
+	assert(memcmp(buffer, data, size_in_bytes) == 0);
+	FreeImage_CloseMemory(hfixed);
+	hfixed = FreeImage_OpenMemoryBuffer(buffer, size_in_bytes / 2);
+	assert(!FreeImage_SaveToMemory(FIF_GIF, pages[0], hfixed, GIF_OPTIMIZE));
+	FreeImage_CloseMemory(hfixed);
+	free(buffer);
+	FreeImage_CloseMemory(hmem);
+
+	for(unsigned i = 0; i < page_count; i++) {
+		FreeImage_Unload(pages[i]);
+	}
+}
+
+void testGIFPlayback(unsigned width, unsigned height) {
+	const char *lpszPathName = "playback.gif";
+	const unsigned frame_count = 24;
+
+	printf("testGIFPlayback (%u x %u) ...\n", width / 4, height / 4);
+
+	assert(buildPlaybackGIF(lpszPathName, width / 4, height / 4, frame_count));
+
+	// sequential access : each page is composited on the canvas kept from the previous one
+	FIBITMAP *frames[frame_count];
+	FIMULTIBITMAP *src = FreeImage_OpenMultiBitmap(FIF_GIF, lpszPathName, FALSE, TRUE, FALSE, GIF_PLAYBACK);
+	assert(src != NULL);
+	assert(FreeImage_GetPageCount(src) == (int)frame_count);
+	for(unsigned i = 0; i < frame_count; i++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib != NULL);
+		frames[i] = FreeImage_Clone(dib);
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// backward access : each page is replayed from the start of the animation
+	src = FreeImage_OpenMultiBitmap(FIF_GIF, lpszPathName, FALSE, TRUE, FALSE, GIF_PLAYBACK);
+	assert(src != NULL);
+	for(int i = frame_count - 1; i >= 0; i--) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib != NULL);
+		assert(isSameCanvas(dib, frames[i]));
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+
+	// forward jumps : the kept canvas is only partly reused
+	for(unsigned i = 1; i < frame_count; i += 3) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib != NULL);
+		assert(isSameCanvas(dib, frames[i]));
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	for(unsigned i = 0; i < frame_count; i++) {
+		FreeImage_Unload(frames[i]);
+	}
+}
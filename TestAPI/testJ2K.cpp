@@ -0,0 +1,154 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+void FreeImageErrorHandler(FREE_IMAGE_FORMAT fif, const char *message);
+
+// Local test functions
+// ----------------------------------------------------------
+
+static unsigned s_message_count = 0;
+
+/**
+Count the messages of the library instead of printing them
+*/
+static void CountMessageHandler(FREE_IMAGE_FORMAT fif, const char *message) {
+	s_message_count++;
+}
+
+/**
+Load a JPEG-2000 stream with one thread and with four threads, check that both decodings are the same
+*/
+static FIBITMAP* loadJ2KThreads(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int flags) {
+	FreeImage_SetThreadCount(1);
+	FreeImage_SeekMemory(stream, 0L, SEEK_SET);
+	FIBITMAP *serial = FreeImage_LoadFromMemory(fif, stream, flags);
+
+	FreeImage_SetThreadCount(4);
+	FreeImage_SeekMemory(stream, 0L, SEEK_SET);
+	FIBITMAP *parallel = FreeImage_LoadFromMemory(fif, stream, flags);
+
+	assert(serial && parallel);
+	assert(isSameImage(serial, parallel));
+	FreeImage_Unload(parallel);
+
+	return serial;
+}
+
+/**
+Load a truncated JPEG-2000 stream with one thread and with four threads,
+check that both loads give the same result and report the same number of messages
+*/
+static void loadTruncatedJ2KThreads(FREE_IMAGE_FORMAT fif, BYTE *data, DWORD size) {
+	FIBITMAP *dib[2] = { NULL, NULL };
+	unsigned message_count[2] = { 0, 0 };
+
+	FreeImage_SetOutputMessage(CountMessageHandler);
+	for(int i = 0; i < 2; i++) {
+		FreeImage_SetThreadCount(i ? 4 : 1);
+		s_message_count = 0;
+		FIMEMORY *stream = FreeImage_OpenMemory(data, size);
+		dib[i] = FreeImage_LoadFromMemory(fif, stream, J2K_DEFAULT);
+		FreeImage_CloseMemory(stream);
+		message_count[i] = s_message_count;
+	}
+	FreeImage_SetOutputMessage(FreeImageErrorHandler);
+
+	// errors of the band decoders are not reported when the serial fallback decodes the stream
+	assert(message_count[0] == message_count[1]);
+	assert((dib[0] != NULL) == (dib[1] != NULL));
+	if(dib[0] && dib[1]) {
+		assert(isSameImage(dib[0], dib[1]));
+	}
+	FreeImage_Unload(dib[0]);
+	FreeImage_Unload(dib[1]);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testLoadJ2KThreads(unsigned width, unsigned height) {
+	printf("testLoadJ2KThreads (%d x %d) ...\n", width, height);
+
+	const int thread_count = FreeImage_GetThreadCount();
+
+	// odd sizes: partial tiles on the right and bottom edges
+	FIBITMAP *zone = createZonePlateImage(width + 3, height + 5, 128);
+	assert(zone);
+	width = FreeImage_GetWidth(zone);
+	height = FreeImage_GetHeight(zone);
+
+	FIBITMAP *images[] = {
+		FreeImage_Clone(zone),
+		FreeImage_ConvertTo24Bits(zone),
+		FreeImage_ConvertTo32Bits(zone),
+		FreeImage_ConvertToType(zone, FIT_RGB16)
+	};
+	const FREE_IMAGE_FORMAT formats[] = { FIF_J2K, FIF_JP2 };
+
+	for(size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+			assert(images[i]);
+			FIMEMORY *stream = FreeImage_OpenMemory();
+			assert(FreeImage_SaveToMemory(formats[f], images[i], stream, J2K_TILESIZE(96)));
+
+			FIBITMAP *full = loadJ2KThreads(formats[f], stream, J2K_DEFAULT);
+			assert((FreeImage_GetWidth(full) == width) && (FreeImage_GetHeight(full) == height));
+
+			// discarded resolution levels
+			for(unsigned level = 1; level <= 3; level++) {
+				FIBITMAP *reduced = loadJ2KThreads(formats[f], stream, J2K_REDUCE(level));
+				assert(FreeImage_GetWidth(reduced) == (width + (1 << level) - 1) >> level);
+				assert(FreeImage_GetHeight(reduced) == (height + (1 << level) - 1) >> level);
+				FreeImage_Unload(reduced);
+			}
+
+			// the header gives the reduced size
+			FreeImage_SeekMemory(stream, 0L, SEEK_SET);
+			FIBITMAP *header = FreeImage_LoadFromMemory(formats[f], stream, FIF_LOAD_NOPIXELS | J2K_REDUCE(2));
+			assert(header && !FreeImage_HasPixels(header));
+			assert(FreeImage_GetWidth(header) == (width + 3) / 4);
+			FreeImage_Unload(header);
+
+			// the stream has a single quality layer
+			FIBITMAP *layers = loadJ2KThreads(formats[f], stream, J2K_LAYERS(1));
+			assert(isSameImage(layers, full));
+			FreeImage_Unload(layers);
+
+			// truncated streams
+			BYTE *data = NULL;
+			DWORD size = 0;
+			assert(FreeImage_AcquireMemory(stream, &data, &size));
+			for(DWORD cut = size / 4; cut < size; cut += size / 16) {
+				loadTruncatedJ2KThreads(formats[f], data, cut);
+			}
+
+			FreeImage_Unload(full);
+			FreeImage_CloseMemory(stream);
+		}
+	}
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		FreeImage_Unload(images[i]);
+	}
+	FreeImage_Unload(zone);
+
+	FreeImage_SetThreadCount(thread_count);
+}
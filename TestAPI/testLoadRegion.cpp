@@ -0,0 +1,149 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Save an image to memory, then check that region loading returns the crop of the regular loader
+*/
+static void checkLoadRegion(FIBITMAP *dib, FREE_IMAGE_FORMAT fif, int save_flags, int load_flags) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(fif, dib, hmem, save_flags));
+
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FIBITMAP *check = FreeImage_LoadFromMemory(fif, hmem, load_flags);
+	assert(check != NULL);
+
+	const int width = (int)FreeImage_GetWidth(check);
+	const int height = (int)FreeImage_GetHeight(check);
+
+	// inner regions (odd bounds, full rows), regions crossing the image bounds, reversed corners
+	const int regions[][4] = {
+		{ 13, 17, width / 2 + 7, height / 3 + 5 },
+		{ 0, height / 4, width, height / 2 },
+		{ width / 3, 0, width / 3 + 1, height },
+		{ width - 29, height - 31, width + 50, height + 50 },
+		{ -10, -20, 21, 9 },
+		{ width - 3, 40, 5, 11 },
+	};
+
+	for(size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+		int left = regions[i][0], top = regions[i][1], right = regions[i][2], bottom = regions[i][3];
+
+		FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+		FIBITMAP *region = FreeImage_LoadRegionFromMemory(fif, hmem, left, top, right, bottom, load_flags);
+		assert(region != NULL);
+
+		// expected result
+		if(right < left) {
+			const int tmp = left; left = right; right = tmp;
+		}
+		if(bottom < top) {
+			const int tmp = top; top = bottom; bottom = tmp;
+		}
+		left = (left < 0) ? 0 : left;
+		top = (top < 0) ? 0 : top;
+		right = (right > width) ? width : right;
+		bottom = (bottom > height) ? height : bottom;
+
+		FIBITMAP *crop = FreeImage_Copy(check, left, top, right, bottom);
+		assert(crop != NULL);
+
+		assert(FreeImage_GetImageType(region) == FreeImage_GetImageType(crop));
+		assert(FreeImage_GetWidth(region) == FreeImage_GetWidth(crop));
+		assert(FreeImage_GetHeight(region) == FreeImage_GetHeight(crop));
+		assert(FreeImage_GetBPP(region) == FreeImage_GetBPP(crop));
+		assert(FreeImage_GetColorsUsed(region) == FreeImage_GetColorsUsed(crop));
+		if(FreeImage_GetColorsUsed(crop)) {
+			assert(memcmp(FreeImage_GetPalette(region), FreeImage_GetPalette(crop), FreeImage_GetColorsUsed(crop) * sizeof(RGBQUAD)) == 0);
+		}
+		for(unsigned y = 0; y < FreeImage_GetHeight(crop); y++) {
+			assert(memcmp(FreeImage_GetScanLine(region, y), FreeImage_GetScanLine(crop, y), FreeImage_GetLine(crop)) == 0);
+		}
+
+		FreeImage_Unload(crop);
+		FreeImage_Unload(region);
+	}
+
+	// a region outside of the image
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	assert(FreeImage_LoadRegionFromMemory(fif, hmem, width, 0, width + 10, 10, load_flags) == NULL);
+
+	FreeImage_Unload(check);
+	FreeImage_CloseMemory(hmem);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testLoadRegion(unsigned width, unsigned height) {
+	printf("testLoadRegion ...\n");
+
+	// odd sizes: partial last strip, partial last tile
+	width += 3;
+	height += 5;
+
+	FIBITMAP *dib1 = createScanlineImage(FIT_BITMAP, width, height, 1);
+	FIBITMAP *dib8 = createScanlineImage(FIT_BITMAP, width, height, 8);
+	FIBITMAP *dib24 = createScanlineImage(FIT_BITMAP, width, height, 24);
+	FIBITMAP *dib32 = createScanlineImage(FIT_BITMAP, width, height, 32);
+	FIBITMAP *dibf = createScanlineImage(FIT_RGBF, width, height, 0);
+
+	// TIFF: strips intersecting the region
+	checkLoadRegion(dib1, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT);
+	checkLoadRegion(dib8, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT);
+	checkLoadRegion(dib24, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT);
+	checkLoadRegion(dib32, FIF_TIFF, TIFF_NONE, TIFF_DEFAULT);
+	checkLoadRegion(dibf, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT);
+	// TIFF: tiles intersecting the region
+	checkLoadRegion(dib1, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(32), TIFF_DEFAULT);
+	checkLoadRegion(dib8, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(48), TIFF_DEFAULT);
+	checkLoadRegion(dib24, FIF_TIFF, TIFF_TILED, TIFF_DEFAULT);
+	checkLoadRegion(dib32, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(64), TIFF_DEFAULT);
+	checkLoadRegion(dibf, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(16), TIFF_DEFAULT);
+
+	// JPEG-2000: tiles intersecting the region
+	checkLoadRegion(dib24, FIF_J2K, J2K_DEFAULT, J2K_DEFAULT);
+	checkLoadRegion(dib32, FIF_JP2, JP2_DEFAULT, JP2_DEFAULT);
+
+	// OpenEXR: rows intersecting the region
+	checkLoadRegion(dibf, FIF_EXR, EXR_DEFAULT, EXR_DEFAULT);
+	checkLoadRegion(dibf, FIF_EXR, EXR_FLOAT | EXR_NONE, EXR_DEFAULT);
+
+	// formats with a scanline decoder stop decoding after the region
+	checkLoadRegion(dib24, FIF_JPEG, JPEG_DEFAULT, JPEG_DEFAULT);
+	checkLoadRegion(dib8, FIF_JPEG, JPEG_DEFAULT, JPEG_DEFAULT);
+	checkLoadRegion(dib1, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT);
+	checkLoadRegion(dib32, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT);
+	checkLoadRegion(dibf, FIF_HDR, HDR_DEFAULT, HDR_DEFAULT);
+
+	// full decode fallback
+	checkLoadRegion(dib24, FIF_PNG, PNG_INTERLACED, PNG_DEFAULT);
+	checkLoadRegion(dib24, FIF_JPEG, JPEG_DEFAULT, JPEG_EXIFROTATE);
+	checkLoadRegion(dib8, FIF_BMP, BMP_DEFAULT, BMP_DEFAULT);
+
+	FreeImage_Unload(dib1);
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(dib32);
+	FreeImage_Unload(dibf);
+}
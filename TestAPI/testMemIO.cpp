@@ -139,10 +139,151 @@ void testAcquireMemIO(const char *lpszPathName) {
 
 }
 
+void testLoadMappedMemIO(const char *lpszPathName) {
+	// load a regular file
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(lpszPathName);
+	FIBITMAP *dib = FreeImage_Load(fif, lpszPathName, 0);
+	assert(dib != NULL);
+
+	// load the same file using a memory mapping
+	FIBITMAP *check = FreeImage_LoadMapped(fif, lpszPathName, 0);
+	assert(check != NULL);
+	assert(FreeImage_GetWidth(check) == FreeImage_GetWidth(dib));
+	assert(FreeImage_GetHeight(check) == FreeImage_GetHeight(dib));
+	assert(FreeImage_GetBPP(check) == FreeImage_GetBPP(dib));
+	FreeImage_Unload(check);
+
+	// a memory mapped file is read-only
+	FIMEMORY *hmem = FreeImage_OpenMemoryMapped(lpszPathName);
+	assert(hmem != NULL);
+	assert(FreeImage_GetFileTypeFromMemory(hmem, 0) == fif);
+	assert(FreeImage_SaveToMemory(FIF_PNG, dib, hmem, 0) == FALSE);
+	FreeImage_CloseMemory(hmem);
+
+	// TIFF strips are read directly from the memory mapping
+	if(FreeImage_Save(FIF_TIFF, dib, "mapped.tif", TIFF_DEFAULT)) {
+		check = FreeImage_LoadMapped(FIF_TIFF, "mapped.tif", 0);
+		assert(check != NULL);
+		for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+			assert(memcmp(FreeImage_GetScanLine(dib, y), FreeImage_GetScanLine(check, y), FreeImage_GetLine(dib)) == 0);
+		}
+		FreeImage_Unload(check);
+	}
+
+	FreeImage_Unload(dib);
+}
+
+/**
+Grow callback used with FreeImage_OpenMemoryBuffer
+*/
+static BYTE * DLL_CALLCONV 
+growMemIOBuffer(BYTE *data, DWORD *size_in_bytes, DWORD min_size, void *user_data) {
+	BYTE *new_data = (BYTE*)realloc(data, min_size);
+	if(new_data) {
+		*size_in_bytes = min_size;
+		*(BYTE**)user_data = new_data;
+	}
+	return new_data;
+}
+
+/**
+Check that a memory stream has the size of a reference stream and can be loaded back. 
+PNG streams are also compared byte per byte (TIFF streams may contain uninitialized padding bytes). 
+*/
+static void checkMemIOContent(FIMEMORY *hmem, FIMEMORY *reference, FREE_IMAGE_FORMAT fif, FIBITMAP *dib) {
+	BYTE *ref_data = NULL;
+	DWORD ref_size = 0;
+	assert(FreeImage_AcquireMemory(reference, &ref_data, &ref_size));
+
+	// walk through the chunks without copying them
+	DWORD offset = 0;
+	BYTE *chunk = NULL;
+	DWORD chunk_size = 0;
+	for(unsigned index = 0; FreeImage_GetMemoryChunk(hmem, index, &chunk, &chunk_size); index++) {
+		assert(offset + chunk_size <= ref_size);
+		if(fif == FIF_PNG) {
+			assert(memcmp(chunk, ref_data + offset, chunk_size) == 0);
+		}
+		offset += chunk_size;
+	}
+	assert(offset == ref_size);
+
+	// reload the image
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FIBITMAP *check = FreeImage_LoadFromMemory(fif, hmem, 0);
+	assert(check != NULL);
+	assert(FreeImage_GetWidth(check) == FreeImage_GetWidth(dib));
+	assert(FreeImage_GetHeight(check) == FreeImage_GetHeight(dib));
+	assert(FreeImage_GetLine(check) == FreeImage_GetLine(dib));
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		assert(memcmp(FreeImage_GetScanLine(dib, y), FreeImage_GetScanLine(check, y), FreeImage_GetLine(dib)) == 0);
+	}
+	FreeImage_Unload(check);
+}
+
+void testWritableMemIO(const char *lpszPathName) {
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(lpszPathName);
+	FIBITMAP *dib = FreeImage_Load(fif, lpszPathName, 0);
+	assert(dib != NULL);
+
+	const FREE_IMAGE_FORMAT formats[] = { FIF_PNG, FIF_TIFF };
+
+	for(int i = 0; i < 2; i++) {
+		// reference: a stream allocated by the library
+		FIMEMORY *reference = FreeImage_OpenMemory();
+		assert(FreeImage_SaveToMemory(formats[i], dib, reference, 0));
+		const long file_size = (FreeImage_SeekMemory(reference, 0, SEEK_END), FreeImage_TellMemory(reference));
+
+		// user buffer grown by a callback
+		BYTE *buffer = (BYTE*)malloc(16);
+		FIMEMORY *hmem = FreeImage_OpenMemoryBuffer(buffer, 16, growMemIOBuffer, &buffer);
+		assert(hmem != NULL);
+		assert(FreeImage_SaveToMemory(formats[i], dib, hmem, 0));
+		checkMemIOContent(hmem, reference, formats[i], dib);
+		FreeImage_CloseMemory(hmem);
+		// the user buffer is owned by the caller
+		free(buffer);
+
+		// fixed size user buffer: writing fails when the buffer is full, an exact fit is allowed
+		// (the TIFF plugin doesn't report write errors)
+		buffer = (BYTE*)malloc(file_size);
+		if(formats[i] == FIF_PNG) {
+			hmem = FreeImage_OpenMemoryBuffer(buffer, file_size / 2);
+			assert(FreeImage_SaveToMemory(formats[i], dib, hmem, 0) == FALSE);
+			FreeImage_CloseMemory(hmem);
+		}
+		hmem = FreeImage_OpenMemoryBuffer(buffer, file_size);
+		assert(FreeImage_SaveToMemory(formats[i], dib, hmem, 0));
+		checkMemIOContent(hmem, reference, formats[i], dib);
+		FreeImage_CloseMemory(hmem);
+		free(buffer);
+
+		// chunked stream, using small chunks so that writes and seeks cross chunk boundaries
+		hmem = FreeImage_OpenMemoryChunked(1000);
+		assert(hmem != NULL);
+		assert(FreeImage_SaveToMemory(formats[i], dib, hmem, 0));
+		checkMemIOContent(hmem, reference, formats[i], dib);
+
+		// acquiring the buffer of a chunked stream makes it contiguous
+		BYTE *data = NULL;
+		DWORD size_in_bytes = 0;
+		assert(FreeImage_AcquireMemory(hmem, &data, &size_in_bytes));
+		assert(size_in_bytes == (DWORD)file_size);
+		checkMemIOContent(hmem, reference, formats[i], dib);
+		FreeImage_CloseMemory(hmem);
+
+		FreeImage_CloseMemory(reference);
+	}
+
+	FreeImage_Unload(dib);
+}
+
 void testMemIO(const char *lpszPathName) {
 	printf("testMemIO ...\n");
 	testSaveMemIO(lpszPathName);
 	testLoadMemIO(lpszPathName);
 	testAcquireMemIO(lpszPathName);
+	testLoadMappedMemIO(lpszPathName);
+	testWritableMemIO(lpszPathName);
 }
 
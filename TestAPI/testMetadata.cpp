@@ -0,0 +1,109 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Enumerate a metadata model, check that keys are visited once and in order
+@return Returns the number of tags found
+*/
+static unsigned enumerateMetadata(FREE_IMAGE_MDMODEL model, FIBITMAP *dib) {
+	unsigned count = 0;
+	char previous_key[64] = { 0 };
+	FITAG *tag = NULL;
+
+	FIMETADATA *mdhandle = FreeImage_FindFirstMetadata(model, dib, &tag);
+	if(mdhandle) {
+		do {
+			const char *key = FreeImage_GetTagKey(tag);
+			assert(key != NULL);
+			assert(strcmp(previous_key, key) < 0);
+			strncpy(previous_key, key, sizeof(previous_key) - 1);
+			count++;
+		} while(FreeImage_FindNextMetadata(mdhandle, &tag));
+
+		FreeImage_FindCloseMetadata(mdhandle);
+	}
+
+	return count;
+}
+
+/**
+Store tag_count comment tags in a dib
+*/
+static void addComments(FIBITMAP *dib, unsigned tag_count) {
+	char key[64];
+	char value[64];
+
+	FITAG *tag = FreeImage_CreateTag();
+	assert(tag != NULL);
+
+	for(unsigned i = 0; i < tag_count; i++) {
+		sprintf(key, "Comment%06u", (tag_count - 1 - i) * 7919 % tag_count);
+		sprintf(value, "value %u", i);
+		FreeImage_SetTagKey(tag, key);
+		FreeImage_SetTagLength(tag, (DWORD)strlen(value) + 1);
+		FreeImage_SetTagCount(tag, (DWORD)strlen(value) + 1);
+		FreeImage_SetTagType(tag, FIDT_ASCII);
+		FreeImage_SetTagValue(tag, value);
+		FreeImage_SetMetadata(FIMD_COMMENTS, dib, key, tag);
+	}
+
+	FreeImage_DeleteTag(tag);
+}
+
+// ----------------------------------------------------------
+
+/**
+Enumerate and clone a large metadata model (a few thousand tags, as found in maker notes)
+*/
+void testMetadataIteration(unsigned tag_count) {
+	printf("testMetadataIteration ...\n");
+
+	FIBITMAP *dib = FreeImage_Allocate(16, 16, 24);
+	assert(dib != NULL);
+
+	// an empty model cannot be enumerated
+	FITAG *tag = NULL;
+	assert(FreeImage_FindFirstMetadata(FIMD_COMMENTS, dib, &tag) == NULL);
+
+	addComments(dib, tag_count);
+	assert(FreeImage_GetMetadataCount(FIMD_COMMENTS, dib) == tag_count);
+	assert(enumerateMetadata(FIMD_COMMENTS, dib) == tag_count);
+
+	// clone the metadata and check the clone
+	FIBITMAP *clone = FreeImage_Allocate(16, 16, 24);
+	assert(clone != NULL);
+	BOOL bResult = FreeImage_CloneMetadata(clone, dib);
+	assert(bResult);
+	assert(enumerateMetadata(FIMD_COMMENTS, clone) == tag_count);
+
+	FITAG *src_tag = NULL;
+	FITAG *dst_tag = NULL;
+	FreeImage_GetMetadata(FIMD_COMMENTS, dib, "Comment000000", &src_tag);
+	FreeImage_GetMetadata(FIMD_COMMENTS, clone, "Comment000000", &dst_tag);
+	assert(src_tag && dst_tag && (src_tag != dst_tag));
+	assert(strcmp((const char*)FreeImage_GetTagValue(src_tag), (const char*)FreeImage_GetTagValue(dst_tag)) == 0);
+
+	FreeImage_Unload(clone);
+	FreeImage_Unload(dib);
+}
@@ -0,0 +1,144 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Save an image to PNG with parallel compression, using one and four threads, 
+check that both files are the same and decode to the image saved without parallel compression
+(with the filter selection flags, the image saved without parallel compression is filtered by the same encoder)
+*/
+static void testSavePNGThreadsType(FIBITMAP *src, int flags) {
+	FIMEMORY *reference_stream = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(FIF_PNG, src, reference_stream, flags));
+	FreeImage_SeekMemory(reference_stream, 0L, SEEK_SET);
+	FIBITMAP *reference = FreeImage_LoadFromMemory(FIF_PNG, reference_stream, PNG_DEFAULT);
+	assert(reference);
+
+	// the block boundaries do not depend on the number of threads
+	FIBITMAP *parallel = saveLoadThreads(FIF_PNG, src, flags | PNG_PARALLEL, TRUE);
+
+	assert(isSameImage(reference, parallel));
+	assert(FreeImage_GetTransparencyCount(reference) == FreeImage_GetTransparencyCount(parallel));
+
+	FreeImage_Unload(parallel);
+	FreeImage_Unload(reference);
+	FreeImage_CloseMemory(reference_stream);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testSavePNGThreads(unsigned width, unsigned height) {
+	printf("testSavePNGThreads (%d x %d) ...\n", width, height);
+
+	const int thread_count = FreeImage_GetThreadCount();
+
+	FIBITMAP *zone = createZonePlateImage(width + 3, height + 5, 128);
+	assert(zone);
+
+	FIBITMAP *images[] = {
+		FreeImage_Threshold(zone, 128),
+		FreeImage_ConvertTo4Bits(zone),
+		FreeImage_Clone(zone),
+		FreeImage_Clone(zone),
+		FreeImage_ConvertTo24Bits(zone),
+		FreeImage_ConvertTo32Bits(zone),
+		FreeImage_ConvertToType(zone, FIT_UINT16),
+		FreeImage_ConvertToType(zone, FIT_RGB16),
+		FreeImage_ConvertToType(zone, FIT_RGBA16)
+	};
+
+	// 1-bit min-is-white and 8-bit transparent images
+	RGBQUAD *pal = FreeImage_GetPalette(images[0]);
+	const RGBQUAD black = pal[0];
+	pal[0] = pal[1];
+	pal[1] = black;
+	BYTE table[256];
+	for(int i = 0; i < 256; i++) {
+		table[i] = (BYTE)(255 - i);
+	}
+	FreeImage_SetTransparencyTable(images[3], table, 256);
+
+	// 32-bit image with an alpha channel
+	for(unsigned y = 0; y < FreeImage_GetHeight(images[5]); y++) {
+		BYTE *bits = FreeImage_GetScanLine(images[5], y);
+		for(unsigned x = 0; x < FreeImage_GetWidth(images[5]); x++) {
+			bits[4 * x + FI_RGBA_ALPHA] = (BYTE)(x + y);
+		}
+	}
+
+	const int flags[] = {
+		PNG_DEFAULT,
+		PNG_Z_BEST_SPEED,
+		PNG_Z_BEST_COMPRESSION,
+		PNG_Z_NO_COMPRESSION,
+		PNG_FILTER_ADAPTIVE,
+		PNG_Z_BEST_SPEED | PNG_FILTER_BRUTE
+	};
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		assert(images[i]);
+		for(size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); j++) {
+			testSavePNGThreadsType(images[i], flags[j]);
+		}
+		FreeImage_Unload(images[i]);
+	}
+	FreeImage_Unload(zone);
+
+	// more than one batch of blocks
+	FIBITMAP *large = createZonePlateImage(width * 6, height * 4, 128);
+	FIBITMAP *large24 = FreeImage_ConvertTo24Bits(large);
+	assert(large && large24);
+	testSavePNGThreadsType(large24, PNG_DEFAULT);
+
+	// copy-on-write clone: the pool threads read the pixels shared with the source image
+	FreeImage_SetCopyOnWrite(TRUE);
+	FIBITMAP *clone = FreeImage_Clone(large24);
+	assert(clone);
+	const unsigned clone_size = FreeImage_GetMemorySize(clone);
+	FreeImage_SetThreadCount(4);
+	// the filter selection flags also filter the rows on the thread pool
+	const int clone_flags[] = {
+		PNG_PARALLEL | PNG_Z_BEST_SPEED,
+		PNG_FILTER_ADAPTIVE,
+		PNG_Z_BEST_SPEED | PNG_FILTER_BRUTE,
+		PNG_DEFAULT
+	};
+	for(size_t j = 0; j < sizeof(clone_flags) / sizeof(clone_flags[0]); j++) {
+		FIMEMORY *stream = FreeImage_OpenMemory();
+		assert(FreeImage_SaveToMemory(FIF_PNG, clone, stream, clone_flags[j]));
+		assert(FreeImage_GetMemorySize(clone) == clone_size);
+		FreeImage_SeekMemory(stream, 0L, SEEK_SET);
+		FIBITMAP *loaded = FreeImage_LoadFromMemory(FIF_PNG, stream, PNG_DEFAULT);
+		assert(loaded && isSameImage(large24, loaded));
+		FreeImage_Unload(loaded);
+		FreeImage_CloseMemory(stream);
+	}
+	FreeImage_Unload(clone);
+	FreeImage_SetCopyOnWrite(FALSE);
+
+	FreeImage_Unload(large24);
+	FreeImage_Unload(large);
+
+	FreeImage_SetThreadCount(thread_count);
+}
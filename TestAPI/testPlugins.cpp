@@ -36,3 +36,37 @@ void showPlugins() {
 	printf("\n");
 }
 
+// Check file type identification
+// ----------------------------------------------------------
+void testFileType() {
+	// icons cannot be larger than 256x256
+	const unsigned width = 64;
+	const unsigned height = 64;
+	const FREE_IMAGE_FORMAT formats[] = { FIF_BMP, FIF_ICO, FIF_JPEG, FIF_PNG, FIF_TARGA, FIF_TIFF, FIF_GIF, FIF_J2K, FIF_JP2, FIF_WEBP };
+
+	printf("testFileType ...\n");
+
+	FIBITMAP *dib24 = FreeImage_Allocate(width, height, 24);
+	assert(dib24 != NULL);
+	FIBITMAP *dib8 = FreeImage_ConvertTo8Bits(dib24);
+	assert(dib8 != NULL);
+
+	for(unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		const FREE_IMAGE_FORMAT fif = formats[i];
+		FIBITMAP *dib = FreeImage_FIFSupportsExportBPP(fif, 24) ? dib24 : dib8;
+
+		FIMEMORY *hmem = FreeImage_OpenMemory();
+		assert(FreeImage_SaveToMemory(fif, dib, hmem, 0));
+
+		// identification must not move the stream position
+		assert(FreeImage_TellMemory(hmem) > 0);
+		FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+		assert(FreeImage_GetFileTypeFromMemory(hmem, 0) == fif);
+		assert(FreeImage_TellMemory(hmem) == 0);
+
+		FreeImage_CloseMemory(hmem);
+	}
+
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+}
@@ -0,0 +1,180 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+static void testRescaleThreadsType(FIBITMAP *src, unsigned dst_width, unsigned dst_height, FREE_IMAGE_FILTER filter) {
+	const unsigned width = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+
+	FreeImage_SetThreadCount(1);
+	FIBITMAP *serial = FreeImage_Rescale(src, dst_width, dst_height, filter);
+	FIBITMAP *serial_rect = FreeImage_RescaleRect(src, dst_height, dst_width, width / 4, height / 3, width - 5, height - 2, filter);
+	assert(serial && serial_rect);
+
+	FreeImage_SetThreadCount(4);
+	assert(FreeImage_GetThreadCount() == 4);
+	FIBITMAP *parallel = FreeImage_Rescale(src, dst_width, dst_height, filter);
+	FIBITMAP *parallel_rect = FreeImage_RescaleRect(src, dst_height, dst_width, width / 4, height / 3, width - 5, height - 2, filter);
+	assert(parallel && parallel_rect);
+
+	// threaded output must be bit-identical to the serial output
+	assert(isSameImage(serial, parallel));
+	assert(isSameImage(serial_rect, parallel_rect));
+
+	FreeImage_Unload(parallel_rect);
+	FreeImage_Unload(parallel);
+	FreeImage_Unload(serial_rect);
+	FreeImage_Unload(serial);
+}
+
+static int maxSampleDifference(FIBITMAP *dib1, FIBITMAP *dib2) {
+	const BOOL bWords = (FreeImage_GetImageType(dib1) != FIT_BITMAP);
+	const unsigned count = bWords ? FreeImage_GetLine(dib1) / 2 : FreeImage_GetLine(dib1);
+	int max_diff = 0;
+
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib1); y++) {
+		const BYTE *bits1 = FreeImage_GetScanLine(dib1, y);
+		const BYTE *bits2 = FreeImage_GetScanLine(dib2, y);
+		for(unsigned i = 0; i < count; i++) {
+			const int diff = bWords ? abs(((WORD*)bits1)[i] - ((WORD*)bits2)[i]) : abs(bits1[i] - bits2[i]);
+			max_diff = (diff > max_diff) ? diff : max_diff;
+		}
+	}
+	return max_diff;
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testRescaleThreads(unsigned width, unsigned height) {
+	printf("testRescaleThreads (%d x %d) ...\n", width, height);
+
+	const int thread_count = FreeImage_GetThreadCount();
+
+	FIBITMAP *zone = createZonePlateImage(width, height, 128);
+	assert(zone);
+
+	FIBITMAP *images[] = {
+		FreeImage_Threshold(zone, 128),
+		FreeImage_ConvertTo4Bits(zone),
+		FreeImage_Clone(zone),
+		FreeImage_ConvertTo24Bits(zone),
+		FreeImage_ConvertTo32Bits(zone),
+		FreeImage_ConvertToType(zone, FIT_UINT16),
+		FreeImage_ConvertToType(zone, FIT_RGB16),
+		FreeImage_ConvertToType(zone, FIT_RGBAF)
+	};
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		assert(images[i]);
+		// downscaling (xy filtering) and upscaling (yx filtering)
+		testRescaleThreadsType(images[i], width / 3, height / 2, FILTER_CATMULLROM);
+		testRescaleThreadsType(images[i], width * 2 - 1, height + 7, FILTER_LANCZOS3);
+		FreeImage_Unload(images[i]);
+	}
+
+	FreeImage_Unload(zone);
+
+	FreeImage_SetThreadCount(thread_count);
+}
+
+void testRescaleFixedPoint(unsigned width, unsigned height) {
+	printf("testRescaleFixedPoint (%d x %d) ...\n", width, height);
+
+	FIBITMAP *zone = createZonePlateImage(width, height, 128);
+	assert(zone);
+
+	FIBITMAP *images[] = {
+		FreeImage_Clone(zone),
+		FreeImage_ConvertTo24Bits(zone),
+		FreeImage_ConvertTo32Bits(zone),
+		FreeImage_ConvertToType(zone, FIT_UINT16),
+		FreeImage_ConvertToType(zone, FIT_RGB16),
+		FreeImage_ConvertToType(zone, FIT_RGBA16)
+	};
+	const FREE_IMAGE_FILTER filters[] = {
+		FILTER_BOX, FILTER_BICUBIC, FILTER_BILINEAR, FILTER_BSPLINE, FILTER_CATMULLROM, FILTER_LANCZOS3
+	};
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		assert(images[i]);
+		// each of the 2 passes may be 1 off (8-bit) or a few 1/10000 of the range off (16-bit)
+		const int tolerance = (FreeImage_GetImageType(images[i]) == FIT_BITMAP) ? 2 : 32;
+
+		for(size_t k = 0; k < sizeof(filters) / sizeof(filters[0]); k++) {
+			FIBITMAP *fixed = FreeImage_RescaleRect(images[i], width / 3, height * 2, 1, 2, width - 1, height, filters[k], FI_RESCALE_FIXED_POINT);
+			FIBITMAP *reference = FreeImage_RescaleRect(images[i], width / 3, height * 2, 1, 2, width - 1, height, filters[k], FI_RESCALE_DEFAULT);
+			assert(fixed && reference);
+			assert(maxSampleDifference(fixed, reference) <= tolerance);
+			FreeImage_Unload(reference);
+			FreeImage_Unload(fixed);
+
+			// strong downscaling: long horizontal filters
+			fixed = FreeImage_RescaleRect(images[i], width / 9, height / 2, 3, 0, width - 2, height, filters[k], FI_RESCALE_FIXED_POINT);
+			reference = FreeImage_RescaleRect(images[i], width / 9, height / 2, 3, 0, width - 2, height, filters[k], FI_RESCALE_DEFAULT);
+			assert(fixed && reference);
+			assert(maxSampleDifference(fixed, reference) <= tolerance);
+			FreeImage_Unload(reference);
+			FreeImage_Unload(fixed);
+		}
+		FreeImage_Unload(images[i]);
+	}
+
+	FreeImage_Unload(zone);
+}
+
+void testRescaleCache(unsigned width, unsigned height) {
+	printf("testRescaleCache (%d x %d) ...\n", width, height);
+
+	FIBITMAP *src = createZonePlateImage(width, height, 128);
+	assert(src);
+
+	// reference without cache
+	FreeImage_SetRescaleCacheSize(0);
+	FIBITMAP *reference = FreeImage_Rescale(src, width / 2 + 1, height / 3, FILTER_LANCZOS3);
+	assert(reference);
+
+	// cached tables must give the same result
+	FreeImage_SetRescaleCacheSize(1024 * 1024);
+	assert(FreeImage_PrewarmRescaleCache(width, height, width / 2 + 1, height / 3, FILTER_LANCZOS3));
+	assert(!FreeImage_PrewarmRescaleCache(0, height, width, height, FILTER_LANCZOS3));
+	for(int i = 0; i < 2; i++) {
+		FIBITMAP *cached = FreeImage_Rescale(src, width / 2 + 1, height / 3, FILTER_LANCZOS3);
+		assert(cached);
+		assert(isSameImage(cached, reference));
+		FreeImage_Unload(cached);
+	}
+
+	// a table larger than the cache is still usable
+	FreeImage_SetRescaleCacheSize(16);
+	FIBITMAP *uncached = FreeImage_Rescale(src, width / 2 + 1, height / 3, FILTER_LANCZOS3);
+	assert(uncached);
+	assert(isSameImage(uncached, reference));
+	FreeImage_Unload(uncached);
+
+	FreeImage_ClearRescaleCache();
+	FreeImage_SetRescaleCacheSize(4 * 1024 * 1024);
+
+	FreeImage_Unload(reference);
+	FreeImage_Unload(src);
+}
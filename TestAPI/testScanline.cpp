@@ -0,0 +1,266 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Save an image to memory, then check that the scanline reader delivers the rows of the regular loader
+@param streaming Expected decoding mode (TRUE: rows are decoded on demand, FALSE: full decode fallback)
+*/
+static void checkScanlineReader(FIBITMAP *dib, FREE_IMAGE_FORMAT fif, int save_flags, int load_flags, BOOL streaming) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(fif, dib, hmem, save_flags));
+
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FIBITMAP *check = FreeImage_LoadFromMemory(fif, hmem, load_flags);
+	assert(check != NULL);
+
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FISCANLINEREADER *reader = FreeImage_OpenScanlineReaderFromMemory(fif, hmem, load_flags);
+	assert(reader != NULL);
+	assert(FreeImage_IsScanlineReaderStreaming(reader) == streaming);
+
+	// the reader describes the image
+	FIBITMAP *info = FreeImage_GetScanlineReaderInfo(reader);
+	assert(info != NULL);
+	assert(FreeImage_GetImageType(info) == FreeImage_GetImageType(check));
+	assert(FreeImage_GetWidth(info) == FreeImage_GetWidth(check));
+	assert(FreeImage_GetHeight(info) == FreeImage_GetHeight(check));
+	assert(FreeImage_GetBPP(info) == FreeImage_GetBPP(check));
+
+	// read bands of 7 rows (top row first) into an unaligned buffer
+	const unsigned height = FreeImage_GetHeight(check);
+	const unsigned line = FreeImage_GetLine(check);
+	const unsigned pitch = line + 3;
+	const unsigned band = 7;
+	BYTE *bits = (BYTE*)malloc(band * pitch);
+	assert(bits != NULL);
+
+	unsigned y = 0;
+	while(y < height) {
+		const unsigned rows = FreeImage_ReadScanlines(reader, bits, pitch, band);
+		assert(rows == ((height - y < band) ? height - y : band));
+		for(unsigned i = 0; i < rows; i++, y++) {
+			assert(memcmp(bits + i * pitch, FreeImage_GetScanLine(check, height - 1 - y), line) == 0);
+		}
+		assert(FreeImage_GetScanlineReaderPosition(reader) == y);
+	}
+	assert(FreeImage_ReadScanlines(reader, bits, pitch, band) == 0);
+
+	free(bits);
+	FreeImage_CloseScanlineReader(reader);
+	FreeImage_Unload(check);
+	FreeImage_CloseMemory(hmem);
+}
+
+/**
+Encode an image row by row to memory, then check that the result decodes to the image saved by the regular saver
+@param streaming Expected encoding mode (TRUE: rows are encoded on the fly, FALSE: whole image fallback)
+*/
+static void checkScanlineWriter(FIBITMAP *dib, FREE_IMAGE_FORMAT fif, int save_flags, BOOL streaming) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned line = FreeImage_GetLine(dib);
+
+	FIMEMORY *hcheck = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(fif, dib, hcheck, save_flags));
+
+	// the writer only needs an image description
+	FIBITMAP *header = FreeImage_AllocateHeaderT(TRUE, FreeImage_GetImageType(dib), width, height, FreeImage_GetBPP(dib));
+	assert(header != NULL);
+	if(FreeImage_GetColorsUsed(dib)) {
+		memcpy(FreeImage_GetPalette(header), FreeImage_GetPalette(dib), FreeImage_GetColorsUsed(dib) * sizeof(RGBQUAD));
+	}
+
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	FISCANLINEWRITER *writer = FreeImage_OpenScanlineWriterToMemory(fif, header, hmem, save_flags);
+	assert(writer != NULL);
+	assert(FreeImage_IsScanlineWriterStreaming(writer) == streaming);
+	// the header is copied by the writer
+	FreeImage_Unload(header);
+
+	// write bands of 7 rows (top row first) from an unaligned buffer
+	const unsigned pitch = line + 3;
+	const unsigned band = 7;
+	BYTE *bits = (BYTE*)malloc(band * pitch);
+	assert(bits != NULL);
+
+	unsigned y = 0;
+	while(y < height) {
+		const unsigned count = (height - y < band) ? height - y : band;
+		for(unsigned i = 0; i < count; i++) {
+			memcpy(bits + i * pitch, FreeImage_GetScanLine(dib, height - 1 - y - i), line);
+		}
+		assert(FreeImage_WriteScanlines(writer, bits, pitch, band) == count);
+		y += count;
+		assert(FreeImage_GetScanlineWriterPosition(writer) == y);
+	}
+	assert(FreeImage_WriteScanlines(writer, bits, pitch, band) == 0);
+	free(bits);
+
+	assert(FreeImage_CloseScanlineWriter(writer));
+
+	if(fif != FIF_TIFF) {
+		// same encoder, same bytes
+		BYTE *check_data = NULL, *data = NULL;
+		DWORD check_size = 0, size = 0;
+		FreeImage_AcquireMemory(hcheck, &check_data, &check_size);
+		FreeImage_AcquireMemory(hmem, &data, &size);
+		assert((size == check_size) && (memcmp(data, check_data, size) == 0));
+	}
+
+	FreeImage_SeekMemory(hcheck, 0L, SEEK_SET);
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FIBITMAP *check = FreeImage_LoadFromMemory(fif, hcheck, 0);
+	FIBITMAP *result = FreeImage_LoadFromMemory(fif, hmem, 0);
+	assert((check != NULL) && (result != NULL));
+	assert(FreeImage_GetBPP(result) == FreeImage_GetBPP(check));
+	for(y = 0; y < height; y++) {
+		assert(memcmp(FreeImage_GetScanLine(result, y), FreeImage_GetScanLine(check, y), FreeImage_GetLine(check)) == 0);
+	}
+
+	FreeImage_Unload(result);
+	FreeImage_Unload(check);
+	FreeImage_CloseMemory(hmem);
+	FreeImage_CloseMemory(hcheck);
+}
+
+// ----------------------------------------------------------
+
+void testScanlineReader(unsigned width, unsigned height) {
+	printf("testScanlineReader ...\n");
+
+	// odd sizes: partial last band, partial last strip
+	width += 3;
+	height += 5;
+
+	FIBITMAP *dib1 = createScanlineImage(FIT_BITMAP, width, height, 1);
+	FIBITMAP *dib8 = createScanlineImage(FIT_BITMAP, width, height, 8);
+	FIBITMAP *dib24 = createScanlineImage(FIT_BITMAP, width, height, 24);
+	FIBITMAP *dib32 = createScanlineImage(FIT_BITMAP, width, height, 32);
+	FIBITMAP *dibf = createScanlineImage(FIT_RGBF, width, height, 0);
+
+	// JPEG
+	checkScanlineReader(dib24, FIF_JPEG, JPEG_DEFAULT, JPEG_DEFAULT, TRUE);
+	checkScanlineReader(dib24, FIF_JPEG, JPEG_DEFAULT, JPEG_ACCURATE | JPEG_GREYSCALE, TRUE);
+	checkScanlineReader(dib8, FIF_JPEG, JPEG_DEFAULT, JPEG_DEFAULT, TRUE);
+	// Exif rotation needs the whole image
+	checkScanlineReader(dib24, FIF_JPEG, JPEG_DEFAULT, JPEG_EXIFROTATE, FALSE);
+
+	// PNG
+	checkScanlineReader(dib1, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT, TRUE);
+	checkScanlineReader(dib8, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT, TRUE);
+	checkScanlineReader(dib24, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT, TRUE);
+	checkScanlineReader(dib32, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT, TRUE);
+	// interlaced rows are only complete after the last pass
+	checkScanlineReader(dib24, FIF_PNG, PNG_INTERLACED, PNG_DEFAULT, FALSE);
+
+	// HDR
+	checkScanlineReader(dibf, FIF_HDR, HDR_DEFAULT, HDR_DEFAULT, TRUE);
+
+	// TIFF
+	checkScanlineReader(dib1, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkScanlineReader(dib8, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkScanlineReader(dib24, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkScanlineReader(dib32, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkScanlineReader(dib24, FIF_TIFF, TIFF_NONE, TIFF_DEFAULT, TRUE);
+	checkScanlineReader(dib24, FIF_TIFF, TIFF_JPEG, TIFF_DEFAULT, TRUE);
+
+	// formats without a scanline decoder use the full decode fallback
+	checkScanlineReader(dib24, FIF_BMP, BMP_DEFAULT, BMP_DEFAULT, FALSE);
+
+	// file based reader
+	assert(FreeImage_Save(FIF_PNG, dib24, "scanline.png", PNG_DEFAULT));
+	FISCANLINEREADER *reader = FreeImage_OpenScanlineReader(FIF_PNG, "scanline.png", PNG_DEFAULT);
+	assert(reader != NULL);
+	BYTE *bits = (BYTE*)malloc(FreeImage_GetLine(dib24));
+	assert(FreeImage_ReadScanlines(reader, bits, FreeImage_GetLine(dib24), 1) == 1);
+	assert(memcmp(bits, FreeImage_GetScanLine(dib24, height - 1), FreeImage_GetLine(dib24)) == 0);
+	free(bits);
+	// the reader can be closed before the last row
+	FreeImage_CloseScanlineReader(reader);
+
+	FreeImage_Unload(dib1);
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(dib32);
+	FreeImage_Unload(dibf);
+}
+
+void testScanlineWriter(unsigned width, unsigned height) {
+	printf("testScanlineWriter ...\n");
+
+	// odd sizes: partial last band, partial last strip
+	width += 3;
+	height += 5;
+
+	FIBITMAP *dib1 = createScanlineImage(FIT_BITMAP, width, height, 1);
+	FIBITMAP *dib8 = createScanlineImage(FIT_BITMAP, width, height, 8);
+	FIBITMAP *dib24 = createScanlineImage(FIT_BITMAP, width, height, 24);
+	FIBITMAP *dib32 = createScanlineImage(FIT_BITMAP, width, height, 32);
+	FIBITMAP *dibf = createScanlineImage(FIT_RGBF, width, height, 0);
+
+	// JPEG
+	checkScanlineWriter(dib24, FIF_JPEG, JPEG_DEFAULT, TRUE);
+	checkScanlineWriter(dib24, FIF_JPEG, JPEG_PROGRESSIVE | JPEG_SUBSAMPLING_444, TRUE);
+	checkScanlineWriter(dib8, FIF_JPEG, JPEG_QUALITYGOOD, TRUE);
+
+	// PNG
+	checkScanlineWriter(dib1, FIF_PNG, PNG_DEFAULT, TRUE);
+	checkScanlineWriter(dib8, FIF_PNG, PNG_DEFAULT, TRUE);
+	checkScanlineWriter(dib24, FIF_PNG, PNG_Z_BEST_SPEED, TRUE);
+	checkScanlineWriter(dib32, FIF_PNG, PNG_DEFAULT, TRUE);
+	// interlaced rows are only written once the whole image is known
+	checkScanlineWriter(dib24, FIF_PNG, PNG_INTERLACED, FALSE);
+
+	// HDR
+	checkScanlineWriter(dibf, FIF_HDR, HDR_DEFAULT, TRUE);
+
+	// TIFF
+	checkScanlineWriter(dib1, FIF_TIFF, TIFF_DEFAULT, TRUE);
+	checkScanlineWriter(dib8, FIF_TIFF, TIFF_DEFAULT, TRUE);
+	checkScanlineWriter(dib24, FIF_TIFF, TIFF_DEFAULT, TRUE);
+	checkScanlineWriter(dib32, FIF_TIFF, TIFF_DEFAULT, TRUE);
+	checkScanlineWriter(dib24, FIF_TIFF, TIFF_JPEG, TRUE);
+	checkScanlineWriter(dibf, FIF_TIFF, TIFF_DEFAULT, TRUE);
+
+	// formats without a scanline encoder use the whole image fallback
+	checkScanlineWriter(dib24, FIF_BMP, BMP_DEFAULT, FALSE);
+
+	// file based writer, closed before the last row
+	FISCANLINEWRITER *writer = FreeImage_OpenScanlineWriter(FIF_PNG, dib24, "scanline.png", PNG_DEFAULT);
+	assert(writer != NULL);
+	assert(FreeImage_WriteScanlines(writer, FreeImage_GetScanLine(dib24, height - 1), FreeImage_GetLine(dib24), 1) == 1);
+	assert(FreeImage_CloseScanlineWriter(writer) == FALSE);
+
+	// a user buffer is read only
+	BYTE buffer[1024];
+	FIMEMORY *hread = FreeImage_OpenMemory(buffer, sizeof(buffer));
+	assert(FreeImage_OpenScanlineWriterToMemory(FIF_PNG, dib24, hread, PNG_DEFAULT) == NULL);
+	FreeImage_CloseMemory(hread);
+
+	FreeImage_Unload(dib1);
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(dib32);
+	FreeImage_Unload(dibf);
+}
@@ -0,0 +1,389 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Save an image to TIFF with one and with four threads, check that both files decode to the same image
+@param lossless If TRUE, also check the decoded image against the source image
+*/
+static void testSaveTIFFThreadsType(FIBITMAP *src, int flags, BOOL lossless) {
+	FIBITMAP *parallel = saveLoadThreads(FIF_TIFF, src, flags, FALSE);
+	if(lossless) {
+		assert(isSameImage(src, parallel));
+	}
+	FreeImage_Unload(parallel);
+}
+
+/**
+Compare count pixels of two rows
+*/
+static BOOL samePixels(const BYTE *a, const BYTE *b, unsigned count, unsigned bpp) {
+	if(bpp >= 8) {
+		return (memcmp(a, b, count * bpp / 8) == 0) ? TRUE : FALSE;
+	}
+	for(unsigned x = 0; x < count * bpp; x++) {
+		if(((a[x >> 3] ^ b[x >> 3]) & (0x80 >> (x & 7))) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Check a block of decoded tiles (top row first) against the image decoded by the regular loader
+@param x Left column of the block in the image
+@param y Top row of the block in the image
+*/
+static void checkTileBlock(FIBITMAP *check, const BYTE *bits, unsigned pitch, unsigned x, unsigned y, unsigned block_width, unsigned block_height) {
+	const unsigned width = FreeImage_GetWidth(check);
+	const unsigned height = FreeImage_GetHeight(check);
+	const unsigned bpp = FreeImage_GetBPP(check);
+
+	// pixels outside of the image are black
+	const unsigned columns = (x + block_width > width) ? width - x : block_width;
+	const unsigned rows = (y + block_height > height) ? height - y : block_height;
+
+	BYTE *black = (BYTE*)calloc(pitch, 1);
+	assert(black != NULL);
+
+	for(unsigned k = 0; k < block_height; k++, bits += pitch) {
+		if(k < rows) {
+			// byte aligned start column, as tiles are
+			const BYTE *src = FreeImage_GetScanLine(check, height - 1 - y - k) + x * bpp / 8;
+			assert(samePixels(bits, src, columns, bpp));
+		}
+		if(columns < block_width) {
+			// bytes fully outside of the image
+			const unsigned first = (columns * bpp + 7) / 8;
+			const unsigned last = (block_width * bpp + 7) / 8;
+			assert(memcmp(bits + first, black, last - first) == 0);
+		}
+		if(k >= rows) {
+			assert(memcmp(bits, black, (block_width * bpp + 7) / 8) == 0);
+		}
+	}
+
+	free(black);
+}
+
+/**
+Save an image to memory, then check that the tile reader delivers the pixels of the regular loader
+@param streaming Expected decoding mode (TRUE: tiles are decoded on demand, FALSE: full decode fallback)
+*/
+static void checkTileReader(FIBITMAP *dib, FREE_IMAGE_FORMAT fif, int save_flags, int load_flags, BOOL streaming) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(fif, dib, hmem, save_flags));
+
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FIBITMAP *check = FreeImage_LoadFromMemory(fif, hmem, load_flags);
+	assert(check != NULL);
+
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	FITILEREADER *reader = FreeImage_OpenTileReaderFromMemory(fif, hmem, -1, load_flags);
+	assert(reader != NULL);
+	assert(FreeImage_IsTileReaderStreaming(reader) == streaming);
+
+	// the reader describes the image
+	FIBITMAP *info = FreeImage_GetTileReaderInfo(reader);
+	assert(info != NULL);
+	assert(FreeImage_GetImageType(info) == FreeImage_GetImageType(check));
+	assert(FreeImage_GetWidth(info) == FreeImage_GetWidth(check));
+	assert(FreeImage_GetHeight(info) == FreeImage_GetHeight(check));
+	assert(FreeImage_GetBPP(info) == FreeImage_GetBPP(check));
+
+	unsigned tile_width, tile_height, columns, rows;
+	assert(FreeImage_GetTileReaderGrid(reader, &tile_width, &tile_height, &columns, &rows));
+	assert(columns * tile_width >= FreeImage_GetWidth(check));
+	assert(rows * tile_height >= FreeImage_GetHeight(check));
+	if(!streaming) {
+		// the whole image is a single tile
+		assert((columns == 1) && (rows == 1));
+	}
+
+	const unsigned bpp = FreeImage_GetBPP(check);
+
+	// every tile, bottom-right first, into an unaligned buffer
+	const unsigned pitch = (tile_width * bpp + 7) / 8 + 3;
+	BYTE *bits = (BYTE*)malloc(tile_height * pitch);
+	assert(bits != NULL);
+
+	for(int row = (int)rows - 1; row >= 0; row--) {
+		for(int column = (int)columns - 1; column >= 0; column--) {
+			memset(bits, 0xFF, tile_height * pitch);
+			assert(FreeImage_ReadTile(reader, column, row, bits, pitch));
+			checkTileBlock(check, bits, pitch, column * tile_width, row * tile_height, tile_width, tile_height);
+		}
+	}
+	// out of the grid
+	assert(FreeImage_ReadTile(reader, columns, 0, bits, pitch) == FALSE);
+	assert(FreeImage_ReadTile(reader, 0, rows, bits, pitch) == FALSE);
+	// pitch too small
+	assert(FreeImage_ReadTile(reader, 0, 0, bits, pitch - 4) == FALSE);
+
+	free(bits);
+
+	// a range of tiles, through a single tile cache
+	FreeImage_SetTileReaderCacheSize(reader, 1);
+
+	const unsigned first_column = columns / 2;
+	const unsigned first_row = rows / 3;
+	const unsigned range_columns = columns - first_column;
+	const unsigned range_rows = (rows - first_row > 3) ? 3 : rows - first_row;
+	const unsigned range_pitch = (range_columns * tile_width * bpp + 7) / 8 + 5;
+
+	bits = (BYTE*)malloc(range_rows * tile_height * range_pitch);
+	assert(bits != NULL);
+
+	for(int pass = 0; pass < 2; pass++) {
+		memset(bits, 0xFF, range_rows * tile_height * range_pitch);
+		assert(FreeImage_ReadTiles(reader, first_column, first_row, range_columns, range_rows, bits, range_pitch));
+		checkTileBlock(check, bits, range_pitch, first_column * tile_width, first_row * tile_height, range_columns * tile_width, range_rows * tile_height);
+	}
+	assert(FreeImage_ReadTiles(reader, first_column, first_row, range_columns + 1, range_rows, bits, range_pitch) == FALSE);
+
+	free(bits);
+	FreeImage_CloseTileReader(reader);
+	FreeImage_Unload(check);
+	FreeImage_CloseMemory(hmem);
+}
+
+/**
+Save a tiled pyramid to memory, then check every level against successive half-size box filter reductions
+@param levels Expected number of reduced levels
+*/
+static void checkTilePyramid(FIBITMAP *dib, int save_flags, unsigned levels) {
+	// a thumbnail is the first SubIFD, it must not be taken for a level
+	FIBITMAP *image = FreeImage_Clone(dib);
+	FIBITMAP *thumbnail = FreeImage_Rescale(dib, 32, 32, FILTER_BOX);
+	assert(image && thumbnail);
+	FreeImage_SetThumbnail(image, thumbnail);
+	FreeImage_Unload(thumbnail);
+
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(FreeImage_SaveToMemory(FIF_TIFF, image, hmem, TIFF_PYRAMID | save_flags));
+
+	FIBITMAP *expected = FreeImage_Clone(dib);
+
+	for(unsigned level = 0; level <= levels; level++) {
+		if(level > 0) {
+			const unsigned width = FreeImage_GetWidth(expected);
+			const unsigned height = FreeImage_GetHeight(expected);
+			FIBITMAP *reduced = FreeImage_Rescale(expected, (width + 1) / 2, (height + 1) / 2, FILTER_BOX);
+			assert(reduced != NULL);
+			FreeImage_Unload(expected);
+			expected = reduced;
+		}
+
+		FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+		FIBITMAP *check = FreeImage_LoadFromMemory(FIF_TIFF, hmem, TIFF_LEVEL(level));
+		assert(check != NULL);
+		assert(FreeImage_GetWidth(check) == FreeImage_GetWidth(expected));
+		assert(FreeImage_GetHeight(check) == FreeImage_GetHeight(expected));
+		assert(FreeImage_GetBPP(check) == FreeImage_GetBPP(expected));
+		assert((FreeImage_GetThumbnail(check) != NULL) == (level == 0));
+
+		const unsigned bpp = FreeImage_GetBPP(check);
+		for(unsigned y = 0; y < FreeImage_GetHeight(check); y++) {
+			assert(samePixels(FreeImage_GetScanLine(check, y), FreeImage_GetScanLine(expected, y), FreeImage_GetWidth(check), bpp));
+		}
+		FreeImage_Unload(check);
+
+		// the tile reader reaches any level
+		FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+		FITILEREADER *reader = FreeImage_OpenTileReaderFromMemory(FIF_TIFF, hmem, -1, TIFF_LEVEL(level));
+		assert(reader != NULL);
+		assert(FreeImage_IsTileReaderStreaming(reader));
+
+		unsigned tile_width, tile_height, columns, rows;
+		assert(FreeImage_GetTileReaderGrid(reader, &tile_width, &tile_height, &columns, &rows));
+		assert((level < levels) || ((columns == 1) && (rows == 1)));
+
+		BYTE *bits = (BYTE*)malloc(rows * tile_height * columns * tile_width * 4 * sizeof(float));
+		assert(bits != NULL);
+		const unsigned pitch = (columns * tile_width * bpp + 7) / 8;
+		assert(FreeImage_ReadTiles(reader, 0, 0, columns, rows, bits, pitch));
+		for(unsigned y = 0; y < FreeImage_GetHeight(expected); y++) {
+			assert(samePixels(bits + y * pitch, FreeImage_GetScanLine(expected, FreeImage_GetHeight(expected) - 1 - y), FreeImage_GetWidth(expected), bpp));
+		}
+		free(bits);
+		FreeImage_CloseTileReader(reader);
+	}
+
+	// no more levels
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	assert(FreeImage_LoadFromMemory(FIF_TIFF, hmem, TIFF_LEVEL(levels + 1)) == NULL);
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	assert(FreeImage_OpenTileReaderFromMemory(FIF_TIFF, hmem, -1, TIFF_LEVEL(levels + 1)) == NULL);
+
+	FreeImage_Unload(expected);
+	FreeImage_Unload(image);
+	FreeImage_CloseMemory(hmem);
+}
+
+/**
+Check that TIFF_PYRAMID refuses an image whose levels would not keep its layout, before writing any page
+*/
+static void checkTilePyramidRefused(FIBITMAP *dib) {
+	assert(dib != NULL);
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(!FreeImage_SaveToMemory(FIF_TIFF, dib, hmem, TIFF_PYRAMID | TIFF_TILESIZE(64)));
+	FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+	assert(FreeImage_LoadFromMemory(FIF_TIFF, hmem, TIFF_DEFAULT) == NULL);
+	FreeImage_CloseMemory(hmem);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testSaveTIFFThreads(unsigned width, unsigned height) {
+	printf("testSaveTIFFThreads (%d x %d) ...\n", width, height);
+
+	// odd sizes: partial last strip, partial last tiles
+	FIBITMAP *zone = createZonePlateImage(width + 3, height + 5, 128);
+	assert(zone);
+
+	FIBITMAP *images[] = {
+		FreeImage_Threshold(zone, 128),
+		FreeImage_ConvertTo4Bits(zone),
+		FreeImage_Clone(zone),
+		FreeImage_ConvertTo24Bits(zone),
+		FreeImage_ConvertTo32Bits(zone),
+		FreeImage_ConvertToType(zone, FIT_RGB16),
+		FreeImage_ConvertToType(zone, FIT_FLOAT)
+	};
+
+	const int lossless_flags[] = {
+		TIFF_DEFAULT,
+		TIFF_NONE,
+		TIFF_PACKBITS,
+		TIFF_ADOBE_DEFLATE,
+		TIFF_LZW | TIFF_TILED,
+		TIFF_DEFLATE | TIFF_TILED | TIFF_TILESIZE(64),
+		TIFF_NONE | TIFF_TILED | TIFF_TILESIZE(16)
+	};
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		assert(images[i]);
+		for(size_t j = 0; j < sizeof(lossless_flags) / sizeof(lossless_flags[0]); j++) {
+			testSaveTIFFThreadsType(images[i], lossless_flags[j], TRUE);
+		}
+	}
+
+	// lossy compressions
+	testSaveTIFFThreadsType(images[2], TIFF_JPEG, FALSE);
+	testSaveTIFFThreadsType(images[3], TIFF_JPEG, FALSE);
+	testSaveTIFFThreadsType(images[3], TIFF_JPEG | TIFF_TILED | TIFF_TILESIZE(128), FALSE);
+	testSaveTIFFThreadsType(images[0], TIFF_CCITTFAX4 | TIFF_TILED, FALSE);
+
+	for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		FreeImage_Unload(images[i]);
+	}
+	FreeImage_Unload(zone);
+
+	// more than one batch of strips
+	FIBITMAP *large = createZonePlateImage(width * 6, height * 4, 128);
+	FIBITMAP *large24 = FreeImage_ConvertTo24Bits(large);
+	assert(large && large24);
+	testSaveTIFFThreadsType(large24, TIFF_LZW, TRUE);
+
+	// copy-on-write clone: the worker threads share the pixels of the source image
+	FreeImage_SetCopyOnWrite(TRUE);
+	FIBITMAP *clone = FreeImage_Clone(large24);
+	assert(clone);
+	testSaveTIFFThreadsType(clone, TIFF_LZW | TIFF_TILED, TRUE);
+	testSaveTIFFThreadsType(clone, TIFF_ADOBE_DEFLATE, TRUE);
+	FreeImage_Unload(clone);
+	FreeImage_SetCopyOnWrite(FALSE);
+
+	FreeImage_Unload(large24);
+	FreeImage_Unload(large);
+}
+
+void testTileReader(unsigned width, unsigned height) {
+	printf("testTileReader ...\n");
+
+	// odd sizes: partial last strip, partial last tiles
+	width += 3;
+	height += 5;
+
+	FIBITMAP *dib1 = createScanlineImage(FIT_BITMAP, width, height, 1);
+	FIBITMAP *dib8 = createScanlineImage(FIT_BITMAP, width, height, 8);
+	FIBITMAP *dib24 = createScanlineImage(FIT_BITMAP, width, height, 24);
+	FIBITMAP *dib32 = createScanlineImage(FIT_BITMAP, width, height, 32);
+	FIBITMAP *dibf = createScanlineImage(FIT_RGBF, width, height, 0);
+
+	// TIFF: strips are delivered as full width tiles
+	checkTileReader(dib1, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkTileReader(dib8, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkTileReader(dib24, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	checkTileReader(dib32, FIF_TIFF, TIFF_NONE, TIFF_DEFAULT, TRUE);
+	checkTileReader(dibf, FIF_TIFF, TIFF_DEFAULT, TIFF_DEFAULT, TRUE);
+	// TIFF: tiles
+	checkTileReader(dib1, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(32), TIFF_DEFAULT, TRUE);
+	checkTileReader(dib8, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(48), TIFF_DEFAULT, TRUE);
+	checkTileReader(dib24, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(64), TIFF_DEFAULT, TRUE);
+	checkTileReader(dib32, FIF_TIFF, TIFF_TILED, TIFF_DEFAULT, TRUE);
+	checkTileReader(dibf, FIF_TIFF, TIFF_TILED | TIFF_TILESIZE(16), TIFF_DEFAULT, TRUE);
+
+	// formats without a tile decoder use the full decode fallback
+	checkTileReader(dib24, FIF_PNG, PNG_DEFAULT, PNG_DEFAULT, FALSE);
+	checkTileReader(dib8, FIF_BMP, BMP_DEFAULT, BMP_DEFAULT, FALSE);
+
+	FreeImage_Unload(dib1);
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(dib32);
+	FreeImage_Unload(dibf);
+}
+
+void testTIFFPyramid(unsigned width, unsigned height) {
+	printf("testTIFFPyramid ...\n");
+
+	// odd sizes: partial last tiles, odd level sizes
+	width += 3;
+	height += 5;
+
+	FIBITMAP *dib1 = createScanlineImage(FIT_BITMAP, width, height, 1);
+	FIBITMAP *dib8 = createScanlineImage(FIT_BITMAP, width, height, 8);
+	FIBITMAP *dib24 = createScanlineImage(FIT_BITMAP, width, height, 24);
+	FIBITMAP *dibf = createScanlineImage(FIT_RGBF, width, height, 0);
+
+	// pyramid levels
+	checkTilePyramid(dib8, TIFF_NONE | TIFF_TILESIZE(128), 3);
+	checkTilePyramid(dib24, TIFF_LZW | TIFF_TILESIZE(64), 4);
+	checkTilePyramid(dibf, TIFF_DEFAULT, 2);
+
+	// pyramid levels are not computed for low bit depth, palettized or unsupported image types
+	FIBITMAP *palettized = FreeImage_ColorQuantize(dib24, FIQ_WUQUANT);
+	FIBITMAP *dibd = FreeImage_AllocateT(FIT_DOUBLE, width, height);
+	checkTilePyramidRefused(dib1);
+	checkTilePyramidRefused(palettized);
+	checkTilePyramidRefused(dibd);
+	FreeImage_Unload(palettized);
+	FreeImage_Unload(dibd);
+
+	FreeImage_Unload(dib1);
+	FreeImage_Unload(dib8);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(dibf);
+}
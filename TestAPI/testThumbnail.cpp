@@ -137,3 +137,124 @@ void testThumbnail(const char *lpszPathName, int flags) {
 
 }
 
+/**
+Save an image to memory and load it back at a reduced resolution
+*/
+static FIBITMAP* saveLoadScaled(FREE_IMAGE_FORMAT fif, FIBITMAP *dib, int save_flags, int max_width, int max_height, FIBITMAP **reference = NULL) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	BOOL bResult = FreeImage_SaveToMemory(fif, dib, hmem, save_flags);
+	assert(bResult);
+
+	FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+	FIBITMAP *scaled = FreeImage_LoadScaledFromMemory(fif, hmem, max_width, max_height, 0);
+
+	if(scaled && reference) {
+		// full decoding, rescaled to the same size
+		FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+		FIBITMAP *full = FreeImage_LoadFromMemory(fif, hmem, 0);
+		assert(full != NULL);
+		*reference = FreeImage_Rescale(full, FreeImage_GetWidth(scaled), FreeImage_GetHeight(scaled), FILTER_CATMULLROM);
+		FreeImage_Unload(full);
+	}
+
+	FreeImage_CloseMemory(hmem);
+
+	return scaled;
+}
+
+/**
+Mean absolute difference between the samples of two 24-bit images of the same size
+*/
+static double meanSampleDifference(FIBITMAP *dib1, FIBITMAP *dib2) {
+	const unsigned width = FreeImage_GetWidth(dib1);
+	const unsigned height = FreeImage_GetHeight(dib1);
+	double sum = 0;
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *bits1 = FreeImage_GetScanLine(dib1, y);
+		const BYTE *bits2 = FreeImage_GetScanLine(dib2, y);
+		for(unsigned x = 0; x < 3 * width; x++) {
+			sum += abs((int)bits1[x] - (int)bits2[x]);
+		}
+	}
+	return sum / (3.0 * width * height);
+}
+
+/**
+Test reduced-resolution loading
+*/
+void testLoadScaled(unsigned width, unsigned height) {
+	printf("testLoadScaled ...\n");
+
+	// smooth test image: the reduced-resolution decodings are compared with a rescaled full decoding
+	FIBITMAP *dib = FreeImage_Allocate(width, height, 24);
+	assert(dib != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[FI_RGBA_RED] = (BYTE)((255 * x) / width);
+			bits[FI_RGBA_GREEN] = (BYTE)((255 * y) / height);
+			bits[FI_RGBA_BLUE] = (BYTE)((255 * (x + y)) / (width + height));
+			bits += 3;
+		}
+	}
+
+	// expected size of the image fitted inside a (width / 5) x (height / 9) box
+	const int max_width = width / 5;
+	const int max_height = height / 9;
+	const double factor = ((double)width / max_width > (double)height / max_height) ? (double)width / max_width : (double)height / max_height;
+	const unsigned fit_width = (unsigned)(width / factor + 0.5);
+	const unsigned fit_height = (unsigned)(height / factor + 0.5);
+
+	// native reduced-resolution paths (JPEG, J2K, JP2, WebP) and the generic path (PNG)
+	const FREE_IMAGE_FORMAT formats[] = { FIF_JPEG, FIF_J2K, FIF_JP2, FIF_WEBP, FIF_PNG };
+	for(size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		FIBITMAP *reference = NULL;
+		FIBITMAP *scaled = saveLoadScaled(formats[i], dib, 0, max_width, max_height, &reference);
+		assert(scaled != NULL);
+		assert(FreeImage_GetWidth(scaled) == fit_width);
+		assert(FreeImage_GetHeight(scaled) == fit_height);
+		assert(reference != NULL);
+		assert(meanSampleDifference(scaled, reference) < 4);
+		FreeImage_Unload(reference);
+		FreeImage_Unload(scaled);
+	}
+
+	// an unconstrained box loads the full image
+	{
+		FIBITMAP *scaled = saveLoadScaled(FIF_PNG, dib, 0, 0, 0);
+		assert(scaled != NULL);
+		assert(FreeImage_GetWidth(scaled) == width);
+		assert(FreeImage_GetHeight(scaled) == height);
+		FreeImage_Unload(scaled);
+	}
+
+	// TIFF: a reduced-resolution SubIFD covering the box is loaded instead of the image
+	{
+		FIBITMAP *level = FreeImage_Allocate(width / 2, height / 2, 24);
+		assert(level != NULL);
+		RGBQUAD red = { 0, 0, 255, 0 };
+		FreeImage_FillBackground(level, &red, 0);
+		FreeImage_SetThumbnail(dib, level);
+
+		FIBITMAP *scaled = saveLoadScaled(FIF_TIFF, dib, TIFF_NONE, max_width, max_height);
+		assert(scaled != NULL);
+		assert(FreeImage_GetWidth(scaled) == fit_width);
+		assert(FreeImage_GetHeight(scaled) == fit_height);
+		RGBQUAD color;
+		FreeImage_GetPixelColor(scaled, fit_width / 2, fit_height / 2, &color);
+		assert((color.rgbRed == 255) && (color.rgbGreen == 0) && (color.rgbBlue == 0));
+		FreeImage_Unload(scaled);
+
+		// the level is too small for a larger box: the image is used
+		scaled = saveLoadScaled(FIF_TIFF, dib, TIFF_NONE, (3 * width) / 4, (3 * height) / 4);
+		assert(scaled != NULL);
+		FreeImage_GetPixelColor(scaled, 0, 0, &color);
+		assert((color.rgbRed == color.rgbGreen) && (color.rgbGreen == color.rgbBlue));
+		FreeImage_Unload(scaled);
+
+		FreeImage_SetThumbnail(dib, NULL);
+		FreeImage_Unload(level);
+	}
+
+	FreeImage_Unload(dib);
+}
@@ -80,3 +80,116 @@ FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale) {
 	return dst;
 }
 
+
+/**
+Compare the size, the type and the pixels of two images
+*/
+BOOL isSameImage(FIBITMAP *dib1, FIBITMAP *dib2) {
+	if((FreeImage_GetWidth(dib1) != FreeImage_GetWidth(dib2)) || (FreeImage_GetHeight(dib1) != FreeImage_GetHeight(dib2))) {
+		return FALSE;
+	}
+	if((FreeImage_GetImageType(dib1) != FreeImage_GetImageType(dib2)) || (FreeImage_GetBPP(dib1) != FreeImage_GetBPP(dib2))) {
+		return FALSE;
+	}
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib1); y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), FreeImage_GetLine(dib1)) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Save an image to memory with one thread and with four threads, then load both files back. 
+Checks that both files decode to the same image. The thread count is restored on return.
+@param same_file If TRUE, also check that both files are the same
+@return Returns the image decoded from the file saved with four threads
+*/
+FIBITMAP* saveLoadThreads(FREE_IMAGE_FORMAT fif, FIBITMAP *src, int flags, BOOL same_file) {
+	const int thread_count = FreeImage_GetThreadCount();
+
+	FIMEMORY *serial_stream = FreeImage_OpenMemory();
+	FIMEMORY *parallel_stream = FreeImage_OpenMemory();
+
+	FreeImage_SetThreadCount(1);
+	assert(FreeImage_SaveToMemory(fif, src, serial_stream, flags));
+
+	FreeImage_SetThreadCount(4);
+	assert(FreeImage_SaveToMemory(fif, src, parallel_stream, flags));
+
+	FreeImage_SetThreadCount(thread_count);
+
+	if(same_file) {
+		BYTE *serial_data = NULL, *parallel_data = NULL;
+		DWORD serial_size = 0, parallel_size = 0;
+		assert(FreeImage_AcquireMemory(serial_stream, &serial_data, &serial_size));
+		assert(FreeImage_AcquireMemory(parallel_stream, &parallel_data, &parallel_size));
+		assert((serial_size == parallel_size) && (memcmp(serial_data, parallel_data, serial_size) == 0));
+	}
+
+	FreeImage_SeekMemory(serial_stream, 0L, SEEK_SET);
+	FIBITMAP *serial = FreeImage_LoadFromMemory(fif, serial_stream, 0);
+	FreeImage_SeekMemory(parallel_stream, 0L, SEEK_SET);
+	FIBITMAP *parallel = FreeImage_LoadFromMemory(fif, parallel_stream, 0);
+	assert(serial && parallel);
+	assert(isSameImage(serial, parallel));
+
+	FreeImage_Unload(serial);
+	FreeImage_CloseMemory(parallel_stream);
+	FreeImage_CloseMemory(serial_stream);
+
+	return parallel;
+}
+
+/**
+Create a test pattern image
+@param type Image type (FIT_BITMAP or FIT_RGBF)
+@param bpp Bitdepth of a FIT_BITMAP image (1, 8, 24 or 32)
+*/
+FIBITMAP* createScanlineImage(FREE_IMAGE_TYPE type, unsigned width, unsigned height, unsigned bpp) {
+	if(type == FIT_RGBF) {
+		FIBITMAP *dib = FreeImage_AllocateT(FIT_RGBF, width, height);
+		assert(dib != NULL);
+		for(unsigned y = 0; y < height; y++) {
+			FIRGBF *bits = (FIRGBF*)FreeImage_GetScanLine(dib, y);
+			for(unsigned x = 0; x < width; x++) {
+				bits[x].red = (float)x / width;
+				bits[x].green = (float)y / height;
+				bits[x].blue = (float)((x + y) % 17) * 4;
+			}
+		}
+		return dib;
+	}
+
+	if(bpp == 1) {
+		FIBITMAP *grey = createScanlineImage(FIT_BITMAP, width, height, 8);
+		FIBITMAP *dib = FreeImage_Threshold(grey, 128);
+		FreeImage_Unload(grey);
+		assert(dib != NULL);
+		return dib;
+	}
+
+	FIBITMAP *dib = FreeImage_Allocate(width, height, bpp);
+	assert(dib != NULL);
+
+	if(bpp == 8) {
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+		for(int i = 0; i < 256; i++) {
+			pal[i].rgbRed = pal[i].rgbGreen = pal[i].rgbBlue = (BYTE)i;
+		}
+	}
+
+	const unsigned bytespp = bpp / 8;
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width; x++) {
+			for(unsigned c = 0; c < bytespp; c++) {
+				// smooth gradients (JPEG friendly) with a different pattern per channel
+				bits[c] = (BYTE)((c == 0) ? x * 255 / width : (c == 1) ? y * 255 / height : (c == 2) ? (x + y) * 127 / (width + height) : 255 - x * 255 / width);
+			}
+			bits += bytespp;
+		}
+	}
+
+	return dib;
+}
@@ -0,0 +1,208 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Save an image as WebP to memory and load it back
+*/
+static FIBITMAP* saveLoadWebP(FIBITMAP *src, int flags) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	FIBITMAP *dst = NULL;
+	if(FreeImage_SaveToMemory(FIF_WEBP, src, hmem, flags)) {
+		FreeImage_SeekMemory(hmem, 0L, SEEK_SET);
+		dst = FreeImage_LoadFromMemory(FIF_WEBP, hmem, WEBP_DEFAULT);
+	}
+	FreeImage_CloseMemory(hmem);
+	return dst;
+}
+
+/**
+Save an image with 1 and 4 threads and check that both files are the same
+*/
+static void testSaveWebPThreadsType(FIBITMAP *src, int flags) {
+	FIBITMAP *parallel = saveLoadThreads(FIF_WEBP, src, flags | WEBP_THREADS, TRUE);
+	FreeImage_Unload(parallel);
+}
+
+static void setAnimationLong(FIBITMAP *dib, const char *key, LONG value) {
+	FITAG *tag = FreeImage_CreateTag();
+	FreeImage_SetTagKey(tag, key);
+	FreeImage_SetTagType(tag, FIDT_LONG);
+	FreeImage_SetTagCount(tag, 1);
+	FreeImage_SetTagLength(tag, 4);
+	FreeImage_SetTagValue(tag, &value);
+	FreeImage_SetMetadata(FIMD_ANIMATION, dib, key, tag);
+	FreeImage_DeleteTag(tag);
+}
+
+static LONG getAnimationLong(FIBITMAP *dib, const char *key) {
+	FITAG *tag = NULL;
+	if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, key, &tag) && (FreeImage_GetTagType(tag) == FIDT_LONG)) {
+		return *(LONG*)FreeImage_GetTagValue(tag);
+	}
+	return -1;
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testSaveWebPOptions(unsigned width, unsigned height) {
+	printf("testSaveWebPOptions (%d x %d) ...\n", width, height);
+
+	FIBITMAP *zone = createZonePlateImage(width + 3, height + 5, 128);
+	FIBITMAP *dib24 = FreeImage_ConvertTo24Bits(zone);
+	FIBITMAP *dib32 = FreeImage_ConvertTo32Bits(zone);
+	assert(zone && dib24 && dib32);
+
+	// 32-bit image with fully transparent areas
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib32); y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib32, y);
+		for(unsigned x = 0; x < FreeImage_GetWidth(dib32); x++) {
+			bits[4 * x + FI_RGBA_ALPHA] = ((x / 16 + y / 16) & 1) ? 0 : (BYTE)(x + y);
+		}
+	}
+
+	// every method gives a valid file
+	for(int method = 0; method <= 6; method++) {
+		FIBITMAP *dst = saveLoadWebP(dib24, WEBP_METHOD(method));
+		assert(dst);
+		assert((FreeImage_GetWidth(dst) == FreeImage_GetWidth(dib24)) && (FreeImage_GetHeight(dst) == FreeImage_GetHeight(dib24)));
+		FreeImage_Unload(dst);
+	}
+	for(int segments = 1; segments <= 4; segments++) {
+		FIBITMAP *dst = saveLoadWebP(dib24, WEBP_METHOD(2) | WEBP_SEGMENTS(segments));
+		assert(dst);
+		FreeImage_Unload(dst);
+	}
+
+	// lossless modes
+	FIBITMAP *lossless = saveLoadWebP(dib24, WEBP_LOSSLESS | WEBP_METHOD(1));
+	assert(lossless && isSameImage(lossless, dib24));
+	FreeImage_Unload(lossless);
+	FIBITMAP *exact = saveLoadWebP(dib32, WEBP_LOSSLESS | WEBP_EXACT | WEBP_METHOD(1));
+	assert(exact && isSameImage(exact, dib32));
+	FreeImage_Unload(exact);
+	FIBITMAP *near_lossless = saveLoadWebP(dib24, WEBP_NEAR_LOSSLESS(60) | WEBP_METHOD(1));
+	assert(near_lossless);
+	assert((FreeImage_GetWidth(near_lossless) == FreeImage_GetWidth(dib24)) && (FreeImage_GetHeight(near_lossless) == FreeImage_GetHeight(dib24)));
+	FreeImage_Unload(near_lossless);
+
+	// multi-threaded encoding
+	const int flags[] = {
+		WEBP_DEFAULT,
+		WEBP_METHOD(0) | 90,
+		WEBP_METHOD(4) | WEBP_SEGMENTS(2),
+		WEBP_LOSSLESS | WEBP_METHOD(1)
+	};
+	for(size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); j++) {
+		testSaveWebPThreadsType(dib24, flags[j]);
+		testSaveWebPThreadsType(dib32, flags[j]);
+	}
+
+	FreeImage_Unload(dib32);
+	FreeImage_Unload(dib24);
+	FreeImage_Unload(zone);
+}
+
+void testWebPAnimation(unsigned width, unsigned height) {
+	const char *lpszPathName = "animation.webp";
+	const unsigned page_count = 12;
+
+	width /= 4;
+	height /= 4;
+
+	printf("testWebPAnimation (%d x %d) ...\n", width, height);
+
+	// a zone plate with a moving square
+	FIBITMAP *zone = createZonePlateImage(width, height, 128);
+	assert(zone);
+	FIBITMAP *pages[page_count];
+	for(unsigned i = 0; i < page_count; i++) {
+		pages[i] = FreeImage_ConvertTo32Bits(zone);
+		assert(pages[i]);
+		for(unsigned y = 0; y < 16; y++) {
+			BYTE *bits = FreeImage_GetScanLine(pages[i], i * 3 + y) + 4 * i * 5;
+			for(unsigned x = 0; x < 16; x++) {
+				bits[FI_RGBA_RED] = (BYTE)(i * 20);
+				bits[FI_RGBA_GREEN] = (BYTE)(255 - i * 20);
+				bits[FI_RGBA_BLUE] = (BYTE)(x * y);
+				bits += 4;
+			}
+		}
+		setAnimationLong(pages[i], "FrameTime", 40 + i * 10);
+	}
+	setAnimationLong(pages[0], "Loop", 3);
+	FreeImage_Unload(zone);
+
+	// save the pages as an animation
+	FIMULTIBITMAP *out = FreeImage_OpenMultiBitmap(FIF_WEBP, lpszPathName, TRUE, FALSE, TRUE);
+	assert(out);
+	for(unsigned i = 0; i < page_count; i++) {
+		FreeImage_AppendPage(out, pages[i]);
+	}
+	assert(FreeImage_CloseMultiBitmap(out, WEBP_LOSSLESS | WEBP_METHOD(1)));
+
+	// playback gives the original pages, in sequence and backwards
+	FIMULTIBITMAP *src = FreeImage_OpenMultiBitmap(FIF_WEBP, lpszPathName, FALSE, TRUE, FALSE, WEBP_PLAYBACK);
+	assert(src);
+	assert(FreeImage_GetPageCount(src) == (int)page_count);
+	for(unsigned i = 0; i < page_count; i++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib && isSameImage(dib, pages[i]));
+		assert(getAnimationLong(dib, "FrameTime") == (LONG)(40 + i * 10));
+		if(i == 0) {
+			assert(getAnimationLong(dib, "Loop") == 3);
+		}
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	for(int i = 4; i >= 0; i -= 2) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib && isSameImage(dib, pages[i]));
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// raw frames fit in the canvas
+	src = FreeImage_OpenMultiBitmap(FIF_WEBP, lpszPathName, FALSE, TRUE, FALSE, WEBP_DEFAULT);
+	assert(src);
+	for(unsigned i = 0; i < page_count; i++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, i);
+		assert(dib);
+		FITAG *left = NULL, *top = NULL;
+		assert(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameLeft", &left));
+		assert(FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameTop", &top));
+		assert(*(WORD*)FreeImage_GetTagValue(left) + FreeImage_GetWidth(dib) <= width);
+		assert(*(WORD*)FreeImage_GetTagValue(top) + FreeImage_GetHeight(dib) <= height);
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// a single page load gives the first page
+	FIBITMAP *first = FreeImage_Load(FIF_WEBP, lpszPathName, WEBP_PLAYBACK);
+	assert(first && isSameImage(first, pages[0]));
+	FreeImage_Unload(first);
+
+	for(unsigned i = 0; i < page_count; i++) {
+		FreeImage_Unload(pages[i]);
+	}
+}